@@ -184,7 +184,52 @@ enum
     NRSC5_EVENT_HERE_IMAGE,
     NRSC5_EVENT_LOT_HEADER,
     NRSC5_EVENT_LOT_FRAGMENT,
-    NRSC5_EVENT_AGC
+    NRSC5_EVENT_AGC,
+    NRSC5_EVENT_SCAN,
+    NRSC5_EVENT_STATS
+};
+
+/**
+ * Bit for an event type in the mask passed to nrsc5_set_event_mask().
+ */
+#define NRSC5_EVENT_MASK(event) (1ULL << (event))
+#define NRSC5_EVENT_MASK_ALL (~0ULL)
+
+/**
+ * Processing stages timed for NRSC5_EVENT_STATS, used to index `stats.stages`.
+ * Time spent in a stage called from another stage is only counted once, in
+ * the inner stage.
+ */
+enum
+{
+    NRSC5_STAGE_DECIMATE,    /**< input conversion, and decimation of cu8 samples */
+    NRSC5_STAGE_ACQUIRE,     /**< symbol timing and frequency acquisition, FFT */
+    NRSC5_STAGE_SYNC,        /**< block sync, equalization and demapping */
+    NRSC5_STAGE_DECODE_PIDS, /**< PIDS deinterleaving and Viterbi decoding */
+    NRSC5_STAGE_DECODE_P1,   /**< P1 deinterleaving and Viterbi decoding */
+    NRSC5_STAGE_DECODE_P3,   /**< P3 deinterleaving and Viterbi decoding */
+    NRSC5_STAGE_DECODE_P4,   /**< P4 deinterleaving and Viterbi decoding */
+    NRSC5_STAGE_FRAME,       /**< PDU parsing and packet reassembly */
+    NRSC5_STAGE_RS,          /**< Reed-Solomon correction of PDU headers */
+    NRSC5_STAGE_AAC,         /**< HDC audio decoding */
+    NRSC5_STAGE_CALLBACK,    /**< user callback, when events are not queued */
+    NRSC5_NUM_STAGES
+};
+
+/**
+ * Time spent in one processing stage, see NRSC5_EVENT_STATS.
+ */
+typedef struct
+{
+    uint64_t calls;          /**< number of times the stage was entered */
+    uint64_t wall_ns;        /**< elapsed time in nanoseconds */
+    uint64_t cpu_ns;         /**< CPU time of the processing thread in nanoseconds */
+} nrsc5_stage_stats_t;
+
+enum
+{
+    NRSC5_EVENT_QUEUE_DROP,  /**< drop new events while the queue is full */
+    NRSC5_EVENT_QUEUE_BLOCK  /**< stall the demodulator until the queue has room */
 };
 
 enum
@@ -390,6 +435,8 @@ struct nrsc5_event_t
  * - `NRSC5_EVENT_EMERGENCY_ALERT` : emergency alert, see `emergency_alert` member
  * - `NRSC5_EVENT_HERE_IMAGE` : HERE Images traffic/weather map, see `here_image` member
  * - `NRSC5_EVENT_AGC` : automatic gain control status, see `agc` member
+ * - `NRSC5_EVENT_SCAN` : result for one channel of nrsc5_scan(), see `scan` member
+ * - `NRSC5_EVENT_STATS` : processing statistics, see `stats` member and nrsc5_set_stats_interval()
  */
     unsigned int event;
     union
@@ -419,6 +466,7 @@ struct nrsc5_event_t
             unsigned int program;
             const int16_t *data;
             size_t count;
+            float latency;  /**< seconds from the start of the over-the-air frame carrying the newest packet to its release, see nrsc5_get_audio_latency() */
         } audio;
         struct {
             unsigned int program;
@@ -568,6 +616,26 @@ struct nrsc5_event_t
             float peak_dbfs;     /**< peak signal amplitude in dB, relative to full scale */
             int is_final;        /**< 1 if this is the final (best) gain value, otherwise 0 */
         } agc;
+        struct {
+            float freq;          /**< channel center frequency in Hz */
+            int hd_present;      /**< 1 if HD Radio sidebands were detected, otherwise 0 */
+            int psmi;            /**< Primary Service Mode Indicator if sync was achieved, otherwise -1 */
+            float cp_metric;     /**< cyclic prefix correlation, peak to average ratio */
+            float ref_metric;    /**< reference subcarrier coherence (FM only), 0 to 1 */
+        } scan;
+        struct {
+            float duration;      /**< seconds of input signal covered by this report */
+            float elapsed;       /**< wall-clock seconds since the previous report */
+            const nrsc5_stage_stats_t *stages; /**< per-stage times, indexed by NRSC5_STAGE_* */
+            unsigned int num_stages;      /**< number of elements in `stages` */
+            unsigned int input_fill;      /**< samples waiting in the input buffer */
+            unsigned int input_peak;      /**< highest input buffer fill, in samples */
+            unsigned int input_size;      /**< capacity of the input buffer, in samples */
+            unsigned int input_overflows; /**< sample blocks dropped because the input buffer was full */
+            unsigned int queue_depth;     /**< events waiting in the event queue */
+            unsigned int queue_peak;      /**< highest event queue depth */
+            unsigned int source_drops;    /**< IQ samples lost before reaching the demodulator, e.g. by the rtl_tcp reader */
+        } stats;
     };
 };
 /**
@@ -586,10 +654,36 @@ typedef void (*nrsc5_callback_t)(const nrsc5_event_t *evt, void *opaque);
 /**
  * An opaque data type used by API functions to represent session information.
  * Applications should acquire a pointer to one via the `open_` functions:
- * nrsc5_open(), nrsc5_open_file(), nrsc5_open_pipe(), or nrsc5_open_rtltcp().
+ * nrsc5_open(), nrsc5_open_file(), nrsc5_open_mmap(), nrsc5_open_segmented(),
+ * nrsc5_open_pipe(), or nrsc5_open_rtltcp().
  */
 typedef struct nrsc5_t nrsc5_t;
 
+/**
+ * An opaque data type representing a wideband channelizer, which splits one
+ * wideband capture into streams for several FM stations.
+ * See nrsc5_channelizer_open().
+ */
+typedef struct nrsc5_channelizer_t nrsc5_channelizer_t;
+
+/**
+ * An opaque data type representing a baseband signal generator, which
+ * synthesizes HD Radio IQ samples for testing receivers.
+ * See nrsc5_generator_open().
+ */
+typedef struct nrsc5_generator_t nrsc5_generator_t;
+
+/**
+ * Prototype for a callback supplying the audio packets of a generator.
+ *
+ * @param[in] program  audio program number
+ * @param[out] data  buffer receiving the HDC packet payload
+ * @param[in] max_size  size of the buffer in bytes
+ * @param[in] opaque  pointer passed to nrsc5_generator_set_packet_callback()
+ * @return number of bytes written to `data`
+ */
+typedef unsigned int (*nrsc5_generator_packet_callback_t)(unsigned int program, uint8_t *data, unsigned int max_size, void *opaque);
+
 
 /* ============================================================================
  * Public functions. All functions return void or an error code (0 == success).
@@ -665,9 +759,54 @@ NRSC5_API int nrsc5_open(nrsc5_t **, char *device_args);
  * @param[in]  fp  FILE pointer handle with nrsc5 data
  * @return 0 on success, nonzero on error
  *
+ * The file holds either raw IQ samples or a recording made by
+ * nrsc5_record_iq(). A recording sets the mode and frequency of the session
+ * from its header and is decoded in its own sample format, whichever driver
+ * the library was built for. Compressed chunks are unpacked on a reader thread
+ * ahead of the decoder. Seekable files can be positioned with
+ * nrsc5_seek_file().
  */
 NRSC5_API int nrsc5_open_file(nrsc5_t **st, FILE *fp);
 
+/**
+ * Initializes a session that decodes an IQ file by memory-mapping it.
+ * @param[out] st  handle for an `nrsc5_t`
+ * @param[in]  path  path of a regular file holding IQ samples
+ * @return 0 on success, nonzero on error
+ *
+ * The samples use the same format as nrsc5_open_file(). The worker thread
+ * feeds the mapped file to the decoder in large spans without copying it
+ * through a read buffer, and decodes as fast as the CPU allows. The kernel is
+ * told that access is sequential, pages ahead of the decoder are prefetched
+ * and pages already decoded are released. NRSC5_EVENT_LOST_DEVICE is reported
+ * at the end of the file; see nrsc5_get_realtime_factor() for throughput.
+ * A recording made by nrsc5_record_iq() is opened as with nrsc5_open_file().
+ */
+NRSC5_API int nrsc5_open_mmap(nrsc5_t **st, const char *path);
+
+/**
+ * Initializes a session that decodes a long IQ file in parallel.
+ * @param[out] st  handle for an `nrsc5_t`
+ * @param[in]  path  path of a regular file holding IQ samples
+ * @param[in]  threads  number of decoding threads, or 0 for one per CPU
+ * @param[in]  segment_length  seconds of signal per segment, or 0 for 300
+ * @return 0 on success, nonzero on error
+ *
+ * The file is split into segments that are decoded independently, each
+ * starting a few seconds early so that synchronization and the
+ * interleavers have settled by the time it begins. Events are delivered to
+ * the callback in signal order once a segment is complete, as if the file
+ * had been decoded by a single session, and events that are only reported
+ * on change are not repeated at segment boundaries. The mode and event mask
+ * are taken when nrsc5_start() is first called. NRSC5_EVENT_LOST_DEVICE is
+ * reported at the end of the file.
+ *
+ * A LOT file that spans a boundary is reported when the next segment
+ * receives a later repetition of it. Memory use grows with the number of
+ * events in a segment, so audio-heavy decodes should use shorter segments.
+ */
+NRSC5_API int nrsc5_open_segmented(nrsc5_t **st, const char *path, unsigned int threads, float segment_length);
+
 /**
  * Initializes a session for use with a pipe.
  * @param[out] st  handle for an `nrsc5_t`
@@ -687,6 +826,45 @@ NRSC5_API int nrsc5_open_pipe(nrsc5_t **st);
 NRSC5_API int nrsc5_open_rtltcp(nrsc5_t **st, int socket);
 #endif
 
+/**
+ * Serves the received IQ samples to rtl_tcp clients.
+ *
+ * The raw 8-bit samples of the session, the same data as
+ * `NRSC5_EVENT_IQ`, are sent to every client that connects to
+ * `listen_socket`. Clients speak the rtl_tcp protocol, so another
+ * `nrsc5 -H` or any rtl_tcp consumer can share one device with this
+ * session. Commands from clients are ignored, as the tuner belongs to this
+ * session. A client that cannot keep up skips ahead to the newest samples.
+ * Must be called while the session is stopped.
+ *
+ * @param[in] st  pointer to an `nrsc5_t` session object
+ * @param[in] listen_socket  a bound, listening TCP socket, which the session
+ *            takes ownership of, or -1 to stop serving
+ * @return 0 on success, nonzero on error
+ */
+#ifdef USE_RTLSDR
+NRSC5_API int nrsc5_serve_rtltcp(nrsc5_t *st, int listen_socket);
+#endif
+
+/**
+ * Sets the buffering of an rtl_tcp session.
+ *
+ * While the session is running, a reader thread drains the socket into a
+ * ring buffer, so that network jitter does not stall the demodulator and
+ * slow processing does not push back on the rtl_tcp server. If the ring
+ * fills up, samples are discarded and counted in `source_drops` of
+ * NRSC5_EVENT_STATS. A new ring size takes effect at the next
+ * nrsc5_start().
+ *
+ * @param[in] st  pointer to an `nrsc5_t` session opened with nrsc5_open_rtltcp()
+ * @param[in] rcvbuf  socket receive buffer in bytes (`SO_RCVBUF`), or 0 to keep it (default 4 MiB)
+ * @param[in] ring_size  ring buffer size in bytes, or 0 to keep it (default 8 MiB)
+ * @return 0 on success, nonzero on error
+ */
+#ifdef USE_RTLSDR
+NRSC5_API int nrsc5_set_rtltcp_buffers(nrsc5_t *st, int rcvbuf, size_t ring_size);
+#endif
+
 /**
  * Closes an nrsc5 session.
  * @param[in] st  pointer to an `nrsc5_t`
@@ -713,6 +891,11 @@ NRSC5_API void nrsc5_stop(nrsc5_t *st);
 
 /**
  * Set the session mode to AM or FM.
+ *
+ * Demodulator state that is specific to one mode is allocated here and the
+ * other mode's state is released. Should be called while the session is
+ * stopped.
+ *
  * @param[in] st  pointer to an `nrsc5_t` session object
  * @param[in] mode  either `NRSC5_MODE_FM` or `NRSC5_MODE_AM`
  * @return 0 on success or nonzero on error.
@@ -784,6 +967,10 @@ NRSC5_API void nrsc5_get_frequency(nrsc5_t *st, float *freq);
  * This function may only be called when the device is **stopped**.
  * Input, output are reset. Gain is reset if auto-gain is enabled.
  * Works with both a local SDR and over a TCP connection.
+ *
+ * The frequency offset and service mode of the last few stations that were
+ * synchronized are remembered, so returning to one of them skips most of
+ * the acquisition search.
  */
 NRSC5_API int nrsc5_set_frequency(nrsc5_t *st, float freq);
 
@@ -835,6 +1022,25 @@ NRSC5_API void nrsc5_set_auto_gain(nrsc5_t *st, int enabled);
  */
 NRSC5_API void nrsc5_set_callback(nrsc5_t *st, nrsc5_callback_t callback, void *opaque);
 
+/**
+ * Set the rate of the incoming samples, for sources that cannot deliver
+ * the native rate of their format exactly.
+ *
+ * The rate replaces NRSC5_SAMPLE_RATE_CU8 for cu8 samples, and
+ * NRSC5_SAMPLE_RATE_CS16_FM or NRSC5_SAMPLE_RATE_CS16_AM for the other
+ * formats. Samples are then resampled to the native rate by a polyphase
+ * filter. Once synchronized, the sample clock offset measured from the
+ * signal is also corrected by the resampler, by up to 500 ppm. Rates far
+ * from the native one (below 1/4 or above 64 times) are rejected when
+ * samples arrive. Passing the native rate itself enables the clock offset
+ * correction alone. Must not run concurrently with sample delivery.
+ *
+ * @param[in] st  pointer to an `nrsc5_t` session object
+ * @param[in] rate  sample rate in Hz, or 0 to disable resampling
+ * @return 0 on success, nonzero on error
+ */
+NRSC5_API int nrsc5_set_input_rate(nrsc5_t *st, float rate);
+
 /**
  * Push an IQ array of 8-bit unsigned samples into the demodulator.
  *
@@ -859,4 +1065,503 @@ NRSC5_API int nrsc5_pipe_samples_cu8(nrsc5_t *st, const uint8_t *samples, unsign
  */
 NRSC5_API int nrsc5_pipe_samples_cs16(nrsc5_t *st, const int16_t *samples, unsigned int length);
 
+/**
+ * Push 16-bit signed samples held in separate I and Q arrays into the
+ * demodulator.
+ *
+ * @param[in] st  pointer to an `nrsc5_t` session object
+ * @param[in] i  pointer to an array of in-phase samples
+ * @param[in] q  pointer to an array of quadrature samples
+ * @param[in] length   the number of samples in each array
+ * @see NRSC5_SAMPLE_RATE_CS16_FM & NRSC5_SAMPLE_RATE_CS16_AM for required sample rate
+ * @return 0 on success, nonzero on error
+ *
+ */
+NRSC5_API int nrsc5_pipe_samples_cs16_planar(nrsc5_t *st, const int16_t *i, const int16_t *q, unsigned int length);
+
+/**
+ * Push an IQ array of 8-bit signed samples into the demodulator.
+ *
+ * Samples are expected at the same rate as nrsc5_pipe_samples_cs16(), and
+ * are scaled to 16 bits.
+ *
+ * @param[in] st  pointer to an `nrsc5_t` session object
+ * @param[in] samples  pointer to an array of interleaved I and Q values
+ * @param[in] length   the number of complex samples, half the number of values
+ * @see NRSC5_SAMPLE_RATE_CS16_FM & NRSC5_SAMPLE_RATE_CS16_AM for required sample rate
+ * @return 0 on success, nonzero on error
+ *
+ */
+NRSC5_API int nrsc5_pipe_samples_cs8(nrsc5_t *st, const int8_t *samples, unsigned int length);
+
+/**
+ * Push an IQ array of 32-bit float samples into the demodulator.
+ *
+ * Samples are expected at the same rate as nrsc5_pipe_samples_cs16(). Full
+ * scale is 1.0; values beyond it are clipped.
+ *
+ * @param[in] st  pointer to an `nrsc5_t` session object
+ * @param[in] samples  pointer to an array of interleaved I and Q values
+ * @param[in] length   the number of complex samples, half the number of values
+ * @see NRSC5_SAMPLE_RATE_CS16_FM & NRSC5_SAMPLE_RATE_CS16_AM for required sample rate
+ * @return 0 on success, nonzero on error
+ *
+ */
+NRSC5_API int nrsc5_pipe_samples_cf32(nrsc5_t *st, const float *samples, unsigned int length);
+
+/**
+ * Enable or disable the pull-based audio ring for a program.
+ *
+ * When enabled, decoded audio for the program is also written into a
+ * library-owned lock-free ring, from which a single consumer thread can read
+ * with nrsc5_audio_acquire() / nrsc5_audio_release() or nrsc5_read_audio().
+ * NRSC5_EVENT_AUDIO is still delivered to the callback. If the ring is full,
+ * new audio is dropped and counted rather than overwriting unread samples.
+ *
+ * Must not be called while samples are being processed, i.e. only when the
+ * session is stopped or from the thread that pipes samples.
+ *
+ * @param[in] st  pointer to an `nrsc5_t` session object
+ * @param[in] program  program number
+ * @param[in] size  ring capacity in 16-bit samples (rounded up to a power of two, at most 2^25), or 0 to disable
+ * @return 0 on success, nonzero on error
+ */
+NRSC5_API int nrsc5_set_audio_ring(nrsc5_t *st, unsigned int program, size_t size);
+
+/**
+ * Borrow decoded audio from a program's ring without copying.
+ *
+ * The returned pointer stays valid until nrsc5_audio_release() is called.
+ * Only the contiguous part of the ring is returned, so after the ring wraps
+ * a second call may return more samples.
+ *
+ * @param[in] st  pointer to an `nrsc5_t` session object
+ * @param[in] program  program number
+ * @param[out] data  pointer to interleaved stereo 16-bit samples
+ * @param[out] count  number of 16-bit samples available at `data`
+ * @return 0 on success, nonzero on error
+ */
+NRSC5_API int nrsc5_audio_acquire(nrsc5_t *st, unsigned int program, const int16_t **data, size_t *count);
+
+/**
+ * Return samples borrowed with nrsc5_audio_acquire() to the ring.
+ *
+ * @param[in] st  pointer to an `nrsc5_t` session object
+ * @param[in] program  program number
+ * @param[in] count  number of 16-bit samples consumed
+ * @return 0 on success, nonzero on error
+ */
+NRSC5_API int nrsc5_audio_release(nrsc5_t *st, unsigned int program, size_t count);
+
+/**
+ * Copy decoded audio out of a program's ring.
+ *
+ * @param[in] st  pointer to an `nrsc5_t` session object
+ * @param[in] program  program number
+ * @param[out] data  destination for interleaved stereo 16-bit samples
+ * @param[in] count  maximum number of 16-bit samples to copy
+ * @param[out] read  number of 16-bit samples copied
+ * @return 0 on success, nonzero on error
+ */
+NRSC5_API int nrsc5_read_audio(nrsc5_t *st, unsigned int program, int16_t *data, size_t count, size_t *read);
+
+/**
+ * Retrieve the fill level of a program's audio ring.
+ *
+ * @param[in] st  pointer to an `nrsc5_t` session object
+ * @param[in] program  program number
+ * @param[out] fill  number of 16-bit samples waiting to be read
+ * @param[out] size  ring capacity in 16-bit samples
+ * @param[out] dropped  number of 16-bit samples dropped because the ring was full
+ * @return 0 on success, nonzero on error
+ */
+NRSC5_API int nrsc5_get_audio_fill(nrsc5_t *st, unsigned int program, size_t *fill, size_t *size, size_t *dropped);
+
+/**
+ * Deliver events asynchronously through a bounded queue.
+ *
+ * By default the callback runs synchronously on the thread doing the
+ * demodulation, so a slow callback stalls the receiver. With a queue, each
+ * event is deep-copied into a lock-free queue and the callback is invoked
+ * later, either from nrsc5_poll_events() or from a dedicated dispatcher
+ * thread. Pointers inside a queued event are valid only for the duration of
+ * the callback. The `service` and `component` members of stream, packet and
+ * LOT events are copies holding only the referenced service and component.
+ *
+ * Must be called while the session is stopped.
+ *
+ * @param[in] st  pointer to an `nrsc5_t` session object
+ * @param[in] size  number of queued events (rounded up to a power of two, at most 2^20), or 0 for synchronous delivery
+ * @param[in] policy  NRSC5_EVENT_QUEUE_DROP or NRSC5_EVENT_QUEUE_BLOCK
+ * @param[in] dispatcher  set to 1 to deliver events from a library-owned thread, 0 to use nrsc5_poll_events()
+ * @return 0 on success, nonzero on error
+ */
+NRSC5_API int nrsc5_set_event_queue(nrsc5_t *st, unsigned int size, int policy, int dispatcher);
+
+/**
+ * Deliver queued events to the callback on the calling thread.
+ *
+ * With NRSC5_EVENT_QUEUE_BLOCK, do not poll from the thread that pipes
+ * samples, since a full queue would then never drain.
+ *
+ * @param[in] st  pointer to an `nrsc5_t` session object
+ * @param[in] max_events  maximum number of events to deliver
+ * @param[out] dispatched  number of events delivered, may be NULL
+ * @return 0 on success, nonzero if no queue is configured or a dispatcher thread is running
+ */
+NRSC5_API int nrsc5_poll_events(nrsc5_t *st, unsigned int max_events, unsigned int *dispatched);
+
+/**
+ * Retrieve the number of events of one type dropped because the queue was full.
+ *
+ * @param[in] st  pointer to an `nrsc5_t` session object
+ * @param[in] event  event type, e.g. NRSC5_EVENT_AUDIO
+ * @param[out] count  number of dropped events
+ * @return 0 on success, nonzero if no queue is configured or the event type is invalid
+ */
+NRSC5_API int nrsc5_get_event_drops(nrsc5_t *st, unsigned int event, unsigned int *count);
+
+/**
+ * Select which event types are delivered to the callback.
+ *
+ * Disabled events are not built at all, and the work that exists only to
+ * produce them is skipped. For example, frames are not re-encoded for BER,
+ * audio is not decoded unless an audio ring is enabled, the SIG list is not
+ * built unless SIG or data service events are enabled, and LOT files are not
+ * reassembled unless a LOT event is enabled. All events are enabled by
+ * default.
+ *
+ * Should be called while the session is stopped.
+ *
+ * @param[in] st  pointer to an `nrsc5_t` session object
+ * @param[in] mask  bitwise OR of NRSC5_EVENT_MASK(event), or NRSC5_EVENT_MASK_ALL
+ * @return 0 on success, nonzero on error
+ */
+NRSC5_API int nrsc5_set_event_mask(nrsc5_t *st, uint64_t mask);
+
+/**
+ * Enable periodic NRSC5_EVENT_STATS reports.
+ *
+ * While enabled, the demodulator measures the wall-clock and CPU time of
+ * each processing stage, the fill of its input buffer and the depth of the
+ * event queue. A report is emitted from the processing thread each time
+ * `interval` seconds of input signal have been processed; all figures
+ * cover the time since the previous report. When disabled (the default),
+ * each stage costs a single branch.
+ *
+ * @param[in] st  pointer to an `nrsc5_t` session object
+ * @param[in] interval  seconds of input between reports, or 0 to disable
+ * @return 0 on success, nonzero on error
+ */
+NRSC5_API int nrsc5_set_stats_interval(nrsc5_t *st, float interval);
+
+/**
+ * Enable low-latency audio output.
+ *
+ * By default, audio packets are held in the elastic buffer until the
+ * playout time signalled by the station, which adds several seconds of
+ * delay. In low-latency mode, each packet is decoded as soon as it and all
+ * packets before it have arrived. A missing packet is waited for until
+ * `depth` newer packets are buffered behind it, and is then played as
+ * silence; a depth of 0 never waits. Should be called while the session is
+ * stopped.
+ *
+ * @param[in] st  pointer to an `nrsc5_t` session object
+ * @param[in] enabled  1 to enable low-latency mode, 0 to restore station timing
+ * @param[in] depth  number of newer packets to wait for before skipping a missing one (less than 32)
+ * @return 0 on success, nonzero on error
+ */
+NRSC5_API int nrsc5_set_low_latency(nrsc5_t *st, int enabled, unsigned int depth);
+
+/**
+ * Report the achieved audio latency of a program.
+ *
+ * The latency is measured from the first input sample of the over-the-air
+ * frame that carried the most recently released audio packet, to the point
+ * in the input at which the packet was released to the decoder. It does not
+ * include buffering in the SDR or in the application.
+ *
+ * @param[in] st  pointer to an `nrsc5_t` session object
+ * @param[in] program  program number, from 0 to 7
+ * @param[out] latency  latency in seconds, or 0 if no audio has been released
+ * @return 0 on success, nonzero on error
+ */
+NRSC5_API int nrsc5_get_audio_latency(nrsc5_t *st, unsigned int program, float *latency);
+
+/**
+ * Limit the memory used to reassemble LOT files.
+ *
+ * LOT fragments are stored in slabs owned by the session. When storing a new
+ * fragment would exceed the budget, the least recently updated LOT file is
+ * discarded, so memory use stays flat on long-running sessions.
+ *
+ * @param[in] st  pointer to an `nrsc5_t` session object
+ * @param[in] bytes  memory budget in bytes (default 8 MiB)
+ * @return 0 on success, nonzero on error
+ */
+NRSC5_API int nrsc5_set_lot_memory_budget(nrsc5_t *st, size_t bytes);
+
+/**
+ * Report the memory held by a session.
+ *
+ * Includes the session object itself, the state of the current mode, the
+ * elastic buffers, LOT storage, audio rings and the event queue. Memory owned
+ * by FFTW plans and AAC decoders is not counted.
+ *
+ * @param[in] st  pointer to an `nrsc5_t` session object
+ * @param[out] bytes  approximate number of bytes in use
+ * @return 0 on success, nonzero on error
+ */
+NRSC5_API int nrsc5_get_memory_usage(nrsc5_t *st, size_t *bytes);
+
+/**
+ * Report how fast a session opened with nrsc5_open_mmap(),
+ * nrsc5_open_file() or nrsc5_open_segmented() is decoding.
+ *
+ * The factor is the duration of the samples decoded so far divided by the
+ * wall-clock time spent decoding them, so 10.0 means ten seconds of signal
+ * per second.
+ *
+ * @param[in] st  pointer to an `nrsc5_t` session object
+ * @param[out] factor  throughput as a multiple of realtime
+ * @return 0 on success, nonzero if the session does not decode a file
+ */
+NRSC5_API int nrsc5_get_realtime_factor(nrsc5_t *st, float *factor);
+
+/**
+ * Record the received IQ samples to a seekable file.
+ *
+ * Samples are stored in chunks of 65536, after a header that holds the
+ * sample format and rate, mode, frequency, gain and start time. The file is
+ * created by this call, and the header is written when the first samples
+ * arrive: cu8 samples are stored as cu8, and all other formats as cs16,
+ * after conversion. Samples delivered later in the other format are not
+ * recorded. Each chunk carries the time its first sample was received, and
+ * an index of the chunks is appended when the recording is closed. With
+ * `compress`, chunks
+ * are stored with a fast lossless delta packing when that makes them
+ * smaller. Recordings are played back with nrsc5_open_file() or
+ * nrsc5_open_mmap(). The file is closed by a call with a NULL `path` or by
+ * nrsc5_close(). Must not run concurrently with sample delivery: call it
+ * while the session is stopped or, for a pipe session, between calls to
+ * nrsc5_pipe_samples_cu8() or nrsc5_pipe_samples_cs16().
+ *
+ * @param[in] st  pointer to an `nrsc5_t` session object
+ * @param[in] path  file to create, or NULL to stop recording
+ * @param[in] compress  nonzero to compress the chunks
+ * @return 0 on success, nonzero on error
+ */
+NRSC5_API int nrsc5_record_iq(nrsc5_t *st, const char *path, int compress);
+
+/**
+ * Move a file session to a time offset.
+ *
+ * Recordings made by nrsc5_record_iq() are positioned through their chunk
+ * index, raw captures by their sample rate. Decoding restarts at the new
+ * position, so input and output are reset. The file must be seekable, and
+ * the session must be stopped.
+ *
+ * @param[in] st  pointer to an `nrsc5_t` session object
+ * @param[in] seconds  offset from the start of the file
+ * @return 0 on success, nonzero on error
+ */
+NRSC5_API int nrsc5_seek_file(nrsc5_t *st, float seconds);
+
+/**
+ * Check whether a file session is playing a recording.
+ *
+ * Recordings made by nrsc5_record_iq() set the frequency and mode of the
+ * session from their header, so callers can skip setting them. Raw captures
+ * carry neither.
+ *
+ * @param[in] st  pointer to an `nrsc5_t` session object
+ * @return 1 for a recording, 0 for raw samples or a device
+ */
+NRSC5_API int nrsc5_is_recording(nrsc5_t *st);
+
+/**
+ * Create a wideband channelizer.
+ *
+ * The channelizer accepts IQ samples at `decimation` times
+ * NRSC5_SAMPLE_RATE_CS16_FM (e.g. 4 for 2.98 Msps, 12 for 8.93 Msps),
+ * centered on `center_freq`, and feeds each station added with
+ * nrsc5_channelizer_add() with 16-bit samples at NRSC5_SAMPLE_RATE_CS16_FM.
+ *
+ * @param[out] result  pointer to the new `nrsc5_channelizer_t` object
+ * @param[in] decimation  ratio of the input sample rate to NRSC5_SAMPLE_RATE_CS16_FM, 1 to 16
+ * @param[in] center_freq  center frequency of the capture in Hz
+ * @param[in] threads  number of worker threads decoding stations, or 0 to decode on the calling thread
+ * @return 0 on success, nonzero on error
+ */
+NRSC5_API int nrsc5_channelizer_open(nrsc5_channelizer_t **result, unsigned int decimation, float center_freq, unsigned int threads);
+
+/**
+ * Close a channelizer. Sessions added to it are not closed.
+ *
+ * @param[in] ch  pointer to an `nrsc5_channelizer_t` object
+ */
+NRSC5_API void nrsc5_channelizer_close(nrsc5_channelizer_t *ch);
+
+/**
+ * Route one station of the wideband capture to a session.
+ *
+ * The session must be opened with nrsc5_open_pipe() in FM mode, and must
+ * not be fed samples from anywhere else. Stations must be added before
+ * samples are pushed, and the whole 744 kHz channel must fit within the
+ * capture bandwidth.
+ *
+ * @param[in] ch  pointer to an `nrsc5_channelizer_t` object
+ * @param[in] st  pointer to an `nrsc5_t` session object
+ * @param[in] freq  station frequency in Hz
+ * @return 0 on success, nonzero on error
+ */
+NRSC5_API int nrsc5_channelizer_add(nrsc5_channelizer_t *ch, nrsc5_t *st, float freq);
+
+/**
+ * Push wideband 16-bit signed IQ samples into a channelizer.
+ *
+ * @param[in] ch  pointer to an `nrsc5_channelizer_t` object
+ * @param[in] samples  pointer to an array of interleaved 16-bit signed samples
+ * @param[in] length  the number of 16-bit values in the array, which must be even
+ * @return 0 on success, nonzero on error
+ */
+NRSC5_API int nrsc5_channelizer_push_cs16(nrsc5_channelizer_t *ch, const int16_t *samples, unsigned int length);
+
+/**
+ * Push wideband 8-bit unsigned IQ samples into a channelizer.
+ *
+ * @param[in] ch  pointer to an `nrsc5_channelizer_t` object
+ * @param[in] samples  pointer to an array of interleaved 8-bit unsigned samples
+ * @param[in] length  the number of bytes in the array, which must be even
+ * @return 0 on success, nonzero on error
+ */
+NRSC5_API int nrsc5_channelizer_push_cu8(nrsc5_channelizer_t *ch, const uint8_t *samples, unsigned int length);
+
+/**
+ * Scans a range of channels for HD Radio signals.
+ * @param[in] st pointer to an nrsc5_t session object
+ * @param[in] begin first channel center frequency in Hz, e.g. NRSC5_SCAN_BEGIN
+ * @param[in] end last channel center frequency in Hz, e.g. NRSC5_SCAN_END
+ * @param[in] skip channel spacing in Hz, e.g. NRSC5_SCAN_SKIP
+ *
+ * Each channel is tuned in turn and listened to for a few acquisition blocks,
+ * without waiting for P1 frames to decode. In FM mode the decision rests on
+ * the coherence of the reference subcarriers, in AM mode on the cyclic prefix
+ * correlation; either way a channel that reaches sync is reported as present,
+ * along with its PSMI. Empty channels are skipped after about 200 ms, and no
+ * channel is listened to for more than about half a second.
+ *
+ * An `NRSC5_EVENT_SCAN` event is reported for every channel. The function
+ * blocks until the scan completes, then leaves the session stopped and tuned
+ * back to its previous frequency. It needs a device or rtl_tcp session; with
+ * no incoming samples it fails after a few seconds.
+ *
+ * @return 0 on success, nonzero on error
+ */
+NRSC5_API int nrsc5_scan(nrsc5_t *st, float begin, float end, float skip);
+
+/**
+ * Create a baseband signal generator.
+ *
+ * The generator produces a complete HD Radio signal: reference subcarriers,
+ * station information in PIDS, and audio PDUs for every program of the
+ * service mode. It is meant to exercise receivers in tests and benchmarks,
+ * for instance by piping its output into nrsc5_pipe_samples_cu8(). Audio
+ * packets are pseudo-random unless a packet callback is set. The same seed
+ * always produces the same samples.
+ *
+ * @param[out] result  pointer to the new `nrsc5_generator_t` object
+ * @param[in] mode  either `NRSC5_MODE_FM` or `NRSC5_MODE_AM`
+ * @param[in] service_mode  FM: 1, 2, 3 or 11 for MP1, MP2, MP3 or MP11; AM: 1 or 3 for MA1 or MA3
+ * @param[in] seed  seed of the pseudo-random packets and noise
+ * @return 0 on success, nonzero on error
+ */
+NRSC5_API int nrsc5_generator_open(nrsc5_generator_t **result, int mode, unsigned int service_mode, unsigned int seed);
+
+/**
+ * Close a signal generator.
+ *
+ * @param[in] gen  pointer to an `nrsc5_generator_t` object
+ */
+NRSC5_API void nrsc5_generator_close(nrsc5_generator_t *gen);
+
+/**
+ * Add white Gaussian noise to the generated signal.
+ *
+ * The SNR is the ratio of the digital signal power to the noise power
+ * within the bandwidth of NRSC5_SAMPLE_RATE_CS16_FM (FM) or
+ * NRSC5_SAMPLE_RATE_CS16_AM (AM); the AM analog carrier is not counted.
+ *
+ * @param[in] gen  pointer to an `nrsc5_generator_t` object
+ * @param[in] snr_db  signal-to-noise ratio in dB, or INFINITY for no noise (the default)
+ * @return 0 on success, nonzero on error
+ */
+NRSC5_API int nrsc5_generator_set_snr(nrsc5_generator_t *gen, float snr_db);
+
+/**
+ * Shift the generated signal in frequency.
+ *
+ * @param[in] gen  pointer to an `nrsc5_generator_t` object
+ * @param[in] hz  carrier frequency offset in Hz
+ * @return 0 on success, nonzero on error
+ */
+NRSC5_API int nrsc5_generator_set_cfo(nrsc5_generator_t *gen, float hz);
+
+/**
+ * Delay the first OFDM symbol. Must be called before the first read.
+ *
+ * @param[in] gen  pointer to an `nrsc5_generator_t` object
+ * @param[in] samples  number of leading samples carrying only noise
+ * @return 0 on success, nonzero on error
+ */
+NRSC5_API int nrsc5_generator_set_timing_offset(nrsc5_generator_t *gen, unsigned int samples);
+
+/**
+ * Set the station identification sent in PIDS. The default is "TEST-FM"
+ * in FM mode and "TEST" in AM mode, with facility ID 0.
+ *
+ * @param[in] gen  pointer to an `nrsc5_generator_t` object
+ * @param[in] name  up to four characters from A-Z, space, '?', '-', '*' and '$', optionally followed by "-FM"
+ * @param[in] facility_id  FCC facility ID, below 524288
+ * @return 0 on success, nonzero on error
+ */
+NRSC5_API int nrsc5_generator_set_station(nrsc5_generator_t *gen, const char *name, unsigned int facility_id);
+
+/**
+ * Supply audio packets from a callback instead of pseudo-random bytes.
+ *
+ * The callback is invoked for each packet of programs carried on the
+ * primary and P3/P4 logical channels, well ahead of the time the packet
+ * is transmitted. The AM enhanced stream stays pseudo-random.
+ *
+ * @param[in] gen  pointer to an `nrsc5_generator_t` object
+ * @param[in] callback  packet callback, or NULL for pseudo-random packets
+ * @param[in] opaque  pointer passed to the callback
+ * @return 0 on success, nonzero on error
+ */
+NRSC5_API int nrsc5_generator_set_packet_callback(nrsc5_generator_t *gen, nrsc5_generator_packet_callback_t callback, void *opaque);
+
+/**
+ * Generate 8-bit unsigned IQ samples at NRSC5_SAMPLE_RATE_CU8.
+ * A generator produces either cu8 or cs16 samples, fixed by the first read.
+ *
+ * @param[in] gen  pointer to an `nrsc5_generator_t` object
+ * @param[out] samples  buffer receiving interleaved 8-bit unsigned samples
+ * @param[in] length  the number of bytes to generate, which must be even
+ * @return 0 on success, nonzero on error
+ */
+NRSC5_API int nrsc5_generator_read_cu8(nrsc5_generator_t *gen, uint8_t *samples, unsigned int length);
+
+/**
+ * Generate 16-bit signed IQ samples at NRSC5_SAMPLE_RATE_CS16_FM or
+ * NRSC5_SAMPLE_RATE_CS16_AM.
+ * A generator produces either cu8 or cs16 samples, fixed by the first read.
+ *
+ * @param[in] gen  pointer to an `nrsc5_generator_t` object
+ * @param[out] samples  buffer receiving interleaved 16-bit signed samples
+ * @param[in] length  the number of 16-bit values to generate, which must be even
+ * @return 0 on success, nonzero on error
+ */
+NRSC5_API int nrsc5_generator_read_cs16(nrsc5_generator_t *gen, int16_t *samples, unsigned int length);
+
 #endif /* NRSC5_H_ */
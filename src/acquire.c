@@ -14,6 +14,7 @@
  */
 
 #include <math.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "acquire.h"
@@ -98,18 +99,21 @@ static float filter_taps_am[] = {
 void acquire_process(acquire_t *st)
 {
     float complex max_v = 0, phase_increment;
-    float angle, angle_diff, angle_factor, max_mag = -1.0f;
+    float angle, angle_diff, angle_factor, max_mag = -1.0f, sum_mag = 0;
+    const cint16_t *in = ringbuf_read_ptr(&st->input->ring);
     int samperr = 0;
     int i, j, keep;
 
     if (st->idx != (unsigned int)st->fftcp * (ACQUIRE_SYMBOLS + 1))
         return;
 
+    stats_begin(&st->input->radio->stats, NRSC5_STAGE_ACQUIRE);
     output_advance(st->input->output);
 
     if (st->input->sync_state == SYNC_STATE_FINE)
     {
         samperr = st->fftcp / 2 + st->input->sync.samperr;
+        input_track_timing(st->input, st->input->sync.samperr);
         st->input->sync.samperr = 0;
 
         angle_diff = -st->input->sync.angle;
@@ -122,7 +126,7 @@ void acquire_process(acquire_t *st)
         cint16_t y;
         for (i = 0; i < st->fftcp * (ACQUIRE_SYMBOLS + 1); i++)
         {
-            fir_q15_execute((st->mode == NRSC5_MODE_FM) ? st->filter_fm : st->filter_am, &st->in_buffer[i], &y);
+            fir_q15_execute((st->mode == NRSC5_MODE_FM) ? st->filter_fm : st->filter_am, &in[i], &y);
             st->buffer[i] = (st->mode == NRSC5_MODE_FM) ? cq15_to_cf_conj(y) : cq15_to_cf(y);
         }
 
@@ -142,6 +146,7 @@ void acquire_process(acquire_t *st)
                 v += st->sums[(i + j) % st->fftcp] * st->shape[j] * st->shape[j + st->fft];
 
             mag = normf(v);
+            sum_mag += mag;
             if (mag > max_mag)
             {
                 max_mag = mag;
@@ -150,6 +155,13 @@ void acquire_process(acquire_t *st)
             }
         }
 
+        if (st->input->scan.active && sum_mag > 0)
+        {
+            float cp_metric = max_mag * st->fftcp / sum_mag;
+            if (cp_metric > st->input->scan.block_cp_metric)
+                st->input->scan.block_cp_metric = cp_metric;
+        }
+
         angle_diff = cargf(max_v * cexpf(I * -st->prev_angle));
         angle_factor = (st->prev_angle) ? 0.25 : 1.0;
         angle = st->prev_angle + (angle_diff * angle_factor);
@@ -158,7 +170,7 @@ void acquire_process(acquire_t *st)
     }
 
     for (i = 0; i < st->fftcp * (ACQUIRE_SYMBOLS + 1); i++)
-        st->buffer[i] = (st->mode == NRSC5_MODE_FM) ? cq15_to_cf_conj(st->in_buffer[i]) : cq15_to_cf(st->in_buffer[i]);
+        st->buffer[i] = (st->mode == NRSC5_MODE_FM) ? cq15_to_cf_conj(in[i]) : cq15_to_cf(in[i]);
 
     sync_adjust(&st->input->sync, st->fftcp / 2 - samperr);
     angle -= 2 * M_PI * st->cfo;
@@ -253,13 +265,19 @@ void acquire_process(acquire_t *st)
 
         fftwf_execute((st->mode == NRSC5_MODE_FM) ? st->fft_plan_fm : st->fft_plan_am);
         fftshift(st->fftout, st->fft);
+        st->input->symbol_end = st->input->position - st->idx + samperr + (i + 1) * st->fftcp;
         sync_push(&st->input->sync, st->fftout);
     }
 
     keep = st->fftcp + (st->fftcp / 2 - samperr) + st->keep_extra;
     st->keep_extra = 0;
-    memmove(&st->in_buffer[0], &st->in_buffer[st->idx - keep], sizeof(cint16_t) * keep);
+    ringbuf_consume(&st->input->ring, sizeof(cint16_t) * (st->idx - keep));
     st->idx = keep;
+
+    if (st->input->scan.active)
+        input_scan_block(st->input);
+
+    stats_end(&st->input->radio->stats);
 }
 
 void acquire_keep_extra(acquire_t *st, int extra)
@@ -272,14 +290,18 @@ void acquire_cfo_adjust(acquire_t *st, int cfo)
     st->cfo += cfo;
 }
 
-unsigned int acquire_push(acquire_t *st, cint16_t *buf, unsigned int length)
+/*
+ * Extends the block by the samples following it in the input ring, up to
+ * the end of the next symbol. Returns how many of the length available
+ * samples were taken.
+ */
+unsigned int acquire_push(acquire_t *st, unsigned int length)
 {
     unsigned int needed = st->fftcp - st->idx % st->fftcp;
 
     if (length < needed)
         return 0;
 
-    memcpy(&st->in_buffer[st->idx], buf, sizeof(cint16_t) * needed);
     st->idx += needed;
 
     return needed;
@@ -296,16 +318,13 @@ void acquire_reset(acquire_t *st)
     st->cfo = 0;
 }
 
-void acquire_init(acquire_t *st, input_t *input)
+int acquire_init(acquire_t *st, input_t *input)
 {
     int i;
 
-    st->mode = NRSC5_MODE_FM;
-    st->fft = FFT_FM;
-    st->fftcp = FFTCP_FM;
-    st->cp = CP_FM;
-
     st->input = input;
+    st->buffer = NULL;
+    st->fftcp = 0;
 
     st->filter_fm = firdecim_q15_create(filter_taps_fm, sizeof(filter_taps_fm) / sizeof(filter_taps_fm[0]));
     st->filter_am = firdecim_q15_create(filter_taps_am, sizeof(filter_taps_am) / sizeof(filter_taps_am[0]));
@@ -337,13 +356,26 @@ void acquire_init(acquire_t *st, input_t *input)
             st->shape_am[i] = cosf(M_PI / 2 * (i - FFT_AM) / CP_AM);
     }
 
-    st->shape = st->shape_fm;
-
+    if (!st->filter_fm || !st->filter_am || acquire_set_mode(st, NRSC5_MODE_FM) != 0)
+        return 1;
     acquire_reset(st);
+    return 0;
 }
 
-void acquire_set_mode(acquire_t *st, int mode)
+int acquire_set_mode(acquire_t *st, int mode)
 {
+    int fftcp = (mode == NRSC5_MODE_FM) ? FFTCP_FM : FFTCP_AM;
+
+    if (fftcp != st->fftcp || !st->buffer)
+    {
+        // the buffer is sized for the symbols of the current mode only
+        float complex *buffer = malloc(sizeof(float complex) * fftcp * (ACQUIRE_SYMBOLS + 1));
+        if (!buffer)
+            return 1;
+        free(st->buffer);
+        st->buffer = buffer;
+    }
+
     st->mode = mode;
 
     if (st->mode == NRSC5_MODE_FM)
@@ -360,6 +392,7 @@ void acquire_set_mode(acquire_t *st, int mode)
         st->cp = CP_AM;
         st->shape = st->shape_am;
     }
+    return 0;
 }
 
 void acquire_free(acquire_t *st)
@@ -371,4 +404,13 @@ void acquire_free(acquire_t *st)
     fftwf_destroy_plan(st->fft_plan_fm);
     fftwf_destroy_plan(st->fft_plan_am);
     pthread_mutex_unlock(&fftw_mutex);
+
+    free(st->buffer);
+}
+
+size_t acquire_memory_usage(const acquire_t *st)
+{
+    if (!st->buffer)
+        return 0;
+    return sizeof(float complex) * st->fftcp * (ACQUIRE_SYMBOLS + 1);
 }
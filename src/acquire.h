@@ -1,6 +1,7 @@
 #pragma once
 
 #include <complex.h>
+#include <stddef.h>
 #include <fftw3.h>
 #include "firdecim_q15.h"
 
@@ -9,8 +10,7 @@ typedef struct
     struct input_t *input;
     firdecim_q15 filter_fm;
     firdecim_q15 filter_am;
-    cint16_t in_buffer[FFTCP_FM * (ACQUIRE_SYMBOLS + 1)];
-    float complex buffer[FFTCP_FM * (ACQUIRE_SYMBOLS + 1)];
+    float complex *buffer;
     float complex sums[FFTCP_FM];
     float complex fftin[FFT_FM];
     float complex fftout[FFT_FM];
@@ -20,7 +20,7 @@ typedef struct
     fftwf_plan fft_plan_fm;
     fftwf_plan fft_plan_am;
 
-    unsigned int idx;
+    unsigned int idx;       // samples of the block held at the read end of the input ring
     float prev_angle;
     float complex phase;
     int keep_extra;
@@ -35,8 +35,9 @@ typedef struct
 void acquire_process(acquire_t *st);
 void acquire_keep_extra(acquire_t *st, int extra);
 void acquire_cfo_adjust(acquire_t *st, int cfo);
-unsigned int acquire_push(acquire_t *st, cint16_t *buf, unsigned int length);
+unsigned int acquire_push(acquire_t *st, unsigned int length);
 void acquire_reset(acquire_t *st);
-void acquire_init(acquire_t *st, struct input_t *input);
-void acquire_set_mode(acquire_t *st, int mode);
+int acquire_init(acquire_t *st, struct input_t *input);
+int acquire_set_mode(acquire_t *st, int mode);
 void acquire_free(acquire_t *st);
+size_t acquire_memory_usage(const acquire_t *st);
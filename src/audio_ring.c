@@ -0,0 +1,103 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "audio_ring.h"
+
+int audio_ring_init(audio_ring_t *st, size_t size)
+{
+    size_t rounded = 1;
+
+    if (size > AUDIO_RING_MAX_SIZE)
+        return 1;
+
+    // round up to a power of two so indices can be masked
+    while (rounded < size)
+        rounded <<= 1;
+
+    st->buffer = malloc(rounded * sizeof(int16_t));
+    if (!st->buffer)
+        return 1;
+    st->size = rounded;
+    atomic_init(&st->head, 0);
+    atomic_init(&st->tail, 0);
+    atomic_init(&st->dropped, 0);
+    return 0;
+}
+
+void audio_ring_free(audio_ring_t *st)
+{
+    free(st->buffer);
+    st->buffer = NULL;
+    st->size = 0;
+}
+
+void audio_ring_push(audio_ring_t *st, const int16_t *data, size_t count)
+{
+    size_t head = atomic_load_explicit(&st->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&st->tail, memory_order_acquire);
+    size_t offset, first;
+
+    // never overwrite samples the consumer may still be reading
+    if (count > st->size - (head - tail))
+    {
+        atomic_fetch_add_explicit(&st->dropped, count, memory_order_relaxed);
+        return;
+    }
+
+    offset = head & (st->size - 1);
+    first = st->size - offset;
+    if (first > count)
+        first = count;
+    memcpy(&st->buffer[offset], data, first * sizeof(int16_t));
+    memcpy(st->buffer, data + first, (count - first) * sizeof(int16_t));
+
+    atomic_store_explicit(&st->head, head + count, memory_order_release);
+}
+
+size_t audio_ring_acquire(audio_ring_t *st, const int16_t **data)
+{
+    size_t tail = atomic_load_explicit(&st->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&st->head, memory_order_acquire);
+    size_t offset = tail & (st->size - 1);
+    size_t avail = head - tail;
+
+    // only the contiguous part up to the end of the buffer can be borrowed
+    if (avail > st->size - offset)
+        avail = st->size - offset;
+
+    *data = &st->buffer[offset];
+    return avail;
+}
+
+void audio_ring_release(audio_ring_t *st, size_t count)
+{
+    size_t tail = atomic_load_explicit(&st->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&st->head, memory_order_acquire);
+
+    if (count > head - tail)
+        count = head - tail;
+    atomic_store_explicit(&st->tail, tail + count, memory_order_release);
+}
+
+size_t audio_ring_fill(audio_ring_t *st)
+{
+    size_t head = atomic_load_explicit(&st->head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&st->tail, memory_order_acquire);
+
+    return head - tail;
+}
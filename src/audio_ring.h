@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Largest ring, in 16-bit samples: about six minutes of 44.1 kHz stereo.
+#define AUDIO_RING_MAX_SIZE ((size_t)1 << 25)
+
+/*
+ * Single-producer, single-consumer ring of interleaved stereo samples.
+ * The DSP thread writes with audio_ring_push; the application reads with
+ * audio_ring_acquire/audio_ring_release. No locks are taken on either side.
+ */
+typedef struct
+{
+    int16_t *buffer;
+    size_t size;
+    atomic_size_t head;
+    atomic_size_t tail;
+    atomic_size_t dropped;
+} audio_ring_t;
+
+int audio_ring_init(audio_ring_t *st, size_t size);
+void audio_ring_free(audio_ring_t *st);
+void audio_ring_push(audio_ring_t *st, const int16_t *data, size_t count);
+size_t audio_ring_acquire(audio_ring_t *st, const int16_t **data);
+void audio_ring_release(audio_ring_t *st, size_t count);
+size_t audio_ring_fill(audio_ring_t *st);
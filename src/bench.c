@@ -0,0 +1,498 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Stage-level microbenchmarks.
+ *
+ * Each stage of the receive chain is run in isolation, against the state of a
+ * pipe session, until a minimum amount of time has passed. Results are written
+ * as JSON in nanoseconds per OFDM symbol, per frame or per codeword, so they
+ * can be compared between releases.
+ *
+ * Without input the stages see deterministic pseudo-random samples, which is
+ * enough for everything whose cost does not depend on the data. Given an FM
+ * capture (-r, 8-bit IQ at NRSC5_SAMPLE_RATE_CU8) the front end stages use the
+ * recorded samples, and the whole pipeline and AAC decoding are measured too.
+ */
+
+#include <getopt.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef USE_FAAD2
+#include <neaacdec.h>
+#endif
+
+#include "conv.h"
+#include "generator.h"
+#include "private.h"
+#include "rs_char.h"
+
+#define BENCH_MAX_STAGES 32
+#define BENCH_MAX_AAC_FRAMES 4096
+#define BENCH_RS_ERRORS 3
+// consecutive P1 frames fed to frame_push(), in sequence
+#define BENCH_P1_FRAMES 4
+// blocks per FM P1 frame, each of which releases audio packets
+#define BENCH_P1_BLOCKS 16
+
+typedef struct
+{
+    const char *name;
+    const char *unit;
+    double ns;
+} bench_result_t;
+
+typedef struct
+{
+    nrsc5_t *radio;
+    double min_time;
+    unsigned int sync_state;
+
+    uint8_t *cu8;                 // input for the front end stages
+    uint8_t *capture;             // recorded capture, if any
+    size_t capture_len;
+    cint16_t decimated[FFTCP_FM * (ACQUIRE_SYMBOLS + 1)];
+    float complex symbols[BLKSZ][FFT_FM];
+    int8_t soft[P1_FRAME_LEN_FM * 3];
+    uint8_t hard[P1_FRAME_LEN_FM];
+    uint8_t rs_block[RS_BLOCK_LEN];
+    uint8_t *p1_frames;
+    unsigned int p1_next;
+
+    uint8_t *aac_frames[BENCH_MAX_AAC_FRAMES];
+    unsigned int aac_sizes[BENCH_MAX_AAC_FRAMES];
+    unsigned int aac_count;
+#ifdef USE_FAAD2
+    NeAACDecHandle aacdec;
+    unsigned int aac_next;
+#endif
+
+    bench_result_t results[BENCH_MAX_STAGES];
+    unsigned int num_results;
+} bench_t;
+
+static uint32_t prng_state = 0x12345678;
+
+static uint32_t prng(void)
+{
+    prng_state ^= prng_state << 13;
+    prng_state ^= prng_state >> 17;
+    prng_state ^= prng_state << 5;
+    return prng_state;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Returns nanoseconds per call.
+static double run(bench_t *b, void (*fn)(bench_t *))
+{
+    unsigned long calls = 0;
+    double start, elapsed;
+
+    fn(b);
+
+    start = now();
+    do
+    {
+        fn(b);
+        calls++;
+        elapsed = now() - start;
+    } while (elapsed < b->min_time);
+
+    return elapsed * 1e9 / calls;
+}
+
+static void add_result(bench_t *b, const char *name, const char *unit, double ns)
+{
+    if (b->num_results == BENCH_MAX_STAGES)
+        return;
+    b->results[b->num_results].name = name;
+    b->results[b->num_results].unit = unit;
+    b->results[b->num_results].ns = ns > 0 ? ns : 0;
+    b->num_results++;
+}
+
+/*
+ * Pushes one symbol of 8-bit input through input_push_cu8(). The ring is
+ * emptied first, so acquisition only counts the symbol and never runs.
+ */
+static void decimate_symbol(bench_t *b, const uint8_t *in)
+{
+    input_t *input = &b->radio->input;
+
+    ringbuf_reset(&input->ring);
+    input->acq.idx = 0;
+    input_push_cu8(input, in, 4 * FFTCP_FM);
+}
+
+static void stage_decimate(bench_t *b)
+{
+    decimate_symbol(b, b->cu8);
+}
+
+static void stage_acquire(bench_t *b)
+{
+    input_t *input = &b->radio->input;
+    acquire_t *acq = &input->acq;
+
+    input->sync_state = b->sync_state;
+    input->sync.samperr = 0;
+    input->sync.angle = 0;
+    acq->cfo = 0;
+    ringbuf_reset(&input->ring);
+    memcpy(ringbuf_write_ptr(&input->ring, sizeof(b->decimated)), b->decimated, sizeof(b->decimated));
+    ringbuf_produce(&input->ring, sizeof(b->decimated));
+    acq->idx = FFTCP_FM * (ACQUIRE_SYMBOLS + 1);
+    acquire_process(acq);
+}
+
+static void stage_sync(bench_t *b)
+{
+    input_t *input = &b->radio->input;
+
+    // keep the decoder from running P1 and P3 on noise
+    input->sync_state = b->sync_state;
+    input->decode.started_pm = 0;
+    input->decode.fm->interleaver_px1.started = 0;
+    input->decode.fm->interleaver_px2.started = 0;
+
+    for (unsigned int i = 0; i < BLKSZ; i++)
+        sync_push(&input->sync, b->symbols[i]);
+}
+
+static void stage_deinterleave_p1(bench_t *b)
+{
+    decode_deinterleave_p1(&b->radio->input.decode);
+}
+
+static void stage_deinterleave_p3(bench_t *b)
+{
+    interleaver_iv_t *interleaver = &b->radio->input.decode.fm->interleaver_px1;
+
+    decode_deinterleave_p3_p4(interleaver, b->soft, P3_FRAME_LEN_FM);
+    if (interleaver->i == P3_FRAME_LEN_FM * 32)
+    {
+        interleaver->i = 0;
+        memset(interleaver->pt, 0, sizeof(interleaver->pt));
+    }
+}
+
+static void stage_viterbi_pids(bench_t *b)
+{
+    nrsc5_conv_decode_pids(b->soft, b->hard);
+}
+
+static void stage_viterbi_p1(bench_t *b)
+{
+    nrsc5_conv_decode_p1(b->soft, b->hard);
+}
+
+static void stage_viterbi_p3(bench_t *b)
+{
+    nrsc5_conv_decode_p3_p4(b->soft, b->hard, P3_FRAME_LEN_FM);
+}
+
+// The work done by fix_header() for a header with correctable errors.
+static void stage_rs_header(bench_t *b)
+{
+    uint8_t hdr[RS_BLOCK_LEN];
+
+    memcpy(hdr, b->rs_block, sizeof(hdr));
+    decode_rs_char(b->radio->input.frame.rs_dec, hdr, NULL, 0);
+}
+
+// One P1 frame, with the packets released as the decoder would over its blocks.
+static void stage_frame_push(bench_t *b)
+{
+    input_t *input = &b->radio->input;
+
+    input->sync_state = SYNC_STATE_FINE;
+    frame_push(&input->frame, &b->p1_frames[b->p1_next * P1_FRAME_LEN_FM], P1_FRAME_LEN_FM, P1_LOGICAL_CHANNEL);
+    for (unsigned int i = 0; i < BENCH_P1_BLOCKS; i++)
+        output_advance(input->output);
+    b->p1_next = (b->p1_next + 1) % BENCH_P1_FRAMES;
+}
+
+#ifdef USE_FAAD2
+static void stage_aac(bench_t *b)
+{
+    NeAACDecFrameInfo info;
+
+    if (b->aac_next == b->aac_count)
+    {
+        NeAACDecClose(b->aacdec);
+        NeAACDecInitHDC(&b->aacdec);
+        b->aac_next = 0;
+    }
+    NeAACDecDecode(b->aacdec, &info, b->aac_frames[b->aac_next], b->aac_sizes[b->aac_next]);
+    b->aac_next++;
+}
+#endif
+
+static void stage_pipeline(bench_t *b)
+{
+    nrsc5_pipe_samples_cu8(b->radio, b->capture, b->capture_len);
+}
+
+static void capture_callback(const nrsc5_event_t *evt, void *opaque)
+{
+    bench_t *b = opaque;
+
+    if (evt->event != NRSC5_EVENT_HDC || evt->hdc.program != 0 || !evt->hdc.data)
+        return;
+    if (evt->hdc.flags & NRSC5_PKT_FLAGS_CRC_ERROR || b->aac_count == BENCH_MAX_AAC_FRAMES)
+        return;
+
+    b->aac_frames[b->aac_count] = malloc(evt->hdc.count);
+    memcpy(b->aac_frames[b->aac_count], evt->hdc.data, evt->hdc.count);
+    b->aac_sizes[b->aac_count] = evt->hdc.count;
+    b->aac_count++;
+}
+
+static int load_capture(bench_t *b, const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    long len;
+
+    if (!fp)
+    {
+        fprintf(stderr, "Unable to open %s\n", path);
+        return 1;
+    }
+    fseek(fp, 0, SEEK_END);
+    len = ftell(fp) & ~3L;
+    fseek(fp, 0, SEEK_SET);
+
+    if (len < (long)(4 * FFTCP_FM * (ACQUIRE_SYMBOLS + 1)))
+    {
+        fprintf(stderr, "%s is too short\n", path);
+        fclose(fp);
+        return 1;
+    }
+
+    b->capture = malloc(len);
+    b->capture_len = fread(b->capture, 1, len, fp) & ~(size_t)3;
+    fclose(fp);
+    return 0;
+}
+
+static void run_pipeline(bench_t *b)
+{
+    double ns;
+    nrsc5_t *radio;
+
+    nrsc5_open_pipe(&radio);
+    nrsc5_set_event_mask(radio, NRSC5_EVENT_MASK(NRSC5_EVENT_HDC));
+    nrsc5_set_callback(radio, capture_callback, b);
+
+    // one decode to collect AAC frames, then timed passes without events
+    nrsc5_pipe_samples_cu8(radio, b->capture, b->capture_len);
+    nrsc5_set_event_mask(radio, 0);
+
+    b->radio = radio;
+    ns = run(b, stage_pipeline);
+    add_result(b, "pipeline", "symbol", ns / (b->capture_len / 4.0 / FFTCP_FM));
+
+#ifdef USE_FAAD2
+    if (b->aac_count > 0)
+    {
+        NeAACDecInitHDC(&b->aacdec);
+        add_result(b, "aac", "frame", run(b, stage_aac));
+        NeAACDecClose(b->aacdec);
+    }
+#endif
+
+    nrsc5_close(radio);
+}
+
+static int make_p1_frames(bench_t *b)
+{
+    nrsc5_generator_t *gen;
+
+    b->p1_frames = malloc(BENCH_P1_FRAMES * P1_FRAME_LEN_FM);
+    if (!b->p1_frames || nrsc5_generator_open(&gen, NRSC5_MODE_FM, 1, 1) != 0)
+        return 1;
+    for (unsigned int i = 0; i < BENCH_P1_FRAMES; i++)
+        generator_p1_frame(gen, &b->p1_frames[i * P1_FRAME_LEN_FM]);
+    nrsc5_generator_close(gen);
+    return 0;
+}
+
+static void run_stages(bench_t *b)
+{
+    double sync_coarse, sync_fine;
+    unsigned int i, j;
+
+    for (i = 0; i < BLKSZ; i++)
+        for (j = 0; j < FFT_FM; j++)
+            b->symbols[i][j] = CMPLXF((int32_t)prng() / 2147483648.0f, (int32_t)prng() / 2147483648.0f);
+    for (i = 0; i < sizeof(b->soft); i++)
+        b->soft[i] = prng();
+    for (i = 0; i < sizeof(b->radio->input.decode.fm->buffer_pm); i++)
+        b->radio->input.decode.fm->buffer_pm[i] = prng();
+    for (i = 0; i < sizeof(b->radio->input.decode.fm->interleaver_px1.buffer); i++)
+        b->radio->input.decode.fm->interleaver_px1.buffer[i] = prng();
+    decode_set_px1_length(&b->radio->input.decode, P3_FRAME_LEN_FM * 2);
+
+    // an all-zero codeword is valid; corrupt a few bytes of the header
+    memset(b->rs_block, 0, sizeof(b->rs_block));
+    for (i = 0; i < BENCH_RS_ERRORS; i++)
+        b->rs_block[RS_BLOCK_LEN - 1 - i * 17] = prng() | 1;
+
+    add_result(b, "decimate", "symbol", run(b, stage_decimate));
+
+    // the acquisition stages need ACQUIRE_SYMBOLS + 1 symbols of decimated input
+    for (i = 0; i < ACQUIRE_SYMBOLS + 1; i++)
+    {
+        decimate_symbol(b, &b->cu8[i * 4 * FFTCP_FM]);
+        memcpy(&b->decimated[i * FFTCP_FM], ringbuf_read_ptr(&b->radio->input.ring), FFTCP_FM * sizeof(cint16_t));
+    }
+
+    // acquire_process() hands its symbols to sync_push(), so the cost of
+    // sync in the same state is subtracted from the acquisition figures.
+    b->sync_state = SYNC_STATE_COARSE;
+    sync_coarse = run(b, stage_sync);
+    add_result(b, "sync_coarse", "symbol", sync_coarse / BLKSZ);
+    b->sync_state = SYNC_STATE_NONE;
+    add_result(b, "acquire_coarse", "symbol", (run(b, stage_acquire) - sync_coarse) / ACQUIRE_SYMBOLS);
+
+    b->sync_state = SYNC_STATE_FINE;
+    sync_fine = run(b, stage_sync);
+    add_result(b, "sync_fine", "symbol", sync_fine / BLKSZ);
+    add_result(b, "acquire_fine", "symbol", (run(b, stage_acquire) - sync_fine) / ACQUIRE_SYMBOLS);
+
+    add_result(b, "deinterleave_p1", "frame", run(b, stage_deinterleave_p1));
+    add_result(b, "deinterleave_p3", "frame", run(b, stage_deinterleave_p3));
+    add_result(b, "viterbi_pids", "frame", run(b, stage_viterbi_pids));
+    add_result(b, "viterbi_p1", "frame", run(b, stage_viterbi_p1));
+    add_result(b, "viterbi_p3", "frame", run(b, stage_viterbi_p3));
+    add_result(b, "rs_header", "codeword", run(b, stage_rs_header));
+
+    if (make_p1_frames(b) != 0)
+    {
+        fprintf(stderr, "Unable to generate P1 frames\n");
+        return;
+    }
+    add_result(b, "frame_p1", "frame", run(b, stage_frame_push));
+}
+
+static void write_json(bench_t *b, FILE *fp)
+{
+    const char *version;
+
+    nrsc5_get_version(&version);
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"version\": \"%s\",\n", version);
+    fprintf(fp, "  \"input\": \"%s\",\n", b->capture ? "recorded" : "synthetic");
+    fprintf(fp, "  \"min_time\": %.3f,\n", b->min_time);
+    fprintf(fp, "  \"stages\": [\n");
+    for (unsigned int i = 0; i < b->num_results; i++)
+    {
+        bench_result_t *r = &b->results[i];
+        fprintf(fp, "    { \"name\": \"%s\", \"unit\": \"%s\", \"ns\": %.1f }%s\n",
+                r->name, r->unit, r->ns, (i + 1 < b->num_results) ? "," : "");
+    }
+    fprintf(fp, "  ]\n");
+    fprintf(fp, "}\n");
+}
+
+static void help(const char *progname)
+{
+    fprintf(stderr, "Usage: %s [-t seconds] [-r iq-input] [-o json-output]\n", progname);
+}
+
+int main(int argc, char *argv[])
+{
+    static bench_t b;
+    const char *output_name = NULL;
+    FILE *out = stdout;
+    int opt;
+
+    b.min_time = 0.5;
+
+    while ((opt = getopt(argc, argv, "t:r:o:")) != -1)
+    {
+        switch (opt)
+        {
+        case 't':
+            b.min_time = atof(optarg);
+            break;
+        case 'r':
+            if (load_capture(&b, optarg) != 0)
+                return 1;
+            break;
+        case 'o':
+            output_name = optarg;
+            break;
+        default:
+            help(argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind != argc || b.min_time <= 0)
+    {
+        help(argv[0]);
+        return 1;
+    }
+
+    if (b.capture)
+    {
+        b.cu8 = b.capture;
+    }
+    else
+    {
+        size_t len = 4 * FFTCP_FM * (ACQUIRE_SYMBOLS + 1);
+        b.cu8 = malloc(len);
+        for (size_t i = 0; i < len; i++)
+            b.cu8[i] = prng();
+    }
+
+    if (nrsc5_open_pipe(&b.radio) != 0)
+        return 1;
+    nrsc5_set_event_mask(b.radio, 0);
+    run_stages(&b);
+    nrsc5_close(b.radio);
+
+    if (b.capture)
+        run_pipeline(&b);
+
+    if (output_name)
+    {
+        out = fopen(output_name, "w");
+        if (!out)
+        {
+            fprintf(stderr, "Unable to open %s\n", output_name);
+            return 1;
+        }
+    }
+    write_json(&b, out);
+    if (out != stdout)
+        fclose(out);
+
+    for (unsigned int i = 0; i < b.aac_count; i++)
+        free(b.aac_frames[i]);
+    if (!b.capture)
+        free(b.cu8);
+    free(b.capture);
+    free(b.p1_frames);
+    return 0;
+}
@@ -0,0 +1,362 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Wideband channelizer. A capture at an integer multiple of
+ * NRSC5_SAMPLE_RATE_CS16_FM is split into per-station streams at
+ * NRSC5_SAMPLE_RATE_CS16_FM with an overlap-save fast-convolution filter
+ * bank: one large forward FFT per block is shared by all stations, and each
+ * station selects the CHANNELIZER_FFT bins around its own frequency, applies
+ * the channel filter and runs a small inverse FFT. This is the FFT-domain
+ * equivalent of a polyphase filter bank, but channels may sit anywhere on
+ * the spectrum, so stations on a 200 kHz grid need not align with the FFT.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "channelizer.h"
+#include "private.h"
+
+#define BIN_SPACING (NRSC5_SAMPLE_RATE_CS16_FM / CHANNELIZER_FFT)
+
+static int16_t clip_s16(float x)
+{
+    long v = lroundf(x);
+
+    if (v > 32767)
+        return 32767;
+    if (v < -32768)
+        return -32768;
+    return v;
+}
+
+static void station_process(nrsc5_channelizer_t *ch, channelizer_station_t *st, const float complex *spectrum)
+{
+    const int half = CHANNELIZER_FFT / 2;
+    int fft = ch->fft;
+    int bin = ((st->bin % fft) + fft) % fft;
+
+    for (int k = -half; k < half; k++)
+    {
+        int src = (bin + k + fft) % fft;
+        int dst = k & (CHANNELIZER_FFT - 1);
+        st->spectrum[dst] = spectrum[src] * ch->filter[dst];
+    }
+    fftwf_execute(st->ifft);
+
+    // undo the phase step caused by shifting each block by an integer number of bins
+    float phase = -2 * M_PI * (float)(((uint64_t)bin * st->pos) % fft) / fft;
+    float complex rot = CMPLXF(cosf(phase), sinf(phase));
+
+    for (int m = 0; m < CHANNELIZER_HOP; m++)
+    {
+        float complex y = st->output[CHANNELIZER_OVERLAP + m] * rot;
+        st->samples[m * 2] = clip_s16(crealf(y));
+        st->samples[m * 2 + 1] = clip_s16(cimagf(y));
+    }
+    st->pos = (st->pos + ch->hop) % ch->fft;
+
+    nrsc5_pipe_samples_cs16(st->radio, st->samples, CHANNELIZER_HOP * 2);
+}
+
+static void process_stations(nrsc5_channelizer_t *ch, unsigned int first, unsigned int stride)
+{
+    for (unsigned int i = first; i < ch->num_stations; i += stride)
+    {
+        for (unsigned int b = 0; b < ch->num_blocks; b++)
+            station_process(ch, &ch->stations[i], &ch->spectra[b * ch->fft]);
+    }
+}
+
+static void *worker_thread(void *arg)
+{
+    channelizer_worker_t *worker = arg;
+    nrsc5_channelizer_t *ch = worker->ch;
+    unsigned int generation = 0;
+
+    pthread_mutex_lock(&ch->mutex);
+    while (1)
+    {
+        while (!ch->closed && ch->generation == generation)
+            pthread_cond_wait(&ch->work_cond, &ch->mutex);
+        if (ch->closed)
+            break;
+        generation = ch->generation;
+        pthread_mutex_unlock(&ch->mutex);
+
+        process_stations(ch, worker->index, ch->num_workers);
+
+        pthread_mutex_lock(&ch->mutex);
+        if (--ch->pending == 0)
+            pthread_cond_signal(&ch->done_cond);
+    }
+    pthread_mutex_unlock(&ch->mutex);
+    return NULL;
+}
+
+static void dispatch(nrsc5_channelizer_t *ch)
+{
+    if (ch->num_workers == 0)
+    {
+        process_stations(ch, 0, 1);
+    }
+    else
+    {
+        pthread_mutex_lock(&ch->mutex);
+        ch->pending = ch->num_workers;
+        ch->generation++;
+        pthread_cond_broadcast(&ch->work_cond);
+        while (ch->pending > 0)
+            pthread_cond_wait(&ch->done_cond, &ch->mutex);
+        pthread_mutex_unlock(&ch->mutex);
+    }
+    ch->num_blocks = 0;
+}
+
+static void channelizer_push(nrsc5_channelizer_t *ch, const int16_t *s16, const uint8_t *u8, unsigned int count)
+{
+    while (count > 0)
+    {
+        unsigned int n = ch->fft - ch->window_len;
+        float complex *dst = &ch->window[ch->window_len];
+
+        if (n > count)
+            n = count;
+        if (u8)
+        {
+            for (unsigned int i = 0; i < n; i++)
+                dst[i] = CMPLXF((u8[i * 2] - 127.5f) * 256, (u8[i * 2 + 1] - 127.5f) * 256);
+            u8 += n * 2;
+        }
+        else
+        {
+            for (unsigned int i = 0; i < n; i++)
+                dst[i] = CMPLXF(s16[i * 2], s16[i * 2 + 1]);
+            s16 += n * 2;
+        }
+        ch->window_len += n;
+        count -= n;
+
+        if (ch->window_len == ch->fft)
+        {
+            fftwf_execute_dft(ch->fft_plan, ch->window, &ch->spectra[ch->num_blocks * ch->fft]);
+            memmove(ch->window, &ch->window[ch->hop], ch->overlap * sizeof(float complex));
+            ch->window_len = ch->overlap;
+
+            if (++ch->num_blocks == CHANNELIZER_MAX_BLOCKS)
+                dispatch(ch);
+        }
+    }
+
+    if (ch->num_blocks > 0)
+        dispatch(ch);
+}
+
+static int design_filter(nrsc5_channelizer_t *ch)
+{
+    float complex *taps = fftwf_malloc(sizeof(float complex) * CHANNELIZER_FFT);
+    float fc = CHANNELIZER_CUTOFF / NRSC5_SAMPLE_RATE_CS16_FM;
+    float sum = 0;
+    fftwf_plan plan;
+
+    if (!taps)
+        return 1;
+
+    // Blackman-windowed sinc, scaled to undo the unnormalized FFT pair
+    for (int i = 0; i < CHANNELIZER_FFT; i++)
+    {
+        float x, w;
+
+        if (i >= CHANNELIZER_TAPS)
+        {
+            taps[i] = 0;
+            continue;
+        }
+        x = i - (CHANNELIZER_TAPS - 1) / 2.0f;
+        w = 0.42f - 0.5f * cosf(2 * M_PI * i / (CHANNELIZER_TAPS - 1)) + 0.08f * cosf(4 * M_PI * i / (CHANNELIZER_TAPS - 1));
+        taps[i] = (x == 0 ? 2 * fc : sinf(2 * M_PI * fc * x) / (M_PI * x)) * w;
+        sum += crealf(taps[i]);
+    }
+    for (int i = 0; i < CHANNELIZER_TAPS; i++)
+        taps[i] /= sum * ch->fft;
+
+    pthread_mutex_lock(&fftw_mutex);
+    plan = fftwf_plan_dft_1d(CHANNELIZER_FFT, taps, ch->filter, FFTW_FORWARD, FFTW_ESTIMATE);
+    pthread_mutex_unlock(&fftw_mutex);
+    if (!plan)
+    {
+        fftwf_free(taps);
+        return 1;
+    }
+    fftwf_execute(plan);
+    pthread_mutex_lock(&fftw_mutex);
+    fftwf_destroy_plan(plan);
+    pthread_mutex_unlock(&fftw_mutex);
+
+    fftwf_free(taps);
+    return 0;
+}
+
+int nrsc5_channelizer_open(nrsc5_channelizer_t **result, unsigned int decimation, float center_freq, unsigned int threads)
+{
+    nrsc5_channelizer_t *ch;
+
+    *result = NULL;
+    if (decimation < 1 || decimation > 16 || threads > CHANNELIZER_MAX_THREADS)
+        return 1;
+
+    ch = calloc(1, sizeof(*ch));
+    if (!ch)
+        return 1;
+
+    ch->decimation = decimation;
+    ch->fft = decimation * CHANNELIZER_FFT;
+    ch->overlap = decimation * CHANNELIZER_OVERLAP;
+    ch->hop = ch->fft - ch->overlap;
+    ch->center_freq = center_freq;
+
+    ch->window = fftwf_malloc(sizeof(float complex) * ch->fft);
+    ch->spectra = fftwf_malloc(sizeof(float complex) * ch->fft * CHANNELIZER_MAX_BLOCKS);
+    if (!ch->window || !ch->spectra)
+        goto error;
+    memset(ch->window, 0, sizeof(float complex) * ch->fft);
+    ch->window_len = ch->overlap;
+
+    pthread_mutex_lock(&fftw_mutex);
+    ch->fft_plan = fftwf_plan_dft_1d(ch->fft, ch->window, ch->spectra, FFTW_FORWARD, FFTW_ESTIMATE);
+    pthread_mutex_unlock(&fftw_mutex);
+    if (!ch->fft_plan || design_filter(ch) != 0)
+        goto error;
+
+    pthread_mutex_init(&ch->mutex, NULL);
+    pthread_cond_init(&ch->work_cond, NULL);
+    pthread_cond_init(&ch->done_cond, NULL);
+    for (unsigned int i = 0; i < threads; i++)
+    {
+        ch->workers[i].ch = ch;
+        ch->workers[i].index = i;
+        if (pthread_create(&ch->workers[i].thread, NULL, worker_thread, &ch->workers[i]) != 0)
+        {
+            nrsc5_channelizer_close(ch);
+            return 1;
+        }
+        ch->num_workers++;
+    }
+
+    *result = ch;
+    return 0;
+
+error:
+    if (ch->fft_plan)
+    {
+        pthread_mutex_lock(&fftw_mutex);
+        fftwf_destroy_plan(ch->fft_plan);
+        pthread_mutex_unlock(&fftw_mutex);
+    }
+    fftwf_free(ch->window);
+    fftwf_free(ch->spectra);
+    free(ch);
+    return 1;
+}
+
+void nrsc5_channelizer_close(nrsc5_channelizer_t *ch)
+{
+    if (!ch)
+        return;
+
+    pthread_mutex_lock(&ch->mutex);
+    ch->closed = 1;
+    pthread_cond_broadcast(&ch->work_cond);
+    pthread_mutex_unlock(&ch->mutex);
+    for (unsigned int i = 0; i < ch->num_workers; i++)
+        pthread_join(ch->workers[i].thread, NULL);
+
+    pthread_mutex_lock(&fftw_mutex);
+    for (unsigned int i = 0; i < ch->num_stations; i++)
+        fftwf_destroy_plan(ch->stations[i].ifft);
+    fftwf_destroy_plan(ch->fft_plan);
+    pthread_mutex_unlock(&fftw_mutex);
+
+    for (unsigned int i = 0; i < ch->num_stations; i++)
+    {
+        fftwf_free(ch->stations[i].spectrum);
+        fftwf_free(ch->stations[i].output);
+    }
+    fftwf_free(ch->window);
+    fftwf_free(ch->spectra);
+
+    pthread_cond_destroy(&ch->done_cond);
+    pthread_cond_destroy(&ch->work_cond);
+    pthread_mutex_destroy(&ch->mutex);
+    free(ch);
+}
+
+int nrsc5_channelizer_add(nrsc5_channelizer_t *ch, nrsc5_t *radio, float freq)
+{
+    channelizer_station_t *st;
+    int bin = lroundf((freq - ch->center_freq) / BIN_SPACING);
+
+    if (ch->num_stations == CHANNELIZER_MAX_STATIONS || radio->mode != NRSC5_MODE_FM)
+        return 1;
+
+    // the whole output band must fit inside the capture
+    if (abs(bin) + CHANNELIZER_FFT / 2 > (int)ch->fft / 2)
+        return 1;
+
+    st = &ch->stations[ch->num_stations];
+    memset(st, 0, sizeof(*st));
+    st->radio = radio;
+    st->bin = bin;
+    st->spectrum = fftwf_malloc(sizeof(float complex) * CHANNELIZER_FFT);
+    st->output = fftwf_malloc(sizeof(float complex) * CHANNELIZER_FFT);
+    if (!st->spectrum || !st->output)
+    {
+        fftwf_free(st->spectrum);
+        fftwf_free(st->output);
+        return 1;
+    }
+
+    pthread_mutex_lock(&fftw_mutex);
+    st->ifft = fftwf_plan_dft_1d(CHANNELIZER_FFT, st->spectrum, st->output, FFTW_BACKWARD, FFTW_ESTIMATE);
+    pthread_mutex_unlock(&fftw_mutex);
+    if (!st->ifft)
+    {
+        fftwf_free(st->spectrum);
+        fftwf_free(st->output);
+        return 1;
+    }
+
+    ch->num_stations++;
+    return 0;
+}
+
+int nrsc5_channelizer_push_cs16(nrsc5_channelizer_t *ch, const int16_t *samples, unsigned int length)
+{
+    if (length % 2 != 0)
+        return 1;
+
+    channelizer_push(ch, samples, NULL, length / 2);
+    return 0;
+}
+
+int nrsc5_channelizer_push_cu8(nrsc5_channelizer_t *ch, const uint8_t *samples, unsigned int length)
+{
+    if (length % 2 != 0)
+        return 1;
+
+    channelizer_push(ch, NULL, samples, length / 2);
+    return 0;
+}
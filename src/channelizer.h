@@ -0,0 +1,62 @@
+#pragma once
+
+#include <complex.h>
+#include <fftw3.h>
+#include <pthread.h>
+
+#include <nrsc5.h>
+
+#define CHANNELIZER_FFT 2048
+#define CHANNELIZER_OVERLAP (CHANNELIZER_FFT / 4)
+#define CHANNELIZER_HOP (CHANNELIZER_FFT - CHANNELIZER_OVERLAP)
+#define CHANNELIZER_TAPS CHANNELIZER_OVERLAP
+#define CHANNELIZER_CUTOFF 215000.0f
+#define CHANNELIZER_MAX_BLOCKS 16
+#define CHANNELIZER_MAX_STATIONS 32
+#define CHANNELIZER_MAX_THREADS 16
+
+typedef struct
+{
+    nrsc5_t *radio;
+    int bin;
+    unsigned int pos;
+    float complex *spectrum;
+    float complex *output;
+    fftwf_plan ifft;
+    int16_t samples[CHANNELIZER_HOP * 2];
+} channelizer_station_t;
+
+typedef struct
+{
+    struct nrsc5_channelizer_t *ch;
+    unsigned int index;
+    pthread_t thread;
+} channelizer_worker_t;
+
+struct nrsc5_channelizer_t
+{
+    unsigned int decimation;
+    unsigned int fft;
+    unsigned int overlap;
+    unsigned int hop;
+    float center_freq;
+
+    float complex *window;
+    unsigned int window_len;
+    float complex *spectra;
+    unsigned int num_blocks;
+    fftwf_plan fft_plan;
+    float complex filter[CHANNELIZER_FFT];
+
+    channelizer_station_t stations[CHANNELIZER_MAX_STATIONS];
+    unsigned int num_stations;
+
+    channelizer_worker_t workers[CHANNELIZER_MAX_THREADS];
+    unsigned int num_workers;
+    unsigned int generation;
+    unsigned int pending;
+    int closed;
+    pthread_mutex_t mutex;
+    pthread_cond_t work_cond;
+    pthread_cond_t done_cond;
+};
@@ -0,0 +1,757 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Headless multi-station mode.
+ *
+ * The config file has one station per line:
+ *
+ *     name source [mode=fm|am] [format=cu8|cs16] [freq=hz] [gain=db] [dir=path]
+ *
+ * where source is a path to an IQ file or FIFO, or rtltcp:host[:port]. Blank
+ * lines and lines starting with '#' are ignored. Each station gets its own
+ * output directory (output-dir/name unless dir= is given) holding one WAV and
+ * one HDC file per audio program and an aas/ directory for LOT files.
+ *
+ * File and FIFO inputs are read by a bounded pool of threads, one chunk at a
+ * time, so any number of stations share the same few cores. rtl_tcp inputs are
+ * paced by the remote end and run on the session's own worker thread.
+ */
+
+#include <ao/ao.h>
+#include <getopt.h>
+#include <nrsc5.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef __MINGW32__
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+
+#include "log.h"
+#include "main.h"
+
+#ifdef __MINGW32__
+
+int daemon_main(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+    log_fatal("Daemon mode is not supported on Windows.");
+    return 1;
+}
+
+#else
+
+#define DAEMON_PROGRAMS 8
+#define DAEMON_CHUNK_BYTES (256 * 1024)
+#define DAEMON_MAX_THREADS 64
+#define DAEMON_LINE_LEN 1024
+
+enum { STATION_IDLE, STATION_QUEUED, STATION_BUSY, STATION_LIVE, STATION_DONE };
+
+typedef struct station_t
+{
+    struct station_t *next_ready;
+    struct daemon_t *daemon;
+
+    char *name;
+    char *source;
+    char *dir;
+    char *aas_dir;
+    int mode;
+    int cs16;
+    float freq;
+    float gain;
+
+    int fd;
+    uint8_t carry;
+    int carry_len;
+    int state;
+    nrsc5_t *radio;
+
+    pthread_mutex_t output_mutex;
+    ao_device *audio[DAEMON_PROGRAMS];
+    FILE *hdc[DAEMON_PROGRAMS];
+} station_t;
+
+typedef struct daemon_t
+{
+    station_t *stations;
+    unsigned int count;
+
+    station_t *ready_head, *ready_tail;
+    int stop;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int wake[2];
+} daemon_t;
+
+static volatile sig_atomic_t interrupted;
+static pthread_mutex_t ao_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void help(const char *progname)
+{
+    fprintf(stderr, "Usage: %s --daemon [-q] [-l log-level] [-j threads] [-o output-dir] config-file\n", progname);
+}
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    interrupted = 1;
+}
+
+static void wake_poller(daemon_t *d)
+{
+    char c = 0;
+    if (write(d->wake[1], &c, 1) < 0 && errno != EAGAIN)
+        log_warn("Failed to wake poller (%d)", errno);
+}
+
+static int make_dir(const char *path)
+{
+    if (mkdir(path, 0777) != 0 && errno != EEXIST)
+    {
+        log_error("Failed to create %s (%d)", path, errno);
+        return 1;
+    }
+    return 0;
+}
+
+static char *path_join(const char *dir, const char *name)
+{
+    char *path = malloc(strlen(dir) + strlen(name) + 2);
+    if (!path)
+        return NULL;
+    sprintf(path, "%s/%s", dir, name);
+    return path;
+}
+
+static void station_audio(station_t *s, unsigned int program, const int16_t *data, size_t count)
+{
+    if (program >= DAEMON_PROGRAMS)
+        return;
+
+    pthread_mutex_lock(&s->output_mutex);
+    if (!s->audio[program])
+    {
+        char name[32];
+        char *path;
+
+        snprintf(name, sizeof(name), "program%u.wav", program);
+        path = path_join(s->dir, name);
+        if (!path)
+        {
+            log_error("%s: Unable to allocate output path", s->name);
+            pthread_mutex_unlock(&s->output_mutex);
+            return;
+        }
+        // libao keeps global driver state, so opens are serialized across stations
+        pthread_mutex_lock(&ao_mutex);
+        s->audio[program] = open_ao_file(path, "wav");
+        pthread_mutex_unlock(&ao_mutex);
+        if (!s->audio[program])
+            log_error("%s: Unable to open %s", s->name, path);
+        free(path);
+    }
+    if (s->audio[program])
+        ao_play(s->audio[program], (char *)data, count * sizeof(data[0]));
+    pthread_mutex_unlock(&s->output_mutex);
+}
+
+static void station_hdc(station_t *s, unsigned int program, const uint8_t *data, size_t count)
+{
+    if (program >= DAEMON_PROGRAMS)
+        return;
+
+    pthread_mutex_lock(&s->output_mutex);
+    if (!s->hdc[program])
+    {
+        char name[32];
+        char *path;
+
+        snprintf(name, sizeof(name), "program%u.hdc", program);
+        path = path_join(s->dir, name);
+        if (!path)
+        {
+            log_error("%s: Unable to allocate output path", s->name);
+            pthread_mutex_unlock(&s->output_mutex);
+            return;
+        }
+        s->hdc[program] = fopen(path, "wb");
+        if (!s->hdc[program])
+            log_error("%s: Unable to open %s", s->name, path);
+        free(path);
+    }
+    if (s->hdc[program])
+        dump_hdc(s->hdc[program], data, count);
+    pthread_mutex_unlock(&s->output_mutex);
+}
+
+static void station_callback(const nrsc5_event_t *evt, void *opaque)
+{
+    station_t *s = opaque;
+
+    switch (evt->event)
+    {
+    case NRSC5_EVENT_LOST_DEVICE:
+        pthread_mutex_lock(&s->daemon->mutex);
+        s->state = STATION_DONE;
+        pthread_mutex_unlock(&s->daemon->mutex);
+        wake_poller(s->daemon);
+        break;
+    case NRSC5_EVENT_SYNC:
+        log_info("%s: Synchronized", s->name);
+        break;
+    case NRSC5_EVENT_LOST_SYNC:
+        log_info("%s: Lost synchronization", s->name);
+        break;
+    case NRSC5_EVENT_STATION_NAME:
+        log_info("%s: Station name: %s", s->name, evt->station_name.name);
+        break;
+    case NRSC5_EVENT_AUDIO:
+        station_audio(s, evt->audio.program, evt->audio.data, evt->audio.count);
+        break;
+    case NRSC5_EVENT_HDC:
+        station_hdc(s, evt->hdc.program, evt->hdc.data, evt->hdc.count);
+        break;
+    case NRSC5_EVENT_LOT:
+    case NRSC5_EVENT_HERE_IMAGE:
+        dump_aas_file(s->aas_dir, evt);
+        break;
+    }
+}
+
+static int parse_station(station_t *s, char *line, const char *output_dir)
+{
+    char *saveptr = NULL, *tok, *endptr;
+
+    s->name = strtok_r(line, " \t", &saveptr);
+    s->source = strtok_r(NULL, " \t", &saveptr);
+    if (!s->name || !s->source)
+        return 1;
+    s->name = strdup(s->name);
+    s->source = strdup(s->source);
+    if (!s->name || !s->source)
+        goto error;
+    s->mode = NRSC5_MODE_FM;
+    s->freq = NRSC5_SCAN_BEGIN;
+    s->gain = -1;
+    s->fd = -1;
+
+    while ((tok = strtok_r(NULL, " \t", &saveptr)) != NULL)
+    {
+        char *value = strchr(tok, '=');
+        if (!value)
+            goto error;
+        *value++ = 0;
+
+        if (strcmp(tok, "mode") == 0 && strcmp(value, "fm") == 0)
+            s->mode = NRSC5_MODE_FM;
+        else if (strcmp(tok, "mode") == 0 && strcmp(value, "am") == 0)
+            s->mode = NRSC5_MODE_AM;
+        else if (strcmp(tok, "format") == 0 && strcmp(value, "cu8") == 0)
+            s->cs16 = 0;
+        else if (strcmp(tok, "format") == 0 && strcmp(value, "cs16") == 0)
+            s->cs16 = 1;
+        else if (strcmp(tok, "freq") == 0)
+        {
+            s->freq = strtof(value, &endptr);
+            if (*endptr != 0)
+                goto error;
+            // same convention as the frequency argument
+            if (s->freq < 10000.0f)
+                s->freq *= 1e6f;
+        }
+        else if (strcmp(tok, "gain") == 0)
+        {
+            s->gain = strtof(value, &endptr);
+            if (*endptr != 0)
+                goto error;
+        }
+        else if (strcmp(tok, "dir") == 0)
+        {
+            free(s->dir);
+            s->dir = strdup(value);
+            if (!s->dir)
+                goto error;
+        }
+        else
+            goto error;
+    }
+
+    if (!s->dir)
+        s->dir = path_join(output_dir, s->name);
+    if (!s->dir)
+        goto error;
+    s->aas_dir = path_join(s->dir, "aas");
+    if (!s->aas_dir)
+        goto error;
+    return 0;
+
+error:
+    free(s->name);
+    free(s->source);
+    free(s->dir);
+    s->name = s->source = s->dir = NULL;
+    return 1;
+}
+
+static int load_config(daemon_t *d, const char *config, const char *output_dir)
+{
+    char line[DAEMON_LINE_LEN];
+    unsigned int lineno = 0;
+    FILE *fp = fopen(config, "r");
+
+    if (!fp)
+    {
+        log_fatal("Unable to open %s", config);
+        return 1;
+    }
+
+    while (fgets(line, sizeof(line), fp))
+    {
+        char *p = line;
+
+        lineno++;
+        line[strcspn(line, "\r\n")] = 0;
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (*p == 0 || *p == '#')
+            continue;
+
+        station_t *stations = realloc(d->stations, (d->count + 1) * sizeof(station_t));
+        if (!stations)
+        {
+            log_fatal("Unable to allocate station %u", d->count + 1);
+            fclose(fp);
+            return 1;
+        }
+        d->stations = stations;
+        memset(&d->stations[d->count], 0, sizeof(station_t));
+        if (parse_station(&d->stations[d->count], p, output_dir) != 0)
+        {
+            log_fatal("%s:%u: invalid station", config, lineno);
+            fclose(fp);
+            return 1;
+        }
+        d->count++;
+    }
+
+    fclose(fp);
+    if (d->count == 0)
+    {
+        log_fatal("No stations in %s", config);
+        return 1;
+    }
+    return 0;
+}
+
+static int open_station(daemon_t *d, station_t *s)
+{
+    s->daemon = d;
+    pthread_mutex_init(&s->output_mutex, NULL);
+
+    if (make_dir(s->dir) != 0 || make_dir(s->aas_dir) != 0)
+        return 1;
+
+    if (strncmp(s->source, "rtltcp:", 7) == 0)
+    {
+#ifdef USE_RTLSDR
+        int sock = connect_tcp(s->source + 7, "1234");
+        if (sock == -1)
+        {
+            log_fatal("%s: Connection failed.", s->name);
+            return 1;
+        }
+        if (nrsc5_open_rtltcp(&s->radio, sock) != 0)
+        {
+            log_fatal("%s: Open remote device failed.", s->name);
+            return 1;
+        }
+        if (nrsc5_set_frequency(s->radio, s->freq) != 0)
+        {
+            log_fatal("%s: Set frequency failed.", s->name);
+            return 1;
+        }
+        if (s->gain >= 0.0f)
+            nrsc5_set_gain(s->radio, s->gain);
+        s->state = STATION_LIVE;
+#else
+        log_fatal("%s: rtl_tcp is only supported by the RTL-SDR build.", s->name);
+        return 1;
+#endif
+    }
+    else
+    {
+        s->fd = open(s->source, O_RDONLY | O_NONBLOCK);
+        if (s->fd < 0)
+        {
+            log_fatal("%s: Unable to open %s", s->name, s->source);
+            return 1;
+        }
+        if (nrsc5_open_pipe(&s->radio) != 0)
+        {
+            log_fatal("%s: Open pipe failed.", s->name);
+            return 1;
+        }
+        s->state = STATION_IDLE;
+    }
+
+    nrsc5_set_mode(s->radio, s->mode);
+    nrsc5_set_event_mask(s->radio,
+        NRSC5_EVENT_MASK(NRSC5_EVENT_LOST_DEVICE) | NRSC5_EVENT_MASK(NRSC5_EVENT_SYNC) |
+        NRSC5_EVENT_MASK(NRSC5_EVENT_LOST_SYNC) | NRSC5_EVENT_MASK(NRSC5_EVENT_STATION_NAME) |
+        NRSC5_EVENT_MASK(NRSC5_EVENT_AUDIO) | NRSC5_EVENT_MASK(NRSC5_EVENT_HDC) |
+        NRSC5_EVENT_MASK(NRSC5_EVENT_LOT) | NRSC5_EVENT_MASK(NRSC5_EVENT_HERE_IMAGE));
+    nrsc5_set_callback(s->radio, station_callback, s);
+    if (s->state == STATION_LIVE)
+        nrsc5_start(s->radio);
+
+    log_info("%s: Decoding %s into %s", s->name, s->source, s->dir);
+    return 0;
+}
+
+static void close_station(station_t *s)
+{
+    if (s->radio)
+    {
+        nrsc5_stop(s->radio);
+        nrsc5_close(s->radio);
+        s->radio = NULL;
+    }
+    if (s->fd >= 0)
+    {
+        close(s->fd);
+        s->fd = -1;
+    }
+
+    for (int i = 0; i < DAEMON_PROGRAMS; i++)
+    {
+        if (s->audio[i])
+            ao_close(s->audio[i]);
+        if (s->hdc[i])
+            fclose(s->hdc[i]);
+        s->audio[i] = NULL;
+        s->hdc[i] = NULL;
+    }
+}
+
+static void free_station(station_t *s)
+{
+    close_station(s);
+    if (s->daemon)
+        pthread_mutex_destroy(&s->output_mutex);
+    free(s->name);
+    free(s->source);
+    free(s->dir);
+    free(s->aas_dir);
+}
+
+// Returns 0 while the input has more data, 1 at end of file or on error.
+static int process_chunk(station_t *s, uint8_t *buf)
+{
+    ssize_t n;
+
+    if (s->carry_len)
+        buf[0] = s->carry;
+    n = read(s->fd, buf + s->carry_len, DAEMON_CHUNK_BYTES - s->carry_len);
+    if (n < 0)
+        return (errno == EAGAIN || errno == EINTR) ? 0 : 1;
+    if (n == 0)
+        return 1;
+
+    if (s->cs16)
+    {
+        // FIFOs may split a sample across reads
+        n += s->carry_len;
+        s->carry_len = n & 1;
+        if (s->carry_len)
+            s->carry = buf[n - 1];
+        nrsc5_pipe_samples_cs16(s->radio, (const int16_t *)buf, n / 2);
+    }
+    else
+    {
+        nrsc5_pipe_samples_cu8(s->radio, buf, n);
+    }
+    return 0;
+}
+
+static void *pool_worker(void *arg)
+{
+    daemon_t *d = arg;
+    uint8_t *buf = malloc(DAEMON_CHUNK_BYTES);
+
+    if (!buf)
+    {
+        // Without a buffer this worker cannot take jobs; shut the daemon down
+        // rather than leave its share of the stations unserved.
+        log_error("Unable to allocate chunk buffer.");
+        pthread_mutex_lock(&d->mutex);
+        d->stop = 1;
+        pthread_cond_broadcast(&d->cond);
+        pthread_mutex_unlock(&d->mutex);
+        wake_poller(d);
+        return NULL;
+    }
+
+    while (1)
+    {
+        station_t *s;
+        int eof;
+
+        pthread_mutex_lock(&d->mutex);
+        while (!d->stop && !d->ready_head)
+            pthread_cond_wait(&d->cond, &d->mutex);
+        if (d->stop)
+        {
+            pthread_mutex_unlock(&d->mutex);
+            break;
+        }
+        s = d->ready_head;
+        d->ready_head = s->next_ready;
+        if (!d->ready_head)
+            d->ready_tail = NULL;
+        s->state = STATION_BUSY;
+        pthread_mutex_unlock(&d->mutex);
+
+        eof = process_chunk(s, buf);
+        if (eof)
+        {
+            log_info("%s: End of input", s->name);
+            close_station(s);
+        }
+
+        pthread_mutex_lock(&d->mutex);
+        s->state = eof ? STATION_DONE : STATION_IDLE;
+        pthread_mutex_unlock(&d->mutex);
+        wake_poller(d);
+    }
+
+    free(buf);
+    return NULL;
+}
+
+// Waits for idle inputs to become readable and hands them to the pool.
+static void poll_stations(daemon_t *d)
+{
+    struct pollfd *fds = calloc(d->count + 1, sizeof(*fds));
+    station_t **polled = calloc(d->count, sizeof(*polled));
+
+    if (!fds || !polled)
+    {
+        log_error("Unable to allocate poll set.");
+        pthread_mutex_lock(&d->mutex);
+        d->stop = 1;
+        pthread_mutex_unlock(&d->mutex);
+        free(fds);
+        free(polled);
+        return;
+    }
+
+    while (!interrupted)
+    {
+        unsigned int n = 0, remaining = 0;
+
+        pthread_mutex_lock(&d->mutex);
+        if (d->stop)
+        {
+            pthread_mutex_unlock(&d->mutex);
+            break;
+        }
+        for (unsigned int i = 0; i < d->count; i++)
+        {
+            station_t *s = &d->stations[i];
+            if (s->state != STATION_DONE)
+                remaining++;
+            if (s->state == STATION_IDLE)
+            {
+                polled[n] = s;
+                fds[n].fd = s->fd;
+                fds[n].events = POLLIN;
+                fds[n].revents = 0;
+                n++;
+            }
+        }
+        pthread_mutex_unlock(&d->mutex);
+
+        if (remaining == 0)
+            break;
+
+        fds[n].fd = d->wake[0];
+        fds[n].events = POLLIN;
+        fds[n].revents = 0;
+
+        if (poll(fds, n + 1, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            log_error("poll failed (%d)", errno);
+            break;
+        }
+
+        if (fds[n].revents & POLLIN)
+        {
+            char drain[64];
+            while (read(d->wake[0], drain, sizeof(drain)) > 0)
+                ;
+        }
+
+        pthread_mutex_lock(&d->mutex);
+        for (unsigned int i = 0; i < n; i++)
+        {
+            station_t *s = polled[i];
+            if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+
+            s->state = STATION_QUEUED;
+            s->next_ready = NULL;
+            if (d->ready_tail)
+                d->ready_tail->next_ready = s;
+            else
+                d->ready_head = s;
+            d->ready_tail = s;
+            pthread_cond_signal(&d->cond);
+        }
+        pthread_mutex_unlock(&d->mutex);
+    }
+
+    free(fds);
+    free(polled);
+}
+
+int daemon_main(int argc, char *argv[])
+{
+    const char *output_dir = ".";
+    const char *progname = argv[0];
+    pthread_t threads[DAEMON_MAX_THREADS];
+    unsigned int num_threads = 0;
+    struct sigaction sa;
+    sigset_t signals, old_mask;
+    daemon_t d;
+    int opt, ret = 1;
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned int max_threads = cpus > 0 ? cpus : 1;
+
+    log_set_level(LOG_INFO);
+
+    while ((opt = getopt(argc, argv, "j:o:ql:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'j':
+            max_threads = strtoul(optarg, NULL, 10);
+            break;
+        case 'o':
+            output_dir = optarg;
+            break;
+        case 'q':
+            log_set_quiet(1);
+            break;
+        case 'l':
+            log_set_level(atoi(optarg));
+            break;
+        default:
+            help(progname);
+            return 1;
+        }
+    }
+
+    if (optind + 1 != argc || max_threads == 0)
+    {
+        help(progname);
+        return 1;
+    }
+    if (max_threads > DAEMON_MAX_THREADS)
+        max_threads = DAEMON_MAX_THREADS;
+
+    memset(&d, 0, sizeof(d));
+    pthread_mutex_init(&d.mutex, NULL);
+    pthread_cond_init(&d.cond, NULL);
+    if (pipe(d.wake) != 0)
+    {
+        log_fatal("Unable to create wake pipe.");
+        return 1;
+    }
+    fcntl(d.wake[0], F_SETFL, O_NONBLOCK);
+    fcntl(d.wake[1], F_SETFL, O_NONBLOCK);
+
+    if (load_config(&d, argv[optind], output_dir) != 0)
+        goto cleanup;
+    if (make_dir(output_dir) != 0)
+        goto cleanup;
+
+    // Only the main thread takes the signals, so that they interrupt its
+    // poll(). Every thread created from here on inherits the blocked set.
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, &old_mask);
+
+    // Sessions are created here, one at a time, so all FFTW planning
+    // happens before the pool starts. Each station still gets its own
+    // FFTW_ESTIMATE plans; planning is serialized by fftw_mutex, not shared.
+    for (unsigned int i = 0; i < d.count; i++)
+        if (open_station(&d, &d.stations[i]) != 0)
+            goto cleanup;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    if (max_threads > d.count)
+        max_threads = d.count;
+    for (num_threads = 0; num_threads < max_threads; num_threads++)
+        if (pthread_create(&threads[num_threads], NULL, pool_worker, &d) != 0)
+            break;
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+    log_info("Running %u stations on %u threads", d.count, num_threads);
+
+    poll_stations(&d);
+    pthread_mutex_lock(&d.mutex);
+    ret = d.stop ? 1 : 0;
+    pthread_mutex_unlock(&d.mutex);
+
+cleanup:
+    pthread_mutex_lock(&d.mutex);
+    d.stop = 1;
+    pthread_cond_broadcast(&d.cond);
+    pthread_mutex_unlock(&d.mutex);
+    for (unsigned int i = 0; i < num_threads; i++)
+        pthread_join(threads[i], NULL);
+
+    for (unsigned int i = 0; i < d.count; i++)
+        free_station(&d.stations[i]);
+    free(d.stations);
+
+    close(d.wake[0]);
+    close(d.wake[1]);
+    pthread_cond_destroy(&d.cond);
+    pthread_mutex_destroy(&d.mutex);
+    return ret;
+}
+
+#endif
@@ -13,6 +13,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stdlib.h>
 #include <string.h>
 
 #include "conv.h"
@@ -48,22 +49,22 @@ static void interleaver_ma1(decode_t *st)
         b = n/2250;
         k = (n + n/750 + 1) % 750;
         p = n % 3;
-        st->bl[n] = bit_map(st->buffer_pl, b, k, p);
+        st->am->bl[n] = bit_map(st->am->buffer_pl, b, k, p);
 
         b = (3*n + 3) % 8;
         k = (n + n/3000 + 3) % 750;
         p = 3 + (n % 3);
-        st->ml[DIVERSITY_DELAY_AM + n] = bit_map(st->buffer_pl, b, k, p);
+        st->am->ml[DIVERSITY_DELAY_AM + n] = bit_map(st->am->buffer_pl, b, k, p);
 
         b = n/2250;
         k = (n + n/750) % 750;
         p = n % 3;
-        st->bu[n] = bit_map(st->buffer_pu, b, k, p);
+        st->am->bu[n] = bit_map(st->am->buffer_pu, b, k, p);
 
         b = (3*n) % 8;
         k = (n + n/3000 + 2) % 750;
         p = 3 + (n % 3);
-        st->mu[DIVERSITY_DELAY_AM + n] = bit_map(st->buffer_pu, b, k, p);
+        st->am->mu[DIVERSITY_DELAY_AM + n] = bit_map(st->am->buffer_pu, b, k, p);
     }
 
     if (st->input->sync.psmi != SERVICE_MODE_MA3)
@@ -73,14 +74,14 @@ static void interleaver_ma1(decode_t *st)
             b = (3*n + n/3000) % 8;
             k = (n + (n/6000)) % 750;
             p = n % 2;
-            st->el[n] = bit_map(st->buffer_t, b, k, p);
+            st->am->el[n] = bit_map(st->am->buffer_t, b, k, p);
         }
         for (int n = 0; n < 24000; n++)
         {
             b = (3*n + n/3000 + 2*(n/12000)) % 8;
             k = (n + (n/6000)) % 750;
             p = n % 4;
-            st->eu[n] = bit_map(st->buffer_s, b, k, p);
+            st->am->eu[n] = bit_map(st->am->buffer_s, b, k, p);
         }
     }
     else
@@ -90,22 +91,22 @@ static void interleaver_ma1(decode_t *st)
             b = (3*n + 3) % 8;
             k = (n + n/3000 + 3) % 750;
             p = n % 3;
-            st->ebl[n] = bit_map(st->buffer_t, b, k, p);
+            st->am->ebl[n] = bit_map(st->am->buffer_t, b, k, p);
 
             b = (3*n + 3) % 8;
             k = (n + n/3000 + 3) % 750;
             p = 3 + (n % 3);
-            st->eml[DIVERSITY_DELAY_AM + n] = bit_map(st->buffer_t, b, k, p);
+            st->am->eml[DIVERSITY_DELAY_AM + n] = bit_map(st->am->buffer_t, b, k, p);
 
             b = (3*n) % 8;
             k = (n + n/3000 + 2) % 750;
             p = n % 3;
-            st->ebu[n] = bit_map(st->buffer_s, b, k, p);
+            st->am->ebu[n] = bit_map(st->am->buffer_s, b, k, p);
 
             b = (3*n) % 8;
             k = (n + n/3000 + 2) % 750;
             p = 3 + (n % 3);
-            st->emu[DIVERSITY_DELAY_AM + n] = bit_map(st->buffer_s, b, k, p);
+            st->am->emu[DIVERSITY_DELAY_AM + n] = bit_map(st->am->buffer_s, b, k, p);
         }
     }
 
@@ -113,40 +114,40 @@ static void interleaver_ma1(decode_t *st)
     {
         for (int j = 0; j < 3; j++)
         {
-            st->p1_am[i*12 + bl_delay[j]] = st->bl[i*3 + j];
-            st->p1_am[i*12 + ml_delay[j]] = st->ml[i*3 + j];
-            st->p1_am[i*12 + bu_delay[j]] = st->bu[i*3 + j];
-            st->p1_am[i*12 + mu_delay[j]] = st->mu[i*3 + j];
+            st->am->p1_am[i*12 + bl_delay[j]] = st->am->bl[i*3 + j];
+            st->am->p1_am[i*12 + ml_delay[j]] = st->am->ml[i*3 + j];
+            st->am->p1_am[i*12 + bu_delay[j]] = st->am->bu[i*3 + j];
+            st->am->p1_am[i*12 + mu_delay[j]] = st->am->mu[i*3 + j];
         }
         if (st->input->sync.psmi != SERVICE_MODE_MA3)
         {
             for (int j = 0; j < 2; j++)
             {
-                st->p3_am[i*6 + el_delay[j]] = st->el[i*2 + j];
+                st->am->p3_am[i*6 + el_delay[j]] = st->am->el[i*2 + j];
             }
             for (int j = 0; j < 4; j++)
             {
-                st->p3_am[i*6 + eu_delay[j]] = st->eu[i*4 + j];
+                st->am->p3_am[i*6 + eu_delay[j]] = st->am->eu[i*4 + j];
             }
         }
         else
         {
             for (int j = 0; j < 3; j++)
             {
-                st->p3_am[i*12 + bl_delay[j]] = st->ebl[i*3 + j];
-                st->p3_am[i*12 + ml_delay[j]] = st->eml[i*3 + j];
-                st->p3_am[i*12 + bu_delay[j]] = st->ebu[i*3 + j];
-                st->p3_am[i*12 + mu_delay[j]] = st->emu[i*3 + j];
+                st->am->p3_am[i*12 + bl_delay[j]] = st->am->ebl[i*3 + j];
+                st->am->p3_am[i*12 + ml_delay[j]] = st->am->eml[i*3 + j];
+                st->am->p3_am[i*12 + bu_delay[j]] = st->am->ebu[i*3 + j];
+                st->am->p3_am[i*12 + mu_delay[j]] = st->am->emu[i*3 + j];
             }
         }
     }
 
-    memmove(st->ml, st->ml + 18000, DIVERSITY_DELAY_AM);
-    memmove(st->mu, st->mu + 18000, DIVERSITY_DELAY_AM);
+    memmove(st->am->ml, st->am->ml + 18000, DIVERSITY_DELAY_AM);
+    memmove(st->am->mu, st->am->mu + 18000, DIVERSITY_DELAY_AM);
     if (st->input->sync.psmi == SERVICE_MODE_MA3)
     {
-        memmove(st->eml, st->eml + 18000, DIVERSITY_DELAY_AM);
-        memmove(st->emu, st->emu + 18000, DIVERSITY_DELAY_AM);
+        memmove(st->am->eml, st->am->eml + 18000, DIVERSITY_DELAY_AM);
+        memmove(st->am->emu, st->am->emu + 18000, DIVERSITY_DELAY_AM);
     }
 
     int offset = 0;
@@ -157,10 +158,10 @@ static void interleaver_ma1(decode_t *st)
         case 1:
         case 4:
         case 7:
-            st->viterbi_p1_am[i] = 0;
+            st->am->viterbi_p1_am[i] = 0;
             break;
         default:
-            st->viterbi_p1_am[i] = st->p1_am[offset++] ? 1 : -1;
+            st->am->viterbi_p1_am[i] = st->am->p1_am[offset++] ? 1 : -1;
         }
     }
 
@@ -174,10 +175,10 @@ static void interleaver_ma1(decode_t *st)
             case 1:
             case 4:
             case 5:
-                st->viterbi_p3_am[i] = 0;
+                st->am->viterbi_p3_am[i] = 0;
                 break;
             default:
-                st->viterbi_p3_am[i] = st->p3_am[offset++] ? 1 : -1;
+                st->am->viterbi_p3_am[i] = st->am->p3_am[offset++] ? 1 : -1;
             }
         }
     }
@@ -190,10 +191,10 @@ static void interleaver_ma1(decode_t *st)
             case 1:
             case 4:
             case 7:
-                st->viterbi_p3_am[i] = 0;
+                st->am->viterbi_p3_am[i] = 0;
                 break;
             default:
-                st->viterbi_p3_am[i] = st->p3_am[offset++] ? 1 : -1;
+                st->am->viterbi_p3_am[i] = st->am->p3_am[offset++] ? 1 : -1;
             }
         }
     }
@@ -268,7 +269,7 @@ static void descramble(uint8_t *buf, unsigned int length)
     }
 }
 
-void decode_process_p1(decode_t *st)
+void decode_deinterleave_p1(decode_t *st)
 {
     const int J = 20, B = 16, C = 36;
     const int8_t v[] = {
@@ -283,15 +284,22 @@ void decode_process_p1(decode_t *st)
         int k = i / (J * B);
         int row = (k * 11) % 32;
         int column = (k * 11 + k / (32*9)) % C;
-        st->viterbi_p1[out++] = st->buffer_pm[(block * 32 + row) * 720 + partition * C + column];
+        st->fm->viterbi_p1[out++] = st->fm->buffer_pm[(block * 32 + row) * 720 + partition * C + column];
         if ((out % 6) == 5) // depuncture, [1, 1, 1, 1, 1, 0]
-            st->viterbi_p1[out++] = 0;
+            st->fm->viterbi_p1[out++] = 0;
     }
+}
 
-    nrsc5_conv_decode_p1(st->viterbi_p1, st->scrambler_p1);
-    nrsc5_report_ber(st->input->radio, (float) bit_errors_p1_fm(st->viterbi_p1, st->scrambler_p1) / P1_FRAME_LEN_ENCODED_FM);
-    descramble(st->scrambler_p1, P1_FRAME_LEN_FM);
-    frame_push(&st->input->frame, st->scrambler_p1, P1_FRAME_LEN_FM, P1_LOGICAL_CHANNEL);
+void decode_process_p1(decode_t *st)
+{
+    stats_begin(&st->input->radio->stats, NRSC5_STAGE_DECODE_P1);
+    decode_deinterleave_p1(st);
+    nrsc5_conv_decode_p1(st->fm->viterbi_p1, st->fm->scrambler_p1);
+    if (nrsc5_event_enabled(st->input->radio, NRSC5_EVENT_BER))
+        nrsc5_report_ber(st->input->radio, (float) bit_errors_p1_fm(st->fm->viterbi_p1, st->fm->scrambler_p1) / P1_FRAME_LEN_ENCODED_FM);
+    descramble(st->fm->scrambler_p1, P1_FRAME_LEN_FM);
+    frame_push(&st->input->frame, st->fm->scrambler_p1, P1_FRAME_LEN_FM, P1_LOGICAL_CHANNEL);
+    stats_end(&st->input->radio->stats);
 }
 
 void decode_process_pids(decode_t *st)
@@ -302,6 +310,8 @@ void decode_process_pids(decode_t *st)
         11, 3, 19, 7, 15, 9, 17, 1, 13, 5
     };
     unsigned int i, out = 0;
+
+    stats_begin(&st->input->radio->stats, NRSC5_STAGE_DECODE_PIDS);
     for (i = 0; i < PIDS_FRAME_LEN_ENCODED_FM; i++)
     {
         int partition = v[i % J];
@@ -309,7 +319,7 @@ void decode_process_pids(decode_t *st)
         int k = ((i / J) % (PIDS_FRAME_LEN_ENCODED_FM / J)) + (P1_FRAME_LEN_ENCODED_FM / (J * B));
         int row = (k * 11) % 32;
         int column = (k * 11 + k / (32*9)) % C;
-        st->viterbi_pids[out++] = st->buffer_pm[(block * 32 + row) * 720 + partition * C + column];
+        st->viterbi_pids[out++] = st->fm->buffer_pm[(block * 32 + row) * 720 + partition * C + column];
         if ((out % 6) == 5) // depuncture, [1, 1, 1, 1, 1, 0]
             st->viterbi_pids[out++] = 0;
     }
@@ -317,15 +327,15 @@ void decode_process_pids(decode_t *st)
     nrsc5_conv_decode_pids(st->viterbi_pids, st->scrambler_pids);
     descramble(st->scrambler_pids, PIDS_FRAME_LEN);
     pids_frame_push(&st->pids, st->scrambler_pids);
+    stats_end(&st->input->radio->stats);
 }
 
-void decode_process_p3_p4(decode_t *st, interleaver_iv_t *interleaver, int8_t *viterbi, uint8_t *scrambler, unsigned int frame_len, logical_channel_t lc)
+void decode_deinterleave_p3_p4(interleaver_iv_t *interleaver, int8_t *viterbi, unsigned int frame_len)
 {
     const unsigned int J = (frame_len == P3_FRAME_LEN_FM) ? 4 : 2;
     const unsigned int B = 32;
     const unsigned int C = 36;
     const unsigned int M = (frame_len == P3_FRAME_LEN_FM) ? 2 : 4;
-    const unsigned int N = (frame_len == P3_FRAME_LEN_FM) ? 147456 : 73728;
     const unsigned int bk_bits = 32 * C;
     const unsigned int bk_adj = 32 * C - 1;
     unsigned int i, out = 0;
@@ -343,6 +353,14 @@ void decode_process_p3_p4(decode_t *st, interleaver_iv_t *interleaver, int8_t *v
         interleaver->internal[interleaver->i] = interleaver->buffer[i];
         interleaver->i++;
     }
+}
+
+void decode_process_p3_p4(decode_t *st, interleaver_iv_t *interleaver, int8_t *viterbi, uint8_t *scrambler, unsigned int frame_len, logical_channel_t lc)
+{
+    const unsigned int N = (frame_len == P3_FRAME_LEN_FM) ? 147456 : 73728;
+
+    stats_begin(&st->input->radio->stats, (lc == P3_LOGICAL_CHANNEL) ? NRSC5_STAGE_DECODE_P3 : NRSC5_STAGE_DECODE_P4);
+    decode_deinterleave_p3_p4(interleaver, viterbi, frame_len);
     if (interleaver->ready)
     {
         nrsc5_conv_decode_p3_p4(viterbi, scrambler, frame_len);
@@ -355,12 +373,14 @@ void decode_process_p3_p4(decode_t *st, interleaver_iv_t *interleaver, int8_t *v
         memset(interleaver->pt, 0, sizeof(unsigned int) * 4);
         interleaver->ready = 1;
     }
+    stats_end(&st->input->radio->stats);
 }
 
 void decode_process_pids_am(decode_t *st)
 {
     uint8_t il[120], iu[120];
 
+    stats_begin(&st->input->radio->stats, NRSC5_STAGE_DECODE_PIDS);
     /* 1012s.pdf section 10.4 */
     for (int n = 0; n < 120; n++) {
         int k, p, row;
@@ -369,11 +389,11 @@ void decode_process_pids_am(decode_t *st)
 
         k = (n + (n/60) + 11) % 30;
         row = (11 * (k + (k/15)) + 3) % 32;
-        il[n] = (st->buffer_pids_am[row*2] >> p) & 1;
+        il[n] = (st->am->buffer_pids_am[row*2] >> p) & 1;
 
         k = (n + (n/60)) % 30;
         row = (11 * (k + (k/15)) + 3) % 32;
-        iu[n] = (st->buffer_pids_am[row*2 + 1] >> p) & 1;
+        iu[n] = (st->am->buffer_pids_am[row*2 + 1] >> p) & 1;
     }
 
     /* 1012s.pdf figure 10-5 */
@@ -387,42 +407,53 @@ void decode_process_pids_am(decode_t *st)
     nrsc5_conv_decode_e3(st->viterbi_pids, st->scrambler_pids, PIDS_FRAME_LEN);
     descramble(st->scrambler_pids, PIDS_FRAME_LEN);
     pids_frame_push(&st->pids, st->scrambler_pids);
+    stats_end(&st->input->radio->stats);
 }
 
 void decode_process_p1_p3_am(decode_t *st)
 {
     unsigned int block = st->idx_pu_pl_s_t / (PARTITION_WIDTH_AM * BLKSZ) - 1;
+    int report_ber = nrsc5_event_enabled(st->input->radio, NRSC5_EVENT_BER);
+    stats_t *stats = &st->input->radio->stats;
 
+    stats_begin(stats, NRSC5_STAGE_DECODE_P1);
     if (block == 0)
         st->am_errors = 0;
 
     if (st->am_diversity_wait == 0)
     {
-        nrsc5_conv_decode_e1(st->viterbi_p1_am + (block * P1_FRAME_LEN_AM * 3), st->scrambler_p1_am, P1_FRAME_LEN_AM);
-        st->am_errors += bit_errors_p1_am(st->viterbi_p1_am + (block * P1_FRAME_LEN_AM * 3), st->scrambler_p1_am);
-        descramble(st->scrambler_p1_am, P1_FRAME_LEN_AM);
-        frame_push(&st->input->frame, st->scrambler_p1_am, P1_FRAME_LEN_AM, P1_LOGICAL_CHANNEL);
+        nrsc5_conv_decode_e1(st->am->viterbi_p1_am + (block * P1_FRAME_LEN_AM * 3), st->am->scrambler_p1_am, P1_FRAME_LEN_AM);
+        if (report_ber)
+            st->am_errors += bit_errors_p1_am(st->am->viterbi_p1_am + (block * P1_FRAME_LEN_AM * 3), st->am->scrambler_p1_am);
+        descramble(st->am->scrambler_p1_am, P1_FRAME_LEN_AM);
+        frame_push(&st->input->frame, st->am->scrambler_p1_am, P1_FRAME_LEN_AM, P1_LOGICAL_CHANNEL);
 
         if (block == 7)
         {
+            stats_begin(stats, NRSC5_STAGE_DECODE_P3);
             if (st->input->sync.psmi != SERVICE_MODE_MA3)
             {
-                nrsc5_conv_decode_e2(st->viterbi_p3_am, st->scrambler_p3_am, P3_FRAME_LEN_MA1);
-                st->am_errors += bit_errors_p3_ma1(st->viterbi_p3_am, st->scrambler_p3_am);
-                descramble(st->scrambler_p3_am, P3_FRAME_LEN_MA1);
-                frame_push(&st->input->frame, st->scrambler_p3_am, P3_FRAME_LEN_MA1, P3_LOGICAL_CHANNEL);
+                nrsc5_conv_decode_e2(st->am->viterbi_p3_am, st->am->scrambler_p3_am, P3_FRAME_LEN_MA1);
+                if (report_ber)
+                    st->am_errors += bit_errors_p3_ma1(st->am->viterbi_p3_am, st->am->scrambler_p3_am);
+                descramble(st->am->scrambler_p3_am, P3_FRAME_LEN_MA1);
+                frame_push(&st->input->frame, st->am->scrambler_p3_am, P3_FRAME_LEN_MA1, P3_LOGICAL_CHANNEL);
         
-                nrsc5_report_ber(st->input->radio, (float) st->am_errors / (8 * P1_FRAME_LEN_ENCODED_AM + P3_FRAME_LEN_ENCODED_MA1));
+                if (report_ber)
+                    nrsc5_report_ber(st->input->radio, (float) st->am_errors / (8 * P1_FRAME_LEN_ENCODED_AM + P3_FRAME_LEN_ENCODED_MA1));
             }
             else
             {
-                nrsc5_conv_decode_e1(st->viterbi_p3_am, st->scrambler_p3_am, P3_FRAME_LEN_MA3);
-                st->am_errors += bit_errors_p3_ma3(st->viterbi_p3_am, st->scrambler_p3_am);
-                descramble(st->scrambler_p3_am, P3_FRAME_LEN_MA3);
-                frame_push(&st->input->frame, st->scrambler_p3_am, P3_FRAME_LEN_MA3, P3_LOGICAL_CHANNEL);
+                nrsc5_conv_decode_e1(st->am->viterbi_p3_am, st->am->scrambler_p3_am, P3_FRAME_LEN_MA3);
+                if (report_ber)
+                    st->am_errors += bit_errors_p3_ma3(st->am->viterbi_p3_am, st->am->scrambler_p3_am);
+                descramble(st->am->scrambler_p3_am, P3_FRAME_LEN_MA3);
+                frame_push(&st->input->frame, st->am->scrambler_p3_am, P3_FRAME_LEN_MA3, P3_LOGICAL_CHANNEL);
         
-                nrsc5_report_ber(st->input->radio, (float) st->am_errors / (8 * P1_FRAME_LEN_ENCODED_AM + P3_FRAME_LEN_ENCODED_MA3));
+                if (report_ber)
+                    nrsc5_report_ber(st->input->radio, (float) st->am_errors / (8 * P1_FRAME_LEN_ENCODED_AM + P3_FRAME_LEN_ENCODED_MA3));
             }        
+            stats_end(stats);
         }
     }
 
@@ -433,6 +464,7 @@ void decode_process_p1_p3_am(decode_t *st)
         if (st->am_diversity_wait > 0)
             st->am_diversity_wait--;
     }
+    stats_end(stats);
 }
 
 void decode_set_block(decode_t *st, unsigned int bc)
@@ -441,18 +473,18 @@ void decode_set_block(decode_t *st, unsigned int bc)
     if (bc == 0)
         st->started_pm = 1;
 
-    st->interleaver_px1.idx = (st->interleaver_px1.length / 2) * (bc % 2);
-    st->interleaver_px2.idx = (st->interleaver_px2.length / 2) * (bc % 2);
+    st->fm->interleaver_px1.idx = (st->fm->interleaver_px1.length / 2) * (bc % 2);
+    st->fm->interleaver_px2.idx = (st->fm->interleaver_px2.length / 2) * (bc % 2);
     if ((bc % 2) == 0)
     {
-        st->interleaver_px1.started = 1;
-        st->interleaver_px2.started = 1;
+        st->fm->interleaver_px1.started = 1;
+        st->fm->interleaver_px2.started = 1;
     }
 }
 
 void decode_set_px1_length(decode_t *st, unsigned int frame_len)
 {
-    st->interleaver_px1.length = frame_len;
+    st->fm->interleaver_px1.length = frame_len;
 }
 
 static void interleaver_iv_reset(interleaver_iv_t *interleaver)
@@ -472,13 +504,51 @@ void decode_reset(decode_t *st)
     st->idx_pu_pl_s_t = 0;
     st->am_errors = 0;
     st->am_diversity_wait = 4;
-    interleaver_iv_reset(&st->interleaver_px1);
-    interleaver_iv_reset(&st->interleaver_px2);
+    if (st->fm)
+    {
+        interleaver_iv_reset(&st->fm->interleaver_px1);
+        interleaver_iv_reset(&st->fm->interleaver_px2);
+    }
     pids_init(&st->pids, st->input);
 }
 
-void decode_init(decode_t *st, struct input_t *input)
+int decode_set_mode(decode_t *st, int mode)
 {
-    st->input = input;
+    // only the state of the current mode is kept around
+    if (mode == NRSC5_MODE_FM)
+    {
+        if (!st->fm && !(st->fm = calloc(1, sizeof(*st->fm))))
+            return 1;
+        free(st->am);
+        st->am = NULL;
+    }
+    else
+    {
+        if (!st->am && !(st->am = calloc(1, sizeof(*st->am))))
+            return 1;
+        free(st->fm);
+        st->fm = NULL;
+    }
+
     decode_reset(st);
+    return 0;
+}
+
+int decode_init(decode_t *st, struct input_t *input)
+{
+    st->input = input;
+    st->fm = NULL;
+    st->am = NULL;
+    return decode_set_mode(st, NRSC5_MODE_FM);
+}
+
+void decode_free(decode_t *st)
+{
+    free(st->fm);
+    free(st->am);
+}
+
+size_t decode_memory_usage(const decode_t *st)
+{
+    return (st->fm ? sizeof(*st->fm) : 0) + (st->am ? sizeof(*st->am) : 0);
 }
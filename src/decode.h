@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 #include "defines.h"
 #include "pids.h"
@@ -18,21 +19,28 @@ typedef struct
   int ready;
 } interleaver_iv_t;
 
+// state used only in FM mode
 typedef struct
 {
-    struct input_t *input;
     int8_t buffer_pm[720 * BLKSZ * 16];
-    unsigned int idx_pm;
-    int started_pm;
+    int8_t viterbi_p1[P1_FRAME_LEN_FM * 3];
+    uint8_t scrambler_p1[P1_FRAME_LEN_FM];
+    interleaver_iv_t interleaver_px1;
+    interleaver_iv_t interleaver_px2;
+    int8_t viterbi_p3[P3_FRAME_LEN_FM * 3];
+    int8_t viterbi_p4[P3_FRAME_LEN_FM * 3];
+    uint8_t scrambler_p3[P3_FRAME_LEN_FM];
+    uint8_t scrambler_p4[P3_FRAME_LEN_FM];
+} decode_fm_t;
+
+// state used only in AM mode
+typedef struct
+{
     uint8_t buffer_pids_am[2 * BLKSZ];
-    unsigned int idx_pids_am;
     uint8_t buffer_pu[PARTITION_WIDTH_AM * BLKSZ * 8];
     uint8_t buffer_pl[PARTITION_WIDTH_AM * BLKSZ * 8];
     uint8_t buffer_s[PARTITION_WIDTH_AM * BLKSZ * 8];
     uint8_t buffer_t[PARTITION_WIDTH_AM * BLKSZ * 8];
-    unsigned int idx_pu_pl_s_t;
-    unsigned int am_errors;
-    unsigned int am_diversity_wait;
 
     uint8_t bl[18000];
     uint8_t bu[18000];
@@ -45,27 +53,35 @@ typedef struct
     uint8_t eml[18000 + DIVERSITY_DELAY_AM];
     uint8_t emu[18000 + DIVERSITY_DELAY_AM];
 
-    int8_t viterbi_p1[P1_FRAME_LEN_FM * 3];
-    uint8_t scrambler_p1[P1_FRAME_LEN_FM];
-    int8_t viterbi_pids[PIDS_FRAME_LEN * 3];
-    uint8_t scrambler_pids[PIDS_FRAME_LEN];
-    interleaver_iv_t interleaver_px1;
-    interleaver_iv_t interleaver_px2;
-    int8_t viterbi_p3[P3_FRAME_LEN_FM * 3];
-    int8_t viterbi_p4[P3_FRAME_LEN_FM * 3];
-    uint8_t scrambler_p3[P3_FRAME_LEN_FM];
-    uint8_t scrambler_p4[P3_FRAME_LEN_FM];
-
     uint8_t p1_am[8 * P1_FRAME_LEN_ENCODED_AM];
     int8_t viterbi_p1_am[8 * P1_FRAME_LEN_AM * 3];
     uint8_t scrambler_p1_am[P1_FRAME_LEN_AM];
     uint8_t p3_am[P3_FRAME_LEN_ENCODED_MA3];
     int8_t viterbi_p3_am[P3_FRAME_LEN_MA3 * 3];
     uint8_t scrambler_p3_am[P3_FRAME_LEN_MA3];
+} decode_am_t;
+
+typedef struct
+{
+    struct input_t *input;
+    decode_fm_t *fm;
+    decode_am_t *am;
+
+    unsigned int idx_pm;
+    int started_pm;
+    unsigned int idx_pids_am;
+    unsigned int idx_pu_pl_s_t;
+    unsigned int am_errors;
+    unsigned int am_diversity_wait;
+
+    int8_t viterbi_pids[PIDS_FRAME_LEN * 3];
+    uint8_t scrambler_pids[PIDS_FRAME_LEN];
 
     pids_t pids;
 } decode_t;
 
+void decode_deinterleave_p1(decode_t *st);
+void decode_deinterleave_p3_p4(interleaver_iv_t *interleaver, int8_t *viterbi, unsigned int frame_len);
 void decode_process_p1(decode_t *st);
 void decode_process_pids(decode_t *st);
 void decode_process_p3_p4(decode_t *st, interleaver_iv_t *interleaver, int8_t *viterbi, uint8_t *scrambler, unsigned int frame_len, logical_channel_t lc);
@@ -75,46 +91,72 @@ static inline unsigned int decode_get_block(decode_t *st)
 {
     return st->idx_pm / (720 * BLKSZ);
 }
-static inline void decode_push_pm(decode_t *st, int8_t sbit)
+
+/*
+ * The demodulator writes the soft bits (FM) or symbols (AM) of a whole block
+ * straight into the decoder's buffers through a span, then commits them.
+ * A commit must not cross a processing boundary, which always falls at the
+ * end of a block.
+ */
+static inline int8_t *decode_pm_span(decode_t *st)
 {
-    st->buffer_pm[st->idx_pm++] = sbit;
+    return &st->fm->buffer_pm[st->idx_pm];
+}
+static inline void decode_commit_pm(decode_t *st, unsigned int count)
+{
+    st->idx_pm += count;
     if (st->idx_pm % (720 * BLKSZ) == 0)
         decode_process_pids(st);
     if (st->idx_pm == 720 * BLKSZ * 16)
         if (st->started_pm)
             decode_process_p1(st);
 }
-static inline void decode_push_px1_px2(decode_t *st, interleaver_iv_t *interleaver, int8_t *viterbi, uint8_t *scrambler, int8_t sbit)
+static inline void decode_commit_px1_px2(decode_t *st, interleaver_iv_t *interleaver, int8_t *viterbi, uint8_t *scrambler, unsigned int count)
 {
-    interleaver->buffer[interleaver->idx++] = sbit;
+    interleaver->idx += count;
     if (interleaver->idx % interleaver->length == 0)
         if (interleaver->started)
-            decode_process_p3_p4(st, interleaver, viterbi, scrambler, interleaver->length / 2, (interleaver == &st->interleaver_px1) ? P3_LOGICAL_CHANNEL : P4_LOGICAL_CHANNEL);
+            decode_process_p3_p4(st, interleaver, viterbi, scrambler, interleaver->length / 2, (interleaver == &st->fm->interleaver_px1) ? P3_LOGICAL_CHANNEL : P4_LOGICAL_CHANNEL);
+}
+static inline int8_t *decode_px1_span(decode_t *st)
+{
+    return &st->fm->interleaver_px1.buffer[st->fm->interleaver_px1.idx];
 }
-static inline void decode_push_px1(decode_t *st, int8_t sbit)
+static inline void decode_commit_px1(decode_t *st, unsigned int count)
 {
-    decode_push_px1_px2(st, &st->interleaver_px1, st->viterbi_p3, st->scrambler_p3, sbit);
+    decode_commit_px1_px2(st, &st->fm->interleaver_px1, st->fm->viterbi_p3, st->fm->scrambler_p3, count);
 }
-static inline void decode_push_px2(decode_t *st, int8_t sbit)
+static inline int8_t *decode_px2_span(decode_t *st)
 {
-    decode_push_px1_px2(st, &st->interleaver_px2, st->viterbi_p4, st->scrambler_p4, sbit);
+    return &st->fm->interleaver_px2.buffer[st->fm->interleaver_px2.idx];
 }
-static inline void decode_push_pids(decode_t *st, uint8_t sym)
+static inline void decode_commit_px2(decode_t *st, unsigned int count)
 {
-    st->buffer_pids_am[st->idx_pids_am++] = sym;
+    decode_commit_px1_px2(st, &st->fm->interleaver_px2, st->fm->viterbi_p4, st->fm->scrambler_p4, count);
+}
+static inline uint8_t *decode_pids_span(decode_t *st)
+{
+    return &st->am->buffer_pids_am[st->idx_pids_am];
+}
+static inline void decode_commit_pids(decode_t *st, unsigned int count)
+{
+    st->idx_pids_am += count;
     if (st->idx_pids_am == 2 * BLKSZ)
     {
         decode_process_pids_am(st);
         st->idx_pids_am = 0;
     }
 }
-static inline void decode_push_pl_pu_s_t(decode_t *st, uint8_t sym_pl, uint8_t sym_pu, uint8_t sym_s, uint8_t sym_t)
+static inline void decode_pl_pu_s_t_spans(decode_t *st, uint8_t **pl, uint8_t **pu, uint8_t **s, uint8_t **t)
+{
+    *pl = &st->am->buffer_pl[st->idx_pu_pl_s_t];
+    *pu = &st->am->buffer_pu[st->idx_pu_pl_s_t];
+    *s = &st->am->buffer_s[st->idx_pu_pl_s_t];
+    *t = &st->am->buffer_t[st->idx_pu_pl_s_t];
+}
+static inline void decode_commit_pl_pu_s_t(decode_t *st, unsigned int count)
 {
-    st->buffer_pl[st->idx_pu_pl_s_t] = sym_pl;
-    st->buffer_pu[st->idx_pu_pl_s_t] = sym_pu;
-    st->buffer_s[st->idx_pu_pl_s_t] = sym_s;
-    st->buffer_t[st->idx_pu_pl_s_t] = sym_t;
-    st->idx_pu_pl_s_t++;
+    st->idx_pu_pl_s_t += count;
     if (st->idx_pu_pl_s_t % (PARTITION_WIDTH_AM * BLKSZ) == 0)
     {
         decode_process_p1_p3_am(st);
@@ -126,4 +168,7 @@ static inline void decode_push_pl_pu_s_t(decode_t *st, uint8_t sym_pl, uint8_t s
 void decode_set_block(decode_t *st, unsigned int bc);
 void decode_set_px1_length(decode_t *st, unsigned int frame_len);
 void decode_reset(decode_t *st);
-void decode_init(decode_t *st, struct input_t *input);
+int decode_set_mode(decode_t *st, int mode);
+int decode_init(decode_t *st, struct input_t *input);
+void decode_free(decode_t *st);
+size_t decode_memory_usage(const decode_t *st);
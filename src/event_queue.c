@@ -0,0 +1,460 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "event_queue.h"
+#include "private.h"
+
+#define WAIT_TIMEOUT_NS 10000000
+
+typedef struct
+{
+    uint8_t *base;
+    size_t len;
+} arena_t;
+
+/*
+ * Events are copied in two passes: the first with a NULL base only measures
+ * the space needed, the second copies into the slot's buffer.
+ */
+static void *arena_copy(arena_t *a, const void *src, size_t n)
+{
+    void *p = NULL;
+
+    if (src == NULL)
+        return NULL;
+
+    a->len = (a->len + 7) & ~(size_t)7;
+    if (a->base)
+    {
+        p = a->base + a->len;
+        memcpy(p, src, n);
+    }
+    a->len += n;
+    return p;
+}
+
+static char *arena_str(arena_t *a, const char *s)
+{
+    return s ? arena_copy(a, s, strlen(s) + 1) : NULL;
+}
+
+static void copy_service_ref(arena_t *a, nrsc5_sig_service_t **service, nrsc5_sig_component_t **component)
+{
+    nrsc5_sig_service_t *s = arena_copy(a, *service, sizeof(nrsc5_sig_service_t));
+    const char *name = *service ? arena_str(a, (*service)->name) : NULL;
+    nrsc5_sig_component_t *c = arena_copy(a, *component, sizeof(nrsc5_sig_component_t));
+
+    // only the referenced service and component are kept
+    if (c)
+        c->next = NULL;
+    if (s)
+    {
+        s->next = NULL;
+        s->name = name;
+        s->components = c;
+        s->audio_component = (c && c->type == NRSC5_SIG_COMPONENT_AUDIO) ? c : NULL;
+    }
+    *service = s;
+    *component = c;
+}
+
+static nrsc5_sig_service_t *copy_sig(arena_t *a, const nrsc5_sig_service_t *services)
+{
+    nrsc5_sig_service_t *head = NULL, **link = &head;
+
+    for (const nrsc5_sig_service_t *s = services; s != NULL; s = s->next)
+    {
+        nrsc5_sig_service_t *copy = arena_copy(a, s, sizeof(*s));
+        const char *name = arena_str(a, s->name);
+        nrsc5_sig_component_t *components = NULL, **clink = &components, *audio = NULL;
+
+        for (const nrsc5_sig_component_t *c = s->components; c != NULL; c = c->next)
+        {
+            nrsc5_sig_component_t *ccopy = arena_copy(a, c, sizeof(*c));
+
+            if (!ccopy)
+                continue;
+            ccopy->next = NULL;
+            *clink = ccopy;
+            clink = &ccopy->next;
+            if (c == s->audio_component)
+                audio = ccopy;
+        }
+
+        if (!copy)
+            continue;
+        copy->next = NULL;
+        copy->name = name;
+        copy->components = components;
+        copy->audio_component = audio;
+        *link = copy;
+        link = &copy->next;
+    }
+    return head;
+}
+
+static nrsc5_id3_comment_t *copy_comments(arena_t *a, const nrsc5_id3_comment_t *comments)
+{
+    nrsc5_id3_comment_t *head = NULL, **link = &head;
+
+    for (const nrsc5_id3_comment_t *c = comments; c != NULL; c = c->next)
+    {
+        nrsc5_id3_comment_t *copy = arena_copy(a, c, sizeof(*c));
+        char *lang = arena_str(a, c->lang);
+        char *short_content_desc = arena_str(a, c->short_content_desc);
+        char *full_text = arena_str(a, c->full_text);
+
+        if (!copy)
+            continue;
+        copy->next = NULL;
+        copy->lang = lang;
+        copy->short_content_desc = short_content_desc;
+        copy->full_text = full_text;
+        *link = copy;
+        link = &copy->next;
+    }
+    return head;
+}
+
+static nrsc5_sis_asd_t *copy_asd(arena_t *a, const nrsc5_sis_asd_t *list)
+{
+    nrsc5_sis_asd_t *head = NULL, **link = &head;
+
+    for (const nrsc5_sis_asd_t *d = list; d != NULL; d = d->next)
+    {
+        nrsc5_sis_asd_t *copy = arena_copy(a, d, sizeof(*d));
+
+        if (!copy)
+            continue;
+        copy->next = NULL;
+        *link = copy;
+        link = &copy->next;
+    }
+    return head;
+}
+
+static nrsc5_sis_dsd_t *copy_dsd(arena_t *a, const nrsc5_sis_dsd_t *list)
+{
+    nrsc5_sis_dsd_t *head = NULL, **link = &head;
+
+    for (const nrsc5_sis_dsd_t *d = list; d != NULL; d = d->next)
+    {
+        nrsc5_sis_dsd_t *copy = arena_copy(a, d, sizeof(*d));
+
+        if (!copy)
+            continue;
+        copy->next = NULL;
+        *link = copy;
+        link = &copy->next;
+    }
+    return head;
+}
+
+static void serialize(arena_t *a, nrsc5_event_t *dst, const nrsc5_event_t *src)
+{
+    *dst = *src;
+
+    switch (src->event)
+    {
+    case NRSC5_EVENT_IQ:
+        dst->iq.data = arena_copy(a, src->iq.data, src->iq.count);
+        break;
+    case NRSC5_EVENT_HDC:
+        dst->hdc.data = arena_copy(a, src->hdc.data, src->hdc.count);
+        break;
+    case NRSC5_EVENT_AUDIO:
+        dst->audio.data = arena_copy(a, src->audio.data, src->audio.count * sizeof(int16_t));
+        break;
+    case NRSC5_EVENT_ID3:
+        dst->id3.title = arena_str(a, src->id3.title);
+        dst->id3.artist = arena_str(a, src->id3.artist);
+        dst->id3.album = arena_str(a, src->id3.album);
+        dst->id3.genre = arena_str(a, src->id3.genre);
+        dst->id3.ufid.owner = arena_str(a, src->id3.ufid.owner);
+        dst->id3.ufid.id = arena_str(a, src->id3.ufid.id);
+        dst->id3.comments = copy_comments(a, src->id3.comments);
+        break;
+    case NRSC5_EVENT_SIG:
+        dst->sig.services = copy_sig(a, src->sig.services);
+        break;
+    case NRSC5_EVENT_STREAM:
+        dst->stream.data = arena_copy(a, src->stream.data, src->stream.size);
+        copy_service_ref(a, &dst->stream.service, &dst->stream.component);
+        break;
+    case NRSC5_EVENT_PACKET:
+        dst->packet.data = arena_copy(a, src->packet.data, src->packet.size);
+        copy_service_ref(a, &dst->packet.service, &dst->packet.component);
+        break;
+    case NRSC5_EVENT_LOT:
+    case NRSC5_EVENT_LOT_HEADER:
+        dst->lot.name = arena_str(a, src->lot.name);
+        dst->lot.data = arena_copy(a, src->lot.data, src->lot.size);
+        dst->lot.expiry_utc = arena_copy(a, src->lot.expiry_utc, sizeof(struct tm));
+        copy_service_ref(a, &dst->lot.service, &dst->lot.component);
+        break;
+    case NRSC5_EVENT_LOT_FRAGMENT:
+        dst->lot_fragment.data = arena_copy(a, src->lot_fragment.data, src->lot_fragment.size);
+        copy_service_ref(a, &dst->lot_fragment.service, &dst->lot_fragment.component);
+        break;
+    case NRSC5_EVENT_SIS:
+        dst->sis.country_code = arena_str(a, src->sis.country_code);
+        dst->sis.name = arena_str(a, src->sis.name);
+        dst->sis.slogan = arena_str(a, src->sis.slogan);
+        dst->sis.message = arena_str(a, src->sis.message);
+        dst->sis.alert = arena_str(a, src->sis.alert);
+        dst->sis.audio_services = copy_asd(a, src->sis.audio_services);
+        dst->sis.data_services = copy_dsd(a, src->sis.data_services);
+        dst->sis.alert_cnt = arena_copy(a, src->sis.alert_cnt, src->sis.alert_cnt_length);
+        dst->sis.alert_locations = arena_copy(a, src->sis.alert_locations, src->sis.alert_num_locations * sizeof(int));
+        break;
+    case NRSC5_EVENT_STATION_ID:
+        dst->station_id.country_code = arena_str(a, src->station_id.country_code);
+        break;
+    case NRSC5_EVENT_STATION_NAME:
+        dst->station_name.name = arena_str(a, src->station_name.name);
+        break;
+    case NRSC5_EVENT_STATION_SLOGAN:
+        dst->station_slogan.slogan = arena_str(a, src->station_slogan.slogan);
+        break;
+    case NRSC5_EVENT_STATION_MESSAGE:
+        dst->station_message.message = arena_str(a, src->station_message.message);
+        break;
+    case NRSC5_EVENT_EMERGENCY_ALERT:
+        dst->emergency_alert.message = arena_str(a, src->emergency_alert.message);
+        dst->emergency_alert.control_data = arena_copy(a, src->emergency_alert.control_data,
+                                                       src->emergency_alert.control_data_length);
+        dst->emergency_alert.locations = arena_copy(a, src->emergency_alert.locations,
+                                                    src->emergency_alert.num_locations * sizeof(int));
+        break;
+    case NRSC5_EVENT_STATS:
+        dst->stats.stages = arena_copy(a, src->stats.stages, src->stats.num_stages * sizeof(nrsc5_stage_stats_t));
+        break;
+    case NRSC5_EVENT_HERE_IMAGE:
+        dst->here_image.time_utc = arena_copy(a, src->here_image.time_utc, sizeof(struct tm));
+        dst->here_image.name = arena_str(a, src->here_image.name);
+        dst->here_image.data = arena_copy(a, src->here_image.data, src->here_image.size);
+        break;
+    default:
+        // remaining events have no pointer members
+        break;
+    }
+}
+
+nrsc5_event_t *event_clone(const nrsc5_event_t *evt, size_t *size)
+{
+    arena_t arena = { NULL, 0 };
+    nrsc5_event_t scratch;
+    size_t header = (sizeof(nrsc5_event_t) + 7) & ~(size_t)7;
+    uint8_t *data;
+
+    serialize(&arena, &scratch, evt);
+    data = malloc(header + arena.len);
+    if (!data)
+        return NULL;
+
+    arena.base = data + header;
+    arena.len = 0;
+    serialize(&arena, (nrsc5_event_t *)data, evt);
+    *size = header + arena.len;
+    return (nrsc5_event_t *)data;
+}
+
+static void deadline(struct timespec *ts)
+{
+    clock_gettime(CLOCK_REALTIME, ts);
+    ts->tv_nsec += WAIT_TIMEOUT_NS;
+    if (ts->tv_nsec >= 1000000000)
+    {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000;
+    }
+}
+
+static void wake(event_queue_t *st, atomic_int *waiting)
+{
+    if (atomic_load(waiting))
+    {
+        pthread_mutex_lock(&st->mutex);
+        pthread_cond_broadcast(&st->cond);
+        pthread_mutex_unlock(&st->mutex);
+    }
+}
+
+static void *dispatcher_thread(void *arg)
+{
+    event_queue_t *st = arg;
+
+    while (!atomic_load(&st->stop))
+    {
+        if (event_queue_poll(st, st->size) > 0)
+            continue;
+
+        struct timespec ts;
+        deadline(&ts);
+        pthread_mutex_lock(&st->mutex);
+        atomic_store(&st->consumer_waiting, 1);
+        if (atomic_load(&st->head) == atomic_load(&st->tail) && !atomic_load(&st->stop))
+            pthread_cond_timedwait(&st->cond, &st->mutex, &ts);
+        atomic_store(&st->consumer_waiting, 0);
+        pthread_mutex_unlock(&st->mutex);
+    }
+    return NULL;
+}
+
+int event_queue_init(event_queue_t *st, nrsc5_t *radio, unsigned int size, int policy, int dispatcher)
+{
+    unsigned int rounded = 1;
+
+    memset(st, 0, sizeof(*st));
+    if (size > EVENT_QUEUE_MAX_SIZE)
+        return 1;
+
+    while (rounded < size)
+        rounded <<= 1;
+
+    st->slots = calloc(rounded, sizeof(event_slot_t));
+    if (!st->slots)
+        return 1;
+    st->radio = radio;
+    st->size = rounded;
+    st->policy = policy;
+    pthread_mutex_init(&st->mutex, NULL);
+    pthread_cond_init(&st->cond, NULL);
+
+    if (dispatcher)
+    {
+        if (pthread_create(&st->dispatcher, NULL, dispatcher_thread, st) != 0)
+        {
+            event_queue_free(st);
+            return 1;
+        }
+        st->dispatcher_running = 1;
+    }
+    return 0;
+}
+
+void event_queue_free(event_queue_t *st)
+{
+    if (!st->slots)
+        return;
+
+    if (st->dispatcher_running)
+    {
+        pthread_mutex_lock(&st->mutex);
+        atomic_store(&st->stop, 1);
+        pthread_cond_broadcast(&st->cond);
+        pthread_mutex_unlock(&st->mutex);
+        pthread_join(st->dispatcher, NULL);
+        st->dispatcher_running = 0;
+    }
+
+    for (unsigned int i = 0; i < st->size; i++)
+        free(st->slots[i].data);
+    free(st->slots);
+    st->slots = NULL;
+    pthread_cond_destroy(&st->cond);
+    pthread_mutex_destroy(&st->mutex);
+}
+
+size_t event_queue_memory_usage(const event_queue_t *st)
+{
+    size_t bytes;
+
+    if (!st->slots)
+        return 0;
+
+    bytes = st->size * sizeof(event_slot_t);
+    for (unsigned int i = 0; i < st->size; i++)
+        bytes += st->slots[i].capacity;
+    return bytes;
+}
+
+void event_queue_push(event_queue_t *st, const nrsc5_event_t *evt)
+{
+    unsigned int head = atomic_load_explicit(&st->head, memory_order_relaxed);
+    event_slot_t *slot;
+    arena_t arena = { NULL, 0 };
+    nrsc5_event_t scratch;
+
+    while (head - atomic_load_explicit(&st->tail, memory_order_acquire) == st->size)
+    {
+        if (st->policy != NRSC5_EVENT_QUEUE_BLOCK || atomic_load(&st->stop))
+        {
+            if (evt->event < MAX_EVENT_TYPES)
+                atomic_fetch_add_explicit(&st->drops[evt->event], 1, memory_order_relaxed);
+            return;
+        }
+
+        struct timespec ts;
+        deadline(&ts);
+        pthread_mutex_lock(&st->mutex);
+        atomic_store(&st->producer_waiting, 1);
+        if (head - atomic_load(&st->tail) == st->size)
+            pthread_cond_timedwait(&st->cond, &st->mutex, &ts);
+        atomic_store(&st->producer_waiting, 0);
+        pthread_mutex_unlock(&st->mutex);
+    }
+
+    slot = &st->slots[head & (st->size - 1)];
+
+    serialize(&arena, &scratch, evt);
+    if (arena.len > slot->capacity)
+    {
+        uint8_t *data = realloc(slot->data, arena.len);
+        if (!data)
+        {
+            log_error("Failed to allocate event queue slot");
+            if (evt->event < MAX_EVENT_TYPES)
+                atomic_fetch_add_explicit(&st->drops[evt->event], 1, memory_order_relaxed);
+            return;
+        }
+        slot->data = data;
+        slot->capacity = arena.len;
+    }
+    arena.base = slot->data;
+    arena.len = 0;
+    serialize(&arena, &slot->evt, evt);
+
+    atomic_store_explicit(&st->head, head + 1, memory_order_release);
+    wake(st, &st->consumer_waiting);
+}
+
+unsigned int event_queue_depth(event_queue_t *st)
+{
+    return atomic_load_explicit(&st->head, memory_order_relaxed) - atomic_load_explicit(&st->tail, memory_order_relaxed);
+}
+
+unsigned int event_queue_poll(event_queue_t *st, unsigned int max_events)
+{
+    unsigned int tail = atomic_load_explicit(&st->tail, memory_order_relaxed);
+    unsigned int count = 0;
+
+    while (count < max_events && tail != atomic_load_explicit(&st->head, memory_order_acquire))
+    {
+        event_slot_t *slot = &st->slots[tail & (st->size - 1)];
+
+        if (st->radio->callback)
+            st->radio->callback(&slot->evt, st->radio->callback_opaque);
+
+        tail++;
+        atomic_store_explicit(&st->tail, tail, memory_order_release);
+        count++;
+        wake(st, &st->producer_waiting);
+    }
+    return count;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include <nrsc5.h>
+
+#define MAX_EVENT_TYPES 32
+// Largest queue, in events.
+#define EVENT_QUEUE_MAX_SIZE (1u << 20)
+
+typedef struct
+{
+    nrsc5_event_t evt;
+    uint8_t *data;
+    size_t capacity;
+} event_slot_t;
+
+/*
+ * Bounded single-producer, single-consumer queue of deep-copied events.
+ * The DSP thread pushes; events are delivered to the callback either by
+ * nrsc5_poll_events() or by a dispatcher thread.
+ */
+typedef struct
+{
+    nrsc5_t *radio;
+    event_slot_t *slots;
+    unsigned int size;
+    int policy;
+    atomic_uint head;
+    atomic_uint tail;
+    atomic_uint drops[MAX_EVENT_TYPES];
+
+    atomic_int producer_waiting;
+    atomic_int consumer_waiting;
+    atomic_int stop;
+    int dispatcher_running;
+    pthread_t dispatcher;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} event_queue_t;
+
+int event_queue_init(event_queue_t *st, nrsc5_t *radio, unsigned int size, int policy, int dispatcher);
+void event_queue_free(event_queue_t *st);
+void event_queue_push(event_queue_t *st, const nrsc5_event_t *evt);
+unsigned int event_queue_poll(event_queue_t *st, unsigned int max_events);
+size_t event_queue_memory_usage(const event_queue_t *st);
+
+// Deep copy of an event in a single allocation of *size bytes, released with free().
+nrsc5_event_t *event_clone(const nrsc5_event_t *evt, size_t *size);
+unsigned int event_queue_depth(event_queue_t *st);
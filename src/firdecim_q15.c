@@ -2,6 +2,8 @@
 
 #include <assert.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 #ifdef HAVE_NEON
 #include <arm_neon.h>
@@ -26,10 +28,17 @@ firdecim_q15 firdecim_q15_create(const float * taps, unsigned int ntaps)
 {
     firdecim_q15 q;
 
-    q = malloc(sizeof(*q));
+    q = calloc(1, sizeof(*q));
+    if (!q)
+        return NULL;
     q->ntaps = (ntaps == 32) ? 32 : 15;
     q->taps = malloc(sizeof(int16_t) * ntaps * 2);
     q->window = calloc(WINDOW_SIZE, sizeof(cint16_t));
+    if (!q->taps || !q->window)
+    {
+        firdecim_q15_free(q);
+        return NULL;
+    }
     firdecim_q15_reset(q);
 
     // reverse order so we can push into the window
@@ -45,6 +54,9 @@ firdecim_q15 firdecim_q15_create(const float * taps, unsigned int ntaps)
 
 void firdecim_q15_free(firdecim_q15 q)
 {
+    if (!q)
+        return;
+
     free(q->taps);
     free(q->window);
     free(q);
@@ -109,57 +121,162 @@ static cint16_t dotprod_32(cint16_t *a, int16_t *b)
 }
 #endif
 
-#ifdef HAVE_NEON
-static cint16_t dotprod_halfband_4(cint16_t *a, int16_t *b)
+void fir_q15_execute(firdecim_q15 q, const cint16_t *x, cint16_t *y)
 {
-    cint16_t pairs[4];
-    int i;
+    push(q, x[0]);
+    *y = dotprod_32(&q->window[q->idx - q->ntaps], q->taps);
+}
 
-    for (i = 0; i < 7; i += 2)
-    {
-        pairs[i/2].r = a[i].r + a[14-i].r;
-        pairs[i/2].i = a[i].i + a[14-i].i;
-    }
+/*
+ * Halfband decimation by two, one block at a time. Every second tap of a
+ * halfband filter is zero, so the filter splits into two polyphase
+ * branches: the even samples go through the four symmetric taps and the
+ * odd samples through the unit centre tap. Each branch is kept contiguous,
+ * which lets several outputs be computed at once.
+ *
+ * The arithmetic matches a scalar 15-tap filter: each symmetric pair is
+ * multiplied in 32 bits and shifted right by 15, and the sum wraps to 16
+ * bits.
+ */
 
-    int16x8_t prod = vqdmulhq_s16(vld1q_s16((int16_t *)pairs), vld1q_s16(b));
-    int16x4x2_t prod2 = vuzp_s16(vget_high_s16(prod), vget_low_s16(prod));
-    int16x4_t sum = vpadd_s16(prod2.val[0], prod2.val[1]);
-    sum = vpadd_s16(sum, sum);
+#define HALFBAND_HISTORY 7
+#define HALFBAND_BLOCK 1024
 
-    cint16_t result[2];
-    vst1_s16((int16_t*)&result, sum);
+struct halfband_q15 {
+    int16_t taps[4];          // outermost pair first
+    unsigned int phase;       // 1 if the next input sample is an odd one
+    cint16_t even[HALFBAND_HISTORY + HALFBAND_BLOCK];
+    cint16_t odd[HALFBAND_HISTORY + HALFBAND_BLOCK];
+};
 
-    result[0].r += a[7].r;
-    result[0].i += a[7].i;
-    return result[0];
+halfband_q15 halfband_q15_create(const float * taps, unsigned int ntaps)
+{
+    halfband_q15 q;
+
+    assert(ntaps == 4);
+    q = malloc(sizeof(*q));
+    if (!q)
+        return NULL;
+    for (unsigned int i = 0; i < 4; i++)
+        q->taps[i] = taps[3 - i] * 32767.0f;
+    halfband_q15_reset(q);
+
+    return q;
 }
-#else
-static cint16_t dotprod_halfband_4(cint16_t *a, int16_t *b)
+
+void halfband_q15_free(halfband_q15 q)
 {
-    cint16_t sum = { 0 };
-    int i;
+    free(q);
+}
+
+void halfband_q15_reset(halfband_q15 q)
+{
+    q->phase = 0;
+    memset(q->even, 0, sizeof(cint16_t) * HALFBAND_HISTORY);
+    memset(q->odd, 0, sizeof(cint16_t) * HALFBAND_HISTORY);
+}
 
-    for (i = 0; i < 7; i += 2)
+// Output from even samples e[0..7] and odd sample o[3].
+static cint16_t halfband_output(const cint16_t *e, const cint16_t *o, const int16_t *taps)
+{
+    int r = o[3].r, i = o[3].i;
+
+    for (int k = 0; k < 4; k++)
     {
-        sum.r += ((a[i].r + a[14-i].r) * b[i]) >> 15;
-        sum.i += ((a[i].i + a[14-i].i) * b[i]) >> 15;
+        r += ((e[k].r + e[7-k].r) * taps[k]) >> 15;
+        i += ((e[k].i + e[7-k].i) * taps[k]) >> 15;
     }
-    sum.r += a[7].r;
-    sum.i += a[7].i;
 
-    return sum;
+    return (cint16_t) { r, i };
 }
-#endif
 
-void fir_q15_execute(firdecim_q15 q, const cint16_t *x, cint16_t *y)
+static void halfband_block(const cint16_t *e, const cint16_t *o, const int16_t *taps, unsigned int n, cint16_t *y)
 {
-    push(q, x[0]);
-    *y = dotprod_32(&q->window[q->idx - q->ntaps], q->taps);
+    unsigned int m = 0;
+
+#if defined(HAVE_SSE2)
+    for (; m + 4 <= n; m += 4)
+    {
+        __m128i center = _mm_loadu_si128((const __m128i *)&o[m + 3]);
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(center, center), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(center, center), 16);
+
+        for (int k = 0; k < 4; k++)
+        {
+            __m128i a = _mm_loadu_si128((const __m128i *)&e[m + k]);
+            __m128i b = _mm_loadu_si128((const __m128i *)&e[m + 7 - k]);
+            __m128i tap = _mm_set1_epi16(taps[k]);
+
+            // (a + b) * tap as a*tap + b*tap, exact in 32 bits
+            lo = _mm_add_epi32(lo, _mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(a, b), tap), 15));
+            hi = _mm_add_epi32(hi, _mm_srai_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(a, b), tap), 15));
+        }
+
+        // wrap to 16 bits, then pack without saturating
+        lo = _mm_srai_epi32(_mm_slli_epi32(lo, 16), 16);
+        hi = _mm_srai_epi32(_mm_slli_epi32(hi, 16), 16);
+        _mm_storeu_si128((__m128i *)&y[m], _mm_packs_epi32(lo, hi));
+    }
+#elif defined(HAVE_NEON)
+    for (; m + 4 <= n; m += 4)
+    {
+        int16x8_t center = vld1q_s16((const int16_t *)&o[m + 3]);
+        int32x4_t lo = vmovl_s16(vget_low_s16(center));
+        int32x4_t hi = vmovl_s16(vget_high_s16(center));
+
+        for (int k = 0; k < 4; k++)
+        {
+            int16x8_t a = vld1q_s16((const int16_t *)&e[m + k]);
+            int16x8_t b = vld1q_s16((const int16_t *)&e[m + 7 - k]);
+
+            int32x4_t plo = vmlal_n_s16(vmull_n_s16(vget_low_s16(a), taps[k]), vget_low_s16(b), taps[k]);
+            int32x4_t phi = vmlal_n_s16(vmull_n_s16(vget_high_s16(a), taps[k]), vget_high_s16(b), taps[k]);
+            lo = vaddq_s32(lo, vshrq_n_s32(plo, 15));
+            hi = vaddq_s32(hi, vshrq_n_s32(phi, 15));
+        }
+
+        vst1q_s16((int16_t *)&y[m], vcombine_s16(vmovn_s32(lo), vmovn_s32(hi)));
+    }
+#endif
+
+    for (; m < n; m++)
+        y[m] = halfband_output(&e[m], &o[m], taps);
 }
 
-void halfband_q15_execute(firdecim_q15 q, const cint16_t *x, cint16_t *y)
+/*
+ * Decimates n input samples and returns the number of outputs written to
+ * y. There is one output for every even sample, counting from the last
+ * reset, so n need not be even. y may be the same buffer as x.
+ */
+unsigned int halfband_q15_decimate(halfband_q15 q, const cint16_t *x, unsigned int n, cint16_t *y)
 {
-    push(q, x[0]);
-    *y = dotprod_halfband_4(&q->window[q->idx - q->ntaps], q->taps);
-    push(q, x[1]);
+    unsigned int produced = 0;
+
+    while (n > 0)
+    {
+        unsigned int count = (n > 2 * HALFBAND_BLOCK) ? 2 * HALFBAND_BLOCK : n;
+        unsigned int phase = q->phase;
+        unsigned int ne = (count + 1 - phase) / 2;
+        unsigned int no = (count + phase) / 2;
+        cint16_t *e = q->even + HALFBAND_HISTORY;
+        cint16_t *o = q->odd + HALFBAND_HISTORY;
+
+        for (unsigned int i = 0; i < ne; i++)
+            e[i] = x[phase + 2 * i];
+        for (unsigned int i = 0; i < no; i++)
+            o[i] = x[1 - phase + 2 * i];
+
+        // when the block starts with an odd sample, it pairs with the last even one
+        halfband_block(q->even, q->odd + phase, q->taps, ne, y + produced);
+
+        memmove(q->even, q->even + ne, sizeof(cint16_t) * HALFBAND_HISTORY);
+        memmove(q->odd, q->odd + no, sizeof(cint16_t) * HALFBAND_HISTORY);
+        q->phase = (phase + count) & 1;
+
+        produced += ne;
+        x += count;
+        n -= count;
+    }
+
+    return produced;
 }
@@ -3,9 +3,14 @@
 #include "defines.h"
 
 typedef struct firdecim_q15 * firdecim_q15;
+typedef struct halfband_q15 * halfband_q15;
 
 firdecim_q15 firdecim_q15_create(const float * taps, unsigned int ntaps);
 void firdecim_q15_free(firdecim_q15);
 void firdecim_q15_reset(firdecim_q15);
 void fir_q15_execute(firdecim_q15 q, const cint16_t *x, cint16_t *y);
-void halfband_q15_execute(firdecim_q15 q, const cint16_t *x, cint16_t *y);
+
+halfband_q15 halfband_q15_create(const float * taps, unsigned int ntaps);
+void halfband_q15_free(halfband_q15);
+void halfband_q15_reset(halfband_q15);
+unsigned int halfband_q15_decimate(halfband_q15 q, const cint16_t *x, unsigned int n, cint16_t *y);
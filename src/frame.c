@@ -13,6 +13,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stdlib.h>
 #include <string.h>
 
 #include "defines.h"
@@ -155,6 +156,25 @@ static int has_fixed(frame_t *st)
            || (st->pci & 0xFFFFFC) == (PCI_FIXED & 0xFFFFFC);
 }
 
+/*
+ * Input sample at which the frame just decoded started on air: P1 spans
+ * 16 blocks in FM, and the P3/P4 interleavers spread a frame over 32. AM
+ * adds a diversity delay of three 8-block periods to P1 and to MA3 P3.
+ */
+static uint64_t frame_air_start(frame_t *st, logical_channel_t lc)
+{
+    unsigned int blocks;
+    uint64_t span;
+
+    if (st->input->radio->mode == NRSC5_MODE_FM)
+        blocks = (lc == P1_LOGICAL_CHANNEL) ? 16 : 32;
+    else
+        blocks = (lc == P1_LOGICAL_CHANNEL || st->input->sync.psmi == SERVICE_MODE_MA3) ? 32 : 8;
+
+    span = (uint64_t)blocks * BLKSZ * ((st->input->radio->mode == NRSC5_MODE_FM) ? FFTCP_FM : FFTCP_AM);
+    return (st->input->symbol_end > span) ? st->input->symbol_end - span : 0;
+}
+
 static int fix_header(frame_t *st, uint8_t *buf)
 {
     uint8_t hdr[RS_BLOCK_LEN];
@@ -164,7 +184,9 @@ static int fix_header(frame_t *st, uint8_t *buf)
     for (i = 0; i < RS_CODEWORD_LEN; i++)
         hdr[RS_BLOCK_LEN-i-1] = buf[i];
 
+    stats_begin(&st->input->radio->stats, NRSC5_STAGE_RS);
     corrections = decode_rs_char(st->rs_dec, hdr, NULL, 0);
+    stats_end(&st->input->radio->stats);
 
     if (corrections == -1)
         return 0;
@@ -442,6 +464,9 @@ static void process_fixed_block(frame_t *st, int i, logical_channel_t lc)
 {
     ccc_data_t *ccc_data = &st->ccc_data[lc];
     fixed_subchannel_t *subch = &ccc_data->subchannel[i];
+
+    if (!subch->data && !(subch->data = malloc(MAX_AAS_LEN)))
+        return;
     parse_hdlc(st, aas_push, subch->data, &subch->idx, MAX_AAS_LEN, &subch->blocks[4], 255, lc);
 }
 
@@ -517,6 +542,7 @@ void frame_process(frame_t *st, size_t length, logical_channel_t lc)
 {
     unsigned int offset = 0;
     unsigned int audio_end = length;
+    uint64_t air_start = frame_air_start(st, lc);
 
     if (has_fixed(st))
         audio_end = process_fixed_data(st, length, lc);
@@ -544,6 +570,9 @@ void frame_process(frame_t *st, size_t length, logical_channel_t lc)
         offset += 14;
         lc_bits = calc_lc_bits(&hdr);
         loc_bytes = ((lc_bits * hdr.nop) + 4) / 8;
+        // a header without packets is corrupt, and the code below indexes locations[hdr.nop - 1]
+        if (hdr.nop == 0)
+            return;
         if (start + hdr.la_location + 1 < offset + loc_bytes || start + hdr.la_location >= audio_end)
             return;
 
@@ -602,13 +631,23 @@ void frame_process(frame_t *st, size_t length, logical_channel_t lc)
         avg = calc_avg_packets(&hdr);
         seq = (ELASTIC_BUFFER_LEN + hdr.seq - hdr.pfirst) % ELASTIC_BUFFER_LEN;
 
-        output_offset = (ELASTIC_BUFFER_LEN + (hdr.pdu_seq * avg) - (hdr.latency * 2)) % ELASTIC_BUFFER_LEN;
-        if (((ELASTIC_BUFFER_LEN + seq - output_offset) % ELASTIC_BUFFER_LEN) >= (ELASTIC_BUFFER_LEN / 2))
-            output_offset = (output_offset + (ELASTIC_BUFFER_LEN / 2)) % ELASTIC_BUFFER_LEN;
+        if (st->input->output->low_latency)
+        {
+            output_offset = seq;
+        }
+        else
+        {
+            output_offset = (ELASTIC_BUFFER_LEN + (hdr.pdu_seq * avg) - (hdr.latency * 2)) % ELASTIC_BUFFER_LEN;
+            if (((ELASTIC_BUFFER_LEN + seq - output_offset) % ELASTIC_BUFFER_LEN) >= (ELASTIC_BUFFER_LEN / 2))
+                output_offset = (output_offset + (ELASTIC_BUFFER_LEN / 2)) % ELASTIC_BUFFER_LEN;
+        }
 
         output_align(st->input->output, prog, hdr.stream_id, output_offset);
 
-        parse_hdlc(st, aas_push, st->psd_buf[prog], &st->psd_idx[prog], MAX_AAS_LEN, st->buffer + offset, start + hdr.la_location + 1 - offset, lc);
+        if (!st->psd_buf[prog])
+            st->psd_buf[prog] = malloc(MAX_AAS_LEN);
+        if (st->psd_buf[prog])
+            parse_hdlc(st, aas_push, st->psd_buf[prog], &st->psd_idx[prog], MAX_AAS_LEN, st->buffer + offset, start + hdr.la_location + 1 - offset, lc);
         offset = start + hdr.la_location + 1;
 
         for (j = 0; j < hdr.nop; ++j)
@@ -623,6 +662,7 @@ void frame_process(frame_t *st, size_t length, logical_channel_t lc)
             ref.size = cnt;
             ref.seq = seq;
             ref.flags = PACKET_FLAG_NONE;
+            ref.air_start = air_start;
 
             if (crc != 0)
                 ref.flags |= PACKET_FLAG_CRC_ERROR;
@@ -685,6 +725,7 @@ void frame_push(frame_t *st, uint8_t *bits, size_t length, logical_channel_t lc)
         return;
     }
 
+    stats_begin(&st->input->radio->stats, NRSC5_STAGE_FRAME);
     for (i = 0; i < length; ++i)
     {
         // swap bit order
@@ -711,6 +752,7 @@ void frame_push(frame_t *st, uint8_t *bits, size_t length, logical_channel_t lc)
 
     st->pci = header;
     frame_process(st, ptr - st->buffer, lc);
+    stats_end(&st->input->radio->stats);
 }
 
 void frame_reset(frame_t *st)
@@ -741,14 +783,42 @@ void frame_reset(frame_t *st)
     }
 }
 
-void frame_init(frame_t *st, input_t *input)
+int frame_init(frame_t *st, input_t *input)
 {
     st->input = input;
     st->rs_dec = init_rs_char(8, 0x11d, 1, 1, 8);
+    memset(st->psd_buf, 0, sizeof(st->psd_buf));
+    for (int channel = 0; channel < NUM_LOGICAL_CHANNELS; channel++)
+        for (int i = 0; i < 4; i++)
+            st->ccc_data[channel].subchannel[i].data = NULL;
+    if (!st->rs_dec)
+        return 1;
     frame_reset(st);
+    return 0;
 }
 
 void frame_free(frame_t *st)
 {
-    free_rs_char(st->rs_dec);
+    if (st->rs_dec)
+        free_rs_char(st->rs_dec);
+
+    for (int prog = 0; prog < MAX_PROGRAMS; prog++)
+        free(st->psd_buf[prog]);
+    for (int channel = 0; channel < NUM_LOGICAL_CHANNELS; channel++)
+        for (int i = 0; i < 4; i++)
+            free(st->ccc_data[channel].subchannel[i].data);
+}
+
+size_t frame_memory_usage(const frame_t *st)
+{
+    size_t bytes = 0;
+
+    for (int prog = 0; prog < MAX_PROGRAMS; prog++)
+        if (st->psd_buf[prog])
+            bytes += MAX_AAS_LEN;
+    for (int channel = 0; channel < NUM_LOGICAL_CHANNELS; channel++)
+        for (int i = 0; i < 4; i++)
+            if (st->ccc_data[channel].subchannel[i].data)
+                bytes += MAX_AAS_LEN;
+    return bytes;
 }
@@ -24,7 +24,7 @@ typedef struct
     unsigned int block_idx;
     uint8_t blocks[255 + 4];
     int idx;
-    uint8_t data[MAX_AAS_LEN];
+    uint8_t *data; // MAX_AAS_LEN bytes, allocated when the subchannel is first used
 } fixed_subchannel_t;
 
 typedef struct
@@ -44,7 +44,7 @@ typedef struct
     audio_service_t services[MAX_PROGRAMS];
     unsigned int pci;
     unsigned int program;
-    uint8_t psd_buf[MAX_PROGRAMS][MAX_AAS_LEN];
+    uint8_t *psd_buf[MAX_PROGRAMS]; // MAX_AAS_LEN bytes, allocated when the program is first seen
     int psd_idx[MAX_PROGRAMS];
     ccc_data_t ccc_data[NUM_LOGICAL_CHANNELS];
     void *rs_dec;
@@ -53,5 +53,6 @@ typedef struct
 void frame_push(frame_t *st, uint8_t *bits, size_t length, logical_channel_t lc);
 void frame_reset(frame_t *st);
 void frame_set_program(frame_t *st, unsigned int program);
-void frame_init(frame_t *st, struct input_t *input);
+int frame_init(frame_t *st, struct input_t *input);
 void frame_free(frame_t *st);
+size_t frame_memory_usage(const frame_t *st);
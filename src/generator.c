@@ -0,0 +1,1195 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Baseband signal generator. Every stage is the inverse of its counterpart
+ * in the receiver: PDUs are laid out the way frame.c parses them, scrambled
+ * and convolutionally encoded as in decode.c, interleaved onto the same
+ * subcarriers that sync.c demodulates, and OFDM symbols are shaped with the
+ * window used by acquire.c. For cu8 output the spectrum is synthesized
+ * directly at NRSC5_SAMPLE_RATE_CU8 with a proportionally larger IFFT.
+ */
+
+#include <string.h>
+
+#include "generator.h"
+#include "private.h"
+#include "rs_char.h"
+
+#define PCI_AUDIO 0x38D8D3
+#define PARTITION_WIDTH 19
+#define PM_PARTITIONS 10
+#define MIDDLE_REF_SC 30
+#define RS_BLOCK_LEN 255
+#define RS_CODEWORD_LEN 96
+#define PDU_HEADER_LEN 14
+#define HEF_LEN 3
+// first row of each block used by PIDS (FM)
+#define PIDS_K_START (P1_FRAME_LEN_ENCODED_FM / (20 * 16))
+
+// RMS of the output, as a fraction of full scale
+#define OUTPUT_RMS 0.2f
+// AM carrier power relative to one primary subcarrier
+#define AM_CARRIER_DB 30.0f
+// amplitude of the AM reference subcarriers
+#define AM_REF_LEVEL 2.5f
+// mean power of each constellation, in units of the receiver's decision grid
+#define POWER_QPSK_AM 0.5f
+#define POWER_QAM16 2.5f
+#define POWER_QAM64 10.5f
+
+static const char *chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZ ?-*$ ";
+
+/* 1011s.pdf table 10-3, as indexed by decode.c */
+static const uint8_t pm_partitions[] = {
+    10, 2, 18, 6, 14, 8, 16, 0, 12, 4,
+    11, 3, 19, 7, 15, 9, 17, 1, 13, 5
+};
+
+/* 1012s.pdf figure 10-4 */
+static const uint8_t bl_delay[] = { 2, 1, 5 };
+static const uint8_t ml_delay[] = { 11, 6, 7 };
+static const uint8_t bu_delay[] = { 10, 8, 9 };
+static const uint8_t mu_delay[] = { 4, 3, 0 };
+static const uint8_t el_delay[] = { 0, 1 };
+static const uint8_t eu_delay[] = { 2, 3, 5, 4 };
+
+/* 1012s.pdf figure 10-5 */
+static const uint8_t pids_il_delay[] = { 0, 1, 12, 13, 6, 5, 18, 17, 11, 7, 23, 19 };
+static const uint8_t pids_iu_delay[] = { 2, 4, 14, 16, 3, 8, 15, 20, 9, 10, 21, 22 };
+
+static const uint8_t puncture_p1_fm[] = { 1, 1, 1, 1, 1, 0 };
+static const uint8_t puncture_p3_fm[] = { 1, 0, 1, 1, 0, 1 };
+static const uint8_t puncture_e1[] = { 1, 0, 1, 1, 0, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1 };
+static const uint8_t puncture_e2[] = { 1, 0, 1, 1, 0, 0 };
+static const uint8_t puncture_none[] = { 1 };
+
+// Gray-coded constellation levels, indexed by symbol bits as in sync.c
+static const float levels4[] = { -1.5f, 1.5f, -0.5f, 0.5f };
+static const float levels8[] = { -3.5f, 3.5f, -0.5f, 0.5f, -2.5f, 2.5f, -1.5f, 1.5f };
+
+static const uint8_t crc8_tab[] = {
+    0, 0x31, 0x62, 0x53, 0xC4, 0xF5, 0xA6, 0x97, 0xB9,
+    0x88, 0xDB, 0xEA, 0x7D, 0x4C, 0x1F, 0x2E, 0x43, 0x72,
+    0x21, 0x10, 0x87, 0xB6, 0xE5, 0xD4, 0xFA, 0xCB, 0x98,
+    0xA9, 0x3E, 0xF, 0x5C, 0x6D, 0x86, 0xB7, 0xE4, 0xD5,
+    0x42, 0x73, 0x20, 0x11, 0x3F, 0xE, 0x5D, 0x6C, 0xFB,
+    0xCA, 0x99, 0xA8, 0xC5, 0xF4, 0xA7, 0x96, 1, 0x30,
+    0x63, 0x52, 0x7C, 0x4D, 0x1E, 0x2F, 0xB8, 0x89, 0xDA,
+    0xEB, 0x3D, 0xC, 0x5F, 0x6E, 0xF9, 0xC8, 0x9B, 0xAA,
+    0x84, 0xB5, 0xE6, 0xD7, 0x40, 0x71, 0x22, 0x13, 0x7E,
+    0x4F, 0x1C, 0x2D, 0xBA, 0x8B, 0xD8, 0xE9, 0xC7, 0xF6,
+    0xA5, 0x94, 3, 0x32, 0x61, 0x50, 0xBB, 0x8A, 0xD9,
+    0xE8, 0x7F, 0x4E, 0x1D, 0x2C, 2, 0x33, 0x60, 0x51,
+    0xC6, 0xF7, 0xA4, 0x95, 0xF8, 0xC9, 0x9A, 0xAB, 0x3C,
+    0xD, 0x5E, 0x6F, 0x41, 0x70, 0x23, 0x12, 0x85, 0xB4,
+    0xE7, 0xD6, 0x7A, 0x4B, 0x18, 0x29, 0xBE, 0x8F, 0xDC,
+    0xED, 0xC3, 0xF2, 0xA1, 0x90, 7, 0x36, 0x65, 0x54,
+    0x39, 8, 0x5B, 0x6A, 0xFD, 0xCC, 0x9F, 0xAE, 0x80,
+    0xB1, 0xE2, 0xD3, 0x44, 0x75, 0x26, 0x17, 0xFC, 0xCD,
+    0x9E, 0xAF, 0x38, 9, 0x5A, 0x6B, 0x45, 0x74, 0x27,
+    0x16, 0x81, 0xB0, 0xE3, 0xD2, 0xBF, 0x8E, 0xDD, 0xEC,
+    0x7B, 0x4A, 0x19, 0x28, 6, 0x37, 0x64, 0x55, 0xC2,
+    0xF3, 0xA0, 0x91, 0x47, 0x76, 0x25, 0x14, 0x83, 0xB2,
+    0xE1, 0xD0, 0xFE, 0xCF, 0x9C, 0xAD, 0x3A, 0xB, 0x58,
+    0x69, 4, 0x35, 0x66, 0x57, 0xC0, 0xF1, 0xA2, 0x93,
+    0xBD, 0x8C, 0xDF, 0xEE, 0x79, 0x48, 0x1B, 0x2A, 0xC1,
+    0xF0, 0xA3, 0x92, 5, 0x34, 0x67, 0x56, 0x78, 0x49,
+    0x1A, 0x2B, 0xBC, 0x8D, 0xDE, 0xEF, 0x82, 0xB3, 0xE0,
+    0xD1, 0x46, 0x77, 0x24, 0x15, 0x3B, 0xA, 0x59, 0x68,
+    0xFF, 0xCE, 0x9D, 0xAC
+};
+
+static uint8_t crc8(const uint8_t *pkt, unsigned int cnt)
+{
+    unsigned int i, crc = 0xFF;
+    for (i = 0; i < cnt; ++i)
+        crc = crc8_tab[crc ^ pkt[i]];
+    return crc;
+}
+
+static uint16_t crc12(const uint8_t *bits)
+{
+    uint16_t poly = 0xD010;
+    uint16_t reg = 0x0000;
+    int i, lowbit;
+
+    for (i = 67; i >= 0; i--)
+    {
+        lowbit = reg & 1;
+        reg >>= 1;
+        reg ^= ((uint16_t)bits[i] << 15);
+        if (lowbit) reg ^= poly;
+    }
+    for (i = 0; i < 16; i++)
+    {
+        lowbit = reg & 1;
+        reg >>= 1;
+        if (lowbit) reg ^= poly;
+    }
+    reg ^= 0x955;
+    return reg & 0xfff;
+}
+
+static uint64_t seed_state(uint64_t x)
+{
+    // splitmix64, so that nearby seeds give unrelated sequences
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x ? x : 1;
+}
+
+static uint32_t rand32(uint64_t *state)
+{
+    // xorshift64*
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return (x * 0x2545F4914F6CDD1DULL) >> 32;
+}
+
+static float complex complex_gaussian(uint64_t *state)
+{
+    // Box-Muller; E|n|^2 = 1
+    float u1 = (rand32(state) + 1.0f) / 4294967296.0f;
+    float u2 = rand32(state) / 4294967296.0f;
+    float r = sqrtf(-logf(u1));
+    return CMPLXF(r * cosf(2 * M_PI * u2), r * sinf(2 * M_PI * u2));
+}
+
+static void scramble(uint8_t *buf, unsigned int length)
+{
+    const unsigned int width = 11;
+    unsigned int i, val = 0x3ff;
+    for (i = 0; i < length; i++)
+    {
+        int bit = ((val >> 9) ^ val) & 1;
+        val |= bit << width;
+        val >>= 1;
+        buf[i] ^= bit;
+    }
+}
+
+// tail-biting convolutional encoder, the inverse of bit_errors() in decode.c
+static unsigned int conv_encode(const uint8_t *in, unsigned int frame_len, unsigned int k,
+                                unsigned int g1, unsigned int g2, unsigned int g3,
+                                const uint8_t *puncture, unsigned int puncture_len, uint8_t *out)
+{
+    const unsigned int g[3] = { g1, g2, g3 };
+    uint16_t r = 0;
+    unsigned int i, j, m, n = 0;
+
+    for (i = 0; i < (k-1); i++)
+        r = (r >> 1) | (in[frame_len - (k-1) + i] << (k-1));
+
+    for (i = 0, j = 0; i < frame_len; i++)
+    {
+        r = (r >> 1) | (in[i] << (k-1));
+        for (m = 0; m < 3; m++, j++)
+            if (puncture[j % puncture_len])
+                out[n++] = __builtin_parity(r & g[m]);
+    }
+    return n;
+}
+
+static void put_location(uint8_t *buf, unsigned int lc_bits, unsigned int i, unsigned int loc)
+{
+    if (lc_bits == 16)
+    {
+        buf[2*i] = loc & 0xff;
+        buf[2*i + 1] = loc >> 8;
+    }
+    else if (i % 2 == 0)
+    {
+        buf[i/2*3] = loc & 0xff;
+        buf[i/2*3 + 1] = (buf[i/2*3 + 1] & 0xf0) | (loc >> 8);
+    }
+    else
+    {
+        buf[i/2*3 + 1] = (buf[i/2*3 + 1] & 0x0f) | ((loc & 0xf) << 4);
+        buf[i/2*3 + 2] = loc >> 4;
+    }
+}
+
+// Fill gen->pdu with one audio PDU of the given stream, as parsed by frame_process().
+static void build_pdu(nrsc5_generator_t *gen, generator_stream_t *stream, unsigned int length, int random_only)
+{
+    uint8_t *pdu = gen->pdu;
+    uint8_t hdr[RS_BLOCK_LEN], parity[8];
+    unsigned int nop = stream->packets;
+    unsigned int loc_bytes = ((stream->lc_bits * nop) + 4) / 8;
+    unsigned int start = PDU_HEADER_LEN + loc_bytes + HEF_LEN;
+    unsigned int share = (length - start) / nop;
+    unsigned int offset = start;
+    unsigned int seq = stream->seq;
+    unsigned int pdu_seq = (seq / nop) % 8;
+    unsigned int i;
+
+    memset(pdu, 0, length);
+
+    for (i = 0; i < nop; i++)
+    {
+        unsigned int max = (i == nop - 1) ? length - offset - 1 : share - 1;
+        unsigned int cnt = max;
+
+        if (gen->packet_callback && !random_only)
+        {
+            cnt = gen->packet_callback(stream->program, pdu + offset, max, gen->packet_opaque);
+            if (cnt > max)
+                cnt = max;
+        }
+        else
+        {
+            for (unsigned int j = 0; j < cnt; j++)
+                pdu[offset + j] = rand32(&gen->rng);
+        }
+        pdu[offset + cnt] = crc8(pdu + offset, cnt);
+        offset += cnt + 1;
+        put_location(pdu + PDU_HEADER_LEN, stream->lc_bits, i, offset - 1);
+    }
+    // whatever a packet callback leaves unused stays zero after the last packet
+
+    pdu[8] = stream->codec_mode | (stream->stream_id << 4) | ((pdu_seq & 3) << 6);
+    pdu[9] = pdu_seq >> 2;
+    pdu[10] = 0;
+    pdu[11] = (seq & 31) << 3;
+    pdu[12] = ((seq >> 5) & 1) | (nop << 1) | 0x80;
+    pdu[13] = start - 1;
+
+    // header expansion: program number, then access and program type
+    pdu[PDU_HEADER_LEN + loc_bytes] = 0x80 | 0x10 | (stream->program << 1);
+    pdu[PDU_HEADER_LEN + loc_bytes + 1] = 0x20;
+    pdu[PDU_HEADER_LEN + loc_bytes + 2] = 0;
+
+    // Reed-Solomon parity in the first 8 bytes, byte order as in fix_header()
+    memset(hdr, 0, sizeof(hdr));
+    for (i = 8; i < RS_CODEWORD_LEN; i++)
+        hdr[RS_BLOCK_LEN - i - 1] = pdu[i];
+    encode_rs_char(gen->rs_enc, hdr, parity);
+    for (i = 0; i < 8; i++)
+        pdu[7 - i] = parity[i];
+
+    stream->seq = (seq + nop) % ELASTIC_BUFFER_LEN;
+}
+
+// Spread a PDU over an L1 frame with the PCI bits, the inverse of frame_push().
+static void build_frame(const uint8_t *pdu, uint8_t *bits, unsigned int length)
+{
+    unsigned int start, offset, pci_len;
+    unsigned int i, j = 0, h = 0;
+
+    switch (length)
+    {
+    case P1_FRAME_LEN_FM:
+        start = P1_FRAME_LEN_FM - 30000;
+        offset = 1248;
+        pci_len = 24;
+        break;
+    case P3_FRAME_LEN_FM:
+        start = 120;
+        offset = 184;
+        pci_len = 24;
+        break;
+    case P3_FRAME_LEN_FM / 2:
+        start = 120;
+        offset = 88;
+        pci_len = 24;
+        break;
+    case P1_FRAME_LEN_AM:
+        start = 120;
+        offset = 160;
+        pci_len = 22;
+        break;
+    case P3_FRAME_LEN_MA1:
+        start = 120;
+        offset = 992;
+        pci_len = 24;
+        break;
+    default:
+        start = 120;
+        offset = 1240;
+        pci_len = 24;
+        break;
+    }
+
+    for (i = 0; i < length; ++i)
+    {
+        unsigned int byte_start = (i>>3)<<3;
+        unsigned int byte_len = (length - byte_start < 8) ? length - byte_start : 8;
+        uint8_t bit;
+
+        if (i >= start && ((i - start) % offset) == 0 && h < pci_len)
+        {
+            bit = (PCI_AUDIO >> (23 - h)) & 1;
+            ++h;
+        }
+        else
+        {
+            bit = (pdu[j / 8] >> (7 - (j % 8))) & 1;
+            ++j;
+        }
+        bits[byte_start + byte_len - 1 - (i & 7)] = bit;
+    }
+}
+
+// Build, scramble and encode one audio frame into gen->coded.
+static unsigned int encode_frame(nrsc5_generator_t *gen, generator_stream_t *stream, unsigned int frame_len,
+                                 unsigned int k, unsigned int g2, const uint8_t *puncture, unsigned int puncture_len,
+                                 int random_only)
+{
+    build_pdu(gen, stream, (frame_len - PCI_LEN) / 8, random_only);
+    build_frame(gen->pdu, gen->bits, frame_len);
+    scramble(gen->bits, frame_len);
+    if (k == 7)
+        return conv_encode(gen->bits, frame_len, 7, 0133, 0171, 0165, puncture, puncture_len, gen->coded);
+    return conv_encode(gen->bits, frame_len, 9, 0561, g2, 0711, puncture, puncture_len, gen->coded);
+}
+
+// One FM or AM P1 frame as frame_push() receives it, after descrambling.
+void generator_p1_frame(nrsc5_generator_t *gen, uint8_t *bits)
+{
+    unsigned int frame_len = (gen->mode == NRSC5_MODE_FM) ? P1_FRAME_LEN_FM : P1_FRAME_LEN_AM;
+
+    build_pdu(gen, &gen->p1_stream, (frame_len - PCI_LEN) / 8, 0);
+    build_frame(gen->pdu, bits, frame_len);
+}
+
+static unsigned int char5(char c)
+{
+    const char *p = strchr(chars, c);
+    return p ? (unsigned int)(p - chars) : 27;
+}
+
+static void put_int(uint8_t *bits, unsigned int *off, unsigned int value, unsigned int length)
+{
+    for (unsigned int i = 0; i < length; i++)
+        bits[(*off)++] = (value >> (length - 1 - i)) & 1;
+}
+
+// Build and encode a PIDS frame carrying the station ID and short name.
+static void encode_pids(nrsc5_generator_t *gen, uint8_t *coded)
+{
+    uint8_t reversed[PIDS_FRAME_LEN] = {0};
+    uint8_t bits[PIDS_FRAME_LEN];
+    const char *name = gen->short_name;
+    unsigned int off = 0, i;
+
+    put_int(reversed, &off, 0, 1);
+    put_int(reversed, &off, 1, 1); // two payloads
+
+    put_int(reversed, &off, 0, 4);
+    put_int(reversed, &off, char5('U'), 5);
+    put_int(reversed, &off, char5('S'), 5);
+    put_int(reversed, &off, 0, 3);
+    put_int(reversed, &off, gen->facility_id, 19);
+
+    put_int(reversed, &off, 1, 4);
+    for (i = 0; i < 4; i++)
+        put_int(reversed, &off, char5(name[i] ? name[i] : ' '), 5);
+    put_int(reversed, &off, strcmp(name + 4, "-FM") == 0 ? 1 : 0, 2);
+
+    off = 68;
+    put_int(reversed, &off, crc12(reversed), 12);
+
+    for (i = 0; i < PIDS_FRAME_LEN; i++)
+        bits[((i>>3)<<3) + 7 - (i & 7)] = reversed[i];
+    scramble(bits, PIDS_FRAME_LEN);
+
+    if (gen->mode == NRSC5_MODE_FM)
+        conv_encode(bits, PIDS_FRAME_LEN, 7, 0133, 0171, 0165, puncture_p1_fm, 6, coded);
+    else
+        conv_encode(bits, PIDS_FRAME_LEN, 9, 0561, 0753, 0711, puncture_none, 1, coded);
+}
+
+static void set_bin(nrsc5_generator_t *gen, int index, float complex value)
+{
+    int k = index - (int)gen->fft / 2;
+    int nfft = gen->fft * gen->interp;
+    gen->spectrum[(k + nfft) % nfft] = value;
+}
+
+/* FM */
+
+static void fm_ref_bits(uint8_t *c, unsigned int rsid, unsigned int bc, unsigned int psmi)
+{
+    static const uint8_t sync[BLKSZ] = {
+        0, 1, 0, 0, 0, 1, 1, 0, 1, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+    };
+    unsigned int n;
+
+    memcpy(c, sync, BLKSZ);
+    c[10] = rsid >> 1;
+    c[11] = (rsid >> 1) ^ (rsid & 1);
+    // block count and PSMI are differentially encoded
+    for (n = 16; n < 20; n++)
+        c[n] = c[n-1] ^ ((bc >> (19 - n)) & 1);
+    for (n = 25; n < 31; n++)
+        c[n] = c[n-1] ^ ((psmi >> (30 - n)) & 1);
+}
+
+static void px_init(generator_px_t *px, unsigned int program, unsigned int frame_len,
+                    unsigned int first_partition, unsigned int partitions)
+{
+    const unsigned int J = (frame_len == P3_FRAME_LEN_FM) ? 4 : 2;
+    const unsigned int B = 32;
+    const unsigned int C = 36;
+    const unsigned int M = (frame_len == P3_FRAME_LEN_FM) ? 2 : 4;
+    const unsigned int bk_bits = 32 * C;
+    const unsigned int bk_adj = 32 * C - 1;
+    unsigned int pt[4] = {0};
+
+    memset(px, 0, sizeof(*px));
+    px->stream.program = program;
+    px->stream.codec_mode = 13;
+    px->stream.lc_bits = 12;
+    px->stream.packets = 4;
+    px->frame_len = frame_len;
+    px->span = (frame_len == P3_FRAME_LEN_FM) ? 147456 : 73728;
+    px->first_partition = first_partition;
+    px->partitions = partitions;
+
+    // The receiver reads each coded bit a fixed number of bits after it
+    // arrived, and the delay pattern repeats every frame.
+    for (unsigned int g = 0; g < frame_len * 2; g++)
+    {
+        unsigned int partition = ((g + 2 * (M / 4)) / M) % J;
+        unsigned int pti = pt[partition]++;
+        unsigned int block = (pti + (partition * 7) - (bk_adj * (pti / bk_bits))) % B;
+        unsigned int row = ((11 * pti) % bk_bits) / C;
+        unsigned int column = (pti * 11) % C;
+        unsigned int p = (block * 32 + row) * (J * C) + partition * C + column;
+        px->delay[g] = (p < g) ? g - p : px->span + g - p;
+    }
+}
+
+static void px_encode_frame(nrsc5_generator_t *gen, generator_px_t *px)
+{
+    unsigned int coded_len = px->frame_len * 2;
+    uint64_t base = px->encoded * coded_len;
+
+    encode_frame(gen, &px->stream, px->frame_len, 7, 0, puncture_p3_fm, 6, 0);
+    for (unsigned int g = 0; g < coded_len; g++)
+    {
+        if (base + g >= px->delay[g])
+            px->ring[(base + g - px->delay[g]) % (px->span * 2)] = gen->coded[g];
+    }
+    px->encoded++;
+}
+
+static uint8_t px_next_bit(nrsc5_generator_t *gen, generator_px_t *px)
+{
+    unsigned int coded_len = px->frame_len * 2;
+    uint64_t slot = px->sent / coded_len;
+    unsigned int idx = px->sent % (px->span * 2);
+    uint8_t bit;
+
+    // every bit sent within this frame slot must already be encoded
+    while (px->encoded < slot + 1 + px->span / coded_len)
+        px_encode_frame(gen, px);
+
+    bit = px->ring[idx];
+    px->ring[idx] = 0;
+    px->sent++;
+    return bit;
+}
+
+static float complex fm_qpsk(uint8_t re, uint8_t im)
+{
+    return CMPLXF(re ? 1 : -1, im ? 1 : -1) * (float)M_SQRT1_2;
+}
+
+static void fm_begin_block(nrsc5_generator_t *gen, unsigned int bc)
+{
+    generator_fm_t *fm = gen->fm;
+    uint8_t coded[PIDS_FRAME_LEN_ENCODED_FM];
+    unsigned int i;
+
+    if (bc == 0)
+    {
+        encode_frame(gen, &gen->p1_stream, P1_FRAME_LEN_FM, 7, 0, puncture_p1_fm, 6, 0);
+        for (i = 0; i < P1_FRAME_LEN_ENCODED_FM; i++)
+        {
+            unsigned int partition = pm_partitions[i % 20];
+            unsigned int block = ((i / 20) + (partition * 7)) % 16;
+            unsigned int k = i / (20 * 16);
+            unsigned int row = (k * 11) % 32;
+            unsigned int column = (k * 11 + k / (32*9)) % 36;
+            fm->pm[(block * 32 + row) * GENERATOR_PM_BITS + partition * 36 + column] = gen->coded[i];
+        }
+    }
+
+    encode_pids(gen, coded);
+    for (i = 0; i < PIDS_FRAME_LEN_ENCODED_FM; i++)
+    {
+        unsigned int partition = pm_partitions[i % 20];
+        unsigned int k = ((i / 20) % (PIDS_FRAME_LEN_ENCODED_FM / 20)) + PIDS_K_START;
+        unsigned int row = (k * 11) % 32;
+        unsigned int column = (k * 11 + k / (32*9)) % 36;
+        fm->pm[(bc * 32 + row) * GENERATOR_PM_BITS + partition * 36 + column] = coded[i];
+    }
+
+    for (i = 0; i < 4; i++)
+        fm_ref_bits(fm->ref[i], i, bc, gen->psmi);
+}
+
+static void fm_symbol(nrsc5_generator_t *gen, unsigned int bc, unsigned int n)
+{
+    generator_fm_t *fm = gen->fm;
+    const uint8_t *row = &fm->pm[(bc * BLKSZ + n) * GENERATOR_PM_BITS];
+    unsigned int i, j, s, q;
+
+    for (i = 0; i <= gen->partitions; i++)
+    {
+        float complex v = fm_qpsk(fm->ref[(MIDDLE_REF_SC - i) & 0x3][n], fm->ref[(MIDDLE_REF_SC - i) & 0x3][n]);
+        set_bin(gen, LB_START + i * PARTITION_WIDTH, v);
+        set_bin(gen, UB_END - i * PARTITION_WIDTH, v);
+    }
+
+    for (i = 0; i < PM_PARTITIONS * 2; i++)
+    {
+        int base = (i < PM_PARTITIONS) ? LB_START + i * PARTITION_WIDTH
+                                       : UB_END - (2 * PM_PARTITIONS - i) * PARTITION_WIDTH;
+        for (j = 1; j < PARTITION_WIDTH; j++)
+            set_bin(gen, base + j, fm_qpsk(row[i * 36 + (j-1) * 2], row[i * 36 + (j-1) * 2 + 1]));
+    }
+
+    for (s = 0; s < fm->num_px; s++)
+    {
+        generator_px_t *px = &fm->px[s];
+        int first = PM_PARTITIONS + px->first_partition;
+
+        for (q = 0; q < px->partitions; q++)
+        {
+            int base = LB_START + (first + q) * PARTITION_WIDTH;
+            for (j = 1; j < PARTITION_WIDTH; j++)
+            {
+                uint8_t re = px_next_bit(gen, px);
+                set_bin(gen, base + j, fm_qpsk(re, px_next_bit(gen, px)));
+            }
+        }
+        for (q = 0; q < px->partitions; q++)
+        {
+            int base = UB_END - (first + px->partitions - q) * PARTITION_WIDTH;
+            for (j = 1; j < PARTITION_WIDTH; j++)
+            {
+                uint8_t re = px_next_bit(gen, px);
+                set_bin(gen, base + j, fm_qpsk(re, px_next_bit(gen, px)));
+            }
+        }
+    }
+}
+
+/* AM */
+
+static void am_ref_bits(uint8_t *d, unsigned int bc, unsigned int psmi)
+{
+    static const uint8_t sync[BLKSZ] = {
+        0, 1, 1, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0
+    };
+    unsigned int n;
+
+    memcpy(d, sync, BLKSZ);
+    for (n = 0; n < 3; n++)
+        d[17 + n] = (bc >> (2 - n)) & 1;
+    d[20] = __builtin_parity(bc);
+    for (n = 0; n < 5; n++)
+        d[26 + n] = (psmi >> (4 - n)) & 1;
+    d[31] = __builtin_parity(psmi);
+}
+
+static void bit_set(uint8_t *matrix, int b, int k, int p, uint8_t bit)
+{
+    int col = (9*k) % 25;
+    int row = (11*col + 16*(k/25) + 11*(k/50)) % 32;
+    matrix[PARTITION_WIDTH_AM * (b*BLKSZ + row) + col] |= bit << p;
+}
+
+static void am_encode_period(nrsc5_generator_t *gen, unsigned int slot)
+{
+    generator_am_t *am = gen->am;
+
+    for (unsigned int b = 0; b < 8; b++)
+    {
+        encode_frame(gen, &gen->p1_stream, P1_FRAME_LEN_AM, 9, 0657, puncture_e1, 15, 0);
+        memcpy(am->p1[slot] + b * P1_FRAME_LEN_ENCODED_AM, gen->coded, P1_FRAME_LEN_ENCODED_AM);
+    }
+
+    // the enhanced stream is not offered to the packet callback
+    if (gen->service_mode == SERVICE_MODE_MA3)
+        encode_frame(gen, &am->p3_stream, P3_FRAME_LEN_MA3, 9, 0657, puncture_e1, 15, 1);
+    else
+        encode_frame(gen, &am->p3_stream, P3_FRAME_LEN_MA1, 9, 0753, puncture_e2, 6, 1);
+    memcpy(am->p3[slot], gen->coded, P3_FRAME_LEN_ENCODED_MA3);
+}
+
+// The inverse of interleaver_ma1() in decode.c. Bits that the receiver
+// delays for time diversity are taken from the period three ahead.
+static void am_interleave(nrsc5_generator_t *gen)
+{
+    generator_am_t *am = gen->am;
+    const uint8_t *p1 = am->p1[am->period % GENERATOR_AM_PERIODS];
+    const uint8_t *p1_late = am->p1[(am->period + 3) % GENERATOR_AM_PERIODS];
+    const uint8_t *p3 = am->p3[am->period % GENERATOR_AM_PERIODS];
+    const uint8_t *p3_late = am->p3[(am->period + 3) % GENERATOR_AM_PERIODS];
+    int b, k, p;
+
+    memset(am->pl, 0, sizeof(am->pl));
+    memset(am->pu, 0, sizeof(am->pu));
+    memset(am->s, 0, sizeof(am->s));
+    memset(am->t, 0, sizeof(am->t));
+
+    for (int n = 0; n < 18000; n++)
+    {
+        int i = n / 3, j = n % 3;
+
+        b = n/2250;
+        k = (n + n/750 + 1) % 750;
+        p = n % 3;
+        bit_set(am->pl, b, k, p, p1[i*12 + bl_delay[j]]);
+
+        b = (3*n + 3) % 8;
+        k = (n + n/3000 + 3) % 750;
+        p = 3 + (n % 3);
+        bit_set(am->pl, b, k, p, p1_late[i*12 + ml_delay[j]]);
+
+        b = n/2250;
+        k = (n + n/750) % 750;
+        p = n % 3;
+        bit_set(am->pu, b, k, p, p1[i*12 + bu_delay[j]]);
+
+        b = (3*n) % 8;
+        k = (n + n/3000 + 2) % 750;
+        p = 3 + (n % 3);
+        bit_set(am->pu, b, k, p, p1_late[i*12 + mu_delay[j]]);
+    }
+
+    if (gen->service_mode != SERVICE_MODE_MA3)
+    {
+        for (int n = 0; n < 12000; n++)
+        {
+            b = (3*n + n/3000) % 8;
+            k = (n + (n/6000)) % 750;
+            p = n % 2;
+            bit_set(am->t, b, k, p, p3[(n/2)*6 + el_delay[n%2]]);
+        }
+        for (int n = 0; n < 24000; n++)
+        {
+            b = (3*n + n/3000 + 2*(n/12000)) % 8;
+            k = (n + (n/6000)) % 750;
+            p = n % 4;
+            bit_set(am->s, b, k, p, p3[(n/4)*6 + eu_delay[n%4]]);
+        }
+    }
+    else
+    {
+        for (int n = 0; n < 18000; n++)
+        {
+            int i = n / 3, j = n % 3;
+
+            b = (3*n + 3) % 8;
+            k = (n + n/3000 + 3) % 750;
+            p = n % 3;
+            bit_set(am->t, b, k, p, p3[i*12 + bl_delay[j]]);
+            bit_set(am->t, b, k, p + 3, p3_late[i*12 + ml_delay[j]]);
+
+            b = (3*n) % 8;
+            k = (n + n/3000 + 2) % 750;
+            p = n % 3;
+            bit_set(am->s, b, k, p, p3[i*12 + bu_delay[j]]);
+            bit_set(am->s, b, k, p + 3, p3_late[i*12 + mu_delay[j]]);
+        }
+    }
+}
+
+static void am_begin_block(nrsc5_generator_t *gen, unsigned int bc)
+{
+    generator_am_t *am = gen->am;
+    uint8_t coded[PIDS_FRAME_LEN_ENCODED_AM];
+    uint8_t il[120], iu[120];
+
+    if (bc == 0)
+    {
+        if (gen->block == 0)
+        {
+            for (unsigned int slot = 0; slot < GENERATOR_AM_PERIODS - 1; slot++)
+                am_encode_period(gen, slot);
+        }
+        am->period = gen->block / 8;
+        am_encode_period(gen, (am->period + 3) % GENERATOR_AM_PERIODS);
+        am_interleave(gen);
+    }
+
+    /* 1012s.pdf section 10.4 */
+    encode_pids(gen, coded);
+    for (int i = 0; i < 10; i++)
+    {
+        for (int j = 0; j < 12; j++)
+        {
+            il[i*12 + j] = coded[i*24 + pids_il_delay[j]];
+            iu[i*12 + j] = coded[i*24 + pids_iu_delay[j]];
+        }
+    }
+    memset(am->pids, 0, sizeof(am->pids));
+    for (int n = 0; n < 120; n++)
+    {
+        int k, p, row;
+
+        p = n % 4;
+
+        k = (n + (n/60) + 11) % 30;
+        row = (11 * (k + (k/15)) + 3) % 32;
+        am->pids[row*2] |= il[n] << p;
+
+        k = (n + (n/60)) % 30;
+        row = (11 * (k + (k/15)) + 3) % 32;
+        am->pids[row*2 + 1] |= iu[n] << p;
+    }
+
+    am_ref_bits(am->ref, bc, gen->psmi);
+}
+
+static float complex qam64(uint8_t sym)
+{
+    return CMPLXF(levels8[sym & 7], levels8[sym >> 3]);
+}
+
+static float complex qam16(uint8_t sym)
+{
+    return CMPLXF(levels4[sym & 3], levels4[sym >> 2]);
+}
+
+static float complex qpsk(uint8_t sym)
+{
+    return CMPLXF((sym & 1) ? 0.5f : -0.5f, (sym & 2) ? 0.5f : -0.5f);
+}
+
+// lower sideband subcarriers carry the negated conjugate, see sync_process_am()
+static void am_set(nrsc5_generator_t *gen, int index, float complex v)
+{
+    set_bin(gen, CENTER_AM + index, index < 0 ? -conjf(v) : v);
+}
+
+static void am_symbol(nrsc5_generator_t *gen, unsigned int bc, unsigned int n)
+{
+    generator_am_t *am = gen->am;
+    int ma3 = (gen->service_mode == SERVICE_MODE_MA3);
+    unsigned int col;
+    float complex v;
+
+    set_bin(gen, CENTER_AM, gen->carrier);
+
+    v = CMPLXF(0, am->ref[n] ? AM_REF_LEVEL : -AM_REF_LEVEL);
+    am_set(gen, REF_INDEX_AM, v);
+    am_set(gen, -REF_INDEX_AM, v);
+
+    for (unsigned int i = 0; i < 2; i++)
+    {
+        int index = (i == 0) ? (ma3 ? -PIDS_INNER_INDEX_AM : PIDS_INNER_INDEX_AM)
+                             : (ma3 ? PIDS_INNER_INDEX_AM : PIDS_OUTER_INDEX_AM);
+        v = (n == 8 || n == 24) ? CMPLXF(1.5, -0.5) : qam16(am->pids[n*2 + i]);
+        am_set(gen, index, v);
+        if (!ma3)
+            am_set(gen, -index, v);
+    }
+
+    for (col = 0; col < PARTITION_WIDTH_AM; col++)
+    {
+        unsigned int idx = PARTITION_WIDTH_AM * (bc * BLKSZ + n) + col;
+        int train = (n == (5 + 11*col) % 32) || (n == (21 + 11*col) % 32);
+
+        if (!ma3)
+        {
+            am_set(gen, -(OUTER_PARTITION_START_AM + col), train ? CMPLXF(2.5, -2.5) : qam64(am->pl[idx]));
+            am_set(gen, OUTER_PARTITION_START_AM + col, train ? CMPLXF(2.5, -2.5) : qam64(am->pu[idx]));
+
+            v = train ? CMPLXF(1.5, -0.5) : qam16(am->s[idx]);
+            am_set(gen, MIDDLE_PARTITION_START_AM + col, v);
+            am_set(gen, -(MIDDLE_PARTITION_START_AM + col), v);
+
+            v = train ? CMPLXF(-0.5, 0.5) : qpsk(am->t[idx]);
+            am_set(gen, INNER_PARTITION_START_AM + col, v);
+            am_set(gen, -(INNER_PARTITION_START_AM + col), v);
+        }
+        else
+        {
+            am_set(gen, -(INNER_PARTITION_START_AM + col), train ? CMPLXF(2.5, -2.5) : qam64(am->pl[idx]));
+            am_set(gen, INNER_PARTITION_START_AM + col, train ? CMPLXF(2.5, -2.5) : qam64(am->pu[idx]));
+            am_set(gen, MIDDLE_PARTITION_START_AM + col, train ? CMPLXF(2.5, -2.5) : qam64(am->s[idx]));
+            am_set(gen, -(MIDDLE_PARTITION_START_AM + col), train ? CMPLXF(2.5, -2.5) : qam64(am->t[idx]));
+        }
+    }
+}
+
+/* OFDM */
+
+static void next_symbol(nrsc5_generator_t *gen)
+{
+    unsigned int nfft = gen->fft * gen->interp;
+    unsigned int bc = gen->block % ((gen->mode == NRSC5_MODE_FM) ? 16 : 8);
+    unsigned int n = gen->symbol_idx;
+
+    if (n == 0)
+    {
+        if (gen->mode == NRSC5_MODE_FM)
+            fm_begin_block(gen, bc);
+        else
+            am_begin_block(gen, bc);
+    }
+
+    memset(gen->spectrum, 0, sizeof(float complex) * nfft);
+    if (gen->mode == NRSC5_MODE_FM)
+        fm_symbol(gen, bc, n);
+    else
+        am_symbol(gen, bc, n);
+    fftwf_execute(gen->ifft);
+
+    for (unsigned int j = 0; j < gen->symbol_len; j++)
+    {
+        float complex x = gen->shape[j] * gen->time[(j + gen->window_offset) % nfft];
+        // the receiver conjugates FM input
+        gen->symbol[j] = (gen->mode == NRSC5_MODE_FM) ? conjf(x) : x;
+    }
+    gen->symbol_pos = 0;
+
+    if (++gen->symbol_idx == BLKSZ)
+    {
+        gen->symbol_idx = 0;
+        gen->block++;
+    }
+}
+
+static void update_levels(nrsc5_generator_t *gen)
+{
+    float noise_power = 0;
+
+    if (!gen->started)
+        return;
+
+    // noise in the receiver's bandwidth, spread over the whole output band
+    if (isfinite(gen->snr))
+        noise_power = gen->digital_power * powf(10, -gen->snr / 10) * gen->interp;
+
+    gen->gain = OUTPUT_RMS / sqrtf(gen->digital_power + gen->carrier_power + noise_power);
+    gen->noise_std = sqrtf(noise_power);
+    gen->rotation_step = cexpf(I * 2 * M_PI * gen->cfo / gen->sample_rate);
+}
+
+static int start(nrsc5_generator_t *gen, int cu8)
+{
+    unsigned int nfft, cp;
+    float power = 0;
+
+    if (gen->mode == NRSC5_MODE_FM)
+    {
+        gen->fft = FFT_FM;
+        gen->cp = CP_FM;
+        gen->interp = cu8 ? 2 : 1;
+        gen->sample_rate = cu8 ? NRSC5_SAMPLE_RATE_CU8 : NRSC5_SAMPLE_RATE_CS16_FM;
+
+        power = gen->partitions + 1;
+        power += PM_PARTITIONS * (PARTITION_WIDTH - 1);
+        for (unsigned int s = 0; s < gen->fm->num_px; s++)
+            power += gen->fm->px[s].partitions * (PARTITION_WIDTH - 1);
+        power *= 2;
+    }
+    else
+    {
+        gen->fft = FFT_AM;
+        gen->cp = CP_AM;
+        gen->interp = cu8 ? 32 : 1;
+        gen->sample_rate = cu8 ? NRSC5_SAMPLE_RATE_CU8 : NRSC5_SAMPLE_RATE_CS16_AM;
+
+        power = 2 * AM_REF_LEVEL * AM_REF_LEVEL + 2 * PARTITION_WIDTH_AM * POWER_QAM64;
+        if (gen->service_mode == SERVICE_MODE_MA3)
+            power += 2 * PARTITION_WIDTH_AM * POWER_QAM64 + 2 * POWER_QAM16;
+        else
+            power += 2 * PARTITION_WIDTH_AM * (POWER_QAM16 + POWER_QPSK_AM) + 4 * POWER_QAM16;
+        gen->carrier = sqrtf(POWER_QAM64 * powf(10, AM_CARRIER_DB / 10));
+    }
+
+    nfft = gen->fft * gen->interp;
+    cp = gen->cp * gen->interp;
+    gen->symbol_len = nfft + cp;
+    gen->window_offset = (gen->mode == NRSC5_MODE_FM) ? 0 : ((gen->fft - gen->cp) / 2) * gen->interp;
+    // average power of the unnormalized IFFT output, cyclic prefix included
+    gen->digital_power = power * nfft / gen->symbol_len;
+    gen->carrier_power = gen->carrier * gen->carrier * nfft / gen->symbol_len;
+
+    gen->shape = malloc(sizeof(float) * gen->symbol_len);
+    gen->symbol = malloc(sizeof(float complex) * gen->symbol_len);
+    gen->spectrum = fftwf_malloc(sizeof(float complex) * nfft);
+    gen->time = fftwf_malloc(sizeof(float complex) * nfft);
+    if (!gen->shape || !gen->symbol || !gen->spectrum || !gen->time)
+        goto error;
+
+    for (unsigned int i = 0; i < gen->symbol_len; ++i)
+    {
+        if (i < cp)
+            gen->shape[i] = sinf(M_PI / 2 * i / cp);
+        else if (i < nfft)
+            gen->shape[i] = 1;
+        else
+            gen->shape[i] = cosf(M_PI / 2 * (i - nfft) / cp);
+    }
+
+    pthread_mutex_lock(&fftw_mutex);
+    gen->ifft = fftwf_plan_dft_1d(nfft, gen->spectrum, gen->time, FFTW_BACKWARD, FFTW_ESTIMATE);
+    pthread_mutex_unlock(&fftw_mutex);
+    if (!gen->ifft)
+        goto error;
+
+    gen->symbol_pos = gen->symbol_len;
+    gen->rotation = 1;
+    gen->started = cu8 ? 1 : 2;
+    update_levels(gen);
+    return 0;
+
+error:
+    // leave the generator as it was, so that a later call can start it
+    fftwf_free(gen->spectrum);
+    fftwf_free(gen->time);
+    free(gen->shape);
+    free(gen->symbol);
+    gen->spectrum = gen->time = NULL;
+    gen->shape = NULL;
+    gen->symbol = NULL;
+    return 1;
+}
+
+static float complex next_sample(nrsc5_generator_t *gen)
+{
+    float complex v = 0;
+
+    if (gen->timing_offset > 0)
+    {
+        gen->timing_offset--;
+    }
+    else
+    {
+        if (gen->symbol_pos == gen->symbol_len)
+        {
+            next_symbol(gen);
+            gen->rotation /= cabsf(gen->rotation);
+        }
+        v = gen->symbol[gen->symbol_pos++] * gen->rotation;
+        gen->rotation *= gen->rotation_step;
+    }
+
+    if (gen->noise_std > 0)
+        v += gen->noise_std * complex_gaussian(&gen->noise_rng);
+    return v * gen->gain;
+}
+
+int nrsc5_generator_open(nrsc5_generator_t **result, int mode, unsigned int service_mode, unsigned int seed)
+{
+    nrsc5_generator_t *gen;
+
+    *result = NULL;
+    if (mode == NRSC5_MODE_FM)
+    {
+        if (service_mode != 1 && service_mode != 2 && service_mode != 3 && service_mode != 11)
+            return 1;
+    }
+    else if (mode == NRSC5_MODE_AM)
+    {
+        if (service_mode != 1 && service_mode != 3)
+            return 1;
+    }
+    else
+        return 1;
+
+    gen = calloc(1, sizeof(*gen));
+    if (!gen)
+        return 1;
+
+    gen->mode = mode;
+    gen->rng = seed_state(seed);
+    gen->noise_rng = seed_state(~(uint64_t)seed);
+    gen->snr = INFINITY;
+    gen->rs_enc = init_rs_char(8, 0x11d, 1, 1, 8);
+    if (!gen->rs_enc)
+        goto error;
+
+    gen->p1_stream.codec_mode = (mode == NRSC5_MODE_FM) ? 0 : 1;
+    gen->p1_stream.lc_bits = (mode == NRSC5_MODE_FM) ? 16 : 12;
+    gen->p1_stream.packets = (mode == NRSC5_MODE_FM) ? 32 : 4;
+
+    if (mode == NRSC5_MODE_FM)
+    {
+        strcpy(gen->short_name, "TEST-FM");
+        gen->psmi = service_mode;
+        gen->service_mode = service_mode;
+        gen->partitions = (service_mode == 11) ? 14 : PM_PARTITIONS + service_mode - 1;
+
+        gen->fm = calloc(1, sizeof(*gen->fm));
+        if (!gen->fm)
+            goto error;
+        if (service_mode == 2)
+            px_init(&gen->fm->px[gen->fm->num_px++], 1, P3_FRAME_LEN_FM / 2, 0, 1);
+        else if (service_mode != 1)
+            px_init(&gen->fm->px[gen->fm->num_px++], 1, P3_FRAME_LEN_FM, 0, 2);
+        if (service_mode == 11)
+            px_init(&gen->fm->px[gen->fm->num_px++], 2, P3_FRAME_LEN_FM, 2, 2);
+    }
+    else
+    {
+        strcpy(gen->short_name, "TEST");
+        gen->service_mode = (service_mode == 3) ? SERVICE_MODE_MA3 : SERVICE_MODE_MA1;
+        gen->psmi = gen->service_mode;
+
+        gen->am = calloc(1, sizeof(*gen->am));
+        if (!gen->am)
+            goto error;
+        gen->am->p3_stream.stream_id = 1;
+        gen->am->p3_stream.codec_mode = 1;
+        gen->am->p3_stream.lc_bits = 16;
+        gen->am->p3_stream.packets = 32;
+    }
+
+    *result = gen;
+    return 0;
+
+error:
+    nrsc5_generator_close(gen);
+    return 1;
+}
+
+void nrsc5_generator_close(nrsc5_generator_t *gen)
+{
+    if (!gen)
+        return;
+
+    if (gen->ifft)
+    {
+        pthread_mutex_lock(&fftw_mutex);
+        fftwf_destroy_plan(gen->ifft);
+        pthread_mutex_unlock(&fftw_mutex);
+    }
+    fftwf_free(gen->spectrum);
+    fftwf_free(gen->time);
+    free(gen->shape);
+    free(gen->symbol);
+    if (gen->rs_enc)
+        free_rs_char(gen->rs_enc);
+    free(gen->fm);
+    free(gen->am);
+    free(gen);
+}
+
+int nrsc5_generator_set_snr(nrsc5_generator_t *gen, float snr_db)
+{
+    if (isnan(snr_db))
+        return 1;
+
+    gen->snr = snr_db;
+    update_levels(gen);
+    return 0;
+}
+
+int nrsc5_generator_set_cfo(nrsc5_generator_t *gen, float hz)
+{
+    if (!isfinite(hz))
+        return 1;
+
+    gen->cfo = hz;
+    update_levels(gen);
+    return 0;
+}
+
+int nrsc5_generator_set_timing_offset(nrsc5_generator_t *gen, unsigned int samples)
+{
+    if (gen->started)
+        return 1;
+
+    gen->timing_offset = samples;
+    return 0;
+}
+
+int nrsc5_generator_set_station(nrsc5_generator_t *gen, const char *name, unsigned int facility_id)
+{
+    size_t len = strlen(name);
+
+    if (facility_id >= (1 << 19))
+        return 1;
+    if (len > 4 && strcmp(name + len - 3, "-FM") == 0)
+        len -= 3;
+    if (len > 4)
+        return 1;
+    for (size_t i = 0; i < len; i++)
+        if (!strchr(chars, name[i]) || name[i] == '\0')
+            return 1;
+
+    memset(gen->short_name, 0, sizeof(gen->short_name));
+    strncpy(gen->short_name, name, len);
+    while (strlen(gen->short_name) < 4)
+        strcat(gen->short_name, " ");
+    if (len != strlen(name))
+        strcat(gen->short_name, "-FM");
+    gen->facility_id = facility_id;
+    return 0;
+}
+
+int nrsc5_generator_set_packet_callback(nrsc5_generator_t *gen, nrsc5_generator_packet_callback_t callback, void *opaque)
+{
+    gen->packet_callback = callback;
+    gen->packet_opaque = opaque;
+    return 0;
+}
+
+int nrsc5_generator_read_cu8(nrsc5_generator_t *gen, uint8_t *samples, unsigned int length)
+{
+    if (length % 2 != 0)
+        return 1;
+    if (!gen->started && start(gen, 1) != 0)
+        return 1;
+    if (gen->started != 1)
+        return 1;
+
+    for (unsigned int i = 0; i < length; i += 2)
+    {
+        float complex v = next_sample(gen);
+        long re = 127 + lroundf(crealf(v) * 127);
+        long im = 127 + lroundf(cimagf(v) * 127);
+        samples[i] = re < 0 ? 0 : (re > 255 ? 255 : re);
+        samples[i + 1] = im < 0 ? 0 : (im > 255 ? 255 : im);
+    }
+    return 0;
+}
+
+int nrsc5_generator_read_cs16(nrsc5_generator_t *gen, int16_t *samples, unsigned int length)
+{
+    if (length % 2 != 0)
+        return 1;
+    if (!gen->started && start(gen, 0) != 0)
+        return 1;
+    if (gen->started != 2)
+        return 1;
+
+    for (unsigned int i = 0; i < length; i += 2)
+    {
+        float complex v = next_sample(gen);
+        long re = lroundf(crealf(v) * 32767);
+        long im = lroundf(cimagf(v) * 32767);
+        samples[i] = re < -32768 ? -32768 : (re > 32767 ? 32767 : re);
+        samples[i + 1] = im < -32768 ? -32768 : (im > 32767 ? 32767 : im);
+    }
+    return 0;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <complex.h>
+#include <fftw3.h>
+
+#include <nrsc5.h>
+
+#include "defines.h"
+
+// bits of the PM partitions in one OFDM symbol (FM)
+#define GENERATOR_PM_BITS 720
+// coded bits of one P3/P4 frame, and of the span of the P3/P4 interleaver
+#define GENERATOR_PX_CODED_MAX (P3_FRAME_LEN_FM * 2)
+#define GENERATOR_PX_SPAN_MAX 147456
+// encoded AM P1 frames of one interleaver period (8 blocks)
+#define GENERATOR_AM_P1_CODED (8 * P1_FRAME_LEN_ENCODED_AM)
+// interleaver periods in flight: the current one plus the diversity delay
+#define GENERATOR_AM_PERIODS 4
+#define GENERATOR_AM_MATRIX (PARTITION_WIDTH_AM * BLKSZ * 8)
+
+typedef struct
+{
+    unsigned int program;
+    unsigned int stream_id;
+    unsigned int codec_mode;
+    unsigned int lc_bits;
+    unsigned int packets;
+    unsigned int seq;
+} generator_stream_t;
+
+typedef struct
+{
+    generator_stream_t stream;
+    unsigned int frame_len;
+    unsigned int span;
+    unsigned int first_partition;
+    unsigned int partitions;
+    unsigned int delay[GENERATOR_PX_CODED_MAX];
+    uint8_t ring[GENERATOR_PX_SPAN_MAX * 2];
+    uint64_t encoded;
+    uint64_t sent;
+} generator_px_t;
+
+typedef struct
+{
+    uint8_t pm[GENERATOR_PM_BITS * BLKSZ * 16];
+    uint8_t ref[4][BLKSZ];
+    generator_px_t px[2];
+    unsigned int num_px;
+} generator_fm_t;
+
+typedef struct
+{
+    uint8_t p1[GENERATOR_AM_PERIODS][GENERATOR_AM_P1_CODED];
+    uint8_t p3[GENERATOR_AM_PERIODS][P3_FRAME_LEN_ENCODED_MA3];
+    uint8_t pl[GENERATOR_AM_MATRIX];
+    uint8_t pu[GENERATOR_AM_MATRIX];
+    uint8_t s[GENERATOR_AM_MATRIX];
+    uint8_t t[GENERATOR_AM_MATRIX];
+    uint8_t pids[2 * BLKSZ];
+    uint8_t ref[BLKSZ];
+    generator_stream_t p3_stream;
+    uint64_t period;
+} generator_am_t;
+
+struct nrsc5_generator_t
+{
+    int mode;
+    unsigned int service_mode;
+    unsigned int psmi;
+    unsigned int partitions;
+
+    uint64_t rng;
+    uint64_t noise_rng;
+
+    char short_name[8];
+    unsigned int facility_id;
+    nrsc5_generator_packet_callback_t packet_callback;
+    void *packet_opaque;
+
+    float snr;
+    float cfo;
+    unsigned int timing_offset;
+
+    int started;
+    unsigned int interp;
+    float sample_rate;
+    unsigned int fft;
+    unsigned int cp;
+    unsigned int symbol_len;
+    unsigned int window_offset;
+    float *shape;
+    float complex *spectrum;
+    float complex *time;
+    fftwf_plan ifft;
+    float complex *symbol;
+    unsigned int symbol_pos;
+    unsigned int symbol_idx;
+    uint64_t block;
+
+    float carrier;
+    float carrier_power;
+    float digital_power;
+    float gain;
+    float noise_std;
+    float complex rotation;
+    float complex rotation_step;
+
+    void *rs_enc;
+    generator_stream_t p1_stream;
+    uint8_t pdu[MAX_PDU_LEN];
+    uint8_t payload[MAX_PDU_LEN];
+    uint8_t bits[P1_FRAME_LEN_FM];
+    uint8_t coded[P1_FRAME_LEN_ENCODED_FM];
+
+    generator_fm_t *fm;
+    generator_am_t *am;
+};
+
+void generator_p1_frame(nrsc5_generator_t *gen, uint8_t *bits);
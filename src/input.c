@@ -19,6 +19,14 @@
 #include <math.h>
 #include <string.h>
 
+#ifdef HAVE_NEON
+#include <arm_neon.h>
+#endif
+
+#ifdef HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
 #include "defines.h"
 #include "input.h"
 #include "private.h"
@@ -38,149 +46,607 @@ static float decim_taps[] = {
     -0.00410953676328063
 };
 
-int input_shift(input_t *st, unsigned int cnt)
+/*
+ * Returns where to write cnt samples in the ring, which are added by
+ * input_produce(). Returns NULL if they do not fit.
+ */
+static cint16_t *input_reserve(input_t *st, unsigned int cnt)
 {
-    if (cnt + st->avail > INPUT_BUF_LEN)
+    cint16_t *out = ringbuf_write_ptr(&st->ring, cnt * sizeof(cint16_t));
+
+    if (out == NULL)
     {
-        if (st->avail > st->used)
-        {
-            memmove(&st->buffer[0], &st->buffer[st->used], (st->avail - st->used) * sizeof(st->buffer[0]));
-            st->avail -= st->used;
-            st->used = 0;
-        }
-        else
-        {
-            st->avail = 0;
-            st->used = 0;
-        }
+        log_error("input buffer overflow!");
+        st->radio->stats.input_overflows++;
     }
+    return out;
+}
+
+static void input_produce(input_t *st, unsigned int cnt)
+{
+    ringbuf_produce(&st->ring, cnt * sizeof(cint16_t));
+}
+
+// Samples in the ring that have not been handed to acquisition yet.
+unsigned int input_pending(const input_t *st)
+{
+    return ringbuf_used(&st->ring) / sizeof(cint16_t) - st->acq.idx;
+}
+
+// Rate of the input buffer, and of cs16 samples unless another is set.
+static double input_native_rate(const input_t *st)
+{
+    return (st->radio->mode == NRSC5_MODE_FM) ? NRSC5_SAMPLE_RATE_CS16_FM : NRSC5_SAMPLE_RATE_CS16_AM;
+}
+
+/*
+ * Returns the resampler for samples that should arrive at the native rate
+ * of their format, or NULL if they do. It is rebuilt when the input rate
+ * or the mode changes.
+ */
+static resampler_t *input_resampler(input_t *st, double native)
+{
+    double ratio;
 
-    if (cnt + st->avail > INPUT_BUF_LEN)
+    if (st->rate == 0)
     {
-        log_error("input buffer overflow!");
-        return -1;
+        resampler_free(st->resampler);
+        st->resampler = NULL;
+        return NULL;
     }
 
-    return 0;
+    ratio = native / st->rate;
+    if (ratio < RESAMPLER_MIN_RATIO || ratio > RESAMPLER_MAX_RATIO)
+    {
+        log_error("Input rate of %.0f Hz is out of range, expected about %.0f Hz", st->rate, native);
+        st->rate = 0;
+        return NULL;
+    }
+
+    if (!st->resampler || resampler_ratio(st->resampler) != ratio)
+    {
+        resampler_free(st->resampler);
+        st->resampler = resampler_create(ratio);
+        if (!st->resampler)
+            log_error("Failed to create resampler");
+    }
+    return st->resampler;
+}
+
+static void input_update_stats(input_t *st, unsigned int samples)
+{
+    if (stats_count(&st->radio->stats, samples, input_native_rate(st)))
+        nrsc5_report_stats(st->radio);
 }
 
 void input_push(input_t *st)
 {
-    while (st->avail - st->used >= (st->radio->mode == NRSC5_MODE_FM ? FFTCP_FM : FFTCP_AM))
+    stats_input_fill(&st->radio->stats, input_pending(st));
+    while (input_pending(st) >= (st->radio->mode == NRSC5_MODE_FM ? FFTCP_FM : FFTCP_AM))
     {
-        st->used += acquire_push(&st->acq, &st->buffer[st->used], st->avail - st->used);
+        unsigned int consumed = acquire_push(&st->acq, input_pending(st));
+
+        st->position += consumed;
         acquire_process(&st->acq);
     }
 }
 
 void input_push_cu8(input_t *st, const uint8_t *buf, uint32_t len)
 {
-    unsigned int i;
+    resampler_t *resampler = input_resampler(st, NRSC5_SAMPLE_RATE_CU8);
+    cint16_t *out;
+    unsigned int i, n, produced = 0;
     assert(len % 4 == 0);
 
-    nrsc5_report_iq(st->radio, buf, len);
+    if (nrsc5_event_enabled(st->radio, NRSC5_EVENT_IQ))
+        nrsc5_report_iq(st->radio, buf, len);
+    nrsc5_record_samples(st->radio, IQFILE_FORMAT_CU8, buf, len);
+#ifdef USE_RTLSDR
+    if (st->radio->iq_server)
+        iq_server_push(st->radio->iq_server, buf, len);
+#endif
 
-    if (input_shift(st, len / 4) != 0)
+    out = input_reserve(st, resampler ? resampler_max_output(resampler, len / 4) : len / 4);
+    if (out == NULL)
         return;
 
-    for (i = 0; i < len; i += 4)
+    stats_begin(&st->radio->stats, NRSC5_STAGE_DECIMATE);
+    for (i = 0; i < len; i += n * 2)
     {
-        cint16_t x[2];
+        cint16_t *x = st->decim_buf;
+        cint16_t *y = resampler ? x : &out[produced];
+        unsigned int count;
 
-        x[0].r = U8_Q15(buf[i]);
-        x[0].i = U8_Q15(buf[i + 1]);
-        x[1].r = U8_Q15(buf[i + 2]);
-        x[1].i = U8_Q15(buf[i + 3]);
+        n = (len - i) / 2;
+        if (n > DECIM_BLOCK)
+            n = DECIM_BLOCK;
 
         if (st->radio->mode == NRSC5_MODE_FM)
         {
-            halfband_q15_execute(st->decim[0], x, &st->buffer[st->avail++]);
+            for (unsigned int j = 0; j < n; j++)
+            {
+                x[j].r = U8_Q15(buf[i + j * 2]);
+                x[j].i = U8_Q15(buf[i + j * 2 + 1]);
+            }
+            count = halfband_q15_decimate(st->decim[0], x, n, y);
         }
         else
         {
-            x[0].r >>= 4;
-            x[0].i >>= 4;
-            x[1].r >>= 4;
-            x[1].i >>= 4;
-
-            halfband_q15_execute(st->decim[0], x, &st->stages[0][st->offset & 1]);
-            if ((st->offset & 0x1) == 0x1) {
-                halfband_q15_execute(st->decim[1], st->stages[0], &st->stages[1][(st->offset >> 1) & 1]);
+            for (unsigned int j = 0; j < n; j++)
+            {
+                x[j].r = U8_Q15(buf[i + j * 2]) >> 4;
+                x[j].i = U8_Q15(buf[i + j * 2 + 1]) >> 4;
             }
-            if ((st->offset & 0x3) == 0x3) {
-                halfband_q15_execute(st->decim[2], st->stages[1], &st->stages[2][(st->offset >> 2) & 1]);
-            }
-            if ((st->offset & 0x7) == 0x7) {
-                halfband_q15_execute(st->decim[3], st->stages[2], &st->stages[3][(st->offset >> 3) & 1]);
-            }
-            if ((st->offset & 0xf) == 0xf) {
-                halfband_q15_execute(st->decim[4], st->stages[3], &st->buffer[st->avail++]);
-            }
-            st->offset++;
+
+            // each stage decimates the block in place, the last one into y
+            count = n;
+            for (int k = 0; k < AM_DECIM_STAGES - 1; k++)
+                count = halfband_q15_decimate(st->decim[k], x, count, x);
+            count = halfband_q15_decimate(st->decim[AM_DECIM_STAGES - 1], x, count, y);
         }
+
+        if (resampler)
+            count = resampler_execute(resampler, x, count, &out[produced]);
+        produced += count;
     }
+    stats_end(&st->radio->stats);
 
+    input_produce(st, produced);
     input_push(st);
+    input_update_stats(st, produced);
 }
 
 void input_push_cs16(input_t *st, const int16_t *buf, uint32_t len)
 {
+    resampler_t *resampler = input_resampler(st, input_native_rate(st));
+    cint16_t *out;
+    unsigned int count;
     assert(len % 2 == 0);
 
-    if (input_shift(st, len / 2) != 0)
-        return;
+    nrsc5_record_samples(st->radio, IQFILE_FORMAT_CS16, buf, len * sizeof(int16_t));
 
-    memcpy(&st->buffer[st->avail], buf, len * sizeof(int16_t));
-    st->avail += len / 2;
+    if (resampler)
+    {
+        if ((out = input_reserve(st, resampler_max_output(resampler, len / 2))) == NULL)
+            return;
+        count = resampler_execute(resampler, (const cint16_t *)buf, len / 2, out);
+    }
+    else
+    {
+        if ((out = input_reserve(st, len / 2)) == NULL)
+            return;
+        memcpy(out, buf, len * sizeof(int16_t));
+        count = len / 2;
+    }
+    input_produce(st, count);
 
     input_push(st);
+    input_update_stats(st, count);
+}
+
+/*
+ * Converts interleaved float samples to Q15. Values are scaled by 32767,
+ * clamped to the 16-bit range and rounded half away from zero, as
+ * lroundf() does.
+ */
+static void convert_cf32(cint16_t *out, const float *in, unsigned int count)
+{
+    unsigned int n = 0;
+
+#if defined(HAVE_SSE2)
+    const __m128 scale = _mm_set1_ps(32767), lo = _mm_set1_ps(-32768), hi = _mm_set1_ps(32767);
+    const __m128 sign = _mm_set1_ps(-0.0f), half = _mm_set1_ps(0.5f);
+    for (; n + 4 <= count; n += 4)
+    {
+        __m128 a = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(&in[2 * n]), scale), lo), hi);
+        __m128 b = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(&in[2 * n + 4]), scale), lo), hi);
+
+        a = _mm_add_ps(a, _mm_or_ps(_mm_and_ps(a, sign), half));
+        b = _mm_add_ps(b, _mm_or_ps(_mm_and_ps(b, sign), half));
+        _mm_storeu_si128((__m128i *)&out[n], _mm_packs_epi32(_mm_cvttps_epi32(a), _mm_cvttps_epi32(b)));
+    }
+#elif defined(HAVE_NEON)
+    const uint32x4_t sign = vdupq_n_u32(0x80000000);
+    const float32x4_t lo = vdupq_n_f32(-32768), hi = vdupq_n_f32(32767), half = vdupq_n_f32(0.5f);
+    for (; n + 4 <= count; n += 4)
+    {
+        float32x4_t a = vminq_f32(vmaxq_f32(vmulq_n_f32(vld1q_f32(&in[2 * n]), 32767), lo), hi);
+        float32x4_t b = vminq_f32(vmaxq_f32(vmulq_n_f32(vld1q_f32(&in[2 * n + 4]), 32767), lo), hi);
+
+        a = vaddq_f32(a, vbslq_f32(sign, a, half));
+        b = vaddq_f32(b, vbslq_f32(sign, b, half));
+        vst1q_s16((int16_t *)&out[n], vcombine_s16(vqmovn_s32(vcvtq_s32_f32(a)), vqmovn_s32(vcvtq_s32_f32(b))));
+    }
+#endif
+
+    for (; n < count; n++)
+    {
+        out[n].r = lroundf(fmaxf(fminf(in[2 * n] * 32767, 32767), -32768));
+        out[n].i = lroundf(fmaxf(fminf(in[2 * n + 1] * 32767, 32767), -32768));
+    }
+}
+
+// Converts interleaved signed 8-bit samples to Q15.
+static void convert_cs8(cint16_t *out, const int8_t *in, unsigned int count)
+{
+    unsigned int n = 0;
+
+#if defined(HAVE_SSE2)
+    for (; n + 8 <= count; n += 8)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)&in[2 * n]);
+
+        // placing each byte in the high half multiplies it by 256
+        _mm_storeu_si128((__m128i *)&out[n], _mm_unpacklo_epi8(_mm_setzero_si128(), x));
+        _mm_storeu_si128((__m128i *)&out[n + 4], _mm_unpackhi_epi8(_mm_setzero_si128(), x));
+    }
+#elif defined(HAVE_NEON)
+    for (; n + 8 <= count; n += 8)
+    {
+        int8x16_t x = vld1q_s8(&in[2 * n]);
+
+        vst1q_s16((int16_t *)&out[n], vshll_n_s8(vget_low_s8(x), 8));
+        vst1q_s16((int16_t *)&out[n + 4], vshll_n_s8(vget_high_s8(x), 8));
+    }
+#endif
+
+    for (; n < count; n++)
+    {
+        out[n].r = in[2 * n] * 256;
+        out[n].i = in[2 * n + 1] * 256;
+    }
+}
+
+// Interleaves separate I and Q arrays.
+static void convert_planar(cint16_t *out, const int16_t *i, const int16_t *q, unsigned int count)
+{
+    unsigned int n = 0;
+
+#if defined(HAVE_SSE2)
+    for (; n + 8 <= count; n += 8)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i *)&i[n]);
+        __m128i b = _mm_loadu_si128((const __m128i *)&q[n]);
+
+        _mm_storeu_si128((__m128i *)&out[n], _mm_unpacklo_epi16(a, b));
+        _mm_storeu_si128((__m128i *)&out[n + 4], _mm_unpackhi_epi16(a, b));
+    }
+#elif defined(HAVE_NEON)
+    for (; n + 8 <= count; n += 8)
+    {
+        int16x8x2_t x = { { vld1q_s16(&i[n]), vld1q_s16(&q[n]) } };
+
+        vst2q_s16((int16_t *)&out[n], x);
+    }
+#endif
+
+    for (; n < count; n++)
+    {
+        out[n].r = i[n];
+        out[n].i = q[n];
+    }
+}
+
+/*
+ * Returns where to convert up to *count samples: straight into the input
+ * buffer, or into decim_buf when they still have to be resampled, in
+ * which case *count may be reduced. Returns NULL on overflow.
+ */
+static cint16_t *input_target(input_t *st, uint32_t *count)
+{
+    if (!input_resampler(st, input_native_rate(st)))
+        return input_reserve(st, *count);
+
+    if (*count > DECIM_BLOCK)
+        *count = DECIM_BLOCK;
+    return st->decim_buf;
+}
+
+/*
+ * Takes count samples converted by the caller at x, as returned by
+ * input_target(). The recorder is fed the converted samples, so
+ * recordings of these formats are always cs16.
+ */
+static void input_commit(input_t *st, const cint16_t *x, unsigned int count)
+{
+    nrsc5_record_samples(st->radio, IQFILE_FORMAT_CS16, x, count * sizeof(cint16_t));
+
+    if (x == st->decim_buf)
+    {
+        cint16_t *out = input_reserve(st, resampler_max_output(st->resampler, count));
+        if (out == NULL)
+            return;
+        count = resampler_execute(st->resampler, x, count, out);
+    }
+    input_produce(st, count);
+
+    input_push(st);
+    input_update_stats(st, count);
+}
+
+void input_push_cf32(input_t *st, const float *buf, uint32_t count)
+{
+    for (uint32_t done = 0, n; done < count; done += n)
+    {
+        cint16_t *x;
+
+        n = count - done;
+        if (!(x = input_target(st, &n)))
+            return;
+
+        stats_begin(&st->radio->stats, NRSC5_STAGE_DECIMATE);
+        convert_cf32(x, &buf[done * 2], n);
+        stats_end(&st->radio->stats);
+
+        input_commit(st, x, n);
+    }
+}
+
+void input_push_cs8(input_t *st, const int8_t *buf, uint32_t count)
+{
+    for (uint32_t done = 0, n; done < count; done += n)
+    {
+        cint16_t *x;
+
+        n = count - done;
+        if (!(x = input_target(st, &n)))
+            return;
+
+        stats_begin(&st->radio->stats, NRSC5_STAGE_DECIMATE);
+        convert_cs8(x, &buf[done * 2], n);
+        stats_end(&st->radio->stats);
+
+        input_commit(st, x, n);
+    }
+}
+
+void input_push_cs16_planar(input_t *st, const int16_t *i, const int16_t *q, uint32_t count)
+{
+    for (uint32_t done = 0, n; done < count; done += n)
+    {
+        cint16_t *x;
+
+        n = count - done;
+        if (!(x = input_target(st, &n)))
+            return;
+
+        stats_begin(&st->radio->stats, NRSC5_STAGE_DECIMATE);
+        convert_planar(x, &i[done], &q[done], n);
+        stats_end(&st->radio->stats);
+
+        input_commit(st, x, n);
+    }
+}
+
+static sync_cache_entry_t *sync_cache_find(input_t *st)
+{
+    for (int i = 0; i < SYNC_CACHE_ENTRIES; i++)
+    {
+        sync_cache_entry_t *entry = &st->sync_cache[i];
+        if (entry->freq == st->freq && entry->mode == st->radio->mode)
+            return entry;
+    }
+    return NULL;
+}
+
+static void sync_cache_store(input_t *st)
+{
+    sync_cache_entry_t *entry;
+
+    if (st->freq == 0 || st->sync_state != SYNC_STATE_FINE)
+        return;
+
+    entry = sync_cache_find(st);
+    if (!entry)
+    {
+        // replace an unused entry, or else the least recently used one
+        entry = &st->sync_cache[0];
+        for (int i = 1; i < SYNC_CACHE_ENTRIES && entry->freq != 0; i++)
+        {
+            if (st->sync_cache[i].freq == 0 || st->sync_cache[i].last_used < entry->last_used)
+                entry = &st->sync_cache[i];
+        }
+    }
+
+    entry->freq = st->freq;
+    entry->mode = st->radio->mode;
+    entry->cfo = st->acq.cfo;
+    entry->angle = st->acq.prev_angle;
+    entry->psmi = st->sync.psmi;
+    entry->last_used = ++st->sync_cache_clock;
+}
+
+static void sync_cache_load(input_t *st)
+{
+    sync_cache_entry_t *entry;
+
+    if (st->freq == 0 || (entry = sync_cache_find(st)) == NULL)
+        return;
+
+    st->acq.cfo = entry->cfo;
+    st->acq.prev_angle = entry->angle;
+    st->sync.psmi = entry->psmi;
+    st->sync.warm_psmi = entry->psmi;
+    entry->last_used = ++st->sync_cache_clock;
 }
 
 void input_reset(input_t *st)
 {
-    st->avail = 0;
-    st->used = 0;
-    st->offset = 0;
+    ringbuf_reset(&st->ring);
+    st->position = 0;
+    st->symbol_end = 0;
 
     input_set_sync_state(st, SYNC_STATE_NONE);
     for (int i = 0; i < AM_DECIM_STAGES; i++)
-        firdecim_q15_reset(st->decim[i]);
+        halfband_q15_reset(st->decim[i]);
+    if (st->resampler)
+        resampler_reset(st->resampler);
     acquire_reset(&st->acq);
     decode_reset(&st->decode);
     frame_reset(&st->frame);
     sync_reset(&st->sync);
+    sync_cache_load(st);
+}
+
+void input_set_rate(input_t *st, float rate)
+{
+    // the resampler is rebuilt by the next push, once the format is known
+    st->rate = rate;
+}
+
+/*
+ * Steers the resampler with the timing error that sync measured over the
+ * last block, so that an offset of the sample clock is absorbed there
+ * rather than by acquisition shifting its window every few blocks.
+ */
+void input_track_timing(input_t *st, int samperr)
+{
+    float block = BLKSZ * ((st->radio->mode == NRSC5_MODE_FM) ? FFTCP_FM : FFTCP_AM);
+    double correction;
+
+    if (!st->resampler || samperr == 0)
+        return;
+
+    correction = resampler_correction(st->resampler) + RESAMPLER_TRACKING_GAIN * samperr / block;
+    if (correction > RESAMPLER_MAX_CORRECTION)
+        correction = RESAMPLER_MAX_CORRECTION;
+    else if (correction < -RESAMPLER_MAX_CORRECTION)
+        correction = -RESAMPLER_MAX_CORRECTION;
+    resampler_set_correction(st->resampler, correction);
+}
+
+void input_set_frequency(input_t *st, float freq)
+{
+    sync_cache_store(st);
+    st->freq = freq;
+    input_reset(st);
 }
 
-void input_init(input_t *st, nrsc5_t *radio, output_t *output)
+int input_init(input_t *st, nrsc5_t *radio, output_t *output)
 {
+    int err = 0;
+
     st->radio = radio;
     st->output = output;
     st->sync_state = SYNC_STATE_NONE;
 
+    pthread_mutex_init(&st->scan.mutex, NULL);
+    pthread_cond_init(&st->scan.cond, NULL);
+    st->scan.active = 0;
+    st->scan.psmi = -1;
+
+    st->freq = radio->freq;
+    memset(st->sync_cache, 0, sizeof(st->sync_cache));
+    st->sync_cache_clock = 0;
+
+    for (int i = 0; i < AM_DECIM_STAGES; i++)
+        st->decim[i] = halfband_q15_create(decim_taps, sizeof(decim_taps) / sizeof(decim_taps[0]));
+    st->rate = 0;
+    st->resampler = NULL;
+    // every stage is initialized, so that input_free() can undo a failure
+    if (ringbuf_init(&st->ring, (INPUT_BUF_LEN + FFTCP_FM * (ACQUIRE_SYMBOLS + 1)) * sizeof(cint16_t)) != 0)
+        err = 1;
+    err |= acquire_init(&st->acq, st);
+    err |= decode_init(&st->decode, st);
+    err |= frame_init(&st->frame, st);
+    err |= sync_init(&st->sync, st);
     for (int i = 0; i < AM_DECIM_STAGES; i++)
-        st->decim[i] = firdecim_q15_create(decim_taps, sizeof(decim_taps) / sizeof(decim_taps[0]));
+        err |= !st->decim[i];
 
-    acquire_init(&st->acq, st);
-    decode_init(&st->decode, st);
-    frame_init(&st->frame, st);
-    sync_init(&st->sync, st);
+    if (err)
+    {
+        log_error("Failed to allocate input state");
+        input_free(st);
+        return 1;
+    }
 
     input_reset(st);
+    return 0;
 }
 
-void input_set_mode(input_t *st)
+/*
+ * Switches the stages to a new mode. Each stage keeps its state if it
+ * cannot allocate the new one, so on failure the stages that had already
+ * switched are put back and the radio stays in its previous mode.
+ */
+int input_set_mode(input_t *st, int mode)
 {
-    acquire_set_mode(&st->acq, st->radio->mode);
+    int prev = st->radio->mode;
+
+    if (acquire_set_mode(&st->acq, mode) != 0
+        || decode_set_mode(&st->decode, mode) != 0
+        || sync_set_mode(&st->sync, mode) != 0)
+    {
+        log_error("Failed to allocate state for the new mode");
+        if (acquire_set_mode(&st->acq, prev) != 0
+            || decode_set_mode(&st->decode, prev) != 0
+            || sync_set_mode(&st->sync, prev) != 0)
+            log_error("Failed to restore the previous mode");
+        input_reset(st);
+        return 1;
+    }
+
+    st->radio->mode = mode;
     input_reset(st);
+    return 0;
 }
 
 void input_free(input_t *st)
 {
     acquire_free(&st->acq);
+    decode_free(&st->decode);
     frame_free(&st->frame);
+    sync_free(&st->sync);
 
     for (int i = 0; i < AM_DECIM_STAGES; i++)
-        firdecim_q15_free(st->decim[i]);
+        halfband_q15_free(st->decim[i]);
+    resampler_free(st->resampler);
+    ringbuf_free(&st->ring);
+
+    pthread_cond_destroy(&st->scan.cond);
+    pthread_mutex_destroy(&st->scan.mutex);
+}
+
+size_t input_memory_usage(const input_t *st)
+{
+    return st->ring.size
+         + acquire_memory_usage(&st->acq)
+         + decode_memory_usage(&st->decode)
+         + frame_memory_usage(&st->frame)
+         + sync_memory_usage(&st->sync);
+}
+
+void input_scan_arm(input_t *st)
+{
+    pthread_mutex_lock(&st->scan.mutex);
+    st->scan.active = 1;
+    st->scan.blocks = 0;
+    st->scan.cp_metric = 0;
+    st->scan.ref_metric = 0;
+    st->scan.psmi = -1;
+    st->scan.block_cp_metric = 0;
+    st->scan.block_ref_metric = 0;
+    pthread_mutex_unlock(&st->scan.mutex);
+}
+
+// Folds the maxima of the current block into the metrics. Called with the lock held.
+static void input_scan_publish(input_t *st)
+{
+    if (st->scan.block_cp_metric > st->scan.cp_metric)
+        st->scan.cp_metric = st->scan.block_cp_metric;
+    if (st->scan.block_ref_metric > st->scan.ref_metric)
+        st->scan.ref_metric = st->scan.block_ref_metric;
+    st->scan.block_cp_metric = 0;
+    st->scan.block_ref_metric = 0;
+}
+
+void input_scan_block(input_t *st)
+{
+    pthread_mutex_lock(&st->scan.mutex);
+    input_scan_publish(st);
+    st->scan.blocks++;
+    pthread_cond_broadcast(&st->scan.cond);
+    pthread_mutex_unlock(&st->scan.mutex);
 }
 
 void input_set_sync_state(input_t *st, unsigned int new_state)
@@ -196,6 +662,13 @@ void input_set_sync_state(input_t *st, unsigned int new_state)
                           * (st->radio->mode == NRSC5_MODE_FM ? NRSC5_SAMPLE_RATE_CS16_FM : NRSC5_SAMPLE_RATE_CS16_AM)
                           / (2 * M_PI * st->acq.fft);
         nrsc5_report_sync(st->radio, freq_offset, st->sync.psmi);
+
+        // sync_state belongs to this thread, so a scan learns of sync here
+        pthread_mutex_lock(&st->scan.mutex);
+        input_scan_publish(st);
+        st->scan.psmi = st->sync.psmi;
+        pthread_cond_broadcast(&st->scan.cond);
+        pthread_mutex_unlock(&st->scan.mutex);
     }
 
     st->sync_state = new_state;
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <pthread.h>
 #include <stdint.h>
 #include <complex.h>
 
@@ -11,23 +12,68 @@
 #include "firdecim_q15.h"
 #include "frame.h"
 #include "output.h"
+#include "resampler.h"
+#include "ringbuf.h"
 #include "sync.h"
 
 #define INPUT_BUF_LEN (FFTCP_FM * 512)
 #define AM_DECIM_STAGES 5
+#define DECIM_BLOCK 4096
+#define RESAMPLER_MIN_RATIO (1.0 / 64)
+#define RESAMPLER_MAX_RATIO 4.0
+#define RESAMPLER_TRACKING_GAIN 0.25
+#define RESAMPLER_MAX_CORRECTION 500e-6
+#define SYNC_CACHE_ENTRIES 16
 
 enum { SYNC_STATE_NONE, SYNC_STATE_COARSE, SYNC_STATE_FINE };
 
+typedef struct
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    _Atomic int active;    // read by the processing thread without the lock
+    unsigned int blocks;   // acquisition blocks processed since the scan was armed
+    float cp_metric;       // best cyclic prefix correlation, peak to average
+    float ref_metric;      // best reference subcarrier coherence, 0 to 1
+    int psmi;              // PSMI once fine sync was reached, otherwise -1
+    // maxima of the current block, kept by the processing thread without
+    // the lock and folded into the metrics above by input_scan_block()
+    float block_cp_metric;
+    float block_ref_metric;
+} input_scan_t;
+
+/*
+ * Synchronization parameters of a station that was received before, so that
+ * retuning to it can skip most of the acquisition search. Sample timing is
+ * not kept, as the sample stream restarts on every retune.
+ */
+typedef struct
+{
+    float freq;             // 0 if the entry is unused
+    int mode;
+    int cfo;                // integer frequency offset, in subcarriers
+    float angle;            // fine frequency offset tracked by the Costas loops
+    int psmi;
+    unsigned int last_used;
+} sync_cache_entry_t;
+
 typedef struct input_t
 {
     nrsc5_t *radio;
     output_t *output;
 
-    firdecim_q15 decim[AM_DECIM_STAGES];
-    cint16_t stages[AM_DECIM_STAGES][2];
-    cint16_t buffer[INPUT_BUF_LEN];
-    unsigned int avail, used, offset;
+    halfband_q15 decim[AM_DECIM_STAGES];
+    cint16_t decim_buf[DECIM_BLOCK];
+    float rate;             // input sample rate, 0 for the native rate of the format
+    resampler_t *resampler;
+    ringbuf_t ring;      // samples held by acquisition, then those not pushed to it yet
+    uint64_t position;   // samples consumed by acquisition since the last reset
+    uint64_t symbol_end; // input sample following the OFDM symbol being demodulated
     unsigned int sync_state;
+    input_scan_t scan;
+    float freq;
+    sync_cache_entry_t sync_cache[SYNC_CACHE_ENTRIES];
+    unsigned int sync_cache_clock;
 
     acquire_t acq;
     decode_t decode;
@@ -35,10 +81,20 @@ typedef struct input_t
     sync_t sync;
 } input_t;
 
-void input_init(input_t *st, nrsc5_t *radio, output_t *output);
-void input_set_mode(input_t *st);
+int input_init(input_t *st, nrsc5_t *radio, output_t *output);
+int input_set_mode(input_t *st, int mode);
 void input_reset(input_t *st);
+void input_set_frequency(input_t *st, float freq);
+void input_set_rate(input_t *st, float rate);
+void input_track_timing(input_t *st, int samperr);
 void input_free(input_t *st);
+size_t input_memory_usage(const input_t *st);
+unsigned int input_pending(const input_t *st);
 void input_set_sync_state(input_t *st, unsigned int new_state);
 void input_push_cu8(input_t *st, const uint8_t *buf, uint32_t len);
 void input_push_cs16(input_t *st, const int16_t *buf, uint32_t len);
+void input_push_cs16_planar(input_t *st, const int16_t *i, const int16_t *q, uint32_t count);
+void input_push_cs8(input_t *st, const int8_t *buf, uint32_t count);
+void input_push_cf32(input_t *st, const float *buf, uint32_t count);
+void input_scan_arm(input_t *st);
+void input_scan_block(input_t *st);
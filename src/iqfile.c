@@ -0,0 +1,927 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Chunked IQ recordings.
+ *
+ * All fields are little-endian. The file starts with a header:
+ *
+ *    0  magic "NRSC5IQ\x1a"
+ *    8  u16 version
+ *   10  u8  sample format (IQFILE_FORMAT_*)
+ *   11  u8  mode (NRSC5_MODE_*)
+ *   12  u32 sample rate
+ *   16  u32 complex samples per chunk
+ *   20  f32 frequency in Hz
+ *   24  f32 gain in dB, NaN if unknown
+ *   28  u32 reserved
+ *   32  i64 start time, microseconds since the Unix epoch
+ *
+ * followed by chunks, each with a header and a payload:
+ *
+ *    0  magic "IQCK"
+ *    4  u8  codec (CODEC_*), 3 bytes reserved
+ *    8  u32 payload size
+ *   12  u32 decoded size in bytes
+ *   16  u64 index of the first sample
+ *   24  i64 time the first sample was received
+ *
+ * When the recording is closed, an index block ("IQIX", u32 count, then
+ * first sample, file offset and time of each chunk) and a trailer are
+ * appended. The trailer is the last 32 bytes of the file:
+ *
+ *    0  u64 offset of the index block
+ *    8  u64 total number of samples
+ *   16  i64 time the recording ended
+ *   24  u32 number of chunks
+ *   28  magic "IQTR"
+ *
+ * A recording that was cut short has no index; it still plays linearly, and
+ * the index is rebuilt from the chunk headers when the file is seekable.
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "defines.h"
+#include "iqfile.h"
+
+#define IQFILE_VERSION 1
+#define HEADER_LEN 40
+#define CHUNK_HEADER_LEN 32
+#define INDEX_ENTRY_LEN 24
+#define TRAILER_LEN 32
+
+#define CODEC_RAW 0
+#define CODEC_PACKED 1
+
+// Values per group of the packed codec. Must be even so that groups
+// start on an I value.
+#define PACK_GROUP 32
+
+// Decoded chunks buffered ahead of the decoder.
+#define READ_SLOTS 4
+// Bytes per read of a raw capture.
+#define RAW_READ_BYTES (1 << 18)
+#define MAX_CHUNK_SAMPLES (1 << 20)
+
+static const uint8_t file_magic[8] = { 'N', 'R', 'S', 'C', '5', 'I', 'Q', 0x1a };
+
+typedef struct
+{
+    uint64_t first_sample;
+    uint64_t offset;
+    int64_t time;
+} index_entry_t;
+
+struct iqfile_writer_t
+{
+    FILE *fp;
+    int format;
+    int compress;
+    unsigned int sample_bytes;
+    uint8_t *chunk;
+    size_t chunk_len;
+    size_t chunk_size;
+    uint8_t *packed;
+    int64_t chunk_time;
+    uint64_t samples;
+    uint64_t offset;
+    uint64_t stored;
+    index_entry_t *index;
+    size_t index_len;
+    size_t index_capacity;
+    int failed;
+};
+
+struct iqfile_reader_t
+{
+    FILE *fp;
+    int container;
+    iqfile_info_t info;
+    unsigned int sample_bytes;
+    index_entry_t *index;
+    size_t index_len;
+
+    // bytes of a raw capture consumed while probing for the header
+    uint8_t prefix[sizeof(file_magic)];
+    size_t prefix_len;
+    // bytes to drop from the first chunk after a seek
+    size_t skip;
+    uint8_t *packed;
+    size_t packed_size;
+
+    uint8_t *slots[READ_SLOTS];
+    size_t slot_len[READ_SLOTS];
+    size_t slot_start[READ_SLOTS];
+    size_t slot_size;
+    unsigned int head;
+    unsigned int tail;
+    int holding;
+    int eof;
+    int stop;
+    int running;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+
+    struct timespec start;
+    uint64_t handed;
+    uint64_t decoded;
+    double elapsed;
+};
+
+static void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    for (int i = 0; i < 4; i++)
+        p[i] = v >> (8 * i);
+}
+
+static void put_u64(uint8_t *p, uint64_t v)
+{
+    for (int i = 0; i < 8; i++)
+        p[i] = v >> (8 * i);
+}
+
+static void put_f32(uint8_t *p, float f)
+{
+    uint32_t v;
+    memcpy(&v, &f, sizeof(v));
+    put_u32(p, v);
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    uint32_t v = 0;
+    for (int i = 3; i >= 0; i--)
+        v = (v << 8) | p[i];
+    return v;
+}
+
+static uint64_t get_u64(const uint8_t *p)
+{
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--)
+        v = (v << 8) | p[i];
+    return v;
+}
+
+static float get_f32(const uint8_t *p)
+{
+    uint32_t v = get_u32(p);
+    float f;
+    memcpy(&f, &v, sizeof(f));
+    return f;
+}
+
+static int64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static unsigned int value_bytes(int format)
+{
+    return format == IQFILE_FORMAT_CU8 ? 1 : 2;
+}
+
+static size_t packed_capacity(size_t raw_size)
+{
+    // one width byte per group, plus one byte of padding for a partial group
+    return raw_size + 2 * (raw_size / PACK_GROUP + 1);
+}
+
+static inline uint32_t zigzag(int32_t d)
+{
+    return ((uint32_t)d << 1) ^ (uint32_t)(d >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t z)
+{
+    return (int32_t)(z >> 1) ^ -(int32_t)(z & 1);
+}
+
+/*
+ * Lossless packing: each value is replaced by its difference from the
+ * previous value of the same channel, wrapped to the sample width and
+ * zigzag mapped. Groups of PACK_GROUP differences are then stored with the
+ * bit width of their largest member. Captures are oversampled, so the
+ * differences are typically a few bits narrower than the samples.
+ */
+static size_t pack(const void *in, size_t count, int format, uint8_t *out)
+{
+    const uint8_t *u8 = in;
+    const int16_t *s16 = in;
+    int32_t prev[2] = { 0, 0 };
+    uint32_t z[PACK_GROUP];
+    size_t n = 0;
+
+    for (size_t i = 0; i < count; i += PACK_GROUP)
+    {
+        size_t len = (count - i < PACK_GROUP) ? count - i : PACK_GROUP;
+        uint32_t any = 0;
+        unsigned int width = 0, bits = 0;
+        uint64_t acc = 0;
+
+        for (size_t j = 0; j < len; j++)
+        {
+            int32_t v = (format == IQFILE_FORMAT_CU8) ? u8[i + j] : s16[i + j];
+            int32_t d = v - prev[j & 1];
+
+            prev[j & 1] = v;
+            d = (format == IQFILE_FORMAT_CU8) ? (int8_t)d : (int16_t)d;
+            z[j] = zigzag(d);
+            any |= z[j];
+        }
+        while (any >> width)
+            width++;
+
+        out[n++] = width;
+        for (size_t j = 0; j < len; j++)
+        {
+            acc |= (uint64_t)z[j] << bits;
+            bits += width;
+            while (bits >= 8)
+            {
+                out[n++] = acc;
+                acc >>= 8;
+                bits -= 8;
+            }
+        }
+        if (bits)
+            out[n++] = acc;
+    }
+    return n;
+}
+
+static int unpack(const uint8_t *in, size_t size, int format, void *out, size_t count)
+{
+    uint8_t *u8 = out;
+    int16_t *s16 = out;
+    int32_t prev[2] = { 0, 0 };
+    unsigned int max_width = 8 * value_bytes(format);
+    size_t n = 0;
+
+    for (size_t i = 0; i < count; i += PACK_GROUP)
+    {
+        size_t len = (count - i < PACK_GROUP) ? count - i : PACK_GROUP;
+        unsigned int width, bits = 0;
+        uint64_t acc = 0;
+        uint32_t mask;
+
+        if (n >= size)
+            return 1;
+        width = in[n++];
+        if (width > max_width || n + (len * width + 7) / 8 > size)
+            return 1;
+        mask = (1u << width) - 1;
+
+        for (size_t j = 0; j < len; j++)
+        {
+            int32_t v;
+
+            while (bits < width)
+            {
+                acc |= (uint64_t)in[n++] << bits;
+                bits += 8;
+            }
+            v = prev[j & 1] + unzigzag(acc & mask);
+            acc >>= width;
+            bits -= width;
+
+            if (format == IQFILE_FORMAT_CU8)
+                u8[i + j] = v;
+            else
+                s16[i + j] = v;
+            prev[j & 1] = (format == IQFILE_FORMAT_CU8) ? (uint8_t)v : (int16_t)v;
+        }
+    }
+    return n == size ? 0 : 1;
+}
+
+int iqfile_probe(const uint8_t *data, size_t size)
+{
+    return size >= sizeof(file_magic) && memcmp(data, file_magic, sizeof(file_magic)) == 0;
+}
+
+static int write_chunk(iqfile_writer_t *st)
+{
+    uint8_t header[CHUNK_HEADER_LEN] = { 'I', 'Q', 'C', 'K' };
+    const uint8_t *payload = st->chunk;
+    size_t stored = st->chunk_len;
+    index_entry_t *entry;
+
+    if (st->compress)
+    {
+        size_t len = pack(st->chunk, st->chunk_len / value_bytes(st->format), st->format, st->packed);
+        if (len < stored)
+        {
+            header[4] = CODEC_PACKED;
+            payload = st->packed;
+            stored = len;
+        }
+    }
+
+    if (st->index_len == st->index_capacity)
+    {
+        size_t capacity = st->index_capacity ? 2 * st->index_capacity : 1024;
+        index_entry_t *index = realloc(st->index, capacity * sizeof(*index));
+        if (!index)
+            return 1;
+        st->index = index;
+        st->index_capacity = capacity;
+    }
+    entry = &st->index[st->index_len++];
+    entry->first_sample = st->samples;
+    entry->offset = st->offset;
+    entry->time = st->chunk_time;
+
+    put_u32(header + 8, stored);
+    put_u32(header + 12, st->chunk_len);
+    put_u64(header + 16, entry->first_sample);
+    put_u64(header + 24, entry->time);
+    if (fwrite(header, 1, sizeof(header), st->fp) != sizeof(header)
+        || fwrite(payload, 1, stored, st->fp) != stored)
+        return 1;
+
+    st->offset += sizeof(header) + stored;
+    st->stored += stored;
+    st->samples += st->chunk_len / st->sample_bytes;
+    st->chunk_len = 0;
+    return 0;
+}
+
+static int write_index(iqfile_writer_t *st)
+{
+    uint8_t buf[TRAILER_LEN] = { 'I', 'Q', 'I', 'X' };
+
+    put_u32(buf + 4, st->index_len);
+    if (fwrite(buf, 1, 8, st->fp) != 8)
+        return 1;
+    for (size_t i = 0; i < st->index_len; i++)
+    {
+        put_u64(buf, st->index[i].first_sample);
+        put_u64(buf + 8, st->index[i].offset);
+        put_u64(buf + 16, st->index[i].time);
+        if (fwrite(buf, 1, INDEX_ENTRY_LEN, st->fp) != INDEX_ENTRY_LEN)
+            return 1;
+    }
+
+    put_u64(buf, st->offset);
+    put_u64(buf + 8, st->samples);
+    put_u64(buf + 16, now_us());
+    put_u32(buf + 24, st->index_len);
+    memcpy(buf + 28, "IQTR", 4);
+    return fwrite(buf, 1, TRAILER_LEN, st->fp) == TRAILER_LEN ? 0 : 1;
+}
+
+iqfile_writer_t *iqfile_writer_open(const char *path, const iqfile_info_t *info, int compress)
+{
+    uint8_t header[HEADER_LEN] = { 0 };
+    iqfile_writer_t *st = calloc(1, sizeof(*st));
+
+    if (!st)
+        return NULL;
+
+    st->format = info->format;
+    st->compress = compress;
+    st->sample_bytes = 2 * value_bytes(info->format);
+    st->chunk_size = IQFILE_CHUNK_SAMPLES * st->sample_bytes;
+    st->chunk = malloc(st->chunk_size);
+    st->packed = malloc(packed_capacity(st->chunk_size));
+    if (!st->chunk || !st->packed)
+        goto error;
+
+    st->fp = fopen(path, "wb");
+    if (!st->fp)
+    {
+        log_error("Unable to create %s", path);
+        goto error;
+    }
+
+    memcpy(header, file_magic, sizeof(file_magic));
+    put_u16(header + 8, IQFILE_VERSION);
+    header[10] = info->format;
+    header[11] = info->mode;
+    put_u32(header + 12, info->sample_rate);
+    put_u32(header + 16, IQFILE_CHUNK_SAMPLES);
+    put_f32(header + 20, info->frequency);
+    put_f32(header + 24, info->gain);
+    put_u64(header + 32, now_us());
+    if (fwrite(header, 1, sizeof(header), st->fp) != sizeof(header))
+    {
+        fclose(st->fp);
+        goto error;
+    }
+    st->offset = sizeof(header);
+    return st;
+
+error:
+    free(st->chunk);
+    free(st->packed);
+    free(st);
+    return NULL;
+}
+
+void iqfile_writer_push(iqfile_writer_t *st, const void *buf, size_t len)
+{
+    const uint8_t *p = buf;
+
+    while (len > 0 && !st->failed)
+    {
+        size_t n = st->chunk_size - st->chunk_len;
+
+        if (st->chunk_len == 0)
+            st->chunk_time = now_us();
+        if (n > len)
+            n = len;
+        memcpy(st->chunk + st->chunk_len, p, n);
+        st->chunk_len += n;
+        p += n;
+        len -= n;
+
+        if (st->chunk_len == st->chunk_size && write_chunk(st) != 0)
+        {
+            log_error("IQ recording failed");
+            st->failed = 1;
+        }
+    }
+}
+
+int iqfile_writer_format(const iqfile_writer_t *st)
+{
+    return st->format;
+}
+
+int iqfile_writer_close(iqfile_writer_t *st)
+{
+    int ret = st->failed;
+
+    if (!ret && st->chunk_len > 0)
+        ret = write_chunk(st);
+    if (!ret)
+        ret = write_index(st);
+    if (fclose(st->fp) != 0)
+        ret = 1;
+
+    if (ret)
+        log_error("IQ recording failed");
+    else if (st->samples > 0)
+        log_info("IQ recording: %.1f%% of raw size", 100.0 * st->stored / (st->samples * st->sample_bytes));
+
+    free(st->index);
+    free(st->chunk);
+    free(st->packed);
+    free(st);
+    return ret;
+}
+
+static int append_index(iqfile_reader_t *st, size_t *capacity, const index_entry_t *entry)
+{
+    if (st->index_len == *capacity)
+    {
+        size_t size = *capacity ? 2 * *capacity : 1024;
+        index_entry_t *index = realloc(st->index, size * sizeof(*index));
+        if (!index)
+            return 1;
+        st->index = index;
+        *capacity = size;
+    }
+    st->index[st->index_len++] = *entry;
+    return 0;
+}
+
+static int read_index(iqfile_reader_t *st)
+{
+    uint8_t buf[TRAILER_LEN];
+    uint64_t offset;
+    uint32_t count;
+
+    if (fseeko(st->fp, -TRAILER_LEN, SEEK_END) != 0
+        || fread(buf, 1, TRAILER_LEN, st->fp) != TRAILER_LEN
+        || memcmp(buf + 28, "IQTR", 4) != 0)
+        return 1;
+
+    offset = get_u64(buf);
+    st->info.total_samples = get_u64(buf + 8);
+    st->info.end_time = get_u64(buf + 16);
+    count = get_u32(buf + 24);
+    if (count > offset / CHUNK_HEADER_LEN)
+        return 1;
+
+    if (fseeko(st->fp, offset, SEEK_SET) != 0
+        || fread(buf, 1, 8, st->fp) != 8
+        || memcmp(buf, "IQIX", 4) != 0
+        || get_u32(buf + 4) != count)
+        return 1;
+
+    st->index = malloc(count * sizeof(*st->index));
+    if (count > 0 && !st->index)
+        return 1;
+    for (st->index_len = 0; st->index_len < count; st->index_len++)
+    {
+        index_entry_t *entry = &st->index[st->index_len];
+
+        if (fread(buf, 1, INDEX_ENTRY_LEN, st->fp) != INDEX_ENTRY_LEN)
+            return 1;
+        entry->first_sample = get_u64(buf);
+        entry->offset = get_u64(buf + 8);
+        entry->time = get_u64(buf + 16);
+    }
+    return 0;
+}
+
+static void scan_index(iqfile_reader_t *st)
+{
+    uint8_t header[CHUNK_HEADER_LEN];
+    uint64_t offset = HEADER_LEN;
+    size_t capacity = 0;
+
+    free(st->index);
+    st->index = NULL;
+    st->index_len = 0;
+    st->info.total_samples = 0;
+
+    while (fseeko(st->fp, offset, SEEK_SET) == 0
+           && fread(header, 1, sizeof(header), st->fp) == sizeof(header)
+           && memcmp(header, "IQCK", 4) == 0)
+    {
+        index_entry_t entry = { get_u64(header + 16), offset, get_u64(header + 24) };
+
+        if (append_index(st, &capacity, &entry) != 0)
+            break;
+        st->info.total_samples = entry.first_sample + get_u32(header + 12) / st->sample_bytes;
+        st->info.end_time = entry.time;
+        offset += sizeof(header) + get_u32(header + 8);
+    }
+    log_warn("IQ file has no index, rebuilt from %zu chunks", st->index_len);
+}
+
+static int open_container(iqfile_reader_t *st)
+{
+    uint8_t header[HEADER_LEN];
+    uint32_t chunk_samples;
+
+    memcpy(header, st->prefix, sizeof(file_magic));
+    st->prefix_len = 0;
+    if (fread(header + sizeof(file_magic), 1, HEADER_LEN - sizeof(file_magic), st->fp) != HEADER_LEN - sizeof(file_magic))
+        return 1;
+
+    if (get_u16(header + 8) != IQFILE_VERSION)
+    {
+        log_error("Unsupported IQ file version %u", get_u16(header + 8));
+        return 1;
+    }
+    if (header[10] != IQFILE_FORMAT_CU8 && header[10] != IQFILE_FORMAT_CS16)
+    {
+        log_error("Unsupported IQ file sample format %u", header[10]);
+        return 1;
+    }
+    // recordings are played back in their own format, whatever the driver
+    st->info.format = header[10];
+    st->sample_bytes = 2 * value_bytes(st->info.format);
+    chunk_samples = get_u32(header + 16);
+    if (chunk_samples == 0 || chunk_samples > MAX_CHUNK_SAMPLES || chunk_samples % 2 != 0)
+        return 1;
+
+    st->container = 1;
+    st->info.mode = header[11];
+    st->info.sample_rate = get_u32(header + 12);
+    st->info.frequency = get_f32(header + 20);
+    st->info.gain = get_f32(header + 24);
+    st->info.start_time = get_u64(header + 32);
+    st->slot_size = chunk_samples * st->sample_bytes;
+    st->packed_size = packed_capacity(st->slot_size);
+    st->packed = malloc(st->packed_size);
+    if (!st->packed)
+        return 1;
+
+    // seeking fails on pipes, which are then read without an index
+    if (fseeko(st->fp, 0, SEEK_END) == 0)
+    {
+        if (read_index(st) != 0)
+            scan_index(st);
+        if (fseeko(st->fp, HEADER_LEN, SEEK_SET) != 0)
+            return 1;
+    }
+    return 0;
+}
+
+static size_t read_chunk(iqfile_reader_t *st, uint8_t *out)
+{
+    uint8_t header[CHUNK_HEADER_LEN];
+    size_t stored, len;
+
+    // a recording that was cut short ends without an index
+    if (fread(header, 1, sizeof(header), st->fp) != sizeof(header))
+        return 0;
+    if (memcmp(header, "IQCK", 4) != 0)
+    {
+        if (memcmp(header, "IQIX", 4) != 0)
+            log_error("IQ file is corrupt");
+        return 0;
+    }
+
+    stored = get_u32(header + 8);
+    len = get_u32(header + 12);
+    if (len == 0 || len > st->slot_size || len % (2 * st->sample_bytes) != 0)
+    {
+        log_error("IQ file is corrupt");
+        return 0;
+    }
+
+    if (header[4] == CODEC_RAW && stored == len)
+    {
+        if (fread(out, 1, len, st->fp) != len)
+            return 0;
+    }
+    else if (header[4] == CODEC_PACKED && stored <= st->packed_size)
+    {
+        if (fread(st->packed, 1, stored, st->fp) != stored)
+            return 0;
+        if (unpack(st->packed, stored, st->info.format, out, len / value_bytes(st->info.format)) != 0)
+        {
+            log_error("IQ file is corrupt");
+            return 0;
+        }
+    }
+    else
+    {
+        log_error("IQ file is corrupt");
+        return 0;
+    }
+    return len;
+}
+
+static size_t read_raw(iqfile_reader_t *st, uint8_t *out)
+{
+    size_t len = st->prefix_len;
+
+    memcpy(out, st->prefix, len);
+    st->prefix_len = 0;
+
+    // a trailing partial sample is ignored
+    len += fread(out + len, 4, (st->slot_size - len) / 4, st->fp) * 4;
+    return len;
+}
+
+static void *reader_thread(void *arg)
+{
+    iqfile_reader_t *st = arg;
+
+    pthread_mutex_lock(&st->mutex);
+    while (!st->stop)
+    {
+        unsigned int slot;
+        size_t len;
+
+        if (st->head - st->tail == READ_SLOTS)
+        {
+            pthread_cond_wait(&st->cond, &st->mutex);
+            continue;
+        }
+
+        slot = st->head % READ_SLOTS;
+        pthread_mutex_unlock(&st->mutex);
+
+        len = st->container ? read_chunk(st, st->slots[slot]) : read_raw(st, st->slots[slot]);
+        st->slot_start[slot] = (st->skip < len) ? st->skip : len;
+        st->skip = 0;
+
+        pthread_mutex_lock(&st->mutex);
+        if (len == 0)
+        {
+            st->eof = 1;
+            pthread_cond_broadcast(&st->cond);
+            break;
+        }
+        st->slot_len[slot] = len;
+        st->head++;
+        pthread_cond_broadcast(&st->cond);
+    }
+    pthread_mutex_unlock(&st->mutex);
+    return NULL;
+}
+
+static int start_thread(iqfile_reader_t *st)
+{
+    st->head = 0;
+    st->tail = 0;
+    st->holding = 0;
+    st->eof = 0;
+    st->stop = 0;
+    st->handed = 0;
+    st->decoded = 0;
+    st->elapsed = 0;
+    st->running = (pthread_create(&st->thread, NULL, reader_thread, st) == 0);
+    return st->running ? 0 : 1;
+}
+
+static void stop_thread(iqfile_reader_t *st)
+{
+    if (!st->running)
+        return;
+
+    pthread_mutex_lock(&st->mutex);
+    st->stop = 1;
+    pthread_cond_broadcast(&st->cond);
+    pthread_mutex_unlock(&st->mutex);
+    pthread_join(st->thread, NULL);
+    st->running = 0;
+}
+
+iqfile_reader_t *iqfile_reader_open(FILE *fp, int format, iqfile_info_t *info)
+{
+    iqfile_reader_t *st = calloc(1, sizeof(*st));
+
+    if (!st)
+        return NULL;
+
+    st->fp = fp;
+    st->sample_bytes = 2 * value_bytes(format);
+    st->info.format = format;
+    st->info.gain = NAN;
+    st->slot_size = RAW_READ_BYTES;
+    pthread_mutex_init(&st->mutex, NULL);
+    pthread_cond_init(&st->cond, NULL);
+
+    st->prefix_len = fread(st->prefix, 1, sizeof(st->prefix), fp);
+    if (iqfile_probe(st->prefix, st->prefix_len))
+    {
+        if (open_container(st) != 0)
+            goto error;
+    }
+    else if (fseeko(fp, 0, SEEK_END) == 0)
+    {
+        st->info.total_samples = ftello(fp) / st->sample_bytes;
+        if (fseeko(fp, st->prefix_len, SEEK_SET) != 0)
+            goto error;
+    }
+
+    for (int i = 0; i < READ_SLOTS; i++)
+    {
+        st->slots[i] = malloc(st->slot_size);
+        if (!st->slots[i])
+            goto error;
+    }
+    if (start_thread(st) != 0)
+        goto error;
+
+    *info = st->info;
+    return st;
+
+error:
+    iqfile_reader_close(st);
+    return NULL;
+}
+
+void iqfile_reader_close(iqfile_reader_t *st)
+{
+    if (!st)
+        return;
+
+    stop_thread(st);
+    pthread_cond_destroy(&st->cond);
+    pthread_mutex_destroy(&st->mutex);
+    for (int i = 0; i < READ_SLOTS; i++)
+        free(st->slots[i]);
+    free(st->packed);
+    free(st->index);
+    free(st);
+}
+
+int iqfile_reader_is_container(const iqfile_reader_t *st)
+{
+    return st->container;
+}
+
+int iqfile_reader_format(const iqfile_reader_t *st)
+{
+    return st->info.format;
+}
+
+// Raw captures carry no sample rate, so the caller supplies it.
+int iqfile_reader_seek(iqfile_reader_t *st, double seconds, double raw_rate)
+{
+    return iqfile_reader_seek_sample(st, seconds * (st->container ? st->info.sample_rate : raw_rate));
+}
+
+int iqfile_reader_seek_sample(iqfile_reader_t *st, uint64_t sample)
+{
+    uint64_t offset;
+    size_t skip = 0;
+
+    // seek to a whole number of 32-bit words, as the input stage expects
+    sample -= sample % (4 / st->sample_bytes);
+    if (st->info.total_samples && sample >= st->info.total_samples)
+        return 1;
+
+    if (st->container)
+    {
+        size_t low = 0, high = st->index_len;
+
+        if (st->index_len == 0)
+            return 1;
+
+        // find the last chunk that starts at or before the sample
+        while (high - low > 1)
+        {
+            size_t mid = (low + high) / 2;
+            if (st->index[mid].first_sample <= sample)
+                low = mid;
+            else
+                high = mid;
+        }
+        offset = st->index[low].offset;
+        skip = (sample - st->index[low].first_sample) * st->sample_bytes;
+    }
+    else
+    {
+        offset = sample * st->sample_bytes;
+    }
+
+    stop_thread(st);
+    if (fseeko(st->fp, offset, SEEK_SET) != 0)
+    {
+        log_error("IQ file is not seekable");
+        start_thread(st);
+        return 1;
+    }
+    st->prefix_len = 0;
+    st->skip = skip;
+    return start_thread(st);
+}
+
+size_t iqfile_reader_next(iqfile_reader_t *st, const uint8_t **span)
+{
+    unsigned int slot;
+    size_t len;
+
+    if (st->handed == 0)
+        clock_gettime(CLOCK_MONOTONIC, &st->start);
+    else
+    {
+        // everything handed out by the previous call has been decoded by now
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        st->elapsed = (now.tv_sec - st->start.tv_sec) + (now.tv_nsec - st->start.tv_nsec) * 1e-9;
+        st->decoded = st->handed;
+    }
+
+    pthread_mutex_lock(&st->mutex);
+    if (st->holding)
+    {
+        st->tail++;
+        st->holding = 0;
+        pthread_cond_broadcast(&st->cond);
+    }
+    while (st->head == st->tail && !st->eof)
+        pthread_cond_wait(&st->cond, &st->mutex);
+    if (st->head == st->tail)
+    {
+        pthread_mutex_unlock(&st->mutex);
+        return 0;
+    }
+    slot = st->tail % READ_SLOTS;
+    st->holding = 1;
+    pthread_mutex_unlock(&st->mutex);
+
+    *span = st->slots[slot] + st->slot_start[slot];
+    len = st->slot_len[slot] - st->slot_start[slot];
+    st->handed += len;
+    return len;
+}
+
+float iqfile_reader_realtime_factor(iqfile_reader_t *st, double bytes_per_sec)
+{
+    if (st->elapsed <= 0)
+        return 0;
+    return (st->decoded / bytes_per_sec) / st->elapsed;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define IQFILE_FORMAT_CU8 0
+#define IQFILE_FORMAT_CS16 1
+
+// Complex samples per chunk, and the granularity of the seek index.
+#define IQFILE_CHUNK_SAMPLES (1 << 16)
+
+typedef struct
+{
+    int format;
+    int mode;
+    uint32_t sample_rate;
+    float frequency;
+    float gain;               // dB, NAN if unknown
+    int64_t start_time;       // microseconds since the Unix epoch
+    int64_t end_time;
+    uint64_t total_samples;   // 0 if unknown
+} iqfile_info_t;
+
+typedef struct iqfile_writer_t iqfile_writer_t;
+typedef struct iqfile_reader_t iqfile_reader_t;
+
+int iqfile_probe(const uint8_t *data, size_t size);
+
+iqfile_writer_t *iqfile_writer_open(const char *path, const iqfile_info_t *info, int compress);
+void iqfile_writer_push(iqfile_writer_t *st, const void *buf, size_t len);
+int iqfile_writer_format(const iqfile_writer_t *st);
+int iqfile_writer_close(iqfile_writer_t *st);
+
+iqfile_reader_t *iqfile_reader_open(FILE *fp, int format, iqfile_info_t *info);
+void iqfile_reader_close(iqfile_reader_t *st);
+int iqfile_reader_is_container(const iqfile_reader_t *st);
+int iqfile_reader_format(const iqfile_reader_t *st);
+int iqfile_reader_seek(iqfile_reader_t *st, double seconds, double raw_rate);
+int iqfile_reader_seek_sample(iqfile_reader_t *st, uint64_t sample);
+size_t iqfile_reader_next(iqfile_reader_t *st, const uint8_t **span);
+float iqfile_reader_realtime_factor(iqfile_reader_t *st, double bytes_per_sec);
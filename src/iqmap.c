@@ -0,0 +1,208 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#ifdef __MINGW32__
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "defines.h"
+#include "iqmap.h"
+
+// How far ahead of the read position the kernel is asked to fetch pages.
+#define IQMAP_READAHEAD (4 * IQMAP_SPAN_BYTES)
+
+static double elapsed_since(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+#ifdef __MINGW32__
+
+static int map_file(iqmap_t *st, const char *path)
+{
+    LARGE_INTEGER size;
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return 1;
+
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return 1;
+    }
+
+    st->mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (st->mapping == NULL)
+        return 1;
+
+    st->data = MapViewOfFile(st->mapping, FILE_MAP_READ, 0, 0, 0);
+    if (st->data == NULL)
+    {
+        CloseHandle(st->mapping);
+        return 1;
+    }
+    st->size = size.QuadPart;
+    return 0;
+}
+
+static void unmap_file(iqmap_t *st)
+{
+    UnmapViewOfFile(st->data);
+    CloseHandle(st->mapping);
+}
+
+static void advise(iqmap_t *st)
+{
+    (void)st;
+}
+
+#else
+
+static int map_file(iqmap_t *st, const char *path)
+{
+    struct stat sb;
+    void *data;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 1;
+
+    if (fstat(fd, &sb) != 0 || !S_ISREG(sb.st_mode) || sb.st_size == 0)
+    {
+        close(fd);
+        return 1;
+    }
+
+    data = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return 1;
+
+    madvise(data, sb.st_size, MADV_SEQUENTIAL);
+    st->data = data;
+    st->size = sb.st_size;
+    return 0;
+}
+
+static void unmap_file(iqmap_t *st)
+{
+    munmap((void *)st->data, st->size);
+}
+
+// Prefetch the window ahead of the read position and drop pages behind it,
+// so resident memory stays bounded no matter how large the capture is.
+static void advise(iqmap_t *st)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t done = st->offset & ~(page - 1);
+    size_t ahead = st->offset + IQMAP_READAHEAD;
+
+    if (ahead > st->size)
+        ahead = st->size;
+    if (ahead > st->advised)
+    {
+        size_t from = st->advised & ~(page - 1);
+        madvise((void *)(st->data + from), ahead - from, MADV_WILLNEED);
+        st->advised = ahead;
+    }
+
+    if (done > st->released + IQMAP_SPAN_BYTES)
+    {
+        done -= IQMAP_SPAN_BYTES;
+        madvise((void *)(st->data + st->released), done - st->released, MADV_DONTNEED);
+        st->released = done;
+    }
+}
+
+#endif
+
+int iqmap_open(iqmap_t *st, const char *path, unsigned int align)
+{
+    memset(st, 0, sizeof(*st));
+    if (map_file(st, path) != 0)
+    {
+        log_error("Unable to map %s", path);
+        memset(st, 0, sizeof(*st));
+        return 1;
+    }
+
+    // a trailing partial sample is ignored
+    st->align = align;
+    return 0;
+}
+
+void iqmap_close(iqmap_t *st)
+{
+    if (st->data)
+        unmap_file(st);
+    st->data = NULL;
+}
+
+int iqmap_seek(iqmap_t *st, size_t offset)
+{
+    offset -= offset % st->align;
+    if (offset >= st->size)
+        return 1;
+
+    st->offset = offset;
+    st->advised = offset;
+    // pages read again after seeking back have to be dropped again
+    if (st->released > offset)
+        st->released = 0;
+    st->base = offset;
+    st->decoded = 0;
+    st->elapsed = 0;
+    return 0;
+}
+
+size_t iqmap_next(iqmap_t *st, const uint8_t **span)
+{
+    size_t len = st->size - st->offset;
+
+    if (st->offset == st->base)
+        clock_gettime(CLOCK_MONOTONIC, &st->start);
+    else
+    {
+        // everything handed out by the previous call has been decoded by now
+        st->elapsed = elapsed_since(&st->start);
+        st->decoded = st->offset - st->base;
+    }
+
+    if (len > IQMAP_SPAN_BYTES)
+        len = IQMAP_SPAN_BYTES;
+    len -= len % st->align;
+
+    *span = st->data + st->offset;
+    st->offset += len;
+    if (len)
+        advise(st);
+    return len;
+}
+
+float iqmap_realtime_factor(iqmap_t *st, double bytes_per_sec)
+{
+    if (st->elapsed <= 0)
+        return 0;
+    return (st->decoded / bytes_per_sec) / st->elapsed;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// Bytes handed to the input stage per worker iteration.
+#define IQMAP_SPAN_BYTES (1 << 20)
+
+typedef struct
+{
+    const uint8_t *data;
+    size_t size;
+    size_t offset;
+    size_t advised;
+    size_t released;    // pages below this offset have been dropped
+    size_t base;
+    unsigned int align;
+#ifdef __MINGW32__
+    void *mapping;
+#endif
+
+    struct timespec start;
+    size_t decoded;
+    double elapsed;
+} iqmap_t;
+
+int iqmap_open(iqmap_t *st, const char *path, unsigned int align);
+void iqmap_close(iqmap_t *st);
+int iqmap_seek(iqmap_t *st, size_t offset);
+size_t iqmap_next(iqmap_t *st, const uint8_t **span);
+float iqmap_realtime_factor(iqmap_t *st, double bytes_per_sec);
@@ -0,0 +1,315 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __MINGW32__
+#include <windows.h>
+#else
+#include <arpa/inet.h>
+#include <errno.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#include "defines.h"
+#include "iqserver.h"
+
+#define IQ_SERVER_RING_SIZE (8 * 1024 * 1024)
+#define IQ_SERVER_MAX_CLIENTS 16
+#define IQ_SERVER_POLL_MS 10
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+typedef struct
+{
+    int socket;
+    uint64_t pos;          // stream offset of the next byte to send
+    uint64_t skipped;      // bytes skipped because the client fell behind
+} iq_client_t;
+
+/*
+ * rtl_tcp-compatible server for the cu8 samples received by a session.
+ *
+ * The processing thread copies each block once into a shared ring. The
+ * server thread sends to every client straight from the ring, so clients
+ * do not add copies. A client that falls more than half a ring behind is
+ * moved forward to the newest data, since the bytes it was waiting for
+ * are about to be overwritten. The ring is not locked while sending, so
+ * the pusher announces the end of each block in `reserved` before copying
+ * it in; a client whose sent bytes may have been overwritten meanwhile has
+ * received corrupt samples and is disconnected.
+ */
+struct iq_server_t
+{
+    int listen_socket;
+    uint8_t header[12];
+    uint8_t *ring;
+    _Atomic uint64_t head;
+    _Atomic uint64_t reserved;
+
+    iq_client_t clients[IQ_SERVER_MAX_CLIENTS];
+    unsigned int num_clients;
+
+    pthread_t thread;
+    atomic_int stop;
+};
+
+static void close_socket(int socket)
+{
+#ifdef __MINGW32__
+    closesocket(socket);
+#else
+    close(socket);
+#endif
+}
+
+static void add_client(iq_server_t *st)
+{
+    iq_client_t *client;
+    int socket = accept(st->listen_socket, NULL, NULL);
+
+    if (socket < 0)
+        return;
+
+    if (st->num_clients == IQ_SERVER_MAX_CLIENTS)
+    {
+        log_warn("IQ server: too many clients");
+        close_socket(socket);
+        return;
+    }
+
+    if (send(socket, (const char *)st->header, sizeof(st->header), MSG_NOSIGNAL) != sizeof(st->header))
+    {
+        close_socket(socket);
+        return;
+    }
+
+#ifdef __MINGW32__
+    unsigned long mode = 1;
+    ioctlsocket(socket, FIONBIO, &mode);
+#endif
+#ifdef SO_NOSIGPIPE
+    int one = 1;
+    setsockopt(socket, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+
+    client = &st->clients[st->num_clients++];
+    client->socket = socket;
+    client->pos = atomic_load_explicit(&st->head, memory_order_acquire);
+    client->skipped = 0;
+    log_info("IQ server: client %u connected", st->num_clients);
+}
+
+static void remove_client(iq_server_t *st, unsigned int i)
+{
+    close_socket(st->clients[i].socket);
+    st->clients[i] = st->clients[--st->num_clients];
+    log_info("IQ server: client disconnected");
+}
+
+// Clients send rtl_tcp commands; the device is shared, so they are ignored.
+static int drain_commands(iq_client_t *client)
+{
+    char buf[256];
+    int err = recv(client->socket, buf, sizeof(buf), 0);
+
+    return err > 0 ? 0 : 1;
+}
+
+static int send_pending(iq_server_t *st, iq_client_t *client)
+{
+    uint64_t head = atomic_load_explicit(&st->head, memory_order_acquire);
+    size_t len, offset, first;
+    int err;
+
+    if (head - client->pos > IQ_SERVER_RING_SIZE / 2)
+    {
+        // skip an even number of bytes so that I/Q pairs stay aligned
+        uint64_t pos = head - ((head - client->pos) & 1);
+        if (client->skipped == 0)
+            log_warn("IQ server: client fell behind, skipping samples");
+        client->skipped += pos - client->pos;
+        client->pos = pos;
+    }
+
+    len = head - client->pos;
+    if (len == 0)
+        return 0;
+
+    offset = client->pos % IQ_SERVER_RING_SIZE;
+    first = IQ_SERVER_RING_SIZE - offset;
+    if (first > len)
+        first = len;
+
+#ifdef __MINGW32__
+    err = send(client->socket, (const char *)st->ring + offset, first, 0);
+    if (err == (int)first && len > first)
+    {
+        int more = send(client->socket, (const char *)st->ring, len - first, 0);
+        if (more > 0)
+            err += more;
+    }
+    if (err < 0 && WSAGetLastError() == WSAEWOULDBLOCK)
+        return 0;
+#else
+    struct iovec iov[2] = {
+        { .iov_base = st->ring + offset, .iov_len = first },
+        { .iov_base = st->ring, .iov_len = len - first }
+    };
+    struct msghdr msg = { .msg_iov = iov, .msg_iovlen = (len > first) ? 2 : 1 };
+
+    err = sendmsg(client->socket, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (err < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        return 0;
+#endif
+    if (err < 0)
+        return 1;
+
+    // the pusher may have lapped the bytes while they were being sent
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&st->reserved, memory_order_relaxed) - client->pos > IQ_SERVER_RING_SIZE)
+    {
+        log_warn("IQ server: client overrun, disconnecting");
+        return 1;
+    }
+
+    client->pos += err;
+    return 0;
+}
+
+static void *server_thread(void *arg)
+{
+    iq_server_t *st = arg;
+
+    while (!atomic_load(&st->stop))
+    {
+        fd_set rfds, wfds;
+        struct timeval tv = { .tv_sec = 0, .tv_usec = IQ_SERVER_POLL_MS * 1000 };
+        uint64_t head = atomic_load_explicit(&st->head, memory_order_acquire);
+        int max_fd = st->listen_socket;
+
+        FD_ZERO(&rfds);
+        FD_ZERO(&wfds);
+        FD_SET(st->listen_socket, &rfds);
+        for (unsigned int i = 0; i < st->num_clients; i++)
+        {
+            FD_SET(st->clients[i].socket, &rfds);
+            if (st->clients[i].pos != head)
+                FD_SET(st->clients[i].socket, &wfds);
+            if (st->clients[i].socket > max_fd)
+                max_fd = st->clients[i].socket;
+        }
+
+        if (select(max_fd + 1, &rfds, &wfds, NULL, &tv) <= 0)
+            continue;
+
+        if (FD_ISSET(st->listen_socket, &rfds))
+            add_client(st);
+
+        for (unsigned int i = 0; i < st->num_clients; )
+        {
+            iq_client_t *client = &st->clients[i];
+
+            if ((FD_ISSET(client->socket, &rfds) && drain_commands(client) != 0)
+                || (FD_ISSET(client->socket, &wfds) && send_pending(st, client) != 0))
+            {
+                remove_client(st, i);
+                continue;
+            }
+            i++;
+        }
+    }
+
+    for (unsigned int i = 0; i < st->num_clients; i++)
+        close_socket(st->clients[i].socket);
+    st->num_clients = 0;
+    return NULL;
+}
+
+iq_server_t *iq_server_open(int listen_socket, uint32_t tuner_type, uint32_t gain_count)
+{
+    iq_server_t *st = calloc(1, sizeof(*st));
+    uint32_t value;
+
+    if (!st)
+        return NULL;
+
+    st->ring = malloc(IQ_SERVER_RING_SIZE);
+    if (!st->ring)
+        goto error;
+
+    st->listen_socket = listen_socket;
+    memcpy(st->header, "RTL0", 4);
+    value = htonl(tuner_type);
+    memcpy(st->header + 4, &value, 4);
+    value = htonl(gain_count);
+    memcpy(st->header + 8, &value, 4);
+    atomic_init(&st->head, 0);
+    atomic_init(&st->reserved, 0);
+    atomic_init(&st->stop, 0);
+
+    if (pthread_create(&st->thread, NULL, server_thread, st) != 0)
+        goto error;
+    return st;
+
+error:
+    free(st->ring);
+    free(st);
+    return NULL;
+}
+
+void iq_server_close(iq_server_t *st)
+{
+    if (!st)
+        return;
+
+    atomic_store(&st->stop, 1);
+    pthread_join(st->thread, NULL);
+    close_socket(st->listen_socket);
+    free(st->ring);
+    free(st);
+}
+
+void iq_server_push(iq_server_t *st, const uint8_t *buf, unsigned int len)
+{
+    uint64_t head = atomic_load_explicit(&st->head, memory_order_relaxed);
+    size_t offset = head % IQ_SERVER_RING_SIZE;
+    size_t first = IQ_SERVER_RING_SIZE - offset;
+
+    if (len > IQ_SERVER_RING_SIZE / 2)
+    {
+        buf += len - IQ_SERVER_RING_SIZE / 2;
+        head += len - IQ_SERVER_RING_SIZE / 2;
+        len = IQ_SERVER_RING_SIZE / 2;
+        offset = head % IQ_SERVER_RING_SIZE;
+        first = IQ_SERVER_RING_SIZE - offset;
+    }
+
+    if (first > len)
+        first = len;
+    atomic_store_explicit(&st->reserved, head + len, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(st->ring + offset, buf, first);
+    memcpy(st->ring, buf + first, len - first);
+
+    atomic_store_explicit(&st->head, head + len, memory_order_release);
+}
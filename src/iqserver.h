@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdint.h>
+
+typedef struct iq_server_t iq_server_t;
+
+iq_server_t *iq_server_open(int listen_socket, uint32_t tuner_type, uint32_t gain_count);
+void iq_server_close(iq_server_t *st);
+void iq_server_push(iq_server_t *st, const uint8_t *buf, unsigned int len);
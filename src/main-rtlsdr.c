@@ -42,7 +42,7 @@
 #include "log.h"
 #include "main.h"
 
-static int connect_tcp(char *host, const char *default_port)
+int connect_tcp(char *host, const char *default_port)
 {
     int err, s;
     struct addrinfo hints, *res0;
@@ -85,9 +85,60 @@ static int connect_tcp(char *host, const char *default_port)
     return s;
 }
 
+// Listen on [host:]port, on the loopback interface unless a host is given.
+static int listen_tcp(char *address, const char *default_host)
+{
+    int err, s = -1;
+    struct addrinfo hints, *res0;
+    const char *host = default_host, *port = address;
+    char *p = strrchr(address, ':');
+
+#ifdef __MINGW32__
+    WSADATA wsa_data;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0)
+        return -1;
+#endif
+
+    if (p)
+    {
+        *p = 0;
+        host = address;
+        port = p + 1;
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = PF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    err = getaddrinfo(host, port, &hints, &res0);
+    if (err)
+        return -1;
+
+    for (struct addrinfo *res = res0; res != NULL; res = res->ai_next)
+    {
+        int one = 1;
+
+        s = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+        if (s == -1)
+            continue;
+
+        setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const char *)&one, sizeof(one));
+        if (bind(s, res->ai_addr, res->ai_addrlen) == 0 && listen(s, 4) == 0)
+            break;
+
+        // failed, try next address
+        close(s);
+        s = -1;
+    }
+
+    freeaddrinfo(res0);
+    return s;
+}
+
 static void help(const char *progname)
 {
-    fprintf(stderr, "Usage: %s [-v] [-q] [--am] [-l log-level] [-d device-index] [-H rtltcp-host] [-p ppm-error] [-g gain] [-r iq-input] [-w iq-output] [-o audio-output] [-t audio-type] [-T] [-D direct-sampling-mode] [--dump-hdc hdc-output] [--dump-aas-files directory] frequency program\n", progname);
+    fprintf(stderr, "Usage: %s [-v] [-q] [--am] [-l log-level] [-d device-index] [-H rtltcp-host] [--serve-iq [host:]port] [-p ppm-error] [-g gain] [-r iq-input] [--mmap] [--jobs threads] [--seek seconds] [--low-latency depth] [-w iq-output] [--iq-format raw|chunked|compressed] [-o audio-output] [-t audio-type] [-T] [-D direct-sampling-mode] [--dump-hdc hdc-output] [--dump-aas-files directory] frequency program\n", progname);
+    fprintf(stderr, "       %s --daemon [-q] [-l log-level] [-j threads] [-o output-dir] config-file\n", progname);
 }
 
 static int parse_args(state_t *st, int argc, char *argv[])
@@ -96,6 +147,12 @@ static int parse_args(state_t *st, int argc, char *argv[])
         { "dump-aas-files", required_argument, NULL, 1 },
         { "dump-hdc", required_argument, NULL, 2 },
         { "am", no_argument, NULL, 3 },
+        { "mmap", no_argument, NULL, 4 },
+        { "low-latency", required_argument, NULL, 5 },
+        { "serve-iq", required_argument, NULL, 6 },
+        { "iq-format", required_argument, NULL, 7 },
+        { "seek", required_argument, NULL, 8 },
+        { "jobs", required_argument, NULL, 9 },
         { 0 }
     };
     const char *version = NULL;
@@ -124,6 +181,51 @@ static int parse_args(state_t *st, int argc, char *argv[])
         case 3:
             st->mode = NRSC5_MODE_AM;
             break;
+        case 4:
+            st->use_mmap = 1;
+            break;
+        case 5:
+            st->elastic_depth = strtoul(optarg, &endptr, 10);
+            if (*endptr != 0)
+            {
+                log_fatal("Invalid low-latency depth.");
+                return -1;
+            }
+            st->low_latency = 1;
+            break;
+        case 6:
+            st->serve_address = strdup(optarg);
+            break;
+        case 7:
+            if (strcmp(optarg, "raw") == 0)
+                st->iq_format = IQ_FORMAT_RAW;
+            else if (strcmp(optarg, "chunked") == 0)
+                st->iq_format = IQ_FORMAT_CHUNKED;
+            else if (strcmp(optarg, "compressed") == 0)
+                st->iq_format = IQ_FORMAT_COMPRESSED;
+            else
+            {
+                log_fatal("IQ format must be raw, chunked or compressed.");
+                return -1;
+            }
+            break;
+        case 8:
+            st->seek = strtof(optarg, &endptr);
+            if (*endptr != 0 || !(st->seek >= 0))
+            {
+                log_fatal("Invalid seek offset.");
+                return -1;
+            }
+            break;
+        case 9:
+            st->jobs = strtoul(optarg, &endptr, 10);
+            if (*endptr != 0)
+            {
+                log_fatal("Invalid number of jobs.");
+                return -1;
+            }
+            st->use_jobs = 1;
+            break;
         case 'r':
             st->input_name = strdup(optarg);
             break;
@@ -218,7 +320,17 @@ static int parse_args(state_t *st, int argc, char *argv[])
         return 1;
     }
 
-    if (output_name)
+    if (output_name && st->iq_format != IQ_FORMAT_RAW)
+    {
+        // the library writes chunked recordings itself
+        if (strcmp(output_name, "-") == 0)
+        {
+            log_fatal("Chunked IQ output must be a file.");
+            return 1;
+        }
+        st->iq_output_name = strdup(output_name);
+    }
+    else if (output_name)
     {
         if (strcmp(output_name, "-") == 0)
             st->iq_file = stdout;
@@ -259,6 +371,12 @@ int main(int argc, char *argv[])
     log_set_udata(&log_mutex);
 
     ao_initialize();
+    if (argc > 1 && strcmp(argv[1], "--daemon") == 0)
+    {
+        int ret = daemon_main(argc - 1, argv + 1);
+        ao_shutdown();
+        return ret;
+    }
     init_audio_buffers(st);
     if (parse_args(st, argc, argv) != 0)
         return 0;
@@ -269,7 +387,23 @@ int main(int argc, char *argv[])
     setmode(fileno(stdout), O_BINARY);
 #endif
 
-    if (st->input_name)
+    if (st->input_name && st->use_jobs)
+    {
+        if (nrsc5_open_segmented(&radio, st->input_name, st->jobs, 0) != 0)
+        {
+            log_fatal("Open IQ file for parallel decoding failed.");
+            return 1;
+        }
+    }
+    else if (st->input_name && st->use_mmap)
+    {
+        if (nrsc5_open_mmap(&radio, st->input_name) != 0)
+        {
+            log_fatal("Map IQ file failed.");
+            return 1;
+        }
+    }
+    else if (st->input_name)
     {
         FILE *fp = strcmp(st->input_name, "-") == 0 ? stdin : fopen(st->input_name, "rb");
         if (fp == NULL)
@@ -305,6 +439,15 @@ int main(int argc, char *argv[])
             return 1;
         }
     }
+    if (st->serve_address)
+    {
+        int s = listen_tcp(st->serve_address, "127.0.0.1");
+        if (s == -1 || nrsc5_serve_rtltcp(radio, s) != 0)
+        {
+            log_fatal("Start IQ server failed.");
+            return 1;
+        }
+    }
     if (nrsc5_set_bias_tee(radio, st->bias_tee) != 0)
     {
         log_fatal("Set bias-T failed.");
@@ -323,12 +466,29 @@ int main(int argc, char *argv[])
         log_fatal("Set frequency correction failed.");
         return 1;
     }
-    if (nrsc5_set_frequency(radio, st->freq) != 0)
+    // recordings set the frequency and mode from their header
+    if (!nrsc5_is_recording(radio) && nrsc5_set_frequency(radio, st->freq) != 0)
     {
         log_fatal("Set frequency failed.");
         return 1;
     }
-    nrsc5_set_mode(radio, st->mode);
+    if (!nrsc5_is_recording(radio) || st->mode == NRSC5_MODE_AM)
+        nrsc5_set_mode(radio, st->mode);
+    if (st->seek > 0 && nrsc5_seek_file(radio, st->seek) != 0)
+    {
+        log_fatal("Seek failed.");
+        return 1;
+    }
+    if (st->low_latency && nrsc5_set_low_latency(radio, 1, st->elastic_depth) != 0)
+    {
+        log_fatal("Set low-latency mode failed.");
+        return 1;
+    }
+    if (st->iq_output_name && nrsc5_record_iq(radio, st->iq_output_name, st->iq_format == IQ_FORMAT_COMPRESSED) != 0)
+    {
+        log_fatal("Unable to open IQ output.");
+        return 1;
+    }
     if (st->gain >= 0.0f)
         nrsc5_set_gain(radio, st->gain);
     nrsc5_set_callback(radio, callback, st);
@@ -44,7 +44,8 @@
 
 static void help(const char *progname)
 {
-    fprintf(stderr, "Usage: %s [-v] [-q] [--am] [-l log-level] [-d Soapy-device-args] [-p ppm-error] [-g gain-name=gain-value...] [-r iq-input] [-w iq-output] [-o audio-output] [-t audio-type] [-T] [-A antenna] [--dump-hdc hdc-output] [--dump-aas-files directory] frequency program\n", progname);
+    fprintf(stderr, "Usage: %s [-v] [-q] [--am] [-l log-level] [-d Soapy-device-args] [-p ppm-error] [-g gain-name=gain-value...] [-r iq-input] [--mmap] [--jobs threads] [--seek seconds] [--low-latency depth] [-w iq-output] [--iq-format raw|chunked|compressed] [-o audio-output] [-t audio-type] [-T] [-A antenna] [--dump-hdc hdc-output] [--dump-aas-files directory] frequency program\n", progname);
+    fprintf(stderr, "       %s --daemon [-q] [-l log-level] [-j threads] [-o output-dir] config-file\n", progname);
 }
 
 static int parse_args(state_t *st, int argc, char *argv[])
@@ -53,6 +54,11 @@ static int parse_args(state_t *st, int argc, char *argv[])
         { "dump-aas-files", required_argument, NULL, 1 },
         { "dump-hdc", required_argument, NULL, 2 },
         { "am", no_argument, NULL, 3 },
+        { "mmap", no_argument, NULL, 4 },
+        { "low-latency", required_argument, NULL, 5 },
+        { "iq-format", required_argument, NULL, 6 },
+        { "seek", required_argument, NULL, 7 },
+        { "jobs", required_argument, NULL, 8 },
         { 0 }
     };
     const char *version = NULL;
@@ -81,6 +87,48 @@ static int parse_args(state_t *st, int argc, char *argv[])
         case 3:
             st->mode = NRSC5_MODE_AM;
             break;
+        case 4:
+            st->use_mmap = 1;
+            break;
+        case 5:
+            st->elastic_depth = strtoul(optarg, &endptr, 10);
+            if (*endptr != 0)
+            {
+                log_fatal("Invalid low-latency depth.");
+                return -1;
+            }
+            st->low_latency = 1;
+            break;
+        case 6:
+            if (strcmp(optarg, "raw") == 0)
+                st->iq_format = IQ_FORMAT_RAW;
+            else if (strcmp(optarg, "chunked") == 0)
+                st->iq_format = IQ_FORMAT_CHUNKED;
+            else if (strcmp(optarg, "compressed") == 0)
+                st->iq_format = IQ_FORMAT_COMPRESSED;
+            else
+            {
+                log_fatal("IQ format must be raw, chunked or compressed.");
+                return -1;
+            }
+            break;
+        case 7:
+            st->seek = strtof(optarg, &endptr);
+            if (*endptr != 0 || !(st->seek >= 0))
+            {
+                log_fatal("Invalid seek offset.");
+                return -1;
+            }
+            break;
+        case 8:
+            st->jobs = strtoul(optarg, &endptr, 10);
+            if (*endptr != 0)
+            {
+                log_fatal("Invalid number of jobs.");
+                return -1;
+            }
+            st->use_jobs = 1;
+            break;
         case 'r':
             st->input_name = strdup(optarg);
             break;
@@ -167,7 +215,17 @@ static int parse_args(state_t *st, int argc, char *argv[])
         return 1;
     }
 
-    if (output_name)
+    if (output_name && st->iq_format != IQ_FORMAT_RAW)
+    {
+        // the library writes chunked recordings itself
+        if (strcmp(output_name, "-") == 0)
+        {
+            log_fatal("Chunked IQ output must be a file.");
+            return 1;
+        }
+        st->iq_output_name = strdup(output_name);
+    }
+    else if (output_name)
     {
         if (strcmp(output_name, "-") == 0)
             st->iq_file = stdout;
@@ -208,6 +266,12 @@ int main(int argc, char *argv[])
     log_set_udata(&log_mutex);
 
     ao_initialize();
+    if (argc > 1 && strcmp(argv[1], "--daemon") == 0)
+    {
+        int ret = daemon_main(argc - 1, argv + 1);
+        ao_shutdown();
+        return ret;
+    }
     init_audio_buffers(st);
     if (parse_args(st, argc, argv) != 0)
         return 0;
@@ -218,7 +282,23 @@ int main(int argc, char *argv[])
     setmode(fileno(stdout), O_BINARY);
 #endif
 
-    if (st->input_name)
+    if (st->input_name && st->use_jobs)
+    {
+        if (nrsc5_open_segmented(&radio, st->input_name, st->jobs, 0) != 0)
+        {
+            log_fatal("Open IQ file for parallel decoding failed.");
+            return 1;
+        }
+    }
+    else if (st->input_name && st->use_mmap)
+    {
+        if (nrsc5_open_mmap(&radio, st->input_name) != 0)
+        {
+            log_fatal("Map IQ file failed.");
+            return 1;
+        }
+    }
+    else if (st->input_name)
     {
         FILE *fp = strcmp(st->input_name, "-") == 0 ? stdin : fopen(st->input_name, "rb");
         if (fp == NULL)
@@ -255,12 +335,29 @@ int main(int argc, char *argv[])
         log_fatal("Set frequency correction failed.");
         return 1;
     }
-    if (nrsc5_set_frequency(radio, st->freq) != 0)
+    // recordings set the frequency and mode from their header
+    if (!nrsc5_is_recording(radio) && nrsc5_set_frequency(radio, st->freq) != 0)
     {
         log_fatal("Set frequency failed.");
         return 1;
     }
-    nrsc5_set_mode(radio, st->mode);
+    if (!nrsc5_is_recording(radio) || st->mode == NRSC5_MODE_AM)
+        nrsc5_set_mode(radio, st->mode);
+    if (st->seek > 0 && nrsc5_seek_file(radio, st->seek) != 0)
+    {
+        log_fatal("Seek failed.");
+        return 1;
+    }
+    if (st->low_latency && nrsc5_set_low_latency(radio, 1, st->elastic_depth) != 0)
+    {
+        log_fatal("Set low-latency mode failed.");
+        return 1;
+    }
+    if (st->iq_output_name && nrsc5_record_iq(radio, st->iq_output_name, st->iq_format == IQ_FORMAT_COMPRESSED) != 0)
+    {
+        log_fatal("Unable to open IQ output.");
+        return 1;
+    }
     if (st->gain_settings)
         nrsc5_set_gain(radio, st->gain_settings);
     nrsc5_set_callback(radio, callback, st);
@@ -178,14 +178,14 @@ static void write_adts_header(FILE *fp, unsigned int len)
     fwrite(hdr, 7, 1, fp);
 }
 
-static void dump_hdc(FILE *fp, const uint8_t *pkt, unsigned int len)
+void dump_hdc(FILE *fp, const uint8_t *pkt, unsigned int len)
 {
     write_adts_header(fp, len);
     fwrite(pkt, len, 1, fp);
     fflush(fp);
 }
 
-static void dump_aas_file(state_t *st, const nrsc5_event_t *evt)
+void dump_aas_file(const char *path, const nrsc5_event_t *evt)
 {
 #if defined(WIN32) || defined(_WIN32)
 #define PATH_SEPARATOR "\\"
@@ -221,10 +221,10 @@ static void dump_aas_file(state_t *st, const nrsc5_event_t *evt)
         return;
     }
 
-    char fullpath[strlen(st->aas_files_path) + strlen(name) + 16];
+    char fullpath[strlen(path) + strlen(name) + 16];
     FILE *fp;
 
-    sprintf(fullpath, "%s" PATH_SEPARATOR "%u_%s", st->aas_files_path, number, name);
+    sprintf(fullpath, "%s" PATH_SEPARATOR "%u_%s", path, number, name);
     fp = fopen(fullpath, "wb");
     if (fp == NULL)
     {
@@ -316,6 +316,8 @@ void callback(const nrsc5_event_t *evt, void *opaque)
 
             if (st->audio_packets_valid >= 32) {
                 log_info("Audio bit rate: %.1f kbps", (float)st->audio_bytes * 8 * NRSC5_SAMPLE_RATE_AUDIO / NRSC5_AUDIO_FRAME_SAMPLES / st->audio_packets_valid / 1000);
+                if (st->low_latency && st->audio_latency > 0)
+                    log_info("Audio latency: %.2f s", st->audio_latency);
                 st->audio_packets_valid = 0;
                 st->audio_bytes = 0;
             }
@@ -329,6 +331,8 @@ void callback(const nrsc5_event_t *evt, void *opaque)
         }
         break;
     case NRSC5_EVENT_AUDIO:
+        if (evt->audio.program == st->program)
+            st->audio_latency = evt->audio.latency;
         push_audio_buffer(st, evt->audio.program, evt->audio.data, evt->audio.count);
         break;
     case NRSC5_EVENT_SYNC:
@@ -390,7 +394,7 @@ void callback(const nrsc5_event_t *evt, void *opaque)
         break;
     case NRSC5_EVENT_LOT:
         if (st->aas_files_path)
-            dump_aas_file(st, evt);
+            dump_aas_file(st->aas_files_path, evt);
         strftime(time_str, sizeof(time_str), "%Y-%m-%dT%H:%M:%SZ", evt->lot.expiry_utc);
         log_info("LOT file: port=%04X lot=%d name=%s size=%d mime=%08X expiry=%s", evt->lot.component->data.port, evt->lot.lot, evt->lot.name, evt->lot.size, evt->lot.mime, time_str);
         break;
@@ -495,7 +499,7 @@ void callback(const nrsc5_event_t *evt, void *opaque)
         break;
     case NRSC5_EVENT_HERE_IMAGE:
         if (st->aas_files_path)
-            dump_aas_file(st, evt);
+            dump_aas_file(st->aas_files_path, evt);
         strftime(time_str, sizeof(time_str), "%Y-%m-%dT%H:%M:%SZ", evt->here_image.time_utc);
         log_info("HERE Image: type=%s, seq=%d, n1=%d, n2=%d, time=%s, lat1=%.5f, lon1=%.5f, lat2=%.5f, lon2=%.5f, name=%s, size=%d",
                  evt->here_image.image_type == NRSC5_HERE_IMAGE_TRAFFIC ? "TRAFFIC" : "WEATHER",
@@ -602,6 +606,7 @@ void cleanup(state_t *st)
         fclose(st->iq_file);
 
     free(st->input_name);
+    free(st->iq_output_name);
     free(st->aas_files_path);
 
     if (st->dev)
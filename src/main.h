@@ -4,6 +4,10 @@
 #define AUDIO_THRESHOLD 8
 #define AUDIO_DATA_LENGTH 8192
 
+#define IQ_FORMAT_RAW 0
+#define IQ_FORMAT_CHUNKED 1
+#define IQ_FORMAT_COMPRESSED 2
+
 typedef struct buffer_t {
     struct buffer_t *next;
     // The samples are signed 16-bit integers, but ao_play requires a char buffer.
@@ -20,6 +24,7 @@ typedef struct {
     int direct_sampling;
     int ppm_error;
     char *rtltcp_host;
+    char *serve_address;
 #elif defined USE_SDRPLAY
     float gain;
     char *device_serial;
@@ -34,9 +39,17 @@ typedef struct {
     char *antenna;
 #endif
     char *input_name;
+    int use_mmap;
+    int use_jobs;
+    unsigned int jobs;
+    float seek;
+    int low_latency;
+    unsigned int elastic_depth;
     ao_device *dev;
     FILE *hdc_file;
     FILE *iq_file;
+    char *iq_output_name;
+    int iq_format;
     char *aas_files_path;
 
     audio_buffer_t *head, *tail, *free;
@@ -49,13 +62,20 @@ typedef struct {
     unsigned int audio_packets;
     unsigned int audio_bytes;
     unsigned int audio_errors;
+    float audio_latency;
     int done;
 } state_t;
 
 ao_device *open_ao_live(void);
 ao_device *open_ao_file(const char *name, const char *type);
 void init_audio_buffers(state_t *st);
+void dump_hdc(FILE *fp, const uint8_t *pkt, unsigned int len);
+void dump_aas_file(const char *path, const nrsc5_event_t *evt);
 void callback(const nrsc5_event_t *evt, void *opaque);
 void *input_main(void *arg);
 void log_lock(void *udata, int lock);
 void cleanup(state_t *st);
+int daemon_main(int argc, char *argv[]);
+#ifdef USE_RTLSDR
+int connect_tcp(char *host, const char *default_port);
+#endif
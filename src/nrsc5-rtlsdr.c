@@ -112,7 +112,7 @@ error:
 
 static int using_worker(nrsc5_t *st)
 {
-    return st->dev || st->rtltcp || st->iq_file;
+    return st->dev || st->rtltcp || st->iq_reader || st->segmenter || st->iq_map.data;
 }
 
 static void worker_cb(uint8_t *buf, uint32_t len, void *arg)
@@ -134,6 +134,8 @@ static void *worker_thread(void *arg)
     {
         if (st->stopped && !st->worker_stopped)
         {
+            if (st->rtltcp)
+                rtltcp_stop(st->rtltcp);
             st->worker_stopped = 1;
             pthread_cond_broadcast(&st->worker_cond);
         }
@@ -153,6 +155,13 @@ static void *worker_thread(void *arg)
                     continue;
                 }
             }
+
+            if (st->rtltcp && rtltcp_start(st->rtltcp) != 0)
+            {
+                log_error("Failed to start rtl_tcp reader");
+                st->stopped = 1;
+                continue;
+            }
         }
 
         if (st->stopped)
@@ -172,22 +181,63 @@ static void *worker_thread(void *arg)
             }
             else if (st->rtltcp)
             {
+                unsigned int dropped;
+
                 err = rtltcp_read(st->rtltcp, st->samples_buf, sizeof(st->samples_buf));
+                dropped = rtltcp_take_dropped(st->rtltcp);
+                if (dropped > 0)
+                {
+                    log_warn("rtl_tcp: dropped %u samples", dropped);
+                    stats_source_drops(&st->stats, dropped);
+                }
                 if (err >= 0)
                 {
-                    // a short read is possible when EOF and may not be aligned
-                    input_push_cu8(&st->input, st->samples_buf, err & ~3);
-                    if (err == sizeof(st->samples_buf))
-                        err = 0;
+                    // the reader returns whole pairs of samples, and fewer
+                    // than requested when the network is slow
+                    if (err > 0)
+                        input_push_cu8(&st->input, st->samples_buf, err);
+                    err = 0;
+                }
+            }
+            else if (st->iq_reader)
+            {
+                const uint8_t *span;
+                size_t len = iqfile_reader_next(st->iq_reader, &span);
+                if (len > 0 && iqfile_reader_format(st->iq_reader) == IQFILE_FORMAT_CU8)
+                    input_push_cu8(&st->input, span, len);
+                else if (len > 0)
+                    input_push_cs16(&st->input, (const int16_t *)span, len / 2);
+                else
+                {
+                    float factor;
+                    nrsc5_get_realtime_factor(st, &factor);
+                    log_info("Decoded file at %.1fx realtime", factor);
+                    err = 1;
+                }
+            }
+            else if (st->segmenter)
+            {
+                if (segmenter_deliver(st->segmenter) != 0)
+                {
+                    float factor;
+                    nrsc5_get_realtime_factor(st, &factor);
+                    log_info("Decoded file at %.1fx realtime", factor);
+                    err = 1;
                 }
             }
-            else if (st->iq_file)
+            else if (st->iq_map.data)
             {
-                int count = fread(st->samples_buf, 4, sizeof(st->samples_buf) / 4, st->iq_file);
-                if (count > 0)
-                    input_push_cu8(&st->input, st->samples_buf, count * 4);
-                if (feof(st->iq_file) || ferror(st->iq_file))
+                const uint8_t *span;
+                size_t len = iqmap_next(&st->iq_map, &span);
+                if (len > 0)
+                    input_push_cu8(&st->input, span, len);
+                else
+                {
+                    float factor;
+                    nrsc5_get_realtime_factor(st, &factor);
+                    log_info("Decoded file at %.1fx realtime", factor);
                     err = 1;
+                }
             }
 
             pthread_mutex_lock(&st->worker_mutex);
@@ -204,7 +254,7 @@ static void *worker_thread(void *arg)
     return NULL;
 }
 
-static void nrsc5_init(nrsc5_t *st)
+static int nrsc5_init(nrsc5_t *st)
 {
     st->closed = 0;
     st->stopped = 1;
@@ -214,9 +264,14 @@ static void nrsc5_init(nrsc5_t *st)
     st->freq = NRSC5_SCAN_BEGIN;
     st->mode = NRSC5_MODE_FM;
     st->callback = NULL;
+    st->event_mask = NRSC5_EVENT_MASK_ALL;
 
     output_init(&st->output, st);
-    input_init(&st->input, st, &st->output);
+    if (input_init(&st->input, st, &st->output) != 0)
+    {
+        output_free(&st->output);
+        return 1;
+    }
 
     if (using_worker(st))
     {
@@ -225,6 +280,7 @@ static void nrsc5_init(nrsc5_t *st)
         pthread_cond_init(&st->worker_cond, NULL);
         pthread_create(&st->worker, NULL, worker_thread, st);
     }
+    return 0;
 }
 
 static nrsc5_t *nrsc5_alloc(void)
@@ -248,13 +304,15 @@ int nrsc5_open(nrsc5_t **result, int device_index)
     err = rtlsdr_set_offset_tuning(st->dev, 1);
     if (err && err != -2) goto error;
 
-    nrsc5_init(st);
+    if (nrsc5_init(st) != 0)
+        goto error_close;
 
     *result = st;
     return 0;
 
 error:
     log_error("nrsc5_open error: %d", err);
+error_close:
     rtlsdr_close(st->dev);
 error_init:
     free(st);
@@ -264,9 +322,99 @@ error_init:
 
 int nrsc5_open_file(nrsc5_t **result, FILE *fp)
 {
+    iqfile_info_t info;
     nrsc5_t *st = nrsc5_alloc();
+
+    st->iq_reader = iqfile_reader_open(fp, IQFILE_FORMAT_CU8, &info);
+    if (!st->iq_reader)
+    {
+        free(st);
+        *result = NULL;
+        return 1;
+    }
     st->iq_file = fp;
-    nrsc5_init(st);
+    if (nrsc5_init(st) != 0)
+    {
+        iqfile_reader_close(st->iq_reader);
+        free(st);
+        *result = NULL;
+        return 1;
+    }
+    if (iqfile_reader_is_container(st->iq_reader) && nrsc5_load_recording(st, &info) != 0)
+    {
+        // the caller keeps the file on failure
+        st->iq_file = NULL;
+        nrsc5_close(st);
+        *result = NULL;
+        return 1;
+    }
+
+    *result = st;
+    return 0;
+}
+
+int nrsc5_open_segmented(nrsc5_t **result, const char *path, unsigned int threads, float segment_length)
+{
+    iqfile_info_t info;
+    nrsc5_t *st = nrsc5_alloc();
+
+    st->segmenter = segmenter_open(st, path, IQFILE_FORMAT_CU8, threads, segment_length, &info);
+    if (!st->segmenter)
+    {
+        free(st);
+        *result = NULL;
+        return 1;
+    }
+    if (nrsc5_init(st) != 0)
+    {
+        segmenter_close(st->segmenter);
+        free(st);
+        *result = NULL;
+        return 1;
+    }
+    // only recordings carry a sample rate
+    if (info.sample_rate && nrsc5_load_recording(st, &info) != 0)
+    {
+        nrsc5_close(st);
+        *result = NULL;
+        return 1;
+    }
+
+    *result = st;
+    return 0;
+}
+
+int nrsc5_open_mmap(nrsc5_t **result, const char *path)
+{
+    nrsc5_t *st = nrsc5_alloc();
+
+    if (iqmap_open(&st->iq_map, path, 4) != 0)
+    {
+        free(st);
+        *result = NULL;
+        return 1;
+    }
+    if (iqfile_probe(st->iq_map.data, st->iq_map.size))
+    {
+        // recordings may be compressed, so they go through the reader thread
+        FILE *fp = fopen(path, "rb");
+
+        iqmap_close(&st->iq_map);
+        free(st);
+        if (fp && nrsc5_open_file(result, fp) == 0)
+            return 0;
+        if (fp)
+            fclose(fp);
+        *result = NULL;
+        return 1;
+    }
+    if (nrsc5_init(st) != 0)
+    {
+        iqmap_close(&st->iq_map);
+        free(st);
+        *result = NULL;
+        return 1;
+    }
 
     *result = st;
     return 0;
@@ -275,12 +423,50 @@ int nrsc5_open_file(nrsc5_t **result, FILE *fp)
 int nrsc5_open_pipe(nrsc5_t **result)
 {
     nrsc5_t *st = nrsc5_alloc();
-    nrsc5_init(st);
+
+    if (nrsc5_init(st) != 0)
+    {
+        free(st);
+        *result = NULL;
+        return 1;
+    }
 
     *result = st;
     return 0;
 }
 
+int nrsc5_serve_rtltcp(nrsc5_t *st, int listen_socket)
+{
+    // Clients cannot change the gain of a shared device, but they expect a
+    // tuner with a gain table. Without a local device, announce an R820T.
+    uint32_t tuner_type = RTLSDR_TUNER_R820T;
+    int gain_count = 29;
+
+    if (!st->stopped)
+        return 1;
+
+    iq_server_close(st->iq_server);
+    st->iq_server = NULL;
+    if (listen_socket < 0)
+        return 0;
+
+    if (st->dev)
+    {
+        tuner_type = rtlsdr_get_tuner_type(st->dev);
+        gain_count = rtlsdr_get_tuner_gains(st->dev, NULL);
+    }
+
+    st->iq_server = iq_server_open(listen_socket, tuner_type, gain_count > 0 ? gain_count : 0);
+    return st->iq_server ? 0 : 1;
+}
+
+int nrsc5_set_rtltcp_buffers(nrsc5_t *st, int rcvbuf, size_t ring_size)
+{
+    if (!st->rtltcp || rcvbuf < 0)
+        return 1;
+    return rtltcp_set_buffers(st->rtltcp, rcvbuf, ring_size);
+}
+
 int nrsc5_open_rtltcp(nrsc5_t **result, int socket)
 {
     int err;
@@ -297,7 +483,8 @@ int nrsc5_open_rtltcp(nrsc5_t **result, int socket)
     err = rtltcp_set_offset_tuning(st->rtltcp, 1);
     if (err) goto error;
 
-    nrsc5_init(st);
+    if (nrsc5_init(st) != 0)
+        goto error;
 
     *result = st;
     return 0;
@@ -326,11 +513,17 @@ void nrsc5_close(nrsc5_t *st)
 
     if (st->dev)
         rtlsdr_close(st->dev);
+    nrsc5_record_iq(st, NULL, 0);
+    iqfile_reader_close(st->iq_reader);
+    segmenter_close(st->segmenter);
     if (st->iq_file)
         fclose(st->iq_file);
+    iqmap_close(&st->iq_map);
     if (st->rtltcp)
         rtltcp_close(st->rtltcp);
+    iq_server_close(st->iq_server);
 
+    event_queue_free(&st->events);
     input_free(&st->input);
     output_free(&st->output);
     free(st);
@@ -369,11 +562,7 @@ void nrsc5_stop(nrsc5_t *st)
 int nrsc5_set_mode(nrsc5_t *st, int mode)
 {
     if (mode == NRSC5_MODE_FM || mode == NRSC5_MODE_AM)
-    {
-        st->mode = mode;
-        input_set_mode(&st->input);
-        return 0;
-    }
+        return input_set_mode(&st->input, mode);
     return 1;
 }
 
@@ -450,7 +639,7 @@ int nrsc5_set_frequency(nrsc5_t *st, float freq)
 
     if (st->auto_gain)
         st->gain = -1;
-    input_reset(&st->input);
+    input_set_frequency(&st->input, freq);
     output_reset(&st->output);
 
     st->freq = freq;
@@ -553,3 +742,21 @@ int nrsc5_pipe_samples_cs16(nrsc5_t *st, const int16_t *samples, unsigned int le
 
     return 0;
 }
+
+int nrsc5_pipe_samples_cs16_planar(nrsc5_t *st, const int16_t *i, const int16_t *q, unsigned int length)
+{
+    input_push_cs16_planar(&st->input, i, q, length);
+    return 0;
+}
+
+int nrsc5_pipe_samples_cs8(nrsc5_t *st, const int8_t *samples, unsigned int length)
+{
+    input_push_cs8(&st->input, samples, length);
+    return 0;
+}
+
+int nrsc5_pipe_samples_cf32(nrsc5_t *st, const float *samples, unsigned int length)
+{
+    input_push_cf32(&st->input, samples, length);
+    return 0;
+}
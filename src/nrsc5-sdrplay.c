@@ -12,7 +12,7 @@ static void event_callback(sdrplay_api_EventT eventId, sdrplay_api_TunerSelectT
 
 static int using_worker(nrsc5_t *st)
 {
-    return st->iq_file != NULL;
+    return st->iq_reader != NULL || st->segmenter != NULL || st->iq_map.data != NULL;
 }
 
 // fv - FIXME
@@ -54,13 +54,45 @@ static void *worker_thread(void *arg)
 
             pthread_mutex_unlock(&st->worker_mutex);
 
-            if (st->iq_file)
+            if (st->iq_reader)
             {
-                int count = fread(st->samples_buf, 4, sizeof(st->samples_buf) / 4, st->iq_file);
-                if (count > 0)
-                    input_push_cs16(&st->input, st->samples_buf, count * 4);
-                if (feof(st->iq_file) || ferror(st->iq_file))
+                const uint8_t *span;
+                size_t len = iqfile_reader_next(st->iq_reader, &span);
+                if (len > 0 && iqfile_reader_format(st->iq_reader) == IQFILE_FORMAT_CU8)
+                    input_push_cu8(&st->input, span, len);
+                else if (len > 0)
+                    input_push_cs16(&st->input, (const int16_t *)span, len / 2);
+                else
+                {
+                    float factor;
+                    nrsc5_get_realtime_factor(st, &factor);
+                    log_info("Decoded file at %.1fx realtime", factor);
                     err = 1;
+                }
+            }
+            else if (st->segmenter)
+            {
+                if (segmenter_deliver(st->segmenter) != 0)
+                {
+                    float factor;
+                    nrsc5_get_realtime_factor(st, &factor);
+                    log_info("Decoded file at %.1fx realtime", factor);
+                    err = 1;
+                }
+            }
+            else if (st->iq_map.data)
+            {
+                const uint8_t *span;
+                size_t len = iqmap_next(&st->iq_map, &span);
+                if (len > 0)
+                    input_push_cs16(&st->input, (const int16_t *)span, len / 2);
+                else
+                {
+                    float factor;
+                    nrsc5_get_realtime_factor(st, &factor);
+                    log_info("Decoded file at %.1fx realtime", factor);
+                    err = 1;
+                }
             }
 
             pthread_mutex_lock(&st->worker_mutex);
@@ -77,7 +109,7 @@ static void *worker_thread(void *arg)
     return NULL;
 }
 
-static void nrsc5_init(nrsc5_t *st)
+static int nrsc5_init(nrsc5_t *st)
 {
     st->closed = 0;
     st->stopped = 1;
@@ -86,9 +118,14 @@ static void nrsc5_init(nrsc5_t *st)
     st->freq = NRSC5_SCAN_BEGIN;
     st->mode = NRSC5_MODE_FM;
     st->callback = NULL;
+    st->event_mask = NRSC5_EVENT_MASK_ALL;
 
     output_init(&st->output, st);
-    input_init(&st->input, st, &st->output);
+    if (input_init(&st->input, st, &st->output) != 0)
+    {
+        output_free(&st->output);
+        return 1;
+    }
 
     if (using_worker(st))
     {
@@ -97,6 +134,7 @@ static void nrsc5_init(nrsc5_t *st)
         pthread_cond_init(&st->worker_cond, NULL);
         pthread_create(&st->worker, NULL, worker_thread, st);
     }
+    return 0;
 }
 
 static nrsc5_t *nrsc5_alloc(void)
@@ -186,13 +224,15 @@ int nrsc5_open(nrsc5_t **result, char *device_serial, char *antenna)
     /* increase bandwidth since NRSC5 requires about 400kHz */
     st->ch_params->tunerParams.bwType = sdrplay_api_BW_0_600;
 
-    nrsc5_init(st);
+    if (nrsc5_init(st) != 0)
+        goto error_release;
 
     *result = st;
     return 0;
 
 error:
     log_error("nrsc5_open error: %d", err);
+error_release:
     sdrplay_api_LockDeviceApi();
     sdrplay_api_ReleaseDevice(&st->dev);
 error_release_api_lock:
@@ -206,9 +246,99 @@ error_init:
 
 int nrsc5_open_file(nrsc5_t **result, FILE *fp)
 {
+    iqfile_info_t info;
     nrsc5_t *st = nrsc5_alloc();
+
+    st->iq_reader = iqfile_reader_open(fp, IQFILE_FORMAT_CS16, &info);
+    if (!st->iq_reader)
+    {
+        free(st);
+        *result = NULL;
+        return 1;
+    }
     st->iq_file = fp;
-    nrsc5_init(st);
+    if (nrsc5_init(st) != 0)
+    {
+        iqfile_reader_close(st->iq_reader);
+        free(st);
+        *result = NULL;
+        return 1;
+    }
+    if (iqfile_reader_is_container(st->iq_reader) && nrsc5_load_recording(st, &info) != 0)
+    {
+        // the caller keeps the file on failure
+        st->iq_file = NULL;
+        nrsc5_close(st);
+        *result = NULL;
+        return 1;
+    }
+
+    *result = st;
+    return 0;
+}
+
+int nrsc5_open_segmented(nrsc5_t **result, const char *path, unsigned int threads, float segment_length)
+{
+    iqfile_info_t info;
+    nrsc5_t *st = nrsc5_alloc();
+
+    st->segmenter = segmenter_open(st, path, IQFILE_FORMAT_CS16, threads, segment_length, &info);
+    if (!st->segmenter)
+    {
+        free(st);
+        *result = NULL;
+        return 1;
+    }
+    if (nrsc5_init(st) != 0)
+    {
+        segmenter_close(st->segmenter);
+        free(st);
+        *result = NULL;
+        return 1;
+    }
+    // only recordings carry a sample rate
+    if (info.sample_rate && nrsc5_load_recording(st, &info) != 0)
+    {
+        nrsc5_close(st);
+        *result = NULL;
+        return 1;
+    }
+
+    *result = st;
+    return 0;
+}
+
+int nrsc5_open_mmap(nrsc5_t **result, const char *path)
+{
+    nrsc5_t *st = nrsc5_alloc();
+
+    if (iqmap_open(&st->iq_map, path, 4) != 0)
+    {
+        free(st);
+        *result = NULL;
+        return 1;
+    }
+    if (iqfile_probe(st->iq_map.data, st->iq_map.size))
+    {
+        // recordings may be compressed, so they go through the reader thread
+        FILE *fp = fopen(path, "rb");
+
+        iqmap_close(&st->iq_map);
+        free(st);
+        if (fp && nrsc5_open_file(result, fp) == 0)
+            return 0;
+        if (fp)
+            fclose(fp);
+        *result = NULL;
+        return 1;
+    }
+    if (nrsc5_init(st) != 0)
+    {
+        iqmap_close(&st->iq_map);
+        free(st);
+        *result = NULL;
+        return 1;
+    }
 
     *result = st;
     return 0;
@@ -217,7 +347,13 @@ int nrsc5_open_file(nrsc5_t **result, FILE *fp)
 int nrsc5_open_pipe(nrsc5_t **result)
 {
     nrsc5_t *st = nrsc5_alloc();
-    nrsc5_init(st);
+
+    if (nrsc5_init(st) != 0)
+    {
+        free(st);
+        *result = NULL;
+        return 1;
+    }
 
     *result = st;
     return 0;
@@ -246,9 +382,14 @@ void nrsc5_close(nrsc5_t *st)
         sdrplay_api_UnlockDeviceApi();
         sdrplay_api_Close();
     }
+    nrsc5_record_iq(st, NULL, 0);
+    iqfile_reader_close(st->iq_reader);
+    segmenter_close(st->segmenter);
     if (st->iq_file)
         fclose(st->iq_file);
+    iqmap_close(&st->iq_map);
 
+    event_queue_free(&st->events);
     input_free(&st->input);
     output_free(&st->output);
     free(st);
@@ -322,11 +463,7 @@ void nrsc5_stop(nrsc5_t *st)
 int nrsc5_set_mode(nrsc5_t *st, int mode)
 {
     if (mode == NRSC5_MODE_FM || mode == NRSC5_MODE_AM)
-    {
-        st->mode = mode;
-        input_set_mode(&st->input);
-        return 0;
-    }
+        return input_set_mode(&st->input, mode);
     return 1;
 }
 
@@ -425,7 +562,7 @@ int nrsc5_set_frequency(nrsc5_t *st, float freq)
     if (st->ch_params)
         st->ch_params->tunerParams.rfFreq.rfHz = freq;
 
-    input_reset(&st->input);
+    input_set_frequency(&st->input, freq);
     output_reset(&st->output);
 
     st->freq = freq;
@@ -534,6 +671,24 @@ int nrsc5_pipe_samples_cs16(nrsc5_t *st, const int16_t *samples, unsigned int le
     return 0;
 }
 
+int nrsc5_pipe_samples_cs16_planar(nrsc5_t *st, const int16_t *i, const int16_t *q, unsigned int length)
+{
+    input_push_cs16_planar(&st->input, i, q, length);
+    return 0;
+}
+
+int nrsc5_pipe_samples_cs8(nrsc5_t *st, const int8_t *samples, unsigned int length)
+{
+    input_push_cs8(&st->input, samples, length);
+    return 0;
+}
+
+int nrsc5_pipe_samples_cf32(nrsc5_t *st, const float *samples, unsigned int length)
+{
+    input_push_cf32(&st->input, samples, length);
+    return 0;
+}
+
 // SDRplay RX and event callbacks
 static void stream_callback(short *xi, short *xq, sdrplay_api_StreamCbParamsT *params,
                             unsigned int numSamples, unsigned int reset, void *cbContext)
@@ -543,40 +698,7 @@ static void stream_callback(short *xi, short *xq, sdrplay_api_StreamCbParamsT *p
 
     nrsc5_t *st = (nrsc5_t *) cbContext;
 
-    unsigned int num_loops = numSamples / 4;
-    for (unsigned int i = 0; i < num_loops; i++) {
-        st->samples_buf[8*i+0] = xi[4*i];
-        st->samples_buf[8*i+2] = xi[4*i+1];
-        st->samples_buf[8*i+4] = xi[4*i+2];
-        st->samples_buf[8*i+6] = xi[4*i+3];
-        st->samples_buf[8*i+1] = xq[4*i];
-        st->samples_buf[8*i+3] = xq[4*i+1];
-        st->samples_buf[8*i+5] = xq[4*i+2];
-        st->samples_buf[8*i+7] = xq[4*i+3];
-    }
-    switch (numSamples % 4) {
-        case 0:
-            break;
-        case 1:
-            st->samples_buf[numSamples*2-2] = xi[numSamples-1];
-            st->samples_buf[numSamples*2-1] = xq[numSamples-1];
-            break;
-        case 2:
-            st->samples_buf[numSamples*2-4] = xi[numSamples-2];
-            st->samples_buf[numSamples*2-2] = xi[numSamples-1];
-            st->samples_buf[numSamples*2-3] = xq[numSamples-2];
-            st->samples_buf[numSamples*2-1] = xq[numSamples-1];
-            break;
-        case 3:
-            st->samples_buf[numSamples*2-6] = xi[numSamples-3];
-            st->samples_buf[numSamples*2-4] = xi[numSamples-2];
-            st->samples_buf[numSamples*2-2] = xi[numSamples-1];
-            st->samples_buf[numSamples*2-5] = xq[numSamples-3];
-            st->samples_buf[numSamples*2-3] = xq[numSamples-2];
-            st->samples_buf[numSamples*2-1] = xq[numSamples-1];
-            break;
-    }
-    input_push_cs16(&st->input, st->samples_buf, numSamples*2);
+    input_push_cs16_planar(&st->input, xi, xq, numSamples);
     return;
 }
 
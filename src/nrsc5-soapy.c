@@ -5,7 +5,7 @@
 
 static int using_worker(nrsc5_t *st)
 {
-    return st->dev || st->iq_file;
+    return st->dev || st->iq_reader || st->segmenter || st->iq_map.data;
 }
 
 // fv - FIXME
@@ -18,6 +18,42 @@ static void worker_cb(uint8_t *buf, uint32_t len, void *arg)
 }
 #endif
 
+static int read_stream(nrsc5_t *st)
+{
+    int flags;
+    long long timeNs;
+    int ret;
+
+    if (st->direct_access)
+    {
+        // consume the driver's buffer in place, avoiding a copy into samples_buf
+        size_t handle;
+        const void *buffs[1];
+
+        ret = SoapySDRDevice_acquireReadBuffer(st->dev, st->rx_stream, &handle, buffs, &flags, &timeNs, 100000);
+        if (ret < 0)
+        {
+            log_error("SoapySDRDevice_acquireReadBuffer failed");
+            return 1;
+        }
+        input_push_cs16(&st->input, buffs[0], ret * 2);
+        SoapySDRDevice_releaseReadBuffer(st->dev, st->rx_stream, handle);
+    }
+    else
+    {
+        void *buffs[] = {st->samples_buf};
+
+        ret = SoapySDRDevice_readStream(st->dev, st->rx_stream, buffs, st->stream_mtu, &flags, &timeNs, 100000);
+        if (ret < 0)
+        {
+            log_error("SoapySDRDevice_readStream failed");
+            return 1;
+        }
+        input_push_cs16(&st->input, st->samples_buf, ret * 2);
+    }
+    return 0;
+}
+
 static void *worker_thread(void *arg)
 {
     nrsc5_t *st = arg;
@@ -49,24 +85,47 @@ static void *worker_thread(void *arg)
 
             if (st->dev)
             {
-                void *buffs[] = {st->samples_buf}; //array of buffers
-                int flags; //flags set by receive operation
-                long long timeNs; //timestamp for receive buffer
-                err = SoapySDRDevice_readStream(st->dev, st->rx_stream, buffs, 128 * 256 / 2, &flags, &timeNs, 100000);
-                if (err >= 0) {
-                    input_push_cs16(&st->input, st->samples_buf, err*2);
-                    err = 0;
-                } else {
-                    log_error("SoapySDRDevice_readStream failed");
+                err = read_stream(st);
+            }
+            else if (st->iq_reader)
+            {
+                const uint8_t *span;
+                size_t len = iqfile_reader_next(st->iq_reader, &span);
+                if (len > 0 && iqfile_reader_format(st->iq_reader) == IQFILE_FORMAT_CU8)
+                    input_push_cu8(&st->input, span, len);
+                else if (len > 0)
+                    input_push_cs16(&st->input, (const int16_t *)span, len / 2);
+                else
+                {
+                    float factor;
+                    nrsc5_get_realtime_factor(st, &factor);
+                    log_info("Decoded file at %.1fx realtime", factor);
+                    err = 1;
+                }
+            }
+            else if (st->segmenter)
+            {
+                if (segmenter_deliver(st->segmenter) != 0)
+                {
+                    float factor;
+                    nrsc5_get_realtime_factor(st, &factor);
+                    log_info("Decoded file at %.1fx realtime", factor);
+                    err = 1;
                 }
             }
-            else if (st->iq_file)
+            else if (st->iq_map.data)
             {
-                int count = fread(st->samples_buf, 4, sizeof(st->samples_buf) / 4, st->iq_file);
-                if (count > 0)
-                    input_push_cs16(&st->input, st->samples_buf, count * 4);
-                if (feof(st->iq_file) || ferror(st->iq_file))
+                const uint8_t *span;
+                size_t len = iqmap_next(&st->iq_map, &span);
+                if (len > 0)
+                    input_push_cs16(&st->input, (const int16_t *)span, len / 2);
+                else
+                {
+                    float factor;
+                    nrsc5_get_realtime_factor(st, &factor);
+                    log_info("Decoded file at %.1fx realtime", factor);
                     err = 1;
+                }
             }
 
             pthread_mutex_lock(&st->worker_mutex);
@@ -83,7 +142,7 @@ static void *worker_thread(void *arg)
     return NULL;
 }
 
-static void nrsc5_init(nrsc5_t *st)
+static int nrsc5_init(nrsc5_t *st)
 {
     st->closed = 0;
     st->stopped = 1;
@@ -92,9 +151,14 @@ static void nrsc5_init(nrsc5_t *st)
     st->freq = NRSC5_SCAN_BEGIN;
     st->mode = NRSC5_MODE_FM;
     st->callback = NULL;
+    st->event_mask = NRSC5_EVENT_MASK_ALL;
 
     output_init(&st->output, st);
-    input_init(&st->input, st, &st->output);
+    if (input_init(&st->input, st, &st->output) != 0)
+    {
+        output_free(&st->output);
+        return 1;
+    }
 
     if (using_worker(st))
     {
@@ -103,6 +167,7 @@ static void nrsc5_init(nrsc5_t *st)
         pthread_cond_init(&st->worker_cond, NULL);
         pthread_create(&st->worker, NULL, worker_thread, st);
     }
+    return 0;
 }
 
 static nrsc5_t *nrsc5_alloc(void)
@@ -113,25 +178,39 @@ static nrsc5_t *nrsc5_alloc(void)
 
 int nrsc5_open(nrsc5_t **result, char *device_args)
 {
+    // common rates to fall back to, resampled to the native rate
+    static const double fallback_rates[] = { 768e3, 1e6, 1.536e6, 2e6, 2.5e6 };
     int err;
+    double rate;
     nrsc5_t *st = nrsc5_alloc();
 
     if (!(st->dev = SoapySDRDevice_makeStrArgs(device_args)))
         goto error_init;
 
     err = SoapySDRDevice_setSampleRate(st->dev, SOAPY_SDR_RX, 0, NRSC5_SAMPLE_RATE_CS16_FM);
+    for (unsigned int i = 0; err && i < sizeof(fallback_rates) / sizeof(fallback_rates[0]); i++)
+        err = SoapySDRDevice_setSampleRate(st->dev, SOAPY_SDR_RX, 0, fallback_rates[i]);
     if (err) goto error;
     /* increase bandwidth since NRSC5 requires about 400kHz */
     err = SoapySDRDevice_setBandwidth(st->dev, SOAPY_SDR_RX, 0, 600e3);
     if (err) goto error;
 
-    nrsc5_init(st);
+    if (nrsc5_init(st) != 0)
+        goto error_unmake;
+
+    rate = SoapySDRDevice_getSampleRate(st->dev, SOAPY_SDR_RX, 0);
+    if (rate > 0 && fabs(rate - NRSC5_SAMPLE_RATE_CS16_FM) > 0.5)
+    {
+        log_info("Device sample rate is %.0f Hz, resampling", rate);
+        nrsc5_set_input_rate(st, rate);
+    }
 
     *result = st;
     return 0;
 
 error:
     log_error("nrsc5_open error: %d", err);
+error_unmake:
     SoapySDRDevice_unmake(st->dev);
 error_init:
     free(st);
@@ -141,9 +220,99 @@ error_init:
 
 int nrsc5_open_file(nrsc5_t **result, FILE *fp)
 {
+    iqfile_info_t info;
     nrsc5_t *st = nrsc5_alloc();
+
+    st->iq_reader = iqfile_reader_open(fp, IQFILE_FORMAT_CS16, &info);
+    if (!st->iq_reader)
+    {
+        free(st);
+        *result = NULL;
+        return 1;
+    }
     st->iq_file = fp;
-    nrsc5_init(st);
+    if (nrsc5_init(st) != 0)
+    {
+        iqfile_reader_close(st->iq_reader);
+        free(st);
+        *result = NULL;
+        return 1;
+    }
+    if (iqfile_reader_is_container(st->iq_reader) && nrsc5_load_recording(st, &info) != 0)
+    {
+        // the caller keeps the file on failure
+        st->iq_file = NULL;
+        nrsc5_close(st);
+        *result = NULL;
+        return 1;
+    }
+
+    *result = st;
+    return 0;
+}
+
+int nrsc5_open_segmented(nrsc5_t **result, const char *path, unsigned int threads, float segment_length)
+{
+    iqfile_info_t info;
+    nrsc5_t *st = nrsc5_alloc();
+
+    st->segmenter = segmenter_open(st, path, IQFILE_FORMAT_CS16, threads, segment_length, &info);
+    if (!st->segmenter)
+    {
+        free(st);
+        *result = NULL;
+        return 1;
+    }
+    if (nrsc5_init(st) != 0)
+    {
+        segmenter_close(st->segmenter);
+        free(st);
+        *result = NULL;
+        return 1;
+    }
+    // only recordings carry a sample rate
+    if (info.sample_rate && nrsc5_load_recording(st, &info) != 0)
+    {
+        nrsc5_close(st);
+        *result = NULL;
+        return 1;
+    }
+
+    *result = st;
+    return 0;
+}
+
+int nrsc5_open_mmap(nrsc5_t **result, const char *path)
+{
+    nrsc5_t *st = nrsc5_alloc();
+
+    if (iqmap_open(&st->iq_map, path, 4) != 0)
+    {
+        free(st);
+        *result = NULL;
+        return 1;
+    }
+    if (iqfile_probe(st->iq_map.data, st->iq_map.size))
+    {
+        // recordings may be compressed, so they go through the reader thread
+        FILE *fp = fopen(path, "rb");
+
+        iqmap_close(&st->iq_map);
+        free(st);
+        if (fp && nrsc5_open_file(result, fp) == 0)
+            return 0;
+        if (fp)
+            fclose(fp);
+        *result = NULL;
+        return 1;
+    }
+    if (nrsc5_init(st) != 0)
+    {
+        iqmap_close(&st->iq_map);
+        free(st);
+        *result = NULL;
+        return 1;
+    }
 
     *result = st;
     return 0;
@@ -152,7 +321,13 @@ int nrsc5_open_file(nrsc5_t **result, FILE *fp)
 int nrsc5_open_pipe(nrsc5_t **result)
 {
     nrsc5_t *st = nrsc5_alloc();
-    nrsc5_init(st);
+
+    if (nrsc5_init(st) != 0)
+    {
+        free(st);
+        *result = NULL;
+        return 1;
+    }
 
     *result = st;
     return 0;
@@ -177,9 +352,15 @@ void nrsc5_close(nrsc5_t *st)
 
     if (st->dev)
         SoapySDRDevice_unmake(st->dev);
+    free(st->samples_buf);
+    nrsc5_record_iq(st, NULL, 0);
+    iqfile_reader_close(st->iq_reader);
+    segmenter_close(st->segmenter);
     if (st->iq_file)
         fclose(st->iq_file);
+    iqmap_close(&st->iq_map);
 
+    event_queue_free(&st->events);
     input_free(&st->input);
     output_free(&st->output);
     free(st);
@@ -194,6 +375,23 @@ void nrsc5_start(nrsc5_t *st)
             log_error("SoapySDRDevice_setupStream failed");
             return;
         }
+
+        // read whole transfer units, straight from driver buffers when possible
+        st->stream_mtu = SoapySDRDevice_getStreamMTU(st->dev, st->rx_stream);
+        if (st->stream_mtu == 0)
+            st->stream_mtu = 128 * 256 / 2;
+        st->direct_access = SoapySDRDevice_getNumDirectAccessBuffers(st->dev, st->rx_stream) > 0;
+        if (!st->direct_access)
+        {
+            free(st->samples_buf);
+            st->samples_buf = malloc(st->stream_mtu * 2 * sizeof(int16_t));
+            if (st->samples_buf == NULL)
+            {
+                log_error("Failed to allocate sample buffer");
+                SoapySDRDevice_closeStream(st->dev, st->rx_stream);
+                return;
+            }
+        }
         SoapySDRDevice_activateStream(st->dev, st->rx_stream, 0, 0, 0);
     }
 
@@ -228,17 +426,15 @@ void nrsc5_stop(nrsc5_t *st)
     {
         SoapySDRDevice_deactivateStream(st->dev, st->rx_stream, 0, 0);
         SoapySDRDevice_closeStream(st->dev, st->rx_stream);
+        free(st->samples_buf);
+        st->samples_buf = NULL;
     }
 }
 
 int nrsc5_set_mode(nrsc5_t *st, int mode)
 {
     if (mode == NRSC5_MODE_FM || mode == NRSC5_MODE_AM)
-    {
-        st->mode = mode;
-        input_set_mode(&st->input);
-        return 0;
-    }
+        return input_set_mode(&st->input, mode);
     return 1;
 }
 
@@ -296,7 +492,7 @@ int nrsc5_set_frequency(nrsc5_t *st, float freq)
     if (st->dev && SoapySDRDevice_setFrequency(st->dev, SOAPY_SDR_RX, 0, freq, NULL) != 0)
         return 1;
 
-    input_reset(&st->input);
+    input_set_frequency(&st->input, freq);
     output_reset(&st->output);
 
     st->freq = freq;
@@ -422,3 +618,21 @@ int nrsc5_pipe_samples_cs16(nrsc5_t *st, const int16_t *samples, unsigned int le
 
     return 0;
 }
+
+int nrsc5_pipe_samples_cs16_planar(nrsc5_t *st, const int16_t *i, const int16_t *q, unsigned int length)
+{
+    input_push_cs16_planar(&st->input, i, q, length);
+    return 0;
+}
+
+int nrsc5_pipe_samples_cs8(nrsc5_t *st, const int8_t *samples, unsigned int length)
+{
+    input_push_cs8(&st->input, samples, length);
+    return 0;
+}
+
+int nrsc5_pipe_samples_cf32(nrsc5_t *st, const float *samples, unsigned int length)
+{
+    input_push_cf32(&st->input, samples, length);
+    return 0;
+}
@@ -1,8 +1,17 @@
 #include <assert.h>
+#include <errno.h>
+#include <math.h>
 #include <string.h>
+#include <time.h>
 
 #include "private.h"
 
+#define SCAN_MIN_BLOCKS 2
+#define SCAN_MAX_BLOCKS 6
+#define SCAN_TIMEOUT_SEC 3
+#define SCAN_REF_THRESHOLD 0.2f
+#define SCAN_CP_THRESHOLD 8.0f
+
 pthread_mutex_t fftw_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 void nrsc5_get_version(const char **version)
@@ -98,10 +107,432 @@ void nrsc5_alert_category_name(unsigned int type, const char **name)
     }
 }
 
+int nrsc5_set_audio_ring(nrsc5_t *st, unsigned int program, size_t size)
+{
+    audio_ring_t *ring;
+
+    if (program >= MAX_PROGRAMS)
+        return 1;
+
+    ring = &st->output.audio_ring[program];
+    audio_ring_free(ring);
+    if (size == 0)
+        return 0;
+    return audio_ring_init(ring, size);
+}
+
+int nrsc5_audio_acquire(nrsc5_t *st, unsigned int program, const int16_t **data, size_t *count)
+{
+    if (program >= MAX_PROGRAMS || !st->output.audio_ring[program].buffer)
+        return 1;
+
+    *count = audio_ring_acquire(&st->output.audio_ring[program], data);
+    return 0;
+}
+
+int nrsc5_audio_release(nrsc5_t *st, unsigned int program, size_t count)
+{
+    if (program >= MAX_PROGRAMS || !st->output.audio_ring[program].buffer)
+        return 1;
+
+    audio_ring_release(&st->output.audio_ring[program], count);
+    return 0;
+}
+
+int nrsc5_read_audio(nrsc5_t *st, unsigned int program, int16_t *data, size_t count, size_t *read)
+{
+    audio_ring_t *ring;
+
+    if (program >= MAX_PROGRAMS || !st->output.audio_ring[program].buffer)
+        return 1;
+
+    ring = &st->output.audio_ring[program];
+    *read = 0;
+    while (*read < count)
+    {
+        const int16_t *src;
+        size_t avail = audio_ring_acquire(ring, &src);
+
+        if (avail == 0)
+            break;
+        if (avail > count - *read)
+            avail = count - *read;
+        memcpy(data + *read, src, avail * sizeof(int16_t));
+        audio_ring_release(ring, avail);
+        *read += avail;
+    }
+    return 0;
+}
+
+int nrsc5_get_audio_fill(nrsc5_t *st, unsigned int program, size_t *fill, size_t *size, size_t *dropped)
+{
+    audio_ring_t *ring;
+
+    if (program >= MAX_PROGRAMS || !st->output.audio_ring[program].buffer)
+        return 1;
+
+    ring = &st->output.audio_ring[program];
+    if (fill)
+        *fill = audio_ring_fill(ring);
+    if (size)
+        *size = ring->size;
+    if (dropped)
+        *dropped = atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+    return 0;
+}
+
+int nrsc5_set_lot_memory_budget(nrsc5_t *st, size_t bytes)
+{
+    // must hold at least one table and one slab of fragments
+    if (bytes < slab_cache_slab_size(&st->output.lot_tables) + slab_cache_slab_size(&st->output.lot_fragments))
+        return 1;
+
+    st->output.lot_budget = bytes;
+    return 0;
+}
+
+int nrsc5_set_event_queue(nrsc5_t *st, unsigned int size, int policy, int dispatcher)
+{
+    event_queue_free(&st->events);
+    if (size == 0)
+        return 0;
+    if (policy != NRSC5_EVENT_QUEUE_DROP && policy != NRSC5_EVENT_QUEUE_BLOCK)
+        return 1;
+    return event_queue_init(&st->events, st, size, policy, dispatcher);
+}
+
+int nrsc5_poll_events(nrsc5_t *st, unsigned int max_events, unsigned int *dispatched)
+{
+    unsigned int count;
+
+    if (!st->events.slots || st->events.dispatcher_running)
+        return 1;
+
+    count = event_queue_poll(&st->events, max_events);
+    if (dispatched)
+        *dispatched = count;
+    return 0;
+}
+
+int nrsc5_get_event_drops(nrsc5_t *st, unsigned int event, unsigned int *count)
+{
+    if (!st->events.slots || event >= MAX_EVENT_TYPES)
+        return 1;
+
+    *count = atomic_load_explicit(&st->events.drops[event], memory_order_relaxed);
+    return 0;
+}
+
+int nrsc5_get_memory_usage(nrsc5_t *st, size_t *bytes)
+{
+    *bytes = sizeof(*st)
+           + input_memory_usage(&st->input)
+           + output_memory_usage(&st->output)
+           + event_queue_memory_usage(&st->events);
+    return 0;
+}
+
+static double format_native_rate(nrsc5_t *st, int format)
+{
+    if (format == IQFILE_FORMAT_CU8)
+        return NRSC5_SAMPLE_RATE_CU8;
+    return st->mode == NRSC5_MODE_FM ? NRSC5_SAMPLE_RATE_CS16_FM : NRSC5_SAMPLE_RATE_CS16_AM;
+}
+
+// Format of the samples delivered by the SDR driver, or stored in the recording played back.
+static int input_format(nrsc5_t *st)
+{
+    if (st->iq_reader)
+        return iqfile_reader_format(st->iq_reader);
+#ifdef USE_RTLSDR
+    return IQFILE_FORMAT_CU8;
+#else
+    return IQFILE_FORMAT_CS16;
+#endif
+}
+
+static double input_sample_rate(nrsc5_t *st)
+{
+    return st->input.rate ? st->input.rate : format_native_rate(st, input_format(st));
+}
+
+static unsigned int input_sample_bytes(nrsc5_t *st)
+{
+    return input_format(st) == IQFILE_FORMAT_CU8 ? 2 : 4;
+}
+
+int nrsc5_get_realtime_factor(nrsc5_t *st, float *factor)
+{
+    double bytes_per_sec = input_sample_bytes(st) * input_sample_rate(st);
+
+    if (st->iq_reader)
+        *factor = iqfile_reader_realtime_factor(st->iq_reader, bytes_per_sec);
+    else if (st->segmenter)
+        *factor = segmenter_realtime_factor(st->segmenter);
+    else if (st->iq_map.data)
+        *factor = iqmap_realtime_factor(&st->iq_map, bytes_per_sec);
+    else
+        return 1;
+    return 0;
+}
+
+int nrsc5_record_iq(nrsc5_t *st, const char *path, int compress)
+{
+    FILE *fp;
+    int ret = 0;
+
+    if (st->iq_recorder)
+    {
+        ret = iqfile_writer_close(st->iq_recorder);
+        st->iq_recorder = NULL;
+    }
+    free(st->iq_record_path);
+    st->iq_record_path = NULL;
+    if (!path)
+        return ret;
+
+    // the writer is opened by the first samples, whose format goes in the
+    // header, but a path that cannot be written is reported now
+    fp = fopen(path, "wb");
+    if (!fp)
+    {
+        log_error("Unable to create %s", path);
+        return 1;
+    }
+    fclose(fp);
+
+    st->iq_record_path = strdup(path);
+    st->iq_record_compress = compress;
+    st->iq_record_mismatch = 0;
+    return st->iq_record_path ? 0 : 1;
+}
+
+void nrsc5_record_samples(nrsc5_t *st, int format, const void *buf, size_t len)
+{
+    if (st->iq_record_path)
+    {
+        iqfile_info_t info = { 0 };
+
+        info.format = format;
+        info.mode = st->mode;
+        info.sample_rate = lround(st->input.rate ? st->input.rate : format_native_rate(st, format));
+        info.frequency = st->freq;
+#ifdef USE_SOAPY
+        info.gain = NAN;
+#else
+        nrsc5_get_gain(st, &info.gain);
+        if (info.gain < 0)
+            info.gain = NAN;
+#endif
+
+        st->iq_recorder = iqfile_writer_open(st->iq_record_path, &info, st->iq_record_compress);
+        free(st->iq_record_path);
+        st->iq_record_path = NULL;
+    }
+    if (!st->iq_recorder)
+        return;
+
+    if (format != iqfile_writer_format(st->iq_recorder))
+    {
+        if (!st->iq_record_mismatch)
+            log_warn("Not recording %s samples into a %s recording",
+                     format == IQFILE_FORMAT_CU8 ? "cu8" : "cs16", format == IQFILE_FORMAT_CU8 ? "cs16" : "cu8");
+        st->iq_record_mismatch = 1;
+        return;
+    }
+    iqfile_writer_push(st->iq_recorder, buf, len);
+}
+
+int nrsc5_seek_file(nrsc5_t *st, float seconds)
+{
+    if (!st->stopped || !(seconds >= 0))
+        return 1;
+
+    if (st->iq_reader)
+    {
+        if (iqfile_reader_seek(st->iq_reader, seconds, input_sample_rate(st)) != 0)
+            return 1;
+    }
+    else if (st->iq_map.data)
+    {
+        if (iqmap_seek(&st->iq_map, (size_t)(seconds * input_sample_rate(st)) * input_sample_bytes(st)) != 0)
+            return 1;
+    }
+    else
+        return 1;
+
+    input_reset(&st->input);
+    output_reset(&st->output);
+    return 0;
+}
+
+int nrsc5_is_recording(nrsc5_t *st)
+{
+    return st->iq_recording;
+}
+
+int nrsc5_load_recording(nrsc5_t *st, const iqfile_info_t *info)
+{
+    time_t start = info->start_time / 1000000;
+    char time_str[64];
+
+    strftime(time_str, sizeof(time_str), "%Y-%m-%dT%H:%M:%SZ", gmtime(&start));
+    log_info("IQ recording from %s: %.1f MHz, %u Hz, %.1f s", time_str, info->frequency / 1e6,
+             info->sample_rate, info->sample_rate ? (double)info->total_samples / info->sample_rate : 0.0);
+
+    st->iq_recording = 1;
+    if (nrsc5_set_mode(st, info->mode) != 0)
+        return 1;
+    nrsc5_set_frequency(st, info->frequency);
+    // headers store the rate as an integer, so the fractional native rates never match exactly
+    if (fabs(info->sample_rate - format_native_rate(st, info->format)) >= 1.0)
+    {
+        log_info("Resampling IQ recording from %u Hz to %.0f Hz", info->sample_rate, format_native_rate(st, info->format));
+        if (nrsc5_set_input_rate(st, info->sample_rate) != 0)
+            return 1;
+    }
+    return 0;
+}
+
+int nrsc5_set_input_rate(nrsc5_t *st, float rate)
+{
+    if (!(rate >= 0) || isinf(rate))
+        return 1;
+
+    input_set_rate(&st->input, rate);
+    return 0;
+}
+
+int nrsc5_set_stats_interval(nrsc5_t *st, float interval)
+{
+    if (!(interval >= 0))
+        return 1;
+
+    atomic_store_explicit(&st->stats.requested, interval, memory_order_relaxed);
+    return 0;
+}
+
+int nrsc5_set_low_latency(nrsc5_t *st, int enabled, unsigned int depth)
+{
+    if (depth >= ELASTIC_BUFFER_LEN / 2)
+        return 1;
+
+    output_set_low_latency(&st->output, enabled, depth);
+    return 0;
+}
+
+int nrsc5_get_audio_latency(nrsc5_t *st, unsigned int program, float *latency)
+{
+    if (program >= MAX_PROGRAMS)
+        return 1;
+
+    *latency = atomic_load_explicit(&st->output.latency[program], memory_order_relaxed);
+    return 0;
+}
+
+int nrsc5_set_event_mask(nrsc5_t *st, uint64_t mask)
+{
+    st->event_mask = mask;
+    return 0;
+}
+
+static int scan_detected(nrsc5_t *st)
+{
+    if (st->mode == NRSC5_MODE_FM)
+        return st->input.scan.ref_metric >= SCAN_REF_THRESHOLD;
+    return st->input.scan.cp_metric >= SCAN_CP_THRESHOLD;
+}
+
+static int scan_channel(nrsc5_t *st, float freq)
+{
+    input_scan_t *scan = &st->input.scan;
+    struct timespec ts;
+    int ret = 0, hd_present = 0, psmi = -1;
+
+    nrsc5_stop(st);
+    if (nrsc5_set_frequency(st, freq) != 0)
+        return 1;
+
+    input_scan_arm(&st->input);
+    nrsc5_start(st);
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += SCAN_TIMEOUT_SEC;
+
+    pthread_mutex_lock(&scan->mutex);
+    while (1)
+    {
+        if (scan->psmi >= 0)
+        {
+            hd_present = 1;
+            psmi = scan->psmi;
+            break;
+        }
+        if (scan->blocks >= SCAN_MAX_BLOCKS)
+        {
+            hd_present = scan_detected(st);
+            break;
+        }
+        // give up early on empty channels, but keep listening if either metric looks promising
+        if (scan->blocks >= SCAN_MIN_BLOCKS && !scan_detected(st) && scan->cp_metric < SCAN_CP_THRESHOLD)
+            break;
+        if (pthread_cond_timedwait(&scan->cond, &scan->mutex, &ts) == ETIMEDOUT)
+        {
+            ret = 1;
+            break;
+        }
+    }
+    scan->active = 0;
+    pthread_mutex_unlock(&scan->mutex);
+
+    nrsc5_stop(st);
+
+    if (ret == 0)
+        nrsc5_report_scan(st, freq, hd_present, psmi, scan->cp_metric, scan->ref_metric);
+    return ret;
+}
+
+int nrsc5_scan(nrsc5_t *st, float begin, float end, float skip)
+{
+    float prev_freq;
+    int channels, ret = 0;
+
+    if (skip <= 0 || end < begin)
+        return 1;
+
+    prev_freq = st->freq;
+    channels = (int)floorf((end - begin) / skip + 0.5f) + 1;
+
+    for (int i = 0; i < channels; i++)
+    {
+        if (scan_channel(st, begin + i * skip) != 0)
+        {
+            ret = 1;
+            break;
+        }
+    }
+
+    nrsc5_stop(st);
+    nrsc5_set_frequency(st, prev_freq);
+    return ret;
+}
+
 void nrsc5_report(nrsc5_t *st, const nrsc5_event_t *evt)
 {
-    if (st->callback)
+    if (!nrsc5_event_enabled(st, evt->event))
+        return;
+
+    if (st->events.slots)
+    {
+        event_queue_push(&st->events, evt);
+        stats_queue_depth(&st->stats, event_queue_depth(&st->events));
+    }
+    else
+    {
+        stats_begin(&st->stats, NRSC5_STAGE_CALLBACK);
         st->callback(evt, st->callback_opaque);
+        stats_end(&st->stats);
+    }
 }
 
 void nrsc5_report_lost_device(nrsc5_t *st)
@@ -123,6 +554,46 @@ void nrsc5_report_agc(nrsc5_t *st, float gain_db, float peak_dbfs, int is_final)
     nrsc5_report(st, &evt);
 }
 
+void nrsc5_report_scan(nrsc5_t *st, float freq, int hd_present, int psmi, float cp_metric, float ref_metric)
+{
+    nrsc5_event_t evt;
+
+    evt.event = NRSC5_EVENT_SCAN;
+    evt.scan.freq = freq;
+    evt.scan.hd_present = hd_present;
+    evt.scan.psmi = psmi;
+    evt.scan.cp_metric = cp_metric;
+    evt.scan.ref_metric = ref_metric;
+    nrsc5_report(st, &evt);
+}
+
+void nrsc5_report_stats(nrsc5_t *st)
+{
+    nrsc5_event_t evt;
+    nrsc5_stage_stats_t stages[NRSC5_NUM_STAGES];
+    float sample_rate = (st->mode == NRSC5_MODE_FM) ? NRSC5_SAMPLE_RATE_CS16_FM : NRSC5_SAMPLE_RATE_CS16_AM;
+    unsigned int queue_depth = st->events.slots ? event_queue_depth(&st->events) : 0;
+
+    // the callback stage keeps counting while this event is delivered
+    memcpy(stages, st->stats.stages, sizeof(stages));
+
+    evt.event = NRSC5_EVENT_STATS;
+    evt.stats.duration = st->stats.samples / sample_rate;
+    evt.stats.elapsed = stats_elapsed(&st->stats);
+    evt.stats.stages = stages;
+    evt.stats.num_stages = NRSC5_NUM_STAGES;
+    evt.stats.input_fill = input_pending(&st->input);
+    evt.stats.input_peak = st->stats.input_peak;
+    evt.stats.input_size = INPUT_BUF_LEN;
+    evt.stats.input_overflows = st->stats.input_overflows;
+    evt.stats.source_drops = st->stats.source_drops;
+    evt.stats.queue_depth = queue_depth;
+    evt.stats.queue_peak = (queue_depth > st->stats.queue_peak) ? queue_depth : st->stats.queue_peak;
+    nrsc5_report(st, &evt);
+
+    stats_restart(&st->stats);
+}
+
 void nrsc5_report_iq(nrsc5_t *st, const void *data, size_t count)
 {
     nrsc5_event_t evt;
@@ -172,7 +643,7 @@ void nrsc5_report_hdc(nrsc5_t *st, unsigned int program, const packet_t* pkt)
     nrsc5_report(st, &evt);
 }
 
-void nrsc5_report_audio(nrsc5_t *st, unsigned int program, const int16_t *data, size_t count)
+void nrsc5_report_audio(nrsc5_t *st, unsigned int program, const int16_t *data, size_t count, float latency)
 {
     nrsc5_event_t evt;
 
@@ -180,6 +651,7 @@ void nrsc5_report_audio(nrsc5_t *st, unsigned int program, const int16_t *data,
     evt.audio.program = program;
     evt.audio.data = data;
     evt.audio.count = count;
+    evt.audio.latency = latency;
     nrsc5_report(st, &evt);
 }
 
@@ -319,6 +791,15 @@ void nrsc5_report_sig(nrsc5_t *st, sig_service_t *services)
     nrsc5_sig_service_t *service = NULL;
     nrsc5_event_t evt;
 
+    // the list is also referenced by data service events
+    if (!(nrsc5_event_enabled(st, NRSC5_EVENT_SIG)
+          || nrsc5_event_enabled(st, NRSC5_EVENT_STREAM)
+          || nrsc5_event_enabled(st, NRSC5_EVENT_PACKET)
+          || nrsc5_event_enabled(st, NRSC5_EVENT_LOT)
+          || nrsc5_event_enabled(st, NRSC5_EVENT_LOT_HEADER)
+          || nrsc5_event_enabled(st, NRSC5_EVENT_LOT_FRAGMENT)))
+        return;
+
     evt.event = NRSC5_EVENT_SIG;
 
     // convert internal structures to public structures
@@ -28,9 +28,23 @@
 #include "unicode.h"
 #include "here_images.h"
 
+static unsigned int elastic_distance(unsigned int from, unsigned int to)
+{
+    return (ELASTIC_BUFFER_LEN + to - from) % ELASTIC_BUFFER_LEN;
+}
+
 void output_align(output_t *st, unsigned int program, unsigned int stream_id, unsigned int offset)
 {
     elastic_buffer_t *elastic = &st->elastic[program][stream_id];
+
+    if (st->low_latency)
+    {
+        // the play head follows the packets, and is only moved when it is
+        // unset or has run ahead of the stream
+        if (elastic->audio_offset != -1 && elastic_distance(elastic->audio_offset, offset) < ELASTIC_BUFFER_LEN / 2)
+            return;
+        elastic->head = offset;
+    }
     elastic->audio_offset = offset;
 }
 
@@ -44,6 +58,33 @@ static int is_crc_ok(const packet_t* pkt)
     return !(pkt->flags & PACKET_FLAG_CRC_ERROR);
 }
 
+static void pkt_reset(packet_t* pkt)
+{
+    pkt->size = 0;
+    pkt->flags = PACKET_FLAG_NONE;
+    pkt->shape = PACKET_NONE;
+}
+
+static int pkt_reserve(packet_t *pkt, unsigned int size)
+{
+    if (size > pkt->capacity)
+    {
+        unsigned int capacity = (size + PACKET_ALLOC_ALIGN - 1) & ~(PACKET_ALLOC_ALIGN - 1);
+        uint8_t *data = realloc(pkt->data, capacity);
+
+        if (!data)
+        {
+            log_error("Failed to allocate %u bytes for an audio packet", capacity);
+            return 1;
+        }
+        pkt->data = data;
+        pkt->capacity = capacity;
+    }
+    return 0;
+}
+
+static void output_release(output_t *st, unsigned int program);
+
 void output_push(output_t *st, const packet_ref_t* ref)
 {
     elastic_buffer_t *elastic = &st->elastic[ref->program][ref->stream_id];
@@ -52,6 +93,15 @@ void output_push(output_t *st, const packet_ref_t* ref)
     if (ref->stream_id != 0)
         return; // TODO: Process enhanced stream
 
+    if (st->low_latency && elastic->audio_offset != -1)
+    {
+        // already played, or skipped as lost
+        if (elastic_distance(elastic->audio_offset, ref->seq) >= ELASTIC_BUFFER_LEN / 2)
+            return;
+        if (elastic_distance(elastic->audio_offset, ref->seq + 1) > elastic_distance(elastic->audio_offset, elastic->head))
+            elastic->head = (ref->seq + 1) % ELASTIC_BUFFER_LEN;
+    }
+
     if (pkt->shape == PACKET_FULL)
         log_warn("Packet %d already exists in elastic buffer for program %d, stream %d. Overwriting.", ref->seq, ref->program, ref->stream_id);
 
@@ -59,15 +109,23 @@ void output_push(output_t *st, const packet_ref_t* ref)
     {
         pkt->flags |= ref->flags;
         pkt->shape = PACKET_FULL;
+        // the audio started arriving with the first half
+        if (ref->air_start < pkt->air_start)
+            pkt->air_start = ref->air_start;
 
-        if (is_crc_ok(pkt))
+        if (!is_crc_ok(pkt))
+        {
+            pkt->size = 0;
+        }
+        else if (pkt_reserve(pkt, pkt->size + ref->size) == 0)
         {
             memcpy(pkt->data + pkt->size, ref->data, ref->size);
             pkt->size += ref->size;
         }
         else
         {
-            pkt->size = 0;
+            // played as a missing packet rather than an empty one
+            pkt_reset(pkt);
         }
     }
     else
@@ -77,24 +135,118 @@ void output_push(output_t *st, const packet_ref_t* ref)
 
         pkt->flags = ref->flags;
         pkt->shape = ref->shape;
+        pkt->air_start = ref->air_start;
 
-        if (is_crc_ok(pkt))
+        if (!is_crc_ok(pkt))
+        {
+            pkt->size = 0;
+        }
+        else if (pkt_reserve(pkt, ref->size) == 0)
         {
             memcpy(pkt->data, ref->data, ref->size);
             pkt->size = ref->size;
         }
         else
         {
-            pkt->size = 0;
+            pkt_reset(pkt);
         }
     }
+
+    if (st->low_latency)
+        output_release(st, ref->program);
 }
 
-static void pkt_reset(packet_t* pkt)
+#ifdef USE_FAAD2
+static void output_audio(output_t *st, unsigned int program, const int16_t *data, size_t count)
 {
-    pkt->size = 0;
-    pkt->flags = PACKET_FLAG_NONE;
-    pkt->shape = PACKET_NONE;
+    if (st->audio_ring[program].buffer)
+        audio_ring_push(&st->audio_ring[program], data, count);
+    nrsc5_report_audio(st->radio, program, data, count,
+                       atomic_load_explicit(&st->latency[program], memory_order_relaxed));
+}
+#endif
+
+static void output_frame(output_t *st, unsigned int program, elastic_buffer_t *elastic)
+{
+    packet_t* pkt = &elastic->packets[elastic->audio_offset];
+#ifdef USE_FAAD2
+    int decode_audio = st->audio_ring[program].buffer || nrsc5_event_enabled(st->radio, NRSC5_EVENT_AUDIO);
+    int produced_audio = 0;
+#endif
+
+    if (is_complete_pkt(pkt))
+    {
+        float sample_rate = (st->radio->mode == NRSC5_MODE_FM) ? NRSC5_SAMPLE_RATE_CS16_FM : NRSC5_SAMPLE_RATE_CS16_AM;
+        float latency = (st->radio->input.position - pkt->air_start) / sample_rate;
+
+        atomic_store_explicit(&st->latency[program], latency, memory_order_relaxed);
+        nrsc5_report_hdc(st->radio, program, pkt);
+    }
+
+#ifdef USE_FAAD2
+    if (decode_audio && is_complete_pkt(pkt) && is_crc_ok(pkt))
+    {
+        void *buffer;
+        NeAACDecFrameInfo info;
+
+        if (!st->aacdec[program])
+        {
+            NeAACDecInitHDC(&st->aacdec[program]);
+        }
+
+        stats_begin(&st->radio->stats, NRSC5_STAGE_AAC);
+        buffer = NeAACDecDecode(st->aacdec[program], &info, pkt->data, pkt->size);
+        stats_end(&st->radio->stats);
+        if (info.error > 0)
+            log_error("Decode error: %s", NeAACDecGetErrorMessage(info.error));
+
+        if (info.error == 0 && info.samples > 0)
+        {
+            output_audio(st, program, buffer, info.samples);
+            produced_audio = 1;
+        }
+    }
+    else
+    {
+        // Reset decoder. Missing packets, or audio is not wanted.
+        if (st->aacdec[program])
+        {
+            NeAACDecClose(st->aacdec[program]);
+            st->aacdec[program] = NULL;
+        }                
+    }
+#endif
+
+    pkt_reset(pkt);
+
+#ifdef USE_FAAD2
+    if (!produced_audio && decode_audio)
+        output_audio(st, program, st->silence, NRSC5_AUDIO_FRAME_SAMPLES * 2);
+#endif
+
+    elastic->audio_offset = (elastic->audio_offset + 1) % ELASTIC_BUFFER_LEN;
+}
+
+/*
+ * Low-latency mode: play packets as soon as they are complete and in order.
+ * An incomplete packet holds back the ones behind it until more than
+ * elastic_depth newer packets have arrived, then it is played as silence.
+ */
+static void output_release(output_t *st, unsigned int program)
+{
+    elastic_buffer_t *elastic = &st->elastic[program][0]; // TODO: Process enhanced stream
+
+    if (elastic->audio_offset == -1)
+        return;
+
+    while ((unsigned int)elastic->audio_offset != elastic->head)
+    {
+        unsigned int newer = elastic_distance(elastic->audio_offset, elastic->head) - 1;
+
+        if (!is_complete_pkt(&elastic->packets[elastic->audio_offset]) && newer <= st->elastic_depth)
+            break;
+        output_frame(st, program, elastic);
+    }
 }
 
 void output_advance(output_t *st)
@@ -102,6 +254,10 @@ void output_advance(output_t *st)
     unsigned int program, frame;
     unsigned int audio_frames = (st->radio->mode == NRSC5_MODE_FM ? 2 : 4);
 
+    // packets are released by output_push
+    if (st->low_latency)
+        return;
+
     for (program = 0; program < MAX_PROGRAMS; program++)
     {
         elastic_buffer_t *elastic = &st->elastic[program][0]; // TODO: Process enhanced stream
@@ -110,73 +266,108 @@ void output_advance(output_t *st)
             continue;
 
         for (frame = 0; frame < audio_frames; frame++)
-        {
-            packet_t* pkt = &elastic->packets[elastic->audio_offset];
-#ifdef USE_FAAD2
-            int produced_audio = 0;
-#endif
+            output_frame(st, program, elastic);
+    }
+}
 
-            if (is_complete_pkt(pkt))
-            {
-                nrsc5_report_hdc(st->radio, program, pkt);
-            }
+static unsigned int hash16(uint16_t key, unsigned int bits)
+{
+    return ((uint32_t)key * 2654435761u) >> (32 - bits);
+}
 
-            if (is_complete_pkt(pkt) && is_crc_ok(pkt))
-            {
-#ifdef USE_FAAD2
-                void *buffer;
-                NeAACDecFrameInfo info;
+static void lot_index_insert(sig_component_t *component, unsigned int idx)
+{
+    unsigned int mask = (1 << LOT_INDEX_BITS) - 1;
+    unsigned int h = hash16(component->data.lot_files[idx].lot, LOT_INDEX_BITS);
 
-                if (!st->aacdec[program])
-                {
-                    NeAACDecInitHDC(&st->aacdec[program]);
-                }
+    while (component->data.lot_index[h])
+        h = (h + 1) & mask;
+    component->data.lot_index[h] = idx + 1;
+}
 
-                buffer = NeAACDecDecode(st->aacdec[program], &info, pkt->data, pkt->size);
-                if (info.error > 0)
-                    log_error("Decode error: %s", NeAACDecGetErrorMessage(info.error));
+static void lot_index_rebuild(sig_component_t *component)
+{
+    memset(component->data.lot_index, 0, sizeof(component->data.lot_index));
+    for (int i = 0; i < MAX_LOT_FILES; i++)
+    {
+        if (component->data.lot_files[i].timestamp != 0)
+            lot_index_insert(component, i);
+    }
+}
 
-                if (info.error == 0 && info.samples > 0)
-                {
-                    nrsc5_report_audio(st->radio, program, buffer, info.samples);
-                    produced_audio = 1;
-                }
-#endif
-            }
-            else
+static void aas_free_lot(output_t *st, aas_file_t *file)
+{
+    free(file->name);
+    if (file->fragments)
+    {
+        for (int i = 0; i < MAX_LOT_FRAGMENTS; i++)
+            slab_free(&st->lot_fragments, file->fragments[i]);
+        slab_free(&st->lot_tables, file->fragments);
+    }
+    memset(file, 0, sizeof(*file));
+}
+
+static aas_file_t *find_lru_lot(output_t *st, const aas_file_t *keep, sig_component_t **lru_component)
+{
+    aas_file_t *lru = NULL;
+
+    for (int i = 0; i < MAX_SIG_SERVICES; i++)
+    {
+        for (int j = 0; j < MAX_SIG_COMPONENTS; j++)
+        {
+            sig_component_t *component = &st->services[i].component[j];
+
+            if (component->type != SIG_COMPONENT_DATA)
+                continue;
+
+            for (int k = 0; k < MAX_LOT_FILES; k++)
             {
-#ifdef USE_FAAD2
-                // Reset decoder. Missing packets.
-                if (st->aacdec[program])
+                aas_file_t *file = &component->data.lot_files[k];
+
+                if (file->fragments == NULL || file == keep)
+                    continue;
+                if (lru == NULL || file->timestamp < lru->timestamp)
                 {
-                    NeAACDecClose(st->aacdec[program]);
-                    st->aacdec[program] = NULL;
-                }                
-#endif
+                    lru = file;
+                    *lru_component = component;
+                }
             }
-
-            pkt_reset(pkt);
-
-#ifdef USE_FAAD2
-            if (!produced_audio)
-                nrsc5_report_audio(st->radio, program, st->silence, NRSC5_AUDIO_FRAME_SAMPLES * 2);
-#endif
-    
-            elastic->audio_offset = (elastic->audio_offset + 1) % ELASTIC_BUFFER_LEN;
         }
     }
+    return lru;
 }
 
-static void aas_free_lot(aas_file_t *file)
+static void *lot_alloc(output_t *st, slab_cache_t *cache, const aas_file_t *keep)
 {
-    free(file->name);
-    if (file->fragments)
+    void *obj;
+
+    while ((obj = slab_alloc(cache)) == NULL)
     {
-        for (int i = 0; i < MAX_LOT_FRAGMENTS; i++)
-            free(file->fragments[i]);
-        free(file->fragments);
+        aas_file_t *lru;
+        sig_component_t *component;
+
+        if (st->lot_fragments.bytes + st->lot_tables.bytes + slab_cache_slab_size(cache) <= st->lot_budget
+            && slab_cache_grow(cache) == 0)
+            continue;
+
+        // Over budget, so recycle the least recently used file.
+        lru = find_lru_lot(st, keep, &component);
+        if (lru == NULL)
+            return NULL;
+        log_debug("Evicting LOT file %d to stay within memory budget", lru->lot);
+        aas_free_lot(st, lru);
+        lot_index_rebuild(component);
     }
-    memset(file, 0, sizeof(*file));
+    return obj;
+}
+
+static uint8_t **lot_alloc_table(output_t *st, aas_file_t *file)
+{
+    uint8_t **table = lot_alloc(st, &st->lot_tables, file);
+
+    if (table)
+        memset(table, 0, MAX_LOT_FRAGMENTS * sizeof(uint8_t *));
+    return table;
 }
 
 static void aas_reset(output_t *st)
@@ -192,12 +383,13 @@ static void aas_reset(output_t *st)
 
             if (component->type == SIG_COMPONENT_DATA)
                 for (int k = 0; k < MAX_LOT_FILES; k++)
-                    aas_free_lot(&component->data.lot_files[k]);
+                    aas_free_lot(st, &component->data.lot_files[k]);
         }
     }
     st->lot_lru_counter = 1;
 
     memset(st->services, 0, sizeof(st->services));
+    memset(st->port_index, 0, sizeof(st->port_index));
     nrsc5_clear_sig(st->radio);
 }
 
@@ -214,7 +406,9 @@ void output_reset(output_t *st)
                 pkt_reset(&st->elastic[i][j].packets[k]);
             }
             st->elastic[i][j].audio_offset = -1;
+            st->elastic[i][j].head = 0;
         }
+        atomic_store(&st->latency[i], 0);
 #ifdef USE_FAAD2
         if (st->aacdec[i])
             NeAACDecClose(st->aacdec[i]);
@@ -225,6 +419,23 @@ void output_reset(output_t *st)
     here_images_reset(&st->here_images);
 }
 
+void output_set_low_latency(output_t *st, int enabled, unsigned int depth)
+{
+    st->low_latency = enabled;
+    st->elastic_depth = depth;
+
+    // realign every stream under the new release policy
+    for (int i = 0; i < MAX_PROGRAMS; i++)
+    {
+        for (int j = 0; j < MAX_STREAMS; j++)
+        {
+            st->elastic[i][j].audio_offset = -1;
+            st->elastic[i][j].head = 0;
+        }
+        atomic_store(&st->latency[i], 0);
+    }
+}
+
 void output_init(output_t *st, nrsc5_t *radio)
 {
     st->radio = radio;
@@ -234,7 +445,13 @@ void output_init(output_t *st, nrsc5_t *radio)
     memset(st->silence, 0, sizeof(st->silence));
 #endif
 
+    memset(st->audio_ring, 0, sizeof(st->audio_ring));
     memset(st->services, 0, sizeof(st->services));
+    slab_cache_init(&st->lot_fragments, LOT_FRAGMENT_SIZE, LOT_FRAGMENTS_PER_SLAB);
+    slab_cache_init(&st->lot_tables, MAX_LOT_FRAGMENTS * sizeof(uint8_t *), LOT_TABLES_PER_SLAB);
+    st->lot_budget = LOT_MEMORY_BUDGET;
+    st->low_latency = 0;
+    st->elastic_depth = 0;
     here_images_init(&st->here_images, radio);
 
     output_reset(st);
@@ -243,6 +460,34 @@ void output_init(output_t *st, nrsc5_t *radio)
 void output_free(output_t *st)
 {
     output_reset(st);
+
+    for (int i = 0; i < MAX_PROGRAMS; i++)
+    {
+        audio_ring_free(&st->audio_ring[i]);
+
+        for (int j = 0; j < MAX_STREAMS; j++)
+            for (int k = 0; k < ELASTIC_BUFFER_LEN; k++)
+                free(st->elastic[i][j].packets[k].data);
+    }
+
+    slab_cache_destroy(&st->lot_fragments);
+    slab_cache_destroy(&st->lot_tables);
+}
+
+size_t output_memory_usage(const output_t *st)
+{
+    size_t bytes = st->lot_fragments.bytes + st->lot_tables.bytes;
+
+    for (int i = 0; i < MAX_PROGRAMS; i++)
+    {
+        if (st->audio_ring[i].buffer)
+            bytes += st->audio_ring[i].size * sizeof(int16_t);
+
+        for (int j = 0; j < MAX_STREAMS; j++)
+            for (int k = 0; k < ELASTIC_BUFFER_LEN; k++)
+                bytes += st->elastic[i][j].packets[k].capacity;
+    }
+    return bytes;
 }
 
 static unsigned int id3_length(uint8_t *buf)
@@ -509,6 +754,40 @@ static int find_component(sig_service_t *service, uint8_t component_id)
     return component_idx;
 }
 
+static void port_index_build(output_t *st)
+{
+    unsigned int mask = (1 << PORT_INDEX_BITS) - 1;
+    unsigned int i, j;
+
+    memset(st->port_index, 0, sizeof(st->port_index));
+    for (i = 0; i < MAX_SIG_SERVICES; i++)
+    {
+        sig_service_t *service = &st->services[i];
+        if (service->type == SIG_SERVICE_NONE)
+            break;
+
+        for (j = 0; j < MAX_SIG_COMPONENTS; j++)
+        {
+            sig_component_t *component = &service->component[j];
+            if (component->type == SIG_COMPONENT_NONE)
+                break;
+            if (component->type != SIG_COMPONENT_DATA)
+                continue;
+
+            unsigned int h = hash16(component->data.port, PORT_INDEX_BITS);
+            while (st->port_index[h].component && st->port_index[h].port != component->data.port)
+                h = (h + 1) & mask;
+
+            // the first component using a port takes precedence
+            if (!st->port_index[h].component)
+            {
+                st->port_index[h].port = component->data.port;
+                st->port_index[h].component = component;
+            }
+        }
+    }
+}
+
 static void parse_sig(output_t *st, uint8_t *buf, unsigned int len)
 {
     uint8_t *p = buf;
@@ -621,44 +900,40 @@ static void parse_sig(output_t *st, uint8_t *buf, unsigned int len)
     }
 
 done:
+    port_index_build(st);
     nrsc5_report_sig(st->radio, st->services);
 }
 
 static sig_component_t *find_port(output_t *st, uint16_t port_id)
 {
-    unsigned int i, j;
-    for (i = 0; i < MAX_SIG_SERVICES; i++)
-    {
-        sig_service_t *service = &st->services[i];
-        if (service->type == SIG_SERVICE_NONE)
-            break;
+    unsigned int mask = (1 << PORT_INDEX_BITS) - 1;
+    unsigned int h = hash16(port_id, PORT_INDEX_BITS);
 
-        for (j = 0; j < MAX_SIG_COMPONENTS; j++)
-        {
-            sig_component_t *component = &service->component[j];
-            if (component->type == SIG_COMPONENT_NONE)
-                break;
-
-            if ((component->type == SIG_COMPONENT_DATA) && (component->data.port == port_id))
-                return component;
-        }
+    while (st->port_index[h].component)
+    {
+        if (st->port_index[h].port == port_id)
+            return st->port_index[h].component;
+        h = (h + 1) & mask;
     }
     return NULL;
 }
 
 static aas_file_t *find_lot(sig_component_t *component, unsigned int lot)
 {
-    for (int i = 0; i < MAX_LOT_FILES; i++)
+    unsigned int mask = (1 << LOT_INDEX_BITS) - 1;
+    unsigned int h = hash16(lot, LOT_INDEX_BITS);
+
+    while (component->data.lot_index[h])
     {
-        if (component->data.lot_files[i].timestamp == 0)
-            continue;
-        if (component->data.lot_files[i].lot == lot)
-            return &component->data.lot_files[i];
+        aas_file_t *file = &component->data.lot_files[component->data.lot_index[h] - 1];
+        if (file->timestamp != 0 && file->lot == lot)
+            return file;
+        h = (h + 1) & mask;
     }
     return NULL;
 }
 
-static aas_file_t *find_free_lot(sig_component_t *component)
+static aas_file_t *find_free_lot(output_t *st, sig_component_t *component)
 {
     unsigned int min_timestamp = UINT_MAX;
     unsigned int min_idx = 0;
@@ -677,7 +952,8 @@ static aas_file_t *find_free_lot(sig_component_t *component)
     }
 
     file = &component->data.lot_files[min_idx];
-    aas_free_lot(file);
+    aas_free_lot(st, file);
+    lot_index_rebuild(component);
     return file;
 }
 
@@ -703,7 +979,7 @@ static void process_port(output_t *st, uint16_t port_id, uint16_t seq, uint8_t *
     case NRSC5_AAS_TYPE_STREAM:
     {
         nrsc5_report_stream(st->radio, seq, len, buf, component->service_ext, component->component_ext);
-        if (component->data.mime == NRSC5_MIME_HERE_IMAGE)
+        if (component->data.mime == NRSC5_MIME_HERE_IMAGE && nrsc5_event_enabled(st->radio, NRSC5_EVENT_HERE_IMAGE))
             here_images_push(&st->here_images, seq, len, buf);
         break;
     }
@@ -714,6 +990,10 @@ static void process_port(output_t *st, uint16_t port_id, uint16_t seq, uint8_t *
     }
     case NRSC5_AAS_TYPE_LOT:
     {
+        if (!(nrsc5_event_enabled(st->radio, NRSC5_EVENT_LOT)
+              || nrsc5_event_enabled(st->radio, NRSC5_EVENT_LOT_HEADER)
+              || nrsc5_event_enabled(st->radio, NRSC5_EVENT_LOT_FRAGMENT)))
+            return;
         if (len < 8)
         {
             log_warn("bad fragment (port %04X, len %d)", port_id, len);
@@ -741,12 +1021,22 @@ static void process_port(output_t *st, uint16_t port_id, uint16_t seq, uint8_t *
         aas_file_t *file = find_lot(component, lot);
         if (file == NULL)
         {
-            file = find_free_lot(component);
+            file = find_free_lot(st, component);
             file->lot = lot;
-            file->fragments = calloc(MAX_LOT_FRAGMENTS, sizeof(uint8_t*));
+            lot_index_insert(component, file - component->data.lot_files);
         }
         file->timestamp = st->lot_lru_counter++;
 
+        if (file->fragments == NULL)
+        {
+            file->fragments = lot_alloc_table(st, file);
+            if (file->fragments == NULL)
+            {
+                log_warn("LOT memory budget exhausted (port %04X, lot %d)", port_id, lot);
+                return;
+            }
+        }
+
         int new_data = 0;
 
         if (hdrlen > 0)
@@ -787,10 +1077,15 @@ static void process_port(output_t *st, uint16_t port_id, uint16_t seq, uint8_t *
                     || (min != file->expiry_utc.tm_min))
                 {
                     // Reset, since metadata has changed
-                    aas_free_lot(file);
+                    aas_free_lot(st, file);
                     file->lot = lot;
-                    file->fragments = calloc(MAX_LOT_FRAGMENTS, sizeof(uint8_t*));
                     file->timestamp = st->lot_lru_counter;
+                    file->fragments = lot_alloc_table(st, file);
+                    if (file->fragments == NULL)
+                    {
+                        log_warn("LOT memory budget exhausted (port %04X, lot %d)", port_id, lot);
+                        return;
+                    }
                     new_data = 1;
                 }
             }
@@ -827,13 +1122,19 @@ static void process_port(output_t *st, uint16_t port_id, uint16_t seq, uint8_t *
         {
             new_data = 1;
             is_duplicate = 0;
-            uint8_t *fragment = calloc(LOT_FRAGMENT_SIZE, 1);
             if (len > LOT_FRAGMENT_SIZE)
             {
                 log_warn("fragment too large (%d)", len);
                 break;
             }
+            uint8_t *fragment = lot_alloc(st, &st->lot_fragments, file);
+            if (fragment == NULL)
+            {
+                log_warn("LOT memory budget exhausted (port %04X, lot %d)", port_id, lot);
+                break;
+            }
             memcpy(fragment, buf, len);
+            memset(fragment + len, 0, LOT_FRAGMENT_SIZE - len);
             file->fragments[seq] = fragment;
             file->bytes_so_far += len;
         }
@@ -878,7 +1179,8 @@ void output_aas_push(output_t *st, uint8_t *buf, unsigned int len)
     if (port == 0x5100 || (port >= 0x5201 && port <= 0x5207))
     {
         // PSD ports
-        output_id3(st, port & 0x7, buf + 4, len - 4);
+        if (nrsc5_event_enabled(st->radio, NRSC5_EVENT_ID3))
+            output_id3(st, port & 0x7, buf + 4, len - 4);
     }
     else if (port == 0x20)
     {
@@ -1,7 +1,9 @@
 #pragma once
 
 #include "config.h"
+#include "audio_ring.h"
 #include "here_images.h"
+#include "slab.h"
 
 #include <nrsc5.h>
 
@@ -16,6 +18,12 @@
 #define LOT_FRAGMENT_SIZE 256
 #define MAX_FILE_BYTES 65536
 #define MAX_LOT_FRAGMENTS (MAX_FILE_BYTES / LOT_FRAGMENT_SIZE)
+#define LOT_FRAGMENTS_PER_SLAB 64
+#define LOT_TABLES_PER_SLAB 4
+#define LOT_MEMORY_BUDGET (8 * 1024 * 1024)
+#define LOT_INDEX_BITS 5
+#define PORT_INDEX_BITS 8
+#define PACKET_ALLOC_ALIGN 256
 
 enum
 {
@@ -73,6 +81,7 @@ typedef struct
             uint8_t type;
             uint32_t mime;
             aas_file_t lot_files[MAX_LOT_FILES];
+            uint8_t lot_index[1 << LOT_INDEX_BITS]; // lot_files index + 1, or 0 if empty
         } data;
         struct {
             uint8_t port;
@@ -100,20 +109,30 @@ typedef struct
     unsigned int seq;
     unsigned int flags;
     unsigned int shape;
+    uint64_t air_start; // input sample at which the frame carrying the packet began
 } packet_ref_t;
 
+typedef struct
+{
+    uint16_t port;
+    sig_component_t *component;
+} port_index_t;
+
 typedef struct
 {
     unsigned int size;
-    uint8_t data[MAX_PDU_LEN];
+    unsigned int capacity;
+    uint8_t *data; // grown to fit the largest packet stored in this slot
     unsigned int flags;
     unsigned int shape;
+    uint64_t air_start;
 } packet_t;
 
 typedef struct
 {
     packet_t packets[ELASTIC_BUFFER_LEN];
     int audio_offset;
+    unsigned int head; // sequence number following the newest packet (low-latency mode)
 } elastic_buffer_t;
 
 typedef struct
@@ -124,8 +143,16 @@ typedef struct
     NeAACDecHandle aacdec[MAX_PROGRAMS];
     int16_t silence[NRSC5_AUDIO_FRAME_SAMPLES * 2];
 #endif
+    audio_ring_t audio_ring[MAX_PROGRAMS];
+    int low_latency;
+    unsigned int elastic_depth;
+    _Atomic float latency[MAX_PROGRAMS];
     sig_service_t services[MAX_SIG_SERVICES];
+    port_index_t port_index[1 << PORT_INDEX_BITS];
     unsigned int lot_lru_counter;
+    slab_cache_t lot_fragments;
+    slab_cache_t lot_tables;
+    size_t lot_budget;
     here_images_t here_images;
 } output_t;
 
@@ -133,6 +160,8 @@ void output_align(output_t *st, unsigned int program, unsigned int stream_id, un
 void output_push(output_t *st, const packet_ref_t* ref);
 void output_advance(output_t *st);
 void output_reset(output_t *st);
+void output_set_low_latency(output_t *st, int enabled, unsigned int depth);
 void output_init(output_t *st, nrsc5_t *);
 void output_free(output_t *st);
+size_t output_memory_usage(const output_t *st);
 void output_aas_push(output_t *st, uint8_t *psd, unsigned int len);
@@ -15,9 +15,15 @@
 
 #include "config.h"
 #include "defines.h"
+#include "event_queue.h"
 #include "input.h"
+#include "iqfile.h"
+#include "iqmap.h"
 #include "output.h"
+#include "segment.h"
+#include "stats.h"
 #ifdef USE_RTLSDR
+#include "iqserver.h"
 #include "rtltcp.h"
 #endif
 
@@ -29,19 +35,29 @@ struct nrsc5_t
     rtlsdr_dev_t *dev;
     FILE *iq_file;
     rtltcp_t *rtltcp;
+    iq_server_t *iq_server;
     uint8_t samples_buf[128 * 256];
 #elif defined USE_SDRPLAY
     sdrplay_api_DeviceT dev;
     FILE *iq_file;
     sdrplay_api_DeviceParamsT *dev_params;
     sdrplay_api_RxChannelParamsT *ch_params;
-    int16_t samples_buf[128 * 256];
 #elif defined USE_SOAPY
     SoapySDRDevice *dev;
     FILE *iq_file;
     SoapySDRStream *rx_stream;
-    int16_t samples_buf[128 * 256];
+    size_t stream_mtu;
+    int direct_access;
+    int16_t *samples_buf;
 #endif
+    iqmap_t iq_map;
+    iqfile_reader_t *iq_reader;
+    iqfile_writer_t *iq_recorder;
+    char *iq_record_path;       // recording requested, opened by the first samples
+    int iq_record_compress;
+    int iq_record_mismatch;
+    int iq_recording;           // input is a recording, which sets frequency and mode
+    segmenter_t *segmenter;
     float freq;
     int mode;
 #ifdef USE_RTLSDR
@@ -58,7 +74,10 @@ struct nrsc5_t
     int closed;
     nrsc5_callback_t callback;
     void *callback_opaque;
+    uint64_t event_mask;
     nrsc5_sig_service_t *sig_table;
+    event_queue_t events;
+    stats_t stats;
 
     uint8_t leftover_u8[4];
     unsigned int leftover_u8_num;
@@ -73,16 +92,25 @@ struct nrsc5_t
     output_t output;
 };
 
+static inline int nrsc5_event_enabled(const nrsc5_t *st, unsigned int event)
+{
+    return st->callback && (st->event_mask & NRSC5_EVENT_MASK(event));
+}
+
+int nrsc5_load_recording(nrsc5_t *st, const iqfile_info_t *info);
+void nrsc5_record_samples(nrsc5_t *st, int format, const void *buf, size_t len);
 void nrsc5_report(nrsc5_t *, const nrsc5_event_t *evt);
 void nrsc5_report_lost_device(nrsc5_t *st);
 void nrsc5_report_agc(nrsc5_t *st, float gain_db, float peak_dbfs, int is_final);
+void nrsc5_report_scan(nrsc5_t *st, float freq, int hd_present, int psmi, float cp_metric, float ref_metric);
+void nrsc5_report_stats(nrsc5_t *st);
 void nrsc5_report_iq(nrsc5_t *, const void *data, size_t count);
 void nrsc5_report_sync(nrsc5_t *, float freq_offset, int psmi);
 void nrsc5_report_lost_sync(nrsc5_t *);
 void nrsc5_report_mer(nrsc5_t *, float lower, float upper);
 void nrsc5_report_ber(nrsc5_t *, float cber);
 void nrsc5_report_hdc(nrsc5_t *, unsigned int program, const packet_t* pkt);
-void nrsc5_report_audio(nrsc5_t *, unsigned int program, const int16_t *data, size_t count);
+void nrsc5_report_audio(nrsc5_t *, unsigned int program, const int16_t *data, size_t count, float latency);
 void nrsc5_report_stream(nrsc5_t *, uint16_t seq, unsigned int size, const uint8_t *data,
                          nrsc5_sig_service_t *service, nrsc5_sig_component_t *component);
 void nrsc5_report_packet(nrsc5_t *, uint16_t seq, unsigned int size, const uint8_t *data,
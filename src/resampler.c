@@ -0,0 +1,259 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <math.h>
+#include <string.h>
+
+#ifdef HAVE_NEON
+#include <arm_neon.h>
+#endif
+
+#ifdef HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "resampler.h"
+
+// Filter phases per input sample. The output time is rounded to the
+// nearest phase, which keeps timing jitter below 1/512 of a sample.
+#define RESAMPLER_PHASES 256
+// Taps per phase when not decimating; more are used when decimating,
+// so that the transition band keeps the same width at the output.
+#define RESAMPLER_TAPS 24
+#define RESAMPLER_BLOCK 4096
+#define KAISER_BETA 7.0
+
+/*
+ * Polyphase resampler for Q15 samples, at any ratio of output to input
+ * rate. The next output time is kept in 32.32 fixed point, in input
+ * samples, so that the ratio can be corrected by tiny amounts while
+ * running. Each output is a dot product of the input with the filter
+ * phase closest to the fractional output time.
+ */
+struct resampler_t
+{
+    double ratio;             // output rate / input rate
+    double correction;        // relative rate error of the input, added to the ratio
+    uint64_t step;            // input samples per output, 32.32
+    uint64_t pos;             // time of the next output after history[0], 32.32
+    unsigned int ntaps;       // taps per phase, a multiple of 4
+    int16_t *taps;            // RESAMPLER_PHASES + 1 phases of ntaps taps
+    cint16_t *history;
+    unsigned int len;         // samples in history
+};
+
+static double bessel_i0(double x)
+{
+    double sum = 1, term = 1;
+
+    for (int k = 1; k < 32; k++)
+    {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+/*
+ * Windowed-sinc prototype with a cutoff below both Nyquist frequencies.
+ * Phase p delays the output by p / RESAMPLER_PHASES samples. Every phase
+ * is quantized so that its taps sum to exactly 1.0, giving unity gain at
+ * DC for all output times.
+ */
+static void design(resampler_t *st)
+{
+    double scale = (st->ratio < 1) ? st->ratio : 1;
+    double cutoff = 0.45 * scale;
+    double half = st->ntaps / 2;
+
+    for (unsigned int p = 0; p <= RESAMPLER_PHASES; p++)
+    {
+        int16_t *taps = &st->taps[p * st->ntaps];
+        double h[st->ntaps], sum = 0;
+        int total = 0;
+        unsigned int largest = 0;
+
+        for (unsigned int k = 0; k < st->ntaps; k++)
+        {
+            double x = (half - 1) - k + (double)p / RESAMPLER_PHASES;
+            double u = x / half;
+            double w = (u * u < 1) ? bessel_i0(KAISER_BETA * sqrt(1 - u * u)) / bessel_i0(KAISER_BETA) : 0;
+            double s = (x == 0) ? 1 : sin(2 * M_PI * cutoff * x) / (2 * M_PI * cutoff * x);
+
+            h[k] = 2 * cutoff * s * w;
+            sum += h[k];
+        }
+
+        for (unsigned int k = 0; k < st->ntaps; k++)
+        {
+            taps[k] = lround(h[k] / sum * 32768);
+            total += taps[k];
+            if (abs(taps[k]) > abs(taps[largest]))
+                largest = k;
+        }
+        taps[largest] += 32768 - total;
+    }
+}
+
+resampler_t *resampler_create(double ratio)
+{
+    resampler_t *st = calloc(1, sizeof(*st));
+    double scale = (ratio < 1) ? ratio : 1;
+
+    if (!st)
+        return NULL;
+
+    st->ratio = ratio;
+    st->ntaps = (unsigned int)ceil(RESAMPLER_TAPS / scale / 4) * 4;
+    st->taps = malloc(sizeof(int16_t) * (RESAMPLER_PHASES + 1) * st->ntaps);
+    st->history = malloc(sizeof(cint16_t) * (st->ntaps + RESAMPLER_BLOCK));
+    if (!st->taps || !st->history)
+    {
+        resampler_free(st);
+        return NULL;
+    }
+
+    design(st);
+    resampler_set_correction(st, 0);
+    resampler_reset(st);
+    return st;
+}
+
+void resampler_free(resampler_t *st)
+{
+    if (!st)
+        return;
+
+    free(st->taps);
+    free(st->history);
+    free(st);
+}
+
+void resampler_reset(resampler_t *st)
+{
+    st->pos = 0;
+    st->len = 0;
+}
+
+double resampler_ratio(const resampler_t *st)
+{
+    return st->ratio;
+}
+
+void resampler_set_correction(resampler_t *st, double correction)
+{
+    st->correction = correction;
+    st->step = llround(4294967296.0 / st->ratio * (1 + correction));
+}
+
+double resampler_correction(const resampler_t *st)
+{
+    return st->correction;
+}
+
+unsigned int resampler_max_output(const resampler_t *st, unsigned int n)
+{
+    // history can hold up to ntaps samples not yet used by an output
+    return (unsigned int)(((uint64_t)(n + st->ntaps) << 32) / st->step) + 1;
+}
+
+static cint16_t dotprod(const cint16_t *x, const int16_t *h, unsigned int ntaps)
+{
+    unsigned int k = 0;
+    int32_t r = 0, i = 0;
+
+#if defined(HAVE_SSE2)
+    __m128i acc = _mm_setzero_si128();
+    for (; k < ntaps; k += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)&x[k]);
+        __m128i t = _mm_loadl_epi64((const __m128i *)&h[k]);
+
+        // r0 r1 i0 i1 r2 r3 i2 i3 against h0 h1 h0 h1 h2 h3 h2 h3
+        v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(3, 1, 2, 0)), _MM_SHUFFLE(3, 1, 2, 0));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(v, _mm_unpacklo_epi32(t, t)));
+    }
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+    r = _mm_cvtsi128_si32(acc);
+    i = _mm_cvtsi128_si32(_mm_srli_si128(acc, 4));
+#elif defined(HAVE_NEON)
+    int32x4_t acc_r = vdupq_n_s32(0), acc_i = vdupq_n_s32(0);
+    for (; k < ntaps; k += 4)
+    {
+        int16x4x2_t v = vld2_s16((const int16_t *)&x[k]);
+        int16x4_t t = vld1_s16(&h[k]);
+
+        acc_r = vmlal_s16(acc_r, v.val[0], t);
+        acc_i = vmlal_s16(acc_i, v.val[1], t);
+    }
+    int32x2_t sum = vpadd_s32(vpadd_s32(vget_low_s32(acc_r), vget_high_s32(acc_r)),
+                              vpadd_s32(vget_low_s32(acc_i), vget_high_s32(acc_i)));
+    r = vget_lane_s32(sum, 0);
+    i = vget_lane_s32(sum, 1);
+#endif
+
+    for (; k < ntaps; k++)
+    {
+        r += x[k].r * h[k];
+        i += x[k].i * h[k];
+    }
+
+    r = (r + (1 << 14)) >> 15;
+    i = (i + (1 << 14)) >> 15;
+    return (cint16_t) {
+        (r > 32767) ? 32767 : (r < -32768) ? -32768 : r,
+        (i > 32767) ? 32767 : (i < -32768) ? -32768 : i
+    };
+}
+
+/*
+ * Resamples n input samples and returns the number of outputs written to
+ * y, at most resampler_max_output(). y must not overlap x.
+ */
+unsigned int resampler_execute(resampler_t *st, const cint16_t *x, unsigned int n, cint16_t *y)
+{
+    unsigned int produced = 0;
+
+    while (n > 0)
+    {
+        unsigned int count = st->ntaps + RESAMPLER_BLOCK - st->len;
+        unsigned int skip;
+
+        if (count > n)
+            count = n;
+        memcpy(&st->history[st->len], x, sizeof(cint16_t) * count);
+        st->len += count;
+        x += count;
+        n -= count;
+
+        while ((st->pos >> 32) + st->ntaps <= st->len)
+        {
+            // round to the nearest phase; phase RESAMPLER_PHASES is a whole sample later
+            unsigned int p = ((st->pos & 0xffffffff) + (1u << 23)) >> 24;
+
+            y[produced++] = dotprod(&st->history[st->pos >> 32], &st->taps[p * st->ntaps], st->ntaps);
+            st->pos += st->step;
+        }
+
+        skip = ((st->pos >> 32) < st->len) ? (st->pos >> 32) : st->len;
+        memmove(st->history, &st->history[skip], sizeof(cint16_t) * (st->len - skip));
+        st->len -= skip;
+        st->pos -= (uint64_t)skip << 32;
+    }
+
+    return produced;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "defines.h"
+
+typedef struct resampler_t resampler_t;
+
+resampler_t *resampler_create(double ratio);
+void resampler_free(resampler_t *st);
+void resampler_reset(resampler_t *st);
+double resampler_ratio(const resampler_t *st);
+void resampler_set_correction(resampler_t *st, double correction);
+double resampler_correction(const resampler_t *st);
+unsigned int resampler_max_output(const resampler_t *st, unsigned int n);
+unsigned int resampler_execute(resampler_t *st, const cint16_t *x, unsigned int n, cint16_t *y);
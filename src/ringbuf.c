@@ -0,0 +1,213 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __MINGW32__
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "defines.h"
+#include "ringbuf.h"
+
+// Attempts at finding an address range for both views before giving up.
+#define MIRROR_ATTEMPTS 16
+
+#ifdef __MINGW32__
+
+static size_t granularity(void)
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwAllocationGranularity;
+}
+
+static int map_mirror(ringbuf_t *st)
+{
+    HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, (DWORD)st->size, NULL);
+    if (mapping == NULL)
+        return 1;
+
+    // Windows cannot reserve a range and map into it, so release the
+    // reservation and retry if another thread takes the range meanwhile.
+    for (int attempt = 0; attempt < MIRROR_ATTEMPTS; attempt++)
+    {
+        uint8_t *addr, *lower, *upper;
+
+        addr = VirtualAlloc(NULL, 2 * st->size, MEM_RESERVE, PAGE_NOACCESS);
+        if (addr == NULL)
+            break;
+        VirtualFree(addr, 0, MEM_RELEASE);
+
+        lower = MapViewOfFileEx(mapping, FILE_MAP_ALL_ACCESS, 0, 0, st->size, addr);
+        upper = MapViewOfFileEx(mapping, FILE_MAP_ALL_ACCESS, 0, 0, st->size, addr + st->size);
+        if (lower == addr && upper == addr + st->size)
+        {
+            st->data = addr;
+            st->mapping = mapping;
+            return 0;
+        }
+        if (lower)
+            UnmapViewOfFile(lower);
+        if (upper)
+            UnmapViewOfFile(upper);
+    }
+
+    CloseHandle(mapping);
+    return 1;
+}
+
+static void unmap_mirror(ringbuf_t *st)
+{
+    UnmapViewOfFile(st->data);
+    UnmapViewOfFile(st->data + st->size);
+    CloseHandle(st->mapping);
+}
+
+#else
+
+static size_t granularity(void)
+{
+    return sysconf(_SC_PAGESIZE);
+}
+
+static int open_backing(const ringbuf_t *st)
+{
+#ifdef __linux__
+    (void)st;
+    return memfd_create("nrsc5-ring", 0);
+#else
+    char name[64];
+    int fd;
+
+    snprintf(name, sizeof(name), "/nrsc5-%ld-%p", (long)getpid(), (const void *)st);
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd >= 0)
+        shm_unlink(name);
+    return fd;
+#endif
+}
+
+static int map_mirror(ringbuf_t *st)
+{
+    uint8_t *addr;
+    int fd = open_backing(st);
+    if (fd < 0)
+        return 1;
+
+    if (ftruncate(fd, st->size) != 0)
+    {
+        close(fd);
+        return 1;
+    }
+
+    // reserve the whole range first, then map the same pages over both halves
+    addr = mmap(NULL, 2 * st->size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED)
+    {
+        close(fd);
+        return 1;
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (mmap(addr + i * st->size, st->size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+        {
+            munmap(addr, 2 * st->size);
+            close(fd);
+            return 1;
+        }
+    }
+
+    close(fd);
+    st->data = addr;
+    return 0;
+}
+
+static void unmap_mirror(ringbuf_t *st)
+{
+    munmap(st->data, 2 * st->size);
+}
+
+#endif
+
+int ringbuf_init(ringbuf_t *st, size_t size)
+{
+    size_t gran = granularity();
+
+    st->size = (size + gran - 1) / gran * gran;
+    st->mirrored = 1;
+    ringbuf_reset(st);
+
+    if (map_mirror(st) == 0)
+        return 0;
+
+    log_warn("Mirrored ring buffer unavailable, falling back to a linear buffer");
+    st->mirrored = 0;
+    st->data = malloc(st->size);
+    if (st->data == NULL)
+    {
+        st->size = 0;
+        return 1;
+    }
+    return 0;
+}
+
+void ringbuf_free(ringbuf_t *st)
+{
+    if (st->mirrored)
+        unmap_mirror(st);
+    else
+        free(st->data);
+    st->data = NULL;
+    st->size = 0;
+}
+
+/*
+ * Returns where to write len contiguous bytes, or NULL if the ring does not
+ * have that much free space. The bytes are added by ringbuf_produce().
+ */
+void *ringbuf_write_ptr(ringbuf_t *st, size_t len)
+{
+    size_t used = ringbuf_used(st);
+
+    if (used + len > st->size)
+        return NULL;
+
+    if (!st->mirrored && st->head + len > st->size)
+    {
+        memmove(st->data, st->data + st->tail, used);
+        st->head = used;
+        st->tail = 0;
+    }
+    return st->data + st->head;
+}
+
+void ringbuf_consume(ringbuf_t *st, size_t len)
+{
+    st->tail += len;
+    if (st->tail == st->head)
+        ringbuf_reset(st);
+    else if (st->mirrored && st->tail >= st->size)
+    {
+        st->tail -= st->size;
+        st->head -= st->size;
+    }
+}
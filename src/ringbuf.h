@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Byte ring whose pages are mapped twice, back to back, so that the unread
+ * data and the free space are each one contiguous span and nothing ever has
+ * to be moved. Where the mapping is not available the ring falls back to a
+ * plain buffer that is compacted when a write would run past its end.
+ */
+typedef struct
+{
+    uint8_t *data;
+    size_t size;
+    size_t head;    // write offset, less than tail + size
+    size_t tail;    // read offset, less than size
+    int mirrored;
+#ifdef __MINGW32__
+    void *mapping;
+#endif
+} ringbuf_t;
+
+int ringbuf_init(ringbuf_t *st, size_t size);
+void ringbuf_free(ringbuf_t *st);
+void *ringbuf_write_ptr(ringbuf_t *st, size_t len);
+void ringbuf_consume(ringbuf_t *st, size_t len);
+
+static inline void ringbuf_reset(ringbuf_t *st)
+{
+    st->head = 0;
+    st->tail = 0;
+}
+
+static inline size_t ringbuf_used(const ringbuf_t *st)
+{
+    return st->head - st->tail;
+}
+
+static inline void *ringbuf_read_ptr(const ringbuf_t *st)
+{
+    return st->data + st->tail;
+}
+
+static inline void ringbuf_produce(ringbuf_t *st, size_t len)
+{
+    st->head += len;
+}
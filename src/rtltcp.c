@@ -1,10 +1,13 @@
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #ifdef __MINGW32__
 #include <windows.h>
 #else
 #include <arpa/inet.h>
 #include <errno.h>
+#include <sys/select.h>
 #include <sys/socket.h>
 #include <unistd.h>
 #endif
@@ -13,11 +16,36 @@
 #include "defines.h"
 #include "rtltcp.h"
 
+#define RTLTCP_RING_SIZE (8 * 1024 * 1024)
+#define RTLTCP_RCVBUF (4 * 1024 * 1024)
+#define RTLTCP_RECV_MAX (256 * 1024)
+#define RTLTCP_POLL_MS 100
+
 struct rtltcp_t
 {
     int socket;
     uint32_t tuner_type;
     uint32_t gain_count;
+
+    /*
+     * While streaming, a reader thread drains the socket into a ring so that
+     * network jitter is absorbed here and the remote end never sees TCP
+     * backpressure. When the ring is full, incoming data is discarded in
+     * whole samples and counted. head and tail are running byte counts.
+     */
+    pthread_t reader;
+    int running;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    uint8_t *ring;
+    size_t ring_size;
+    size_t requested_ring_size;
+    uint64_t head;
+    uint64_t tail;
+    uint64_t dropped;
+    uint64_t dropped_taken;
+    int stop;
+    int eof;
 };
 
 typedef struct {
@@ -54,6 +82,12 @@ rtltcp_t *rtltcp_open(int socket)
     dongle_info_t dongle_info;
     rtltcp_t *st = calloc(1, sizeof(*st));
     st->socket = socket;
+    st->requested_ring_size = RTLTCP_RING_SIZE;
+    pthread_mutex_init(&st->mutex, NULL);
+    pthread_cond_init(&st->cond, NULL);
+
+    // best effort, the kernel may clamp the size
+    rtltcp_set_buffers(st, RTLTCP_RCVBUF, 0);
 
     if (rtltcp_read(st, (void *)&dongle_info, sizeof(dongle_info)) != sizeof(dongle_info))
         goto error;
@@ -65,12 +99,18 @@ rtltcp_t *rtltcp_open(int socket)
     st->gain_count = htonl(dongle_info.tuner_gain_count);
     return st;
 error:
+    pthread_mutex_destroy(&st->mutex);
+    pthread_cond_destroy(&st->cond);
     free(st);
     return NULL;
 }
 
 void rtltcp_close(rtltcp_t *st)
 {
+    rtltcp_stop(st);
+    free(st->ring);
+    pthread_mutex_destroy(&st->mutex);
+    pthread_cond_destroy(&st->cond);
 #ifdef __MINGW32__
     closesocket(st->socket);
 #else
@@ -79,9 +119,199 @@ void rtltcp_close(rtltcp_t *st)
     free(st);
 }
 
+static int wait_readable(int socket)
+{
+    fd_set fds;
+    struct timeval tv = { .tv_sec = 0, .tv_usec = RTLTCP_POLL_MS * 1000 };
+
+    FD_ZERO(&fds);
+    FD_SET(socket, &fds);
+    return select(socket + 1, &fds, NULL, NULL, &tv);
+}
+
+static void *reader_thread(void *arg)
+{
+    rtltcp_t *st = arg;
+    uint8_t *discard = malloc(RTLTCP_RECV_MAX);
+
+    pthread_mutex_lock(&st->mutex);
+    while (!st->stop && discard)
+    {
+        uint64_t head = st->head;
+        size_t free_bytes = st->ring_size - (head - st->tail);
+        size_t pos = head % st->ring_size;
+        size_t len;
+        int ready, err;
+        uint8_t *dst;
+
+        pthread_mutex_unlock(&st->mutex);
+
+        ready = wait_readable(st->socket);
+        if (ready == 0)
+        {
+            pthread_mutex_lock(&st->mutex);
+            continue;
+        }
+
+        // Keep samples aligned: when the ring is full, or after an unaligned
+        // drop, read into the discard buffer instead. The ring size and tail
+        // are multiples of a sample, so filling the free space always leaves
+        // head on a sample boundary before anything is dropped.
+        if (free_bytes == 0 || (st->dropped & 3))
+        {
+            dst = discard;
+            len = (st->dropped & 3) ? 4 - (st->dropped & 3) : RTLTCP_RECV_MAX;
+        }
+        else
+        {
+            dst = st->ring + pos;
+            len = st->ring_size - pos;
+            if (len > free_bytes)
+                len = free_bytes;
+            if (len > RTLTCP_RECV_MAX)
+                len = RTLTCP_RECV_MAX;
+        }
+
+        err = (ready < 0) ? -1 : recv(st->socket, (char *)dst, len, 0);
+
+        pthread_mutex_lock(&st->mutex);
+        if (err <= 0)
+        {
+            st->eof = 1;
+            break;
+        }
+        if (dst == discard)
+            st->dropped += err;
+        else
+            st->head += err;
+        pthread_cond_broadcast(&st->cond);
+    }
+    if (!discard)
+        st->eof = 1;
+    pthread_cond_broadcast(&st->cond);
+    pthread_mutex_unlock(&st->mutex);
+
+    free(discard);
+    return NULL;
+}
+
+int rtltcp_set_buffers(rtltcp_t *st, int rcvbuf, size_t ring_size)
+{
+    if (rcvbuf > 0 && setsockopt(st->socket, SOL_SOCKET, SO_RCVBUF, (const char *)&rcvbuf, sizeof(rcvbuf)) != 0)
+        return 1;
+    if (ring_size > 0)
+        st->requested_ring_size = (ring_size + 3) & ~(size_t)3;
+    return 0;
+}
+
+int rtltcp_start(rtltcp_t *st)
+{
+    if (st->running)
+        return 0;
+
+    if (st->ring_size != st->requested_ring_size)
+    {
+        uint8_t *ring = realloc(st->ring, st->requested_ring_size);
+        if (!ring)
+            return 1;
+        st->ring = ring;
+        st->ring_size = st->requested_ring_size;
+    }
+
+    st->head = 0;
+    st->tail = 0;
+    st->dropped = 0;
+    st->dropped_taken = 0;
+    st->stop = 0;
+    st->eof = 0;
+    if (pthread_create(&st->reader, NULL, reader_thread, st) != 0)
+        return 1;
+    st->running = 1;
+    return 0;
+}
+
+void rtltcp_stop(rtltcp_t *st)
+{
+    if (!st->running)
+        return;
+
+    pthread_mutex_lock(&st->mutex);
+    st->stop = 1;
+    pthread_mutex_unlock(&st->mutex);
+
+    pthread_join(st->reader, NULL);
+    st->running = 0;
+}
+
+unsigned int rtltcp_take_dropped(rtltcp_t *st)
+{
+    unsigned int samples;
+
+    pthread_mutex_lock(&st->mutex);
+    samples = (st->dropped - st->dropped_taken) / 2;
+    st->dropped_taken = st->dropped;
+    pthread_mutex_unlock(&st->mutex);
+    return samples;
+}
+
+/*
+ * Waits up to RTLTCP_POLL_MS for cnt bytes, then returns what is available,
+ * so that the caller can notice a stop request while the network is stalled
+ * (e.g. when the server is another session's stopped iqserver). Reads are
+ * rounded down to multiples of 4 bytes, since input_push_cu8() takes whole
+ * pairs of samples; the remainder stays in the ring for the next read.
+ * Returns -1 once the connection is closed and drained.
+ */
+static int read_ring(rtltcp_t *st, uint8_t *buf, size_t cnt)
+{
+    size_t avail, pos, first;
+    struct timespec deadline;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += RTLTCP_POLL_MS * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&st->mutex);
+    while (st->head - st->tail < cnt && !st->eof)
+    {
+        if (pthread_cond_timedwait(&st->cond, &st->mutex, &deadline) != 0)
+            break;
+    }
+
+    avail = st->head - st->tail;
+    if (cnt > avail)
+        cnt = avail;
+    cnt &= ~(size_t)3;
+    pthread_mutex_unlock(&st->mutex);
+
+    // the reader never writes into the span between tail and head
+    pos = st->tail % st->ring_size;
+    first = st->ring_size - pos;
+    if (first > cnt)
+        first = cnt;
+    memcpy(buf, st->ring + pos, first);
+    memcpy(buf + first, st->ring, cnt - first);
+
+    pthread_mutex_lock(&st->mutex);
+    st->tail += cnt;
+    pthread_mutex_unlock(&st->mutex);
+
+    if (cnt == 0 && st->eof && st->head - st->tail < 4)
+        return -1;
+    return cnt;
+}
+
 int rtltcp_read(rtltcp_t *st, uint8_t *buf, size_t cnt)
 {
     int offset = 0;
+
+    if (st->running)
+        return read_ring(st, buf, cnt);
+
     while (cnt > 0)
     {
         int err = recv(st->socket, (char *)buf + offset, cnt, 0);
@@ -19,5 +19,9 @@ RTLTCP_DEFINE(set_bias_tee, 0x0e)
 rtltcp_t *rtltcp_open(int socket);
 void rtltcp_close(rtltcp_t *);
 int rtltcp_read(rtltcp_t *, uint8_t *buf, size_t cnt);
+int rtltcp_set_buffers(rtltcp_t *, int rcvbuf, size_t ring_size);
+int rtltcp_start(rtltcp_t *);
+void rtltcp_stop(rtltcp_t *);
+unsigned int rtltcp_take_dropped(rtltcp_t *);
 int rtltcp_get_tuner_gains(rtltcp_t *, int *gains);
 int rtltcp_reset_buffer(rtltcp_t *, size_t cnt);
@@ -0,0 +1,771 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "private.h"
+#include "segment.h"
+
+#define SEGMENT_DEFAULT_LENGTH 300.0f
+// Enough input for acquisition, the P3 interleaver and the elastic buffer.
+#define SEGMENT_OVERLAP_FM 8.0f
+#define SEGMENT_OVERLAP_AM 24.0f
+#define SEGMENT_WAIT_MS 100
+#define SEGMENT_MAX_THREADS 64
+// Events held by segments that are not being delivered yet.
+#define SEGMENT_MAX_BUFFERED (256 * 1024 * 1024)
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+typedef struct
+{
+    nrsc5_event_t *evt;
+    uint64_t position;  // input sample at which the event was reported
+} segment_event_t;
+
+typedef struct
+{
+    uint64_t begin;   // first input sample owned by the segment
+    uint64_t end;     // input sample following the segment
+    segment_event_t *events;  // collected and not yet taken for delivery
+    size_t num_events;
+    size_t capacity;
+    size_t bytes;             // size of the collected events
+    int past_overlap;         // delivery has passed the first overlap
+    int done;
+} segment_t;
+
+typedef struct
+{
+    struct segmenter_t *segmenter;
+    segment_t *segment;
+    nrsc5_t *radio;
+    uint64_t start;
+} collector_t;
+
+typedef struct
+{
+    uint64_t key;   // 0 if the slot is free
+    uint64_t value;
+} fingerprint_t;
+
+typedef struct
+{
+    fingerprint_t *slots;
+    size_t size;
+    size_t count;
+} fingerprint_table_t;
+
+enum { FINGERPRINT_NONE, FINGERPRINT_STATE, FINGERPRINT_BOUNDARY };
+
+/*
+ * Decodes a recording as a series of segments on a pool of threads.
+ *
+ * Each segment is decoded by its own pipeline, which starts a little before
+ * the segment and runs a little past it so that acquisition, the
+ * interleavers and the elastic buffer have settled by the time the owned
+ * range begins. Events are stamped with the input position at which they
+ * are reported, and a segment keeps only those that fall in its owned
+ * range. Segments are delivered in order, so the callback sees the events
+ * of one continuous decode.
+ *
+ * The segment being delivered hands its events over as they arrive, so it
+ * only holds what the callback has not caught up with, up to
+ * SEGMENT_MAX_BUFFERED. Segments further ahead keep everything until their
+ * turn, and their pipelines pause once all buffered events together reach
+ * SEGMENT_MAX_BUFFERED. Event memory thus stays below about twice that
+ * limit however many threads decode. A slow callback makes the decoders
+ * wait.
+ *
+ * Events that the decoder reports on change (station name, SIS, SIG...) are
+ * reported again by every pipeline. They are passed through only when their
+ * value differs from the last one delivered.
+ *
+ * LOT files are different: stations send the same file again and again,
+ * and every complete reception is a legitimate event. The only duplicates
+ * are those from a pipeline that assembled a file during its lead-in which
+ * the previous pipeline had already reported near its end. A file is thus
+ * dropped only if it is reported in the first overlap of a segment and was
+ * delivered since the start of the last overlap of the previous segment.
+ *
+ * Positions are counted in input samples, i.e. after the decimation done
+ * by the input stage and any resampling to the native rate.
+ */
+struct segmenter_t
+{
+    nrsc5_t *radio;
+    char *path;
+    int format;
+    uint64_t total_samples;  // raw samples in the file
+    unsigned int num_threads;
+    float segment_length;
+
+    // set up when decoding starts
+    int mode;
+    float freq;
+    uint64_t event_mask;
+    double decim;            // raw samples per input sample
+    float rate;              // raw sample rate, 0 if native
+    uint64_t overlap;
+    double sample_rate;
+    segment_t *segments;
+    unsigned int num_segments;
+    unsigned int next_segment;
+    unsigned int next_delivery;
+    size_t buffered;         // bytes of events collected and not yet freed
+    pthread_t threads[SEGMENT_MAX_THREADS];
+    unsigned int running_threads;
+    int started;
+    atomic_int stop;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    struct timespec start;
+    double elapsed;
+
+    fingerprint_table_t changes;    // last value of each on-change event
+    fingerprint_table_t boundary;   // files delivered around the current segment boundary
+};
+
+static uint64_t fnv(uint64_t h, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ p[i]) * FNV_PRIME;
+    return h;
+}
+
+static uint64_t fnv_int(uint64_t h, int64_t value)
+{
+    return fnv(h, &value, sizeof(value));
+}
+
+static uint64_t fnv_str(uint64_t h, const char *s)
+{
+    return s ? fnv(h, s, strlen(s) + 1) : fnv(h, "", 1) ^ 1;
+}
+
+static uint64_t hash_sig(const nrsc5_sig_service_t *service)
+{
+    uint64_t h = FNV_OFFSET;
+
+    for (; service; service = service->next)
+    {
+        h = fnv_int(h, service->type);
+        h = fnv_int(h, service->number);
+        h = fnv_str(h, service->name);
+        for (const nrsc5_sig_component_t *c = service->components; c; c = c->next)
+        {
+            h = fnv_int(h, c->type);
+            h = fnv_int(h, c->id);
+            if (c->type == NRSC5_SIG_SERVICE_AUDIO)
+            {
+                h = fnv_int(h, c->audio.port);
+                h = fnv_int(h, c->audio.type);
+                h = fnv_int(h, c->audio.mime);
+            }
+            else
+            {
+                h = fnv_int(h, c->data.port);
+                h = fnv_int(h, c->data.service_data_type);
+                h = fnv_int(h, c->data.type);
+                h = fnv_int(h, c->data.mime);
+            }
+        }
+    }
+    return h;
+}
+
+static uint64_t hash_sis(const nrsc5_event_t *evt)
+{
+    uint64_t h = FNV_OFFSET;
+
+    h = fnv_str(h, evt->sis.country_code);
+    h = fnv_int(h, evt->sis.fcc_facility_id);
+    h = fnv_str(h, evt->sis.name);
+    h = fnv_str(h, evt->sis.slogan);
+    h = fnv_str(h, evt->sis.message);
+    h = fnv_str(h, evt->sis.alert);
+    h = fnv(h, &evt->sis.latitude, sizeof(float));
+    h = fnv(h, &evt->sis.longitude, sizeof(float));
+    h = fnv_int(h, evt->sis.altitude);
+    for (const nrsc5_sis_asd_t *asd = evt->sis.audio_services; asd; asd = asd->next)
+    {
+        h = fnv_int(h, asd->program);
+        h = fnv_int(h, asd->access);
+        h = fnv_int(h, asd->type);
+        h = fnv_int(h, asd->sound_exp);
+    }
+    for (const nrsc5_sis_dsd_t *dsd = evt->sis.data_services; dsd; dsd = dsd->next)
+    {
+        h = fnv_int(h, dsd->access);
+        h = fnv_int(h, dsd->type);
+        h = fnv_int(h, dsd->mime_type);
+    }
+    if (evt->sis.alert_cnt && evt->sis.alert_cnt_length > 0)
+        h = fnv(h, evt->sis.alert_cnt, evt->sis.alert_cnt_length);
+    return h;
+}
+
+static uint64_t hash_alert(const nrsc5_event_t *evt)
+{
+    uint64_t h = FNV_OFFSET;
+
+    h = fnv_str(h, evt->emergency_alert.message);
+    if (evt->emergency_alert.control_data && evt->emergency_alert.control_data_length > 0)
+        h = fnv(h, evt->emergency_alert.control_data, evt->emergency_alert.control_data_length);
+    h = fnv_int(h, evt->emergency_alert.category1);
+    h = fnv_int(h, evt->emergency_alert.category2);
+    h = fnv_int(h, evt->emergency_alert.location_format);
+    if (evt->emergency_alert.locations && evt->emergency_alert.num_locations > 0)
+        h = fnv(h, evt->emergency_alert.locations, evt->emergency_alert.num_locations * sizeof(int));
+    return h;
+}
+
+/*
+ * Computes the key and value under which an event is remembered. Returns
+ * FINGERPRINT_STATE for on-change events, FINGERPRINT_BOUNDARY for files,
+ * which are only checked around segment boundaries, and FINGERPRINT_NONE
+ * for events that are delivered unconditionally.
+ */
+static int fingerprint(const nrsc5_event_t *evt, uint64_t *key, uint64_t *value)
+{
+    uint64_t k = fnv_int(FNV_OFFSET, evt->event);
+    uint64_t v = FNV_OFFSET;
+    int kind = FINGERPRINT_STATE;
+
+    switch (evt->event)
+    {
+    case NRSC5_EVENT_SYNC:
+    case NRSC5_EVENT_LOST_SYNC:
+        // one key for both, so that only transitions are delivered
+        k = fnv_int(FNV_OFFSET, NRSC5_EVENT_SYNC);
+        v = fnv_int(v, evt->event);
+        break;
+    case NRSC5_EVENT_SIG:
+        v = hash_sig(evt->sig.services);
+        break;
+    case NRSC5_EVENT_SIS:
+        v = hash_sis(evt);
+        break;
+    case NRSC5_EVENT_AUDIO_SERVICE:
+        k = fnv_int(k, evt->audio_service.program);
+        v = fnv_int(v, evt->audio_service.access);
+        v = fnv_int(v, evt->audio_service.type);
+        v = fnv_int(v, evt->audio_service.codec_mode);
+        v = fnv_int(v, evt->audio_service.blend_control);
+        v = fnv_int(v, evt->audio_service.digital_audio_gain);
+        v = fnv_int(v, evt->audio_service.common_delay);
+        v = fnv_int(v, evt->audio_service.latency);
+        break;
+    case NRSC5_EVENT_STATION_ID:
+        v = fnv_str(v, evt->station_id.country_code);
+        v = fnv_int(v, evt->station_id.fcc_facility_id);
+        break;
+    case NRSC5_EVENT_STATION_NAME:
+        v = fnv_str(v, evt->station_name.name);
+        break;
+    case NRSC5_EVENT_STATION_SLOGAN:
+        v = fnv_str(v, evt->station_slogan.slogan);
+        break;
+    case NRSC5_EVENT_STATION_MESSAGE:
+        v = fnv_str(v, evt->station_message.message);
+        break;
+    case NRSC5_EVENT_STATION_LOCATION:
+        v = fnv(v, &evt->station_location.latitude, sizeof(float));
+        v = fnv(v, &evt->station_location.longitude, sizeof(float));
+        v = fnv_int(v, evt->station_location.altitude);
+        break;
+    case NRSC5_EVENT_AUDIO_SERVICE_DESCRIPTOR:
+        k = fnv_int(k, evt->asd.program);
+        v = fnv_int(v, evt->asd.access);
+        v = fnv_int(v, evt->asd.type);
+        v = fnv_int(v, evt->asd.sound_exp);
+        break;
+    case NRSC5_EVENT_DATA_SERVICE_DESCRIPTOR:
+        // descriptors accumulate, so each one is reported once
+        k = fnv_int(k, evt->dsd.access);
+        k = fnv_int(k, evt->dsd.type);
+        k = fnv_int(k, evt->dsd.mime_type);
+        break;
+    case NRSC5_EVENT_EMERGENCY_ALERT:
+        v = hash_alert(evt);
+        break;
+    case NRSC5_EVENT_LOT:
+    case NRSC5_EVENT_LOT_HEADER:
+        k = fnv_int(k, evt->lot.component ? evt->lot.component->data.port : evt->lot.port);
+        k = fnv_int(k, evt->lot.lot);
+        v = fnv_int(v, evt->lot.size);
+        v = fnv_int(v, evt->lot.mime);
+        v = fnv_str(v, evt->lot.name);
+        kind = FINGERPRINT_BOUNDARY;
+        break;
+    default:
+        return FINGERPRINT_NONE;
+    }
+
+    *key = k ? k : 1;
+    *value = v;
+    return kind;
+}
+
+static fingerprint_t *fingerprint_slot(fingerprint_t *slots, size_t size, uint64_t key)
+{
+    size_t i = key & (size - 1);
+
+    while (slots[i].key != 0 && slots[i].key != key)
+        i = (i + 1) & (size - 1);
+    return &slots[i];
+}
+
+static int fingerprint_grow(fingerprint_table_t *table)
+{
+    size_t size = table->size ? table->size * 2 : 64;
+    fingerprint_t *slots = calloc(size, sizeof(*slots));
+
+    if (!slots)
+        return 1;
+
+    for (size_t i = 0; i < table->size; i++)
+    {
+        if (table->slots[i].key != 0)
+            *fingerprint_slot(slots, size, table->slots[i].key) = table->slots[i];
+    }
+    free(table->slots);
+    table->slots = slots;
+    table->size = size;
+    return 0;
+}
+
+static void fingerprint_clear(fingerprint_table_t *table)
+{
+    if (table->count == 0)
+        return;
+    memset(table->slots, 0, table->size * sizeof(*table->slots));
+    table->count = 0;
+}
+
+/*
+ * Returns 1 if the key already holds the value. Otherwise the value is
+ * stored, if record is set, and 0 is returned.
+ */
+static int fingerprint_check(fingerprint_table_t *table, uint64_t key, uint64_t value, int record)
+{
+    fingerprint_t *slot;
+
+    if (table->size)
+    {
+        slot = fingerprint_slot(table->slots, table->size, key);
+        if (slot->key == key && slot->value == value)
+            return 1;
+    }
+    if (!record)
+        return 0;
+
+    if (2 * (table->count + 1) > table->size && fingerprint_grow(table) != 0)
+        return 0;
+
+    slot = fingerprint_slot(table->slots, table->size, key);
+    if (slot->key == 0)
+        table->count++;
+    slot->key = key;
+    slot->value = value;
+    return 0;
+}
+
+// Returns 1 if the event duplicates one already delivered.
+static int is_repeat(segmenter_t *st, const segment_t *segment, const segment_event_t *e)
+{
+    uint64_t key, value;
+
+    switch (fingerprint(e->evt, &key, &value))
+    {
+    case FINGERPRINT_STATE:
+        return fingerprint_check(&st->changes, key, value, 1);
+    case FINGERPRINT_BOUNDARY:
+        if (segment->begin > 0 && e->position < segment->begin + st->overlap)
+            return fingerprint_check(&st->boundary, key, value, 1);
+        // files reported near the end are what the next pipeline may repeat
+        fingerprint_check(&st->boundary, key, value, segment->end - e->position <= st->overlap);
+        return 0;
+    default:
+        return 0;
+    }
+}
+
+// Returns 1 if the segment has to wait for delivery to free memory. Called with the lock held.
+static int over_budget(segmenter_t *st, const segment_t *segment, size_t size)
+{
+    // the segment being delivered is drained by the callback, so it only
+    // waits for its own events; it must not wait for those of later segments
+    if (segment == &st->segments[st->next_delivery])
+        return segment->bytes > 0 && segment->bytes + size > SEGMENT_MAX_BUFFERED;
+    return st->buffered + size > SEGMENT_MAX_BUFFERED;
+}
+
+static void collect(const nrsc5_event_t *evt, void *opaque)
+{
+    collector_t *c = opaque;
+    segmenter_t *st = c->segmenter;
+    segment_t *segment = c->segment;
+    uint64_t position = c->start + c->radio->input.symbol_end;
+    nrsc5_event_t *copy;
+    size_t size;
+
+    if (position < segment->begin || position >= segment->end)
+        return;
+
+    copy = event_clone(evt, &size);
+    if (!copy)
+        return;
+
+    pthread_mutex_lock(&st->mutex);
+    while (over_budget(st, segment, size) && !atomic_load(&st->stop))
+        pthread_cond_wait(&st->cond, &st->mutex);
+
+    if (segment->num_events == segment->capacity)
+    {
+        size_t capacity = segment->capacity ? segment->capacity * 2 : 1024;
+        segment_event_t *events = realloc(segment->events, capacity * sizeof(*events));
+
+        if (!events)
+        {
+            pthread_mutex_unlock(&st->mutex);
+            log_error("Failed to allocate segment events");
+            free(copy);
+            return;
+        }
+        segment->events = events;
+        segment->capacity = capacity;
+    }
+
+    segment->events[segment->num_events].evt = copy;
+    segment->events[segment->num_events].position = position;
+    segment->num_events++;
+    segment->bytes += size;
+    st->buffered += size;
+    pthread_cond_broadcast(&st->cond);
+    pthread_mutex_unlock(&st->mutex);
+}
+
+static void decode_segment(segmenter_t *st, segment_t *segment)
+{
+    collector_t collector = { .segmenter = st, .segment = segment };
+    uint64_t start = segment->begin > st->overlap ? segment->begin - st->overlap : 0;
+    uint64_t stop = (segment->end == UINT64_MAX) ? UINT64_MAX : segment->end + st->overlap;
+    iqfile_reader_t *reader = NULL;
+    iqfile_info_t info;
+    FILE *fp;
+
+    fp = fopen(st->path, "rb");
+    if (!fp)
+    {
+        log_error("Failed to open %s: %s", st->path, strerror(errno));
+        return;
+    }
+    reader = iqfile_reader_open(fp, st->format, &info);
+    if (!reader || iqfile_reader_seek_sample(reader, (uint64_t)(start * st->decim)) != 0)
+    {
+        log_error("Failed to read segment at %.1f s", start / st->sample_rate);
+        goto done;
+    }
+
+    if (nrsc5_open_pipe(&collector.radio) != 0)
+        goto done;
+    collector.start = start;
+    nrsc5_set_mode(collector.radio, st->mode);
+    nrsc5_set_frequency(collector.radio, st->freq);
+    nrsc5_set_input_rate(collector.radio, st->rate);
+    nrsc5_set_event_mask(collector.radio, st->event_mask);
+    nrsc5_set_callback(collector.radio, collect, &collector);
+
+    while (start + collector.radio->input.position < stop && !atomic_load_explicit(&st->stop, memory_order_relaxed))
+    {
+        const uint8_t *span;
+        size_t len = iqfile_reader_next(reader, &span);
+
+        if (len == 0)
+            break;
+        if (st->format == IQFILE_FORMAT_CU8)
+            nrsc5_pipe_samples_cu8(collector.radio, span, len);
+        else
+            nrsc5_pipe_samples_cs16(collector.radio, (const int16_t *)span, len / 2);
+    }
+    nrsc5_close(collector.radio);
+
+done:
+    iqfile_reader_close(reader);
+    fclose(fp);
+}
+
+static void *segment_worker(void *arg)
+{
+    segmenter_t *st = arg;
+
+    pthread_mutex_lock(&st->mutex);
+    while (!atomic_load(&st->stop) && st->next_segment < st->num_segments)
+    {
+        segment_t *segment;
+
+        // bound the number of decoded segments waiting to be delivered
+        if (st->next_segment >= st->next_delivery + 2 * st->running_threads)
+        {
+            pthread_cond_wait(&st->cond, &st->mutex);
+            continue;
+        }
+
+        segment = &st->segments[st->next_segment++];
+        pthread_mutex_unlock(&st->mutex);
+
+        decode_segment(st, segment);
+
+        pthread_mutex_lock(&st->mutex);
+        segment->done = 1;
+        pthread_cond_broadcast(&st->cond);
+    }
+    pthread_mutex_unlock(&st->mutex);
+    return NULL;
+}
+
+static int start_segments(segmenter_t *st)
+{
+    double seconds;
+    uint64_t length, total;
+
+    st->mode = st->radio->mode;
+    st->freq = st->radio->freq;
+    st->event_mask = st->radio->event_mask & ~((1ULL << NRSC5_EVENT_LOST_DEVICE) | (1ULL << NRSC5_EVENT_IQ)
+                                               | (1ULL << NRSC5_EVENT_AGC) | (1ULL << NRSC5_EVENT_SCAN)
+                                               | (1ULL << NRSC5_EVENT_STATS));
+    st->sample_rate = (st->mode == NRSC5_MODE_FM) ? NRSC5_SAMPLE_RATE_CS16_FM : NRSC5_SAMPLE_RATE_CS16_AM;
+    st->rate = st->radio->input.rate;
+    if (st->format == IQFILE_FORMAT_CU8)
+        st->decim = (st->rate ? st->rate : NRSC5_SAMPLE_RATE_CU8) / st->sample_rate;
+    else
+        st->decim = (st->rate ? st->rate : st->sample_rate) / st->sample_rate;
+    st->overlap = ((st->mode == NRSC5_MODE_FM) ? SEGMENT_OVERLAP_FM : SEGMENT_OVERLAP_AM) * st->sample_rate;
+
+    total = st->total_samples / st->decim;
+    seconds = st->segment_length > 0 ? st->segment_length : SEGMENT_DEFAULT_LENGTH;
+    length = seconds * st->sample_rate;
+    if (length < 2 * st->overlap)
+        length = 2 * st->overlap;
+
+    st->num_segments = (total + length - 1) / length;
+    if (st->num_segments == 0)
+        st->num_segments = 1;
+    st->segments = calloc(st->num_segments, sizeof(segment_t));
+    if (!st->segments)
+        return 1;
+    for (unsigned int i = 0; i < st->num_segments; i++)
+    {
+        st->segments[i].begin = (uint64_t)i * length;
+        st->segments[i].end = (i + 1 == st->num_segments) ? UINT64_MAX : (uint64_t)(i + 1) * length;
+    }
+
+    log_info("Decoding %u segments of %.0f s on %u threads", st->num_segments, length / st->sample_rate,
+             st->num_threads < st->num_segments ? st->num_threads : st->num_segments);
+
+    clock_gettime(CLOCK_MONOTONIC, &st->start);
+    pthread_mutex_lock(&st->mutex);
+    for (unsigned int i = 0; i < st->num_threads && i < st->num_segments; i++)
+    {
+        if (pthread_create(&st->threads[i], NULL, segment_worker, st) != 0)
+            break;
+        st->running_threads++;
+    }
+    pthread_mutex_unlock(&st->mutex);
+    st->started = 1;
+    return st->running_threads > 0 ? 0 : 1;
+}
+
+segmenter_t *segmenter_open(nrsc5_t *radio, const char *path, int format, unsigned int threads,
+                            float segment_length, iqfile_info_t *info)
+{
+    segmenter_t *st;
+    iqfile_reader_t *reader;
+    FILE *fp = fopen(path, "rb");
+
+    if (!fp)
+    {
+        log_error("Failed to open %s: %s", path, strerror(errno));
+        return NULL;
+    }
+    reader = iqfile_reader_open(fp, format, info);
+    iqfile_reader_close(reader);
+    fclose(fp);
+    if (!reader)
+        return NULL;
+    if (info->total_samples == 0)
+    {
+        log_error("Segmented decoding needs a file of known length");
+        return NULL;
+    }
+
+    st = calloc(1, sizeof(*st));
+    if (!st)
+        return NULL;
+    st->path = strdup(path);
+    if (!st->path)
+    {
+        free(st);
+        return NULL;
+    }
+    st->radio = radio;
+    st->format = info->format;
+    st->total_samples = info->total_samples;
+    if (threads == 0)
+    {
+#ifdef _SC_NPROCESSORS_ONLN
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? cpus : 1;
+#else
+        threads = 1;
+#endif
+    }
+    st->num_threads = threads;
+    if (st->num_threads > SEGMENT_MAX_THREADS)
+        st->num_threads = SEGMENT_MAX_THREADS;
+    st->segment_length = segment_length;
+    pthread_mutex_init(&st->mutex, NULL);
+    pthread_cond_init(&st->cond, NULL);
+    atomic_init(&st->stop, 0);
+    return st;
+}
+
+void segmenter_close(segmenter_t *st)
+{
+    if (!st)
+        return;
+
+    pthread_mutex_lock(&st->mutex);
+    atomic_store(&st->stop, 1);
+    pthread_cond_broadcast(&st->cond);
+    pthread_mutex_unlock(&st->mutex);
+    for (unsigned int i = 0; i < st->running_threads; i++)
+        pthread_join(st->threads[i], NULL);
+
+    for (unsigned int i = 0; i < st->num_segments; i++)
+    {
+        for (size_t j = 0; j < st->segments[i].num_events; j++)
+            free(st->segments[i].events[j].evt);
+        free(st->segments[i].events);
+    }
+    free(st->segments);
+    free(st->changes.slots);
+    free(st->boundary.slots);
+    pthread_cond_destroy(&st->cond);
+    pthread_mutex_destroy(&st->mutex);
+    free(st->path);
+    free(st);
+}
+
+/*
+ * Delivers the events collected so far for the current segment, waiting a
+ * short while for some. Returns 1 once every segment has been delivered, or
+ * on error.
+ */
+int segmenter_deliver(segmenter_t *st)
+{
+    segment_t *segment;
+    segment_event_t *events;
+    size_t num_events, bytes;
+    struct timespec ts, now;
+    int done;
+
+    if (!st->started && start_segments(st) != 0)
+        return 1;
+    if (st->next_delivery == st->num_segments)
+        return 1;
+
+    segment = &st->segments[st->next_delivery];
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_nsec += SEGMENT_WAIT_MS * 1000000L;
+    if (ts.tv_nsec >= 1000000000L)
+    {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    pthread_mutex_lock(&st->mutex);
+    if (!segment->done && segment->num_events == 0)
+        pthread_cond_timedwait(&st->cond, &st->mutex, &ts);
+    // take the events collected so far; the decoder starts a new list
+    done = segment->done;
+    events = segment->events;
+    num_events = segment->num_events;
+    bytes = segment->bytes;
+    segment->events = NULL;
+    segment->num_events = 0;
+    segment->capacity = 0;
+    segment->bytes = 0;
+    pthread_mutex_unlock(&st->mutex);
+
+    for (size_t i = 0; i < num_events; i++)
+    {
+        segment_event_t *e = &events[i];
+
+        // past the first overlap, files of the previous segment cannot recur
+        if (!segment->past_overlap && e->position >= segment->begin + st->overlap)
+        {
+            fingerprint_clear(&st->boundary);
+            segment->past_overlap = 1;
+        }
+        if (!is_repeat(st, segment, e))
+            nrsc5_report(st->radio, e->evt);
+        free(e->evt);
+    }
+    free(events);
+    if (done && !segment->past_overlap)
+        fingerprint_clear(&st->boundary);
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    pthread_mutex_lock(&st->mutex);
+    st->buffered -= bytes;
+    if (done)
+    {
+        st->next_delivery++;
+        st->elapsed = (now.tv_sec - st->start.tv_sec) + (now.tv_nsec - st->start.tv_nsec) * 1e-9;
+    }
+    pthread_cond_broadcast(&st->cond);
+    pthread_mutex_unlock(&st->mutex);
+
+    return done && st->next_delivery == st->num_segments;
+}
+
+float segmenter_realtime_factor(segmenter_t *st)
+{
+    double decoded, factor = 0;
+
+    // called by the application while the worker delivers
+    pthread_mutex_lock(&st->mutex);
+    if (st->next_delivery > 0 && st->elapsed > 0)
+    {
+        if (st->next_delivery == st->num_segments)
+            decoded = st->total_samples / st->decim;
+        else
+            decoded = st->segments[st->next_delivery].begin;
+        factor = (decoded / st->sample_rate) / st->elapsed;
+    }
+    pthread_mutex_unlock(&st->mutex);
+    return factor;
+}
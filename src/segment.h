@@ -0,0 +1,13 @@
+#pragma once
+
+#include <nrsc5.h>
+
+#include "iqfile.h"
+
+typedef struct segmenter_t segmenter_t;
+
+segmenter_t *segmenter_open(nrsc5_t *radio, const char *path, int format, unsigned int threads,
+                            float segment_length, iqfile_info_t *info);
+void segmenter_close(segmenter_t *st);
+int segmenter_deliver(segmenter_t *st);
+float segmenter_realtime_factor(segmenter_t *st);
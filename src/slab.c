@@ -0,0 +1,89 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+
+#include "slab.h"
+
+void slab_cache_init(slab_cache_t *st, size_t obj_size, unsigned int objs_per_slab)
+{
+    // objects double as free list links while unused
+    if (obj_size < sizeof(void *))
+        obj_size = sizeof(void *);
+    st->obj_size = (obj_size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+    st->objs_per_slab = objs_per_slab;
+    st->free_list = NULL;
+    st->slabs = NULL;
+    st->bytes = 0;
+}
+
+void slab_cache_destroy(slab_cache_t *st)
+{
+    slab_t *slab = st->slabs;
+
+    while (slab)
+    {
+        slab_t *next = slab->next;
+        free(slab);
+        slab = next;
+    }
+    st->free_list = NULL;
+    st->slabs = NULL;
+    st->bytes = 0;
+}
+
+size_t slab_cache_slab_size(const slab_cache_t *st)
+{
+    return sizeof(slab_t) + st->obj_size * st->objs_per_slab;
+}
+
+int slab_cache_grow(slab_cache_t *st)
+{
+    size_t size = slab_cache_slab_size(st);
+    slab_t *slab = malloc(size);
+    unsigned char *obj;
+
+    if (!slab)
+        return 1;
+
+    slab->next = st->slabs;
+    st->slabs = slab;
+    st->bytes += size;
+
+    obj = (unsigned char *)(slab + 1);
+    for (unsigned int i = 0; i < st->objs_per_slab; i++, obj += st->obj_size)
+    {
+        *(void **)obj = st->free_list;
+        st->free_list = obj;
+    }
+    return 0;
+}
+
+void *slab_alloc(slab_cache_t *st)
+{
+    void *obj = st->free_list;
+
+    if (obj)
+        st->free_list = *(void **)obj;
+    return obj;
+}
+
+void slab_free(slab_cache_t *st, void *obj)
+{
+    if (!obj)
+        return;
+    *(void **)obj = st->free_list;
+    st->free_list = obj;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stddef.h>
+
+typedef struct slab_t
+{
+    struct slab_t *next;
+} slab_t;
+
+/*
+ * Fixed-size object cache. Objects are carved from slabs holding
+ * objs_per_slab objects each, and freed objects are recycled through a free
+ * list. Slabs are only returned to the system by slab_cache_destroy.
+ */
+typedef struct
+{
+    size_t obj_size;
+    unsigned int objs_per_slab;
+    void *free_list;
+    slab_t *slabs;
+    size_t bytes;
+} slab_cache_t;
+
+void slab_cache_init(slab_cache_t *st, size_t obj_size, unsigned int objs_per_slab);
+void slab_cache_destroy(slab_cache_t *st);
+size_t slab_cache_slab_size(const slab_cache_t *st);
+int slab_cache_grow(slab_cache_t *st);
+void *slab_alloc(slab_cache_t *st);
+void slab_free(slab_cache_t *st, void *obj);
@@ -0,0 +1,102 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "stats.h"
+
+static uint64_t clock_ns(clockid_t clock)
+{
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// charge the time since the last transition to the innermost open stage
+static void charge(stats_t *st)
+{
+    uint64_t wall = clock_ns(CLOCK_MONOTONIC);
+    uint64_t cpu = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+
+    if (st->depth > 0 && st->depth <= STATS_MAX_DEPTH)
+    {
+        nrsc5_stage_stats_t *stage = &st->stages[st->stack[st->depth - 1]];
+        stage->wall_ns += wall - st->wall;
+        stage->cpu_ns += cpu - st->cpu;
+    }
+    st->wall = wall;
+    st->cpu = cpu;
+}
+
+void stats_enter(stats_t *st, unsigned int stage)
+{
+    charge(st);
+    if (st->depth < STATS_MAX_DEPTH)
+        st->stack[st->depth] = stage;
+    st->depth++;
+    st->stages[stage].calls++;
+}
+
+void stats_leave(stats_t *st)
+{
+    // stats may have been enabled while a stage was already running
+    if (st->depth == 0)
+        return;
+
+    charge(st);
+    st->depth--;
+}
+
+void stats_restart(stats_t *st)
+{
+    memset(st->stages, 0, sizeof(st->stages));
+    st->samples = 0;
+    st->input_peak = 0;
+    st->input_overflows = 0;
+    st->source_drops = 0;
+    st->queue_peak = 0;
+    st->start = clock_ns(CLOCK_MONOTONIC);
+}
+
+float stats_elapsed(const stats_t *st)
+{
+    return (clock_ns(CLOCK_MONOTONIC) - st->start) / 1e9f;
+}
+
+/*
+ * Count input samples and apply interval changes. Returns 1 when enough
+ * input has been processed for a report.
+ */
+int stats_count(stats_t *st, unsigned int samples, float sample_rate)
+{
+    float requested = atomic_load_explicit(&st->requested, memory_order_relaxed);
+
+    if (requested != st->interval)
+    {
+        st->interval = requested;
+        st->enabled = (requested > 0);
+        st->depth = 0;
+        stats_restart(st);
+        return 0;
+    }
+
+    if (!st->enabled)
+        return 0;
+
+    st->samples += samples;
+    return st->samples >= st->interval * sample_rate;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include <nrsc5.h>
+
+#define STATS_MAX_DEPTH 16
+
+/*
+ * Processing statistics for NRSC5_EVENT_STATS. Only the processing thread
+ * touches the counters; nrsc5_set_stats_interval() posts a new interval
+ * through `requested`, which is picked up at the next input block.
+ *
+ * Stages nest (acquire calls sync, which calls decode, and so on), so each
+ * transition charges the time since the previous one to the innermost open
+ * stage, and the outer stages only see their own work.
+ */
+typedef struct
+{
+    _Atomic float requested;
+    float interval;
+    int enabled;
+
+    unsigned int depth;
+    unsigned int stack[STATS_MAX_DEPTH];
+    uint64_t wall;
+    uint64_t cpu;
+    uint64_t start;
+
+    nrsc5_stage_stats_t stages[NRSC5_NUM_STAGES];
+    uint64_t samples;
+    unsigned int input_peak;
+    unsigned int input_overflows;
+    unsigned int source_drops;
+    unsigned int queue_peak;
+} stats_t;
+
+void stats_enter(stats_t *st, unsigned int stage);
+void stats_leave(stats_t *st);
+int stats_count(stats_t *st, unsigned int samples, float sample_rate);
+void stats_restart(stats_t *st);
+float stats_elapsed(const stats_t *st);
+
+static inline void stats_begin(stats_t *st, unsigned int stage)
+{
+    if (st->enabled)
+        stats_enter(st, stage);
+}
+
+static inline void stats_end(stats_t *st)
+{
+    if (st->enabled)
+        stats_leave(st);
+}
+
+static inline void stats_input_fill(stats_t *st, unsigned int fill)
+{
+    if (st->enabled && fill > st->input_peak)
+        st->input_peak = fill;
+}
+
+static inline void stats_source_drops(stats_t *st, unsigned int samples)
+{
+    if (st->enabled)
+        st->source_drops += samples;
+}
+
+static inline void stats_queue_depth(stats_t *st, unsigned int depth)
+{
+    if (st->enabled && depth > st->queue_peak)
+        st->queue_peak = depth;
+}
@@ -16,8 +16,17 @@
 #include "config.h"
 
 #include <math.h>
+#include <stdlib.h>
 #include <string.h>
 
+#ifdef HAVE_NEON
+#include <arm_neon.h>
+#endif
+
+#ifdef HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
 #include "defines.h"
 #include "input.h"
 #include "private.h"
@@ -37,57 +46,133 @@ static const int compatibility_mode[64] = {
     6, 1, 2, 3, 1, 5, 6, 5, 6, 1, 2, 11, 1, 5, 6, 5
 };
 
-static uint8_t gray4(float f)
-{
-    if (f < -1)
-        return 0;
-    else if (f < 0)
-        return 2;
-    else if (f < 1)
-        return 3;
-    else
-        return 1;
-}
-
-static uint8_t gray8(float f)
-{
-    if (f < -3)
-        return 0;
-    else if (f < -2)
-        return 4;
-    else if (f < -1)
-        return 6;
-    else if (f < 0)
-        return 2;
-    else if (f < 1)
-        return 3;
-    else if (f < 2)
-        return 7;
-    else if (f < 3)
-        return 5;
-    else
-        return 1;
-}
-
-static inline int8_t demod(float x, float mult)
+/*
+ * Soft-demaps the BLKSZ symbols of one FM subcarrier. The real and imaginary
+ * parts of symbol n are clamped to [-1, 1], scaled by mult and rounded, and
+ * become soft bits out[n * stride] and out[n * stride + 1].
+ */
+static void demod_carrier(int8_t *out, unsigned int stride, const float complex *x, float mult)
 {
-    float clamped = fmaxf(fminf(x, 1), -1);
-    return lroundf(clamped * mult);
+    for (unsigned int n = 0; n < BLKSZ; n += 4)
+    {
+        int8_t sbits[8];
+#if defined(HAVE_SSE2)
+        const __m128 one = _mm_set1_ps(1), minus_one = _mm_set1_ps(-1), scale = _mm_set1_ps(mult);
+        const __m128 sign = _mm_set1_ps(-0.0f), half = _mm_set1_ps(0.5f);
+        __m128 a = _mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps((const float *)&x[n]), minus_one), one), scale);
+        __m128 b = _mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps((const float *)&x[n + 2]), minus_one), one), scale);
+
+        // round half away from zero, as lroundf() does
+        a = _mm_add_ps(a, _mm_or_ps(_mm_and_ps(a, sign), half));
+        b = _mm_add_ps(b, _mm_or_ps(_mm_and_ps(b, sign), half));
+        __m128i packed = _mm_packs_epi32(_mm_cvttps_epi32(a), _mm_cvttps_epi32(b));
+        _mm_storel_epi64((__m128i *)sbits, _mm_packs_epi16(packed, packed));
+#elif defined(HAVE_NEON)
+        const uint32x4_t sign = vdupq_n_u32(0x80000000);
+        const float32x4_t half = vdupq_n_f32(0.5f);
+        float32x4_t a = vmulq_n_f32(vminq_f32(vmaxq_f32(vld1q_f32((const float *)&x[n]), vdupq_n_f32(-1)), vdupq_n_f32(1)), mult);
+        float32x4_t b = vmulq_n_f32(vminq_f32(vmaxq_f32(vld1q_f32((const float *)&x[n + 2]), vdupq_n_f32(-1)), vdupq_n_f32(1)), mult);
+
+        // round half away from zero, as lroundf() does
+        a = vaddq_f32(a, vbslq_f32(sign, a, half));
+        b = vaddq_f32(b, vbslq_f32(sign, b, half));
+        int16x8_t packed = vcombine_s16(vmovn_s32(vcvtq_s32_f32(a)), vmovn_s32(vcvtq_s32_f32(b)));
+        vst1_s8(sbits, vmovn_s16(packed));
+#else
+        for (unsigned int k = 0; k < 8; k++)
+        {
+            float v = ((const float *)&x[n])[k];
+            sbits[k] = lroundf(fmaxf(fminf(v, 1), -1) * mult);
+        }
+#endif
+        for (unsigned int k = 0; k < 4; k++)
+            memcpy(&out[(n + k) * stride], &sbits[2 * k], 2);
+    }
 }
 
-static uint8_t qpsk(complex float cf)
+// Soft-demaps the data subcarriers of consecutive FM partitions.
+static void demod_partitions(int8_t *out, unsigned int stride, float complex (*buffer)[BLKSZ],
+                             unsigned int start, unsigned int count, float mult)
 {
-    return (crealf(cf) < 0 ? 0 : 1) | (cimagf(cf) < 0 ? 0 : 2);
+    for (unsigned int p = 0; p < count; p++)
+    {
+        for (unsigned int j = 1; j < PARTITION_WIDTH; j++)
+        {
+            unsigned int carrier = start + p * PARTITION_WIDTH + j;
+            demod_carrier(out + 2 * (p * PARTITION_DATA_CARRIERS + j - 1), stride, buffer[carrier], mult);
+        }
+    }
 }
 
-static uint8_t qam16(complex float cf)
+/*
+ * Hard-demaps the BLKSZ symbols of one AM subcarrier to the Gray-coded
+ * points of a square constellation with `bits` bits per axis: 1 for QPSK,
+ * 2 for 16-QAM and 3 for 64-QAM. Symbol n is written to out[n * stride].
+ *
+ * The level k of each axis is found by clamping and truncation, without
+ * comparisons. Its Gray code k ^ (k >> 1) is then bit-reversed, since the
+ * constellations put the least significant bit on the outer decision.
+ */
+static void demap_carrier(uint8_t *out, unsigned int stride, const float complex *x, unsigned int bits)
 {
-    return gray4(crealf(cf)) | (gray4(cimagf(cf)) << 2);
-}
+    const float levels = 1 << (bits - 1);
+    const int mid = (bits == 3) ? 2 : 0;
 
-static uint8_t qam64(complex float cf)
-{
-    return gray8(crealf(cf)) | (gray8(cimagf(cf)) << 3);
+    for (unsigned int n = 0; n < BLKSZ; n += 4)
+    {
+        int32_t sym[4];
+#if defined(HAVE_SSE2)
+        const __m128 lo = _mm_set1_ps(-levels), hi = _mm_set1_ps(levels - 0.5f), offset = _mm_set1_ps(levels);
+        const __m128i one = _mm_set1_epi32(1), mid_mask = _mm_set1_epi32(mid);
+        const __m128i count = _mm_cvtsi32_si128(bits - 1);
+        const __m128i weight = _mm_setr_epi16(1, 1 << bits, 1, 1 << bits, 1, 1 << bits, 1, 1 << bits);
+        __m128i k[2], g[2];
+
+        for (unsigned int h = 0; h < 2; h++)
+        {
+            __m128 v = _mm_loadu_ps((const float *)&x[n + 2 * h]);
+            k[h] = _mm_cvttps_epi32(_mm_add_ps(_mm_min_ps(_mm_max_ps(v, lo), hi), offset));
+            k[h] = _mm_xor_si128(k[h], _mm_srli_epi32(k[h], 1));
+            g[h] = _mm_or_si128(_mm_or_si128(_mm_sll_epi32(_mm_and_si128(k[h], one), count),
+                                             _mm_and_si128(k[h], mid_mask)),
+                                _mm_srl_epi32(k[h], count));
+        }
+        // interleaved I/Q levels, combined as I + (Q << bits)
+        _mm_storeu_si128((__m128i *)sym, _mm_madd_epi16(_mm_packs_epi32(g[0], g[1]), weight));
+#elif defined(HAVE_NEON)
+        const float32x4_t lo = vdupq_n_f32(-levels), hi = vdupq_n_f32(levels - 0.5f), offset = vdupq_n_f32(levels);
+        const int32x4_t one = vdupq_n_s32(1), mid_mask = vdupq_n_s32(mid);
+        const int32x4_t left = vdupq_n_s32(bits - 1), right = vdupq_n_s32(1 - (int)bits);
+        const int32_t weight_shifts[4] = { 0, bits, 0, bits };
+        const int32x4_t weight = vld1q_s32(weight_shifts);
+
+        for (unsigned int h = 0; h < 2; h++)
+        {
+            float32x4_t v = vld1q_f32((const float *)&x[n + 2 * h]);
+            int32x4_t k = vcvtq_s32_f32(vaddq_f32(vminq_f32(vmaxq_f32(v, lo), hi), offset));
+            k = veorq_s32(k, vshrq_n_s32(k, 1));
+            int32x4_t g = vorrq_s32(vorrq_s32(vshlq_s32(vandq_s32(k, one), left), vandq_s32(k, mid_mask)),
+                                    vshlq_s32(k, right));
+            // interleaved I/Q levels, combined as I + (Q << bits)
+            g = vshlq_s32(g, weight);
+            vst1_s32(&sym[2 * h], vpadd_s32(vget_low_s32(g), vget_high_s32(g)));
+        }
+#else
+        for (unsigned int k = 0; k < 4; k++)
+        {
+            int gi = fminf(fmaxf(crealf(x[n + k]), -levels), levels - 0.5f) + levels;
+            int gq = fminf(fmaxf(cimagf(x[n + k]), -levels), levels - 0.5f) + levels;
+
+            gi ^= gi >> 1;
+            gq ^= gq >> 1;
+            gi = ((gi & 1) << (bits - 1)) | (gi & mid) | (gi >> (bits - 1));
+            gq = ((gq & 1) << (bits - 1)) | (gq & mid) | (gq >> (bits - 1));
+            sym[k] = gi | (gq << bits);
+        }
+#endif
+        for (unsigned int k = 0; k < 4; k++)
+            out[(n + k) * stride] = sym[k];
+    }
 }
 
 static void adjust_ref(sync_t *st, unsigned int ref, int cfo)
@@ -286,57 +371,122 @@ float phase_diff(float a, float b)
     return diff;
 }
 
+static int try_cfo(sync_t *st, int cfo)
+{
+    int offset;
+    int best_offset = -1;
+    unsigned int best_count = 0;
+    unsigned int offset_count[BLKSZ];
+
+    memset(offset_count, 0, BLKSZ * sizeof(unsigned int));
+
+    for (int i = 0; i <= PM_PARTITIONS; i++)
+    {
+        adjust_ref(st, cfo + LB_START + i * PARTITION_WIDTH, cfo);
+        offset = find_ref_fm(st, cfo + LB_START + i * PARTITION_WIDTH, (MIDDLE_REF_SC-i) & 0x3);
+        reset_ref(st, cfo + LB_START + i * PARTITION_WIDTH);
+        if (offset >= 0)
+            offset_count[offset]++;
+
+        adjust_ref(st, cfo + UB_END - i * PARTITION_WIDTH, cfo);
+        offset = find_ref_fm(st, cfo + UB_END - i * PARTITION_WIDTH, (MIDDLE_REF_SC-i) & 0x3);
+        reset_ref(st, cfo + UB_END - i * PARTITION_WIDTH);
+        if (offset >= 0)
+            offset_count[offset]++;
+    }
+
+    for (offset = 0; offset < BLKSZ; offset++)
+    {
+        if (offset_count[offset] > best_count) {
+            best_offset = offset;
+            best_count = offset_count[offset];
+        }
+    }
+
+    if (best_offset >= 0 && best_count >= 3)
+    {
+        // At least three offsets matched, so this is likely the correct CFO.
+        acquire_keep_extra(&st->input->acq, ((BLKSZ - best_offset) % BLKSZ) * FFTCP_FM);
+        acquire_cfo_adjust(&st->input->acq, cfo);
+
+        // Wait until the buffers have cleared before measuring again.
+        st->cfo_wait = 8;
+        return 1;
+    }
+    return 0;
+}
+
 void detect_cfo(sync_t *st)
 {
+    // After a warm start the offset is already applied, so only the block
+    // alignment is unknown. Check that before searching the whole range.
+    if (st->warm_psmi >= 0 && try_cfo(st, 0))
+        return;
+
     for (int cfo = -2 * PARTITION_WIDTH; cfo < 2 * PARTITION_WIDTH; cfo++)
     {
-        int offset;
-        int best_offset = -1;
-        unsigned int best_count = 0;
-        unsigned int offset_count[BLKSZ];
+        if (try_cfo(st, cfo))
+            break;
+    }
+}
 
-        memset(offset_count, 0, BLKSZ * sizeof(unsigned int));
+// Reference subcarriers are DBPSK, so the square of the symbol-to-symbol product
+// keeps a steady phase, whereas it flips sign at random on QPSK data subcarriers
+// and noise. Returns the coherent fraction of that energy for the given offset,
+// with the self terms removed so that noise averages out to zero.
+static float ref_coherence_fm(sync_t *st, int cfo)
+{
+    float num = 0, den = 0;
 
-        for (int i = 0; i <= PM_PARTITIONS; i++)
-        {
-            adjust_ref(st, cfo + LB_START + i * PARTITION_WIDTH, cfo);
-            offset = find_ref_fm(st, cfo + LB_START + i * PARTITION_WIDTH, (MIDDLE_REF_SC-i) & 0x3);
-            reset_ref(st, cfo + LB_START + i * PARTITION_WIDTH);
-            if (offset >= 0)
-                offset_count[offset]++;
-
-            adjust_ref(st, cfo + UB_END - i * PARTITION_WIDTH, cfo);
-            offset = find_ref_fm(st, cfo + UB_END - i * PARTITION_WIDTH, (MIDDLE_REF_SC-i) & 0x3);
-            reset_ref(st, cfo + UB_END - i * PARTITION_WIDTH);
-            if (offset >= 0)
-                offset_count[offset]++;
-        }
+    for (int i = 0; i <= PM_PARTITIONS; i++)
+    {
+        unsigned int refs[2] = {
+            cfo + LB_START + i * PARTITION_WIDTH,
+            cfo + UB_END - i * PARTITION_WIDTH
+        };
 
-        for (offset = 0; offset < BLKSZ; offset++)
+        for (int k = 0; k < 2; k++)
         {
-            if (offset_count[offset] > best_count) {
-                best_offset = offset;
-                best_count = offset_count[offset];
+            float complex sum = 0;
+            float energy = 0, self = 0;
+            for (int n = 1; n < BLKSZ; n++)
+            {
+                float complex d = st->buffer[refs[k]][n] * conjf(st->buffer[refs[k]][n - 1]);
+                float p = normf(d);
+                sum += d * d;
+                energy += p;
+                self += p * p;
             }
+            num += normf(sum) - self;
+            den += energy * energy - self;
         }
+    }
 
-        if (best_offset >= 0 && best_count >= 3)
-        {
-            // At least three offsets matched, so this is likely the correct CFO.
-            acquire_keep_extra(&st->input->acq, ((BLKSZ - best_offset) % BLKSZ) * FFTCP_FM);
-            acquire_cfo_adjust(&st->input->acq, cfo);
+    return (den > 0) ? num / den : 0;
+}
 
-            // Wait until the buffers have cleared before measuring again.
-            st->cfo_wait = 8;
-            break;
-        }
+static void scan_measure_fm(sync_t *st)
+{
+    float best = 0;
+
+    for (int cfo = -2 * PARTITION_WIDTH; cfo < 2 * PARTITION_WIDTH; cfo++)
+    {
+        float coherence = ref_coherence_fm(st, cfo);
+        if (coherence > best)
+            best = coherence;
     }
+
+    if (best > st->input->scan.block_ref_metric)
+        st->input->scan.block_ref_metric = best;
 }
 
 void sync_process_fm(sync_t *st)
 {
     int i, partitions_per_band;
 
+    if (st->input->scan.active && st->input->sync_state == SYNC_STATE_COARSE)
+        scan_measure_fm(st);
+
     switch (compatibility_mode[st->psmi]) {
         case 2:
             partitions_per_band = 11;
@@ -482,21 +632,24 @@ void sync_process_fm(sync_t *st)
             }
         }
 
-        st->error_lb += error_lb;
-        st->error_ub += error_ub;
-
         // Display average MER for each sideband
-        if (++st->mer_cnt == 16)
+        if (nrsc5_event_enabled(st->input->radio, NRSC5_EVENT_MER))
         {
-            float signal = 2 * BLKSZ * (partitions_per_band * PARTITION_DATA_CARRIERS) * st->mer_cnt;
-            float mer_db_lb = 10 * log10f(signal / st->error_lb);
-            float mer_db_ub = 10 * log10f(signal / st->error_ub);
+            st->error_lb += error_lb;
+            st->error_ub += error_ub;
 
-            nrsc5_report_mer(st->input->radio, mer_db_lb, mer_db_ub);
+            if (++st->mer_cnt == 16)
+            {
+                float signal = 2 * BLKSZ * (partitions_per_band * PARTITION_DATA_CARRIERS) * st->mer_cnt;
+                float mer_db_lb = 10 * log10f(signal / st->error_lb);
+                float mer_db_ub = 10 * log10f(signal / st->error_ub);
 
-            st->mer_cnt = 0;
-            st->error_lb = 0;
-            st->error_ub = 0;
+                nrsc5_report_mer(st->input->radio, mer_db_lb, mer_db_ub);
+
+                st->mer_cnt = 0;
+                st->error_lb = 0;
+                st->error_ub = 0;
+            }
         }
 
         // Soft demod based on MER for each sideband
@@ -507,88 +660,39 @@ void sync_process_fm(sync_t *st)
 
         decode_set_block(&st->input->decode, st->bc);
 
-        for (int n = 0; n < BLKSZ; n++)
+        // Each row of a span holds one OFDM symbol: the lower sideband's
+        // partitions, then the upper sideband's.
+        decode_t *decode = &st->input->decode;
+        const unsigned int pm_row = 4 * PM_PARTITIONS * PARTITION_DATA_CARRIERS;
+        int8_t *span = decode_pm_span(decode);
+
+        demod_partitions(span, pm_row, st->buffer, LB_START, PM_PARTITIONS, mult_lb);
+        demod_partitions(span + pm_row / 2, pm_row, st->buffer, UB_END - PM_PARTITIONS * PARTITION_WIDTH, PM_PARTITIONS, mult_ub);
+        decode_commit_pm(decode, pm_row * BLKSZ);
+
+        if (compatibility_mode[st->psmi] == 2)
         {
-            float complex c;
-            for (i = LB_START; i < LB_START + (PM_PARTITIONS * PARTITION_WIDTH); i += PARTITION_WIDTH)
-            {
-                unsigned int j;
-                for (j = 1; j < PARTITION_WIDTH; j++)
-                {
-                    c = st->buffer[i + j][n];
-                    decode_push_pm(&st->input->decode, demod(crealf(c), mult_lb));
-                    decode_push_pm(&st->input->decode, demod(cimagf(c), mult_lb));
-                }
-            }
-            for (i = UB_END - (PM_PARTITIONS * PARTITION_WIDTH); i < UB_END; i += PARTITION_WIDTH)
-            {
-                unsigned int j;
-                for (j = 1; j < PARTITION_WIDTH; j++)
-                {
-                    c = st->buffer[i + j][n];
-                    decode_push_pm(&st->input->decode, demod(crealf(c), mult_ub));
-                    decode_push_pm(&st->input->decode, demod(cimagf(c), mult_ub));
-                }
-            }
-            if (compatibility_mode[st->psmi] == 2) {
-                unsigned int j;
-                for (j = 1; j < PARTITION_WIDTH; j++)
-                {
-                    c = st->buffer[LB_START + (PM_PARTITIONS * PARTITION_WIDTH) + j][n];
-                    decode_push_px1(&st->input->decode, demod(crealf(c), mult_lb));
-                    decode_push_px1(&st->input->decode, demod(cimagf(c), mult_lb));
-                }
-                for (j = 1; j < PARTITION_WIDTH; j++)
-                {
-                    c = st->buffer[UB_END - (PM_PARTITIONS + 1) * PARTITION_WIDTH + j][n];
-                    decode_push_px1(&st->input->decode, demod(crealf(c), mult_ub));
-                    decode_push_px1(&st->input->decode, demod(cimagf(c), mult_ub));
-                }
-            }
-            if ((compatibility_mode[st->psmi] == 3) || (compatibility_mode[st->psmi] == 11)) {
-                for (i = LB_START + (PM_PARTITIONS * PARTITION_WIDTH); i < LB_START + (PM_PARTITIONS + 2) * PARTITION_WIDTH; i += PARTITION_WIDTH)
-                {
-                    unsigned int j;
-                    for (j = 1; j < PARTITION_WIDTH; j++)
-                    {
-                        c = st->buffer[i + j][n];
-                        decode_push_px1(&st->input->decode, demod(crealf(c), mult_lb));
-                        decode_push_px1(&st->input->decode, demod(cimagf(c), mult_lb));
-                    }
-                }
-                for (i = UB_END - (PM_PARTITIONS + 2) * PARTITION_WIDTH; i < UB_END - (PM_PARTITIONS * PARTITION_WIDTH); i += PARTITION_WIDTH)
-                {
-                    unsigned int j;
-                    for (j = 1; j < PARTITION_WIDTH; j++)
-                    {
-                        c = st->buffer[i + j][n];
-                        decode_push_px1(&st->input->decode, demod(crealf(c), mult_ub));
-                        decode_push_px1(&st->input->decode, demod(cimagf(c), mult_ub));
-                    }
-                }
-            }
-            if (compatibility_mode[st->psmi] == 11) {
-                for (i = LB_START + (PM_PARTITIONS + 2) * PARTITION_WIDTH; i < LB_START + (PM_PARTITIONS + 4) * PARTITION_WIDTH; i += PARTITION_WIDTH)
-                {
-                    unsigned int j;
-                    for (j = 1; j < PARTITION_WIDTH; j++)
-                    {
-                        c = st->buffer[i + j][n];
-                        decode_push_px2(&st->input->decode, demod(crealf(c), mult_lb));
-                        decode_push_px2(&st->input->decode, demod(cimagf(c), mult_lb));
-                    }
-                }
-                for (i = UB_END - (PM_PARTITIONS + 4) * PARTITION_WIDTH; i < UB_END - (PM_PARTITIONS + 2) * PARTITION_WIDTH; i += PARTITION_WIDTH)
-                {
-                    unsigned int j;
-                    for (j = 1; j < PARTITION_WIDTH; j++)
-                    {
-                        c = st->buffer[i + j][n];
-                        decode_push_px2(&st->input->decode, demod(crealf(c), mult_ub));
-                        decode_push_px2(&st->input->decode, demod(cimagf(c), mult_ub));
-                    }
-                }
-            }
+            const unsigned int row = 4 * PARTITION_DATA_CARRIERS;
+            span = decode_px1_span(decode);
+            demod_partitions(span, row, st->buffer, LB_START + PM_PARTITIONS * PARTITION_WIDTH, 1, mult_lb);
+            demod_partitions(span + row / 2, row, st->buffer, UB_END - (PM_PARTITIONS + 1) * PARTITION_WIDTH, 1, mult_ub);
+            decode_commit_px1(decode, row * BLKSZ);
+        }
+        if ((compatibility_mode[st->psmi] == 3) || (compatibility_mode[st->psmi] == 11))
+        {
+            const unsigned int row = 8 * PARTITION_DATA_CARRIERS;
+            span = decode_px1_span(decode);
+            demod_partitions(span, row, st->buffer, LB_START + PM_PARTITIONS * PARTITION_WIDTH, 2, mult_lb);
+            demod_partitions(span + row / 2, row, st->buffer, UB_END - (PM_PARTITIONS + 2) * PARTITION_WIDTH, 2, mult_ub);
+            decode_commit_px1(decode, row * BLKSZ);
+        }
+        if (compatibility_mode[st->psmi] == 11)
+        {
+            const unsigned int row = 8 * PARTITION_DATA_CARRIERS;
+            span = decode_px2_span(decode);
+            demod_partitions(span, row, st->buffer, LB_START + (PM_PARTITIONS + 2) * PARTITION_WIDTH, 2, mult_lb);
+            demod_partitions(span + row / 2, row, st->buffer, UB_END - (PM_PARTITIONS + 4) * PARTITION_WIDTH, 2, mult_ub);
+            decode_commit_px2(decode, row * BLKSZ);
         }
 
         st->bc = (st->bc + 1) % 16;
@@ -641,7 +745,10 @@ void sync_process_am(sync_t *st)
         else
             st->offset_history = (st->offset_history << 4) | bc;
 
-        if ((st->offset_history & 0xffff) == 0x5670)
+        // A cold start waits for four consecutive block counts before trusting
+        // the frame alignment. If the station is known, a single first block
+        // carrying the expected PSMI is enough.
+        if ((st->offset_history & 0xffff) == 0x5670 || (bc == 0 && st->psmi == st->warm_psmi))
         {
             st->bc = 0;
             input_set_sync_state(st->input, SYNC_STATE_FINE);
@@ -659,14 +766,17 @@ void sync_process_am(sync_t *st)
         float complex pids1_mult = 2 * CMPLXF(1.5, -0.5) / (st->buffer[CENTER_AM + pids_0_index][8] + st->buffer[CENTER_AM + pids_0_index][24]);
         float complex pids2_mult = 2 * CMPLXF(1.5, -0.5) / (st->buffer[CENTER_AM + pids_1_index][8] + st->buffer[CENTER_AM + pids_1_index][24]);
 
+        decode_t *decode = &st->input->decode;
+        uint8_t *pids = decode_pids_span(decode);
+
         for (int n = 0; n < BLKSZ; n++)
         {
             st->buffer[CENTER_AM + pids_0_index][n] *= pids1_mult;
-            decode_push_pids(&st->input->decode, qam16(st->buffer[CENTER_AM + pids_0_index][n]));
-
             st->buffer[CENTER_AM + pids_1_index][n] *= pids2_mult;
-            decode_push_pids(&st->input->decode, qam16(st->buffer[CENTER_AM + pids_1_index][n]));
         }
+        demap_carrier(pids, 2, st->buffer[CENTER_AM + pids_0_index], 2);
+        demap_carrier(pids + 1, 2, st->buffer[CENTER_AM + pids_1_index], 2);
+        decode_commit_pids(decode, 2 * BLKSZ);
 
         float complex pl_mult[PARTITION_WIDTH_AM];
         float complex pu_mult[PARTITION_WIDTH_AM];
@@ -705,40 +815,33 @@ void sync_process_am(sync_t *st)
         samperr = samperr / (2 * (PARTITION_WIDTH_AM-1)) * FFT_AM / (2 * M_PI);
         st->samperr = roundf(samperr);
 
-        for (int n = 0; n < BLKSZ; n++)
+        uint8_t *pl, *pu, *sec, *ter;
+        int s_bits = (st->psmi != SERVICE_MODE_MA3) ? 2 : 3;
+        int t_bits = (st->psmi != SERVICE_MODE_MA3) ? 1 : 3;
+
+        decode_pl_pu_s_t_spans(decode, &pl, &pu, &sec, &ter);
+        for (int col = 0; col < PARTITION_WIDTH_AM; col++)
         {
-            for (int col = 0; col < PARTITION_WIDTH_AM; col++)
+            float complex *pl_row = st->buffer[CENTER_AM - primary_index - col];
+            float complex *pu_row = st->buffer[CENTER_AM + primary_index + col];
+            float complex *s_row = st->buffer[CENTER_AM + secondary_index + col];
+            float complex *t_row = (st->psmi != SERVICE_MODE_MA3) ? st->buffer[CENTER_AM + tertiary_index + col]
+                                                                  : st->buffer[CENTER_AM - tertiary_index - col];
+
+            for (int n = 0; n < BLKSZ; n++)
             {
-                st->buffer[CENTER_AM - primary_index - col][n] *= pl_mult[col];
-                st->buffer[CENTER_AM + primary_index + col][n] *= pu_mult[col];
-                st->buffer[CENTER_AM + secondary_index + col][n] *= s_mult[col];
-                if (st->psmi != SERVICE_MODE_MA3)
-                    st->buffer[CENTER_AM + tertiary_index + col][n] *= t_mult[col];
-                else
-                    st->buffer[CENTER_AM - tertiary_index - col][n] *= t_mult[col];
-
-                if (st->psmi != SERVICE_MODE_MA3)
-                {
-                    decode_push_pl_pu_s_t(
-                        &st->input->decode,
-                        qam64(st->buffer[CENTER_AM - primary_index - col][n]),
-                        qam64(st->buffer[CENTER_AM + primary_index + col][n]),
-                        qam16(st->buffer[CENTER_AM + secondary_index + col][n]),
-                        qpsk(st->buffer[CENTER_AM + tertiary_index + col][n])
-                    );
-                }
-                else
-                {
-                    decode_push_pl_pu_s_t(
-                        &st->input->decode,
-                        qam64(st->buffer[CENTER_AM - primary_index - col][n]),
-                        qam64(st->buffer[CENTER_AM + primary_index + col][n]),
-                        qam64(st->buffer[CENTER_AM + secondary_index + col][n]),
-                        qam64(st->buffer[CENTER_AM - tertiary_index - col][n])
-                    );
-                }
+                pl_row[n] *= pl_mult[col];
+                pu_row[n] *= pu_mult[col];
+                s_row[n] *= s_mult[col];
+                t_row[n] *= t_mult[col];
             }
+
+            demap_carrier(pl + col, PARTITION_WIDTH_AM, pl_row, 3);
+            demap_carrier(pu + col, PARTITION_WIDTH_AM, pu_row, 3);
+            demap_carrier(sec + col, PARTITION_WIDTH_AM, s_row, s_bits);
+            demap_carrier(ter + col, PARTITION_WIDTH_AM, t_row, t_bits);
         }
+        decode_commit_pl_pu_s_t(decode, PARTITION_WIDTH_AM * BLKSZ);
 
         st->bc = (st->bc + 1) % 8;
     }
@@ -758,6 +861,7 @@ void sync_push(sync_t *st, float complex *fftout)
 {
     unsigned int i;
 
+    stats_begin(&st->input->radio->stats, NRSC5_STAGE_SYNC);
     if (st->input->radio->mode == NRSC5_MODE_FM)
     {
         for (i = 0; i < MAX_PARTITIONS * PARTITION_WIDTH + 1; i++)
@@ -783,6 +887,7 @@ void sync_push(sync_t *st, float complex *fftout)
         else
             sync_process_am(st);
     }
+    stats_end(&st->input->radio->stats);
 }
 
 void sync_reset(sync_t *st)
@@ -796,6 +901,7 @@ void sync_reset(sync_t *st)
 
     st->idx = 0;
     st->psmi = 1;
+    st->warm_psmi = -1;
     st->cfo_wait = 0;
     st->offset_history = 0;
     st->mer_cnt = 0;
@@ -803,7 +909,7 @@ void sync_reset(sync_t *st)
     st->error_ub = 0;
 }
 
-void sync_init(sync_t *st, input_t *input)
+int sync_init(sync_t *st, input_t *input)
 {
     float loop_bw = 0.05, damping = 0.70710678;
     float denom = 1 + (2 * damping * loop_bw) + (loop_bw * loop_bw);
@@ -811,5 +917,58 @@ void sync_init(sync_t *st, input_t *input)
     st->beta = (4 * loop_bw * loop_bw) / denom;
 
     st->input = input;
+    st->buffer = NULL;
+    st->phases = NULL;
+    return sync_set_mode(st, NRSC5_MODE_FM);
+}
+
+int sync_set_mode(sync_t *st, int mode)
+{
+    unsigned int rows = (mode == NRSC5_MODE_FM) ? FFT_FM : FFT_AM;
+    float complex (*buffer)[BLKSZ];
+    float (*phases)[BLKSZ] = NULL;
+
+    if (st->buffer && st->rows == rows)
+    {
+        sync_reset(st);
+        return 0;
+    }
+
+    // keep the current buffers unless the new ones can be allocated
+    buffer = calloc(rows, sizeof(*st->buffer));
+    if (mode == NRSC5_MODE_FM)
+        phases = calloc(rows, sizeof(*st->phases));
+    if (!buffer || (mode == NRSC5_MODE_FM && !phases))
+    {
+        free(buffer);
+        free(phases);
+        return 1;
+    }
+
+    sync_free(st);
+    st->rows = rows;
+    st->buffer = buffer;
+    st->phases = phases;
     sync_reset(st);
+    return 0;
+}
+
+void sync_free(sync_t *st)
+{
+    free(st->buffer);
+    free(st->phases);
+    st->buffer = NULL;
+    st->phases = NULL;
+    st->rows = 0;
+}
+
+size_t sync_memory_usage(const sync_t *st)
+{
+    size_t bytes = 0;
+
+    if (st->buffer)
+        bytes += st->rows * sizeof(*st->buffer);
+    if (st->phases)
+        bytes += st->rows * sizeof(*st->phases);
+    return bytes;
 }
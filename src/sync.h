@@ -3,14 +3,17 @@
 #include "config.h"
 
 #include <complex.h>
+#include <stddef.h>
 
 typedef struct
 {
     struct input_t *input;
-    float complex buffer[FFT_FM][BLKSZ];
-    float phases[FFT_FM][BLKSZ];
+    float complex (*buffer)[BLKSZ]; // one row per subcarrier of the current mode
+    float (*phases)[BLKSZ];         // FM only
+    unsigned int rows;
     unsigned int idx;
     int psmi;
+    int warm_psmi;                  // PSMI recalled from the sync cache, or -1
     int cfo_wait;
     unsigned int bc;
     unsigned int offset_history;
@@ -30,4 +33,7 @@ typedef struct
 void sync_adjust(sync_t *st, int sample_adj);
 void sync_push(sync_t *st, float complex *fft);
 void sync_reset(sync_t *st);
-void sync_init(sync_t *st, struct input_t *input);
+int sync_set_mode(sync_t *st, int mode);
+int sync_init(sync_t *st, struct input_t *input);
+void sync_free(sync_t *st);
+size_t sync_memory_usage(const sync_t *st);
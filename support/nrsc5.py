@@ -13,6 +13,11 @@ class Mode(enum.Enum):
     AM = 1
 
 
+class EventQueuePolicy(enum.Enum):
+    DROP = 0
+    BLOCK = 1
+
+
 class EventType(enum.Enum):
     LOST_DEVICE = 0
     IQ = 1
@@ -41,6 +46,22 @@ class EventType(enum.Enum):
     LOT_HEADER = 24
     LOT_FRAGMENT = 25
     AGC = 26
+    SCAN = 27
+    STATS = 28
+
+
+class Stage(enum.Enum):
+    DECIMATE = 0
+    ACQUIRE = 1
+    SYNC = 2
+    DECODE_PIDS = 3
+    DECODE_P1 = 4
+    DECODE_P3 = 5
+    DECODE_P4 = 6
+    FRAME = 7
+    RS = 8
+    AAC = 9
+    CALLBACK = 10
 
 
 AUDIO_FRAME_SAMPLES = 2048
@@ -192,7 +213,7 @@ Sync = collections.namedtuple("Sync", ["freq_offset", "psmi"])
 MER = collections.namedtuple("MER", ["lower", "upper"])
 BER = collections.namedtuple("BER", ["cber"])
 HDC = collections.namedtuple("HDC", ["program", "data", "flags"])
-Audio = collections.namedtuple("Audio", ["program", "data"])
+Audio = collections.namedtuple("Audio", ["program", "data", "latency"])
 Comment = collections.namedtuple("Comment", ["lang", "short_content_desc", "full_text"])
 UFID = collections.namedtuple("UFID", ["owner", "id"])
 XHDR = collections.namedtuple("XHDR", ["mime", "param", "lot"])
@@ -223,6 +244,10 @@ AudioService = collections.namedtuple("AudioService", ["program", "access", "typ
 HEREImage = collections.namedtuple("HEREImage", ["image_type", "seq", "n1", "n2", "time_utc", "latitude1", "longitude1",
                                                  "latitude2", "longitude2", "name", "data"])
 AGC = collections.namedtuple("AGC", ["gain_db", "peak_dbfs", "is_final"])
+Scan = collections.namedtuple("Scan", ["freq", "hd_present", "psmi", "cp_metric", "ref_metric"])
+StageStats = collections.namedtuple("StageStats", ["calls", "wall_ns", "cpu_ns"])
+Stats = collections.namedtuple("Stats", ["duration", "elapsed", "stages", "input_fill", "input_peak", "input_size",
+                                         "input_overflows", "queue_depth", "queue_peak", "source_drops"])
 
 
 class _IQ(ctypes.Structure):
@@ -266,6 +291,7 @@ class _Audio(ctypes.Structure):
         ("program", ctypes.c_uint),
         ("data", ctypes.POINTER(ctypes.c_char)),
         ("count", ctypes.c_size_t),
+        ("latency", ctypes.c_float),
     ]
 
 
@@ -580,6 +606,40 @@ class _AGC(ctypes.Structure):
     ]
 
 
+class _Scan(ctypes.Structure):
+    _fields_ = [
+        ("freq", ctypes.c_float),
+        ("hd_present", ctypes.c_int),
+        ("psmi", ctypes.c_int),
+        ("cp_metric", ctypes.c_float),
+        ("ref_metric", ctypes.c_float),
+    ]
+
+
+class _StageStats(ctypes.Structure):
+    _fields_ = [
+        ("calls", ctypes.c_uint64),
+        ("wall_ns", ctypes.c_uint64),
+        ("cpu_ns", ctypes.c_uint64),
+    ]
+
+
+class _Stats(ctypes.Structure):
+    _fields_ = [
+        ("duration", ctypes.c_float),
+        ("elapsed", ctypes.c_float),
+        ("stages", ctypes.POINTER(_StageStats)),
+        ("num_stages", ctypes.c_uint),
+        ("input_fill", ctypes.c_uint),
+        ("input_peak", ctypes.c_uint),
+        ("input_size", ctypes.c_uint),
+        ("input_overflows", ctypes.c_uint),
+        ("queue_depth", ctypes.c_uint),
+        ("queue_peak", ctypes.c_uint),
+        ("source_drops", ctypes.c_uint),
+    ]
+
+
 class _EventUnion(ctypes.Union):
     _fields_ = [
         ("iq", _IQ),
@@ -606,6 +666,8 @@ class _EventUnion(ctypes.Union):
         ("audio_service", _AudioService),
         ("here_image", _HEREImage),
         ("agc", _AGC),
+        ("scan", _Scan),
+        ("stats", _Stats),
     ]
 
 
@@ -683,7 +745,7 @@ class NRSC5:
             evt = HDC(hdc.program, hdc.data[:hdc.count], PacketFlags(hdc.flags))
         elif evt_type == EventType.AUDIO:
             audio = c_evt.u.audio
-            evt = Audio(audio.program, audio.data[:audio.count * 2])
+            evt = Audio(audio.program, audio.data[:audio.count * 2], audio.latency)
         elif evt_type == EventType.ID3:
             id3 = c_evt.u.id3
 
@@ -862,6 +924,17 @@ class NRSC5:
         elif evt_type == EventType.AGC:
             agc = c_evt.u.agc
             evt = AGC(agc.gain_db, agc.peak_dbfs, bool(agc.is_final))
+        elif evt_type == EventType.SCAN:
+            scan = c_evt.u.scan
+            evt = Scan(scan.freq, bool(scan.hd_present), scan.psmi, scan.cp_metric, scan.ref_metric)
+        elif evt_type == EventType.STATS:
+            stats = c_evt.u.stats
+            stages = {}
+            for i in range(min(stats.num_stages, len(Stage))):
+                stage = stats.stages[i]
+                stages[Stage(i)] = StageStats(stage.calls, stage.wall_ns, stage.cpu_ns)
+            evt = Stats(stats.duration, stats.elapsed, stages, stats.input_fill, stats.input_peak, stats.input_size,
+                        stats.input_overflows, stats.queue_depth, stats.queue_peak, stats.source_drops)
 
         self.callback(evt_type, evt, *self.callback_args)
 
@@ -907,6 +980,19 @@ class NRSC5:
             raise NRSC5Error("Failed to open pipe.")
         self._set_callback()
 
+    def open_mmap(self, path):
+        result = NRSC5.libnrsc5.nrsc5_open_mmap(ctypes.byref(self.radio), path.encode())
+        if result != 0:
+            raise NRSC5Error("Failed to map IQ file.")
+        self._set_callback()
+
+    def open_segmented(self, path, threads=0, segment_length=0):
+        result = NRSC5.libnrsc5.nrsc5_open_segmented(ctypes.byref(self.radio), path.encode(), threads,
+                                                     ctypes.c_float(segment_length))
+        if result != 0:
+            raise NRSC5Error("Failed to open IQ file for parallel decoding.")
+        self._set_callback()
+
     def open_rtltcp(self, host, port):
         s = socket.create_connection((host, port))
         result = NRSC5.libnrsc5.nrsc5_open_rtltcp(ctypes.byref(self.radio), s.detach())
@@ -914,9 +1000,26 @@ class NRSC5:
             raise NRSC5Error("Failed to open rtl_tcp.")
         self._set_callback()
 
+    def serve_rtltcp(self, port, host="127.0.0.1"):
+        self._check_session()
+        s = socket.create_server((host, port))
+        result = NRSC5.libnrsc5.nrsc5_serve_rtltcp(self.radio, s.detach())
+        if result != 0:
+            raise NRSC5Error("Failed to start IQ server.")
+
+    def stop_serving_rtltcp(self):
+        self._check_session()
+        NRSC5.libnrsc5.nrsc5_serve_rtltcp(self.radio, -1)
+
+    def set_rtltcp_buffers(self, rcvbuf=0, ring_size=0):
+        self._check_session()
+        result = NRSC5.libnrsc5.nrsc5_set_rtltcp_buffers(self.radio, rcvbuf, ctypes.c_size_t(ring_size))
+        if result != 0:
+            raise NRSC5Error("Failed to set rtl_tcp buffers.")
+
     def _check_session(self):
         if not self.radio:
-            raise NRSC5Error("No session opened. Call open(), open_pipe(), or open_rtltcp() first.")
+            raise NRSC5Error("No session opened. Call open(), open_mmap(), open_pipe(), or open_rtltcp() first.")
 
     def close(self):
         self._check_session()
@@ -965,6 +1068,13 @@ class NRSC5:
         if result != 0:
             raise NRSC5Error("Failed to set frequency.")
 
+    def scan(self, begin=87.9e6, end=107.9e6, skip=0.2e6):
+        self._check_session()
+        result = NRSC5.libnrsc5.nrsc5_scan(self.radio, ctypes.c_float(begin), ctypes.c_float(end),
+                                           ctypes.c_float(skip))
+        if result != 0:
+            raise NRSC5Error("Failed to scan.")
+
     def get_gain(self):
         self._check_session()
         gain = ctypes.c_float()
@@ -977,6 +1087,12 @@ class NRSC5:
         if result != 0:
             raise NRSC5Error("Failed to set gain.")
 
+    def set_input_rate(self, rate):
+        self._check_session()
+        result = NRSC5.libnrsc5.nrsc5_set_input_rate(self.radio, ctypes.c_float(rate))
+        if result != 0:
+            raise NRSC5Error("Failed to set input rate.")
+
     def set_auto_gain(self, enabled):
         self._check_session()
         NRSC5.libnrsc5.nrsc5_set_auto_gain(self.radio, int(enabled))
@@ -999,3 +1115,226 @@ class NRSC5:
         result = NRSC5.libnrsc5.nrsc5_pipe_samples_cs16(self.radio, samples, len(samples) // 2)
         if result != 0:
             raise NRSC5Error("Failed to pipe samples.")
+
+    def pipe_samples_cs16_planar(self, i, q):
+        if len(i) != len(q) or len(i) % 2 != 0:
+            raise NRSC5Error("i and q must have the same even length.")
+        result = NRSC5.libnrsc5.nrsc5_pipe_samples_cs16_planar(self.radio, i, q, len(i) // 2)
+        if result != 0:
+            raise NRSC5Error("Failed to pipe samples.")
+
+    def pipe_samples_cs8(self, samples):
+        if len(samples) % 2 != 0:
+            raise NRSC5Error("len(samples) must be a multiple of 2.")
+        result = NRSC5.libnrsc5.nrsc5_pipe_samples_cs8(self.radio, samples, len(samples) // 2)
+        if result != 0:
+            raise NRSC5Error("Failed to pipe samples.")
+
+    def pipe_samples_cf32(self, samples):
+        if len(samples) % 8 != 0:
+            raise NRSC5Error("len(samples) must be a multiple of 8.")
+        result = NRSC5.libnrsc5.nrsc5_pipe_samples_cf32(self.radio, samples, len(samples) // 8)
+        if result != 0:
+            raise NRSC5Error("Failed to pipe samples.")
+
+    def set_audio_ring(self, program, size):
+        self._check_session()
+        result = NRSC5.libnrsc5.nrsc5_set_audio_ring(self.radio, program, ctypes.c_size_t(size))
+        if result != 0:
+            raise NRSC5Error("Failed to set audio ring.")
+
+    def read_audio(self, program, count):
+        self._check_session()
+        data = (ctypes.c_int16 * count)()
+        read = ctypes.c_size_t()
+        result = NRSC5.libnrsc5.nrsc5_read_audio(self.radio, program, data, ctypes.c_size_t(count), ctypes.byref(read))
+        if result != 0:
+            raise NRSC5Error("Failed to read audio.")
+        return ctypes.string_at(data, read.value * 2)
+
+    def get_audio_fill(self, program):
+        self._check_session()
+        fill = ctypes.c_size_t()
+        size = ctypes.c_size_t()
+        dropped = ctypes.c_size_t()
+        result = NRSC5.libnrsc5.nrsc5_get_audio_fill(self.radio, program, ctypes.byref(fill), ctypes.byref(size),
+                                                     ctypes.byref(dropped))
+        if result != 0:
+            raise NRSC5Error("Failed to get audio fill.")
+        return fill.value, size.value, dropped.value
+
+    def set_event_queue(self, size, policy=EventQueuePolicy.DROP, dispatcher=False):
+        self._check_session()
+        result = NRSC5.libnrsc5.nrsc5_set_event_queue(self.radio, size, policy.value, int(dispatcher))
+        if result != 0:
+            raise NRSC5Error("Failed to set event queue.")
+
+    def poll_events(self, max_events):
+        self._check_session()
+        dispatched = ctypes.c_uint()
+        result = NRSC5.libnrsc5.nrsc5_poll_events(self.radio, max_events, ctypes.byref(dispatched))
+        if result != 0:
+            raise NRSC5Error("Failed to poll events.")
+        return dispatched.value
+
+    def get_event_drops(self, event_type):
+        self._check_session()
+        count = ctypes.c_uint()
+        result = NRSC5.libnrsc5.nrsc5_get_event_drops(self.radio, event_type.value, ctypes.byref(count))
+        if result != 0:
+            raise NRSC5Error("Failed to get event drops.")
+        return count.value
+
+    def set_event_mask(self, event_types):
+        self._check_session()
+        mask = 0
+        for event_type in event_types:
+            mask |= 1 << event_type.value
+        result = NRSC5.libnrsc5.nrsc5_set_event_mask(self.radio, ctypes.c_uint64(mask))
+        if result != 0:
+            raise NRSC5Error("Failed to set event mask.")
+
+    def set_stats_interval(self, interval):
+        self._check_session()
+        result = NRSC5.libnrsc5.nrsc5_set_stats_interval(self.radio, ctypes.c_float(interval))
+        if result != 0:
+            raise NRSC5Error("Failed to set stats interval.")
+
+    def set_low_latency(self, enabled, depth=0):
+        self._check_session()
+        result = NRSC5.libnrsc5.nrsc5_set_low_latency(self.radio, int(enabled), depth)
+        if result != 0:
+            raise NRSC5Error("Failed to set low-latency mode.")
+
+    def get_audio_latency(self, program):
+        self._check_session()
+        latency = ctypes.c_float()
+        result = NRSC5.libnrsc5.nrsc5_get_audio_latency(self.radio, program, ctypes.byref(latency))
+        if result != 0:
+            raise NRSC5Error("Failed to get audio latency.")
+        return latency.value
+
+    def get_memory_usage(self):
+        self._check_session()
+        size = ctypes.c_size_t()
+        result = NRSC5.libnrsc5.nrsc5_get_memory_usage(self.radio, ctypes.byref(size))
+        if result != 0:
+            raise NRSC5Error("Failed to get memory usage.")
+        return size.value
+
+    def get_realtime_factor(self):
+        self._check_session()
+        factor = ctypes.c_float()
+        result = NRSC5.libnrsc5.nrsc5_get_realtime_factor(self.radio, ctypes.byref(factor))
+        if result != 0:
+            raise NRSC5Error("Failed to get realtime factor.")
+        return factor.value
+
+    def set_lot_memory_budget(self, size):
+        self._check_session()
+        result = NRSC5.libnrsc5.nrsc5_set_lot_memory_budget(self.radio, ctypes.c_size_t(size))
+        if result != 0:
+            raise NRSC5Error("Failed to set LOT memory budget.")
+
+    def record_iq(self, path, compress=True):
+        self._check_session()
+        result = NRSC5.libnrsc5.nrsc5_record_iq(self.radio, path.encode(), int(compress))
+        if result != 0:
+            raise NRSC5Error("Failed to start IQ recording.")
+
+    def stop_recording_iq(self):
+        self._check_session()
+        result = NRSC5.libnrsc5.nrsc5_record_iq(self.radio, None, 0)
+        if result != 0:
+            raise NRSC5Error("Failed to finish IQ recording.")
+
+    def seek_file(self, seconds):
+        self._check_session()
+        result = NRSC5.libnrsc5.nrsc5_seek_file(self.radio, ctypes.c_float(seconds))
+        if result != 0:
+            raise NRSC5Error("Failed to seek.")
+
+    def is_recording(self):
+        self._check_session()
+        return NRSC5.libnrsc5.nrsc5_is_recording(self.radio) != 0
+
+
+class NRSC5Generator:
+    def __init__(self):
+        NRSC5._load_library(self)
+        self.gen = ctypes.c_void_p()
+        self.packet_callback = None
+        self.packet_func = None
+
+    def open(self, mode, service_mode, seed=0):
+        result = NRSC5.libnrsc5.nrsc5_generator_open(ctypes.byref(self.gen), mode.value, service_mode, seed)
+        if result != 0:
+            raise NRSC5Error("Failed to open generator.")
+
+    def _check_session(self):
+        if not self.gen:
+            raise NRSC5Error("No generator opened. Call open() first.")
+
+    def close(self):
+        self._check_session()
+        NRSC5.libnrsc5.nrsc5_generator_close(self.gen)
+        self.gen = ctypes.c_void_p()
+
+    def set_snr(self, snr_db):
+        self._check_session()
+        result = NRSC5.libnrsc5.nrsc5_generator_set_snr(self.gen, ctypes.c_float(snr_db))
+        if result != 0:
+            raise NRSC5Error("Failed to set SNR.")
+
+    def set_cfo(self, hz):
+        self._check_session()
+        result = NRSC5.libnrsc5.nrsc5_generator_set_cfo(self.gen, ctypes.c_float(hz))
+        if result != 0:
+            raise NRSC5Error("Failed to set carrier frequency offset.")
+
+    def set_timing_offset(self, samples):
+        self._check_session()
+        result = NRSC5.libnrsc5.nrsc5_generator_set_timing_offset(self.gen, samples)
+        if result != 0:
+            raise NRSC5Error("Failed to set timing offset.")
+
+    def set_station(self, name, facility_id):
+        self._check_session()
+        result = NRSC5.libnrsc5.nrsc5_generator_set_station(self.gen, name.encode(), facility_id)
+        if result != 0:
+            raise NRSC5Error("Failed to set station.")
+
+    def set_packet_callback(self, callback):
+        self._check_session()
+
+        def callback_closure(program, data, max_size, opaque):
+            packet = self.packet_callback(program, max_size)[:max_size]
+            ctypes.memmove(data, packet, len(packet))
+            return len(packet)
+
+        self.packet_callback = callback
+        if callback is None:
+            self.packet_func = None
+            result = NRSC5.libnrsc5.nrsc5_generator_set_packet_callback(self.gen, None, None)
+        else:
+            self.packet_func = ctypes.CFUNCTYPE(ctypes.c_uint, ctypes.c_uint, ctypes.POINTER(ctypes.c_uint8),
+                                                ctypes.c_uint, ctypes.c_void_p)(callback_closure)
+            result = NRSC5.libnrsc5.nrsc5_generator_set_packet_callback(self.gen, self.packet_func, None)
+        if result != 0:
+            raise NRSC5Error("Failed to set packet callback.")
+
+    def read_cu8(self, count):
+        self._check_session()
+        data = (ctypes.c_uint8 * (count * 2))()
+        result = NRSC5.libnrsc5.nrsc5_generator_read_cu8(self.gen, data, count * 2)
+        if result != 0:
+            raise NRSC5Error("Failed to generate samples.")
+        return bytes(data)
+
+    def read_cs16(self, count):
+        self._check_session()
+        data = (ctypes.c_int16 * (count * 2))()
+        result = NRSC5.libnrsc5.nrsc5_generator_read_cs16(self.gen, data, count * 2)
+        if result != 0:
+            raise NRSC5Error("Failed to generate samples.")
+        return ctypes.string_at(data, count * 4)